@@ -731,6 +731,18 @@ const char *SVC_UpdateStringTable::ToString() const {
   return s_text;
 }
 
+bool SVC_UpdateStringTableDelta::WriteToBuffer(bf_write &buffer) {
+  return SVC_UpdateStringTable::WriteToBuffer(buffer);
+}
+
+bool SVC_UpdateStringTableDelta::ReadFromBuffer(bf_read &buffer) {
+  return SVC_UpdateStringTable::ReadFromBuffer(buffer);
+}
+
+const char *SVC_UpdateStringTableDelta::ToString() const {
+  return SVC_UpdateStringTable::ToString();
+}
+
 SVC_CreateStringTable::SVC_CreateStringTable() {}
 
 bool SVC_CreateStringTable::WriteToBuffer(bf_write &buffer) {
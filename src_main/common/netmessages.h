@@ -395,6 +395,13 @@ class SVC_UpdateStringTable : public CNetMessage {
   bf_write m_DataOut;
 };
 
+// Same layout, the data uses the delta encoding of
+// CNetworkStringTable::WriteUpdate. Only sent to clients that set
+// net_stringtable_deltas.
+class SVC_UpdateStringTableDelta : public SVC_UpdateStringTable {
+  DECLARE_SVC_MESSAGE(UpdateStringTableDelta);
+};
+
 class SVC_VoiceInit : public CNetMessage {
   DECLARE_SVC_MESSAGE(VoiceInit);
 
@@ -110,9 +110,9 @@ enum {
 #define svc_CrosshairAngle 20
 
 #define svc_BSPDecal 21  // add a static decal to the worl BSP
-// NOTE: This is now unused!
-//#define	svc_TerrainMod		22		// modification to the
-// terrain/displacement
+// svc_UpdateStringTable with longer shared prefixes and user data patches,
+// reuses the id of the retired svc_TerrainMod
+#define svc_UpdateStringTableDelta 22
 
 // Message from server side to client side entity
 #define svc_UserMessage 23    // a game specific message
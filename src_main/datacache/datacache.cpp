@@ -4,12 +4,15 @@
 
 #include "datacache.h"
 
+#include <algorithm>
+
 #ifdef OS_POSIX
 #include <malloc.h>
 #endif
 
 #include "filesystem.h"
 #include "tier0/include/basetypes.h"
+#include "tier0/include/fasttimer.h"
 #include "tier0/include/vprof.h"
 #include "tier1/convar.h"
 #include "tier1/datamanager.h"
@@ -54,6 +57,9 @@ void DataCacheItem_t::DestroyResource() {
   if (pSection) {
     pSection->DiscardItemData(this, DC_AGE_DISCARD);
   }
+  if (iShard != -1) {
+    g_DataCache.ReleaseShardItem(iShard);
+  }
   delete this;
 }
 
@@ -65,8 +71,6 @@ CDataCacheSection::CDataCacheSection(CDataCache *pSharedCache,
                                      IDataCacheClient *pClient,
                                      const char *pszName)
     : m_pClient(pClient),
-      m_LRU(pSharedCache->m_LRU),
-      m_mutex(pSharedCache->m_mutex),
       m_pSharedCache(pSharedCache),
       m_nFrameUnlockCounter(0),
       m_options(0) {
@@ -173,33 +177,49 @@ bool CDataCacheSection::AddEx(DataCacheClientID_t clientId,
 
   EnsureCapacity(size);
 
+  const int iShard = m_pSharedCache->ReserveShardItem(clientId);
+  if (iShard == -1) {
+    Warning("Data cache full, can't add item to section \"%s\"\n", GetName());
+    if (pHandle) {
+      *pHandle = DC_INVALID_HANDLE;
+    }
+    return false;
+  }
+
+  CDataCacheLRU &lru = m_pSharedCache->m_Shards[iShard].m_LRU;
+
   DataCacheItemData_t itemData = {pItemData, size, clientId, this};
 
-  ResourceMemHandle hMem = m_LRU.CreateResource(itemData, true);
+  ResourceMemHandle hMem = lru.CreateResource(itemData, true);
+
+  Assert(hMem != (ResourceMemHandle)0 &&
+         hMem != (ResourceMemHandle)INVALID_MEMHANDLE);
 
-  Assert(hMem != (ResourceMemHandle)0 && hMem != (ResourceMemHandle)DC_INVALID_HANDLE);
+  DataCacheHandle_t hCache = CDataCache::ToCacheHandle(iShard, hMem);
 
-  AccessItem(hMem)->hLRU = hMem;
+  DataCacheItem_t *pItem = lru.GetResource_NoLockNoLRUTouch(hMem);
+  pItem->hLRU = hCache;
+  pItem->iShard = iShard;
 
   if (pHandle) {
-    *pHandle = (DataCacheHandle_t)hMem;
+    *pHandle = hCache;
   }
 
   NoteAdd(size);
 
-  OnAdd(clientId, (DataCacheHandle_t)hMem);
+  OnAdd(clientId, hCache);
 
   g_iDontForceFlush++;
 
   if (flags & DCAF_LOCK) {
-    Lock((DataCacheHandle_t)hMem);
+    Lock(hCache);
   }
   // Add implies a frame lock. A no-op if not in frame lock
-  FrameLock((DataCacheHandle_t)hMem);
+  FrameLock(hCache);
 
   g_iDontForceFlush--;
 
-  m_LRU.UnlockResource(hMem);
+  lru.UnlockResource(hMem);
 
   return true;
 }
@@ -223,27 +243,34 @@ DataCacheHandle_t CDataCacheSection::Find(DataCacheClientID_t clientId) {
 
 //---------------------------------------------------------
 DataCacheHandle_t CDataCacheSection::DoFind(DataCacheClientID_t clientId) {
-  AUTO_LOCK(m_mutex);
-  ResourceMemHandle hCurrent;
+  // items usually sit in the home shard of their client id
+  const int iHome = CDataCache::GetHomeShard(clientId);
 
-  hCurrent = GetFirstUnlockedItem();
+  for (int i = 0; i < DC_NUM_SHARDS; i++) {
+    const int iShard = (iHome + i) & (DC_NUM_SHARDS - 1);
+    CDataCacheLRU &lru = m_pSharedCache->m_Shards[iShard].m_LRU;
+    AUTO_LOCK(lru.AccessMutex());
+    ResourceMemHandle hCurrent;
 
-  while (hCurrent != INVALID_MEMHANDLE) {
-    if (AccessItem(hCurrent)->clientId == clientId) {
-      m_status.nFindHits++;
-      return (DataCacheHandle_t)hCurrent;
+    hCurrent = GetFirstUnlockedItem(lru);
+
+    while (hCurrent != INVALID_MEMHANDLE) {
+      if (lru.GetResource_NoLockNoLRUTouch(hCurrent)->clientId == clientId) {
+        m_status.nFindHits++;
+        return CDataCache::ToCacheHandle(iShard, hCurrent);
+      }
+      hCurrent = GetNextItem(lru, hCurrent);
     }
-    hCurrent = GetNextItem(hCurrent);
-  }
 
-  hCurrent = GetFirstLockedItem();
+    hCurrent = GetFirstLockedItem(lru);
 
-  while (hCurrent != INVALID_MEMHANDLE) {
-    if (AccessItem(hCurrent)->clientId == clientId) {
-      m_status.nFindHits++;
-      return (DataCacheHandle_t)hCurrent;
+    while (hCurrent != INVALID_MEMHANDLE) {
+      if (lru.GetResource_NoLockNoLRUTouch(hCurrent)->clientId == clientId) {
+        m_status.nFindHits++;
+        return CDataCache::ToCacheHandle(iShard, hCurrent);
+      }
+      hCurrent = GetNextItem(lru, hCurrent);
     }
-    hCurrent = GetNextItem(hCurrent);
   }
 
   return DC_INVALID_HANDLE;
@@ -260,14 +287,15 @@ DataCacheRemoveResult_t CDataCacheSection::Remove(DataCacheHandle_t handle,
   VPROF("CDataCacheSection::Remove");
 
   if (handle != DC_INVALID_HANDLE) {
-    ResourceMemHandle lruHandle = (ResourceMemHandle)handle;
-    if (m_LRU.LockCount(lruHandle) > 0) {
+    ResourceMemHandle lruHandle;
+    CDataCacheLRU &lru = GetLRU(handle, &lruHandle);
+    if (lru.LockCount(lruHandle) > 0) {
       return DC_LOCKED;
     }
 
-    AUTO_LOCK(m_mutex);
+    AUTO_LOCK(lru.AccessMutex());
 
-    DataCacheItem_t *pItem = AccessItem(lruHandle);
+    DataCacheItem_t *pItem = lru.GetResource_NoLockNoLRUTouch(lruHandle);
     if (pItem) {
       if (ppItemData) {
         *ppItemData = pItem->pItemData;
@@ -277,7 +305,7 @@ DataCacheRemoveResult_t CDataCacheSection::Remove(DataCacheHandle_t handle,
         *pItemSize = pItem->size;
       }
 
-      DiscardItem(lruHandle, (bNotify) ? DC_REMOVED : DC_NONE);
+      DiscardItem(lru, lruHandle, (bNotify) ? DC_REMOVED : DC_NONE);
 
       return DC_OK;
     }
@@ -290,7 +318,7 @@ DataCacheRemoveResult_t CDataCacheSection::Remove(DataCacheHandle_t handle,
 //
 //-----------------------------------------------------------------------------
 bool CDataCacheSection::IsPresent(DataCacheHandle_t handle) {
-  return (m_LRU.GetResource_NoLockNoLRUTouch((ResourceMemHandle)handle) != NULL);
+  return (AccessItem(handle) != NULL);
 }
 
 //-----------------------------------------------------------------------------
@@ -302,9 +330,11 @@ void *CDataCacheSection::Lock(DataCacheHandle_t handle) {
   if (mem_force_flush.GetBool() && !g_iDontForceFlush) Flush();
 
   if (handle != DC_INVALID_HANDLE) {
-    DataCacheItem_t *pItem = m_LRU.LockResource((ResourceMemHandle)handle);
+    ResourceMemHandle hLRU;
+    CDataCacheLRU &lru = GetLRU(handle, &hLRU);
+    DataCacheItem_t *pItem = lru.LockResource(hLRU);
     if (pItem) {
-      if (m_LRU.LockCount((ResourceMemHandle)handle) == 1) {
+      if (lru.LockCount(hLRU) == 1) {
         NoteLock(pItem->size);
       }
       return const_cast<void *>(pItem->pItemData);
@@ -322,15 +352,17 @@ int CDataCacheSection::Unlock(DataCacheHandle_t handle) {
 
   int iNewLockCount = 0;
   if (handle != DC_INVALID_HANDLE) {
-    AssertMsg(AccessItem((ResourceMemHandle)handle) != NULL,
+    AssertMsg(AccessItem(handle) != NULL,
               "Attempted to unlock nonexistent cache entry");
     unsigned nBytesUnlocked = 0;
-    m_mutex.Lock();
-    iNewLockCount = m_LRU.UnlockResource((ResourceMemHandle)handle);
+    ResourceMemHandle hLRU;
+    CDataCacheLRU &lru = GetLRU(handle, &hLRU);
+    lru.AccessMutex().Lock();
+    iNewLockCount = lru.UnlockResource(hLRU);
     if (iNewLockCount == 0) {
-      nBytesUnlocked = AccessItem((ResourceMemHandle)handle)->size;
+      nBytesUnlocked = lru.GetResource_NoLockNoLRUTouch(hLRU)->size;
     }
-    m_mutex.Unlock();
+    lru.AccessMutex().Unlock();
     if (nBytesUnlocked) {
       NoteUnlock(nBytesUnlocked);
       EnsureCapacity(0);
@@ -340,11 +372,11 @@ int CDataCacheSection::Unlock(DataCacheHandle_t handle) {
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Lock the mutex
+// Purpose: Lock the mutex, which excludes all cache changes
 //-----------------------------------------------------------------------------
 void CDataCacheSection::LockMutex() {
   g_iDontForceFlush++;
-  m_mutex.Lock();
+  m_pSharedCache->LockAllShards();
 }
 
 //-----------------------------------------------------------------------------
@@ -352,7 +384,7 @@ void CDataCacheSection::LockMutex() {
 //-----------------------------------------------------------------------------
 void CDataCacheSection::UnlockMutex() {
   g_iDontForceFlush--;
-  m_mutex.Unlock();
+  m_pSharedCache->UnlockAllShards();
 }
 
 //-----------------------------------------------------------------------------
@@ -366,8 +398,12 @@ void *CDataCacheSection::Get(DataCacheHandle_t handle, bool bFrameLock) {
   if (handle != DC_INVALID_HANDLE) {
     if (bFrameLock && IsFrameLocking()) return FrameLock(handle);
 
-    AUTO_LOCK(m_mutex);
-    DataCacheItem_t *pItem = m_LRU.GetResource_NoLock((ResourceMemHandle)handle);
+    // Only the item's shard, held until pItemData is read so a purge can't
+    // free the item in between.
+    ResourceMemHandle hLRU;
+    CDataCacheLRU &lru = GetLRU(handle, &hLRU);
+    AUTO_LOCK(lru.AccessMutex());
+    DataCacheItem_t *pItem = lru.GetResource_NoLock(hLRU);
     if (pItem) {
       return const_cast<void *>(pItem->pItemData);
     }
@@ -385,9 +421,10 @@ void *CDataCacheSection::GetNoTouch(DataCacheHandle_t handle, bool bFrameLock) {
   if (handle != DC_INVALID_HANDLE) {
     if (bFrameLock && IsFrameLocking()) return FrameLock(handle);
 
-    AUTO_LOCK(m_mutex);
-    DataCacheItem_t *pItem =
-        m_LRU.GetResource_NoLockNoLRUTouch((ResourceMemHandle)handle);
+    ResourceMemHandle hLRU;
+    CDataCacheLRU &lru = GetLRU(handle, &hLRU);
+    AUTO_LOCK(lru.AccessMutex());
+    DataCacheItem_t *pItem = lru.GetResource_NoLockNoLRUTouch(hLRU);
     if (pItem) {
       return const_cast<void *>(pItem->pItemData);
     }
@@ -436,7 +473,9 @@ void *CDataCacheSection::FrameLock(DataCacheHandle_t handle) {
   void *pResult = NULL;
   FrameLock_t *pFrameLock = m_ThreadFrameLock.Get();
   if (pFrameLock) {
-    DataCacheItem_t *pItem = m_LRU.LockResource((ResourceMemHandle)handle);
+    ResourceMemHandle hLRU;
+    CDataCacheLRU &lru = GetLRU(handle, &hLRU);
+    DataCacheItem_t *pItem = lru.LockResource(hLRU);
 
     if (pItem) {
       int iThread = pFrameLock->m_iThread;
@@ -447,7 +486,7 @@ void *CDataCacheSection::FrameLock(DataCacheHandle_t handle) {
       }
 
       pResult = const_cast<void *>(pItem->pItemData);
-      m_LRU.UnlockResource((ResourceMemHandle)handle);
+      lru.UnlockResource(hLRU);
     }
   }
 
@@ -494,21 +533,24 @@ int *CDataCacheSection::GetFrameUnlockCounterPtr() {
 // Purpose: Lock management, not for the feint of heart
 //-----------------------------------------------------------------------------
 int CDataCacheSection::GetLockCount(DataCacheHandle_t handle) {
-  return m_LRU.LockCount((ResourceMemHandle)handle);
+  ResourceMemHandle hLRU;
+  return GetLRU(handle, &hLRU).LockCount(hLRU);
 }
 
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
 int CDataCacheSection::BreakLock(DataCacheHandle_t handle) {
-  return m_LRU.BreakLock((ResourceMemHandle)handle);
+  ResourceMemHandle hLRU;
+  return GetLRU(handle, &hLRU).BreakLock(hLRU);
 }
 
 //-----------------------------------------------------------------------------
 // Purpose: Explicitly mark an item as "recently used"
 //-----------------------------------------------------------------------------
 bool CDataCacheSection::Touch(DataCacheHandle_t handle) {
-  m_LRU.TouchResource((ResourceMemHandle)handle);
+  ResourceMemHandle hLRU;
+  GetLRU(handle, &hLRU).TouchResource(hLRU);
   return true;
 }
 
@@ -516,7 +558,8 @@ bool CDataCacheSection::Touch(DataCacheHandle_t handle) {
 // Purpose: Explicitly mark an item as "least recently used".
 //-----------------------------------------------------------------------------
 bool CDataCacheSection::Age(DataCacheHandle_t handle) {
-  m_LRU.MarkAsStale((ResourceMemHandle)handle);
+  ResourceMemHandle hLRU;
+  GetLRU(handle, &hLRU).MarkAsStale(hLRU);
   return true;
 }
 
@@ -527,41 +570,14 @@ bool CDataCacheSection::Age(DataCacheHandle_t handle) {
 unsigned CDataCacheSection::Flush(bool bUnlockedOnly, bool bNotify) {
   VPROF("CDataCacheSection::Flush");
 
-  AUTO_LOCK(m_mutex);
-
   DataCacheNotificationType_t notificationType =
       (bNotify) ? DC_FLUSH_DISCARD : DC_NONE;
 
-  ResourceMemHandle hCurrent;
-  ResourceMemHandle hNext;
-
   unsigned nBytesFlushed = 0;
-  unsigned nBytesCurrent = 0;
-
-  hCurrent = GetFirstUnlockedItem();
-
-  while (hCurrent != INVALID_MEMHANDLE) {
-    hNext = GetNextItem(hCurrent);
-    nBytesCurrent = AccessItem(hCurrent)->size;
-
-    if (DiscardItem(hCurrent, notificationType)) {
-      nBytesFlushed += nBytesCurrent;
-    }
-    hCurrent = hNext;
-  }
 
-  if (!bUnlockedOnly) {
-    hCurrent = GetFirstLockedItem();
-
-    while (hCurrent != INVALID_MEMHANDLE) {
-      hNext = GetNextItem(hCurrent);
-      nBytesCurrent = AccessItem(hCurrent)->size;
-
-      if (DiscardItem(hCurrent, notificationType)) {
-        nBytesFlushed += nBytesCurrent;
-      }
-      hCurrent = hNext;
-    }
+  for (int i = 0; i < DC_NUM_SHARDS; i++) {
+    nBytesFlushed += DiscardAll(m_pSharedCache->m_Shards[i].m_LRU,
+                                bUnlockedOnly, notificationType);
   }
 
   return nBytesFlushed;
@@ -574,23 +590,28 @@ unsigned CDataCacheSection::Flush(bool bUnlockedOnly, bool bNotify) {
 unsigned CDataCacheSection::Purge(unsigned nBytes) {
   VPROF("CDataCacheSection::Purge");
 
-  AUTO_LOCK(m_mutex);
-
   unsigned nBytesPurged = 0;
-  unsigned nBytesCurrent = 0;
+  unsigned nItemsPurged = 1;
 
-  ResourceMemHandle hCurrent = GetFirstUnlockedItem();
-  ResourceMemHandle hNext;
+  // Every round takes a slice of the oldest items of each shard, which comes
+  // close to the order a single LRU would purge in.
+  const int iFirst = m_pSharedCache->m_iPurgeShard++;
+
+  while (nBytes > 0 && nItemsPurged > 0) {
+    const unsigned nSlice = nBytes / DC_NUM_SHARDS + 1;
+    nItemsPurged = 0;
 
-  while (hCurrent != INVALID_MEMHANDLE && nBytes > 0) {
-    hNext = GetNextItem(hCurrent);
-    nBytesCurrent = AccessItem(hCurrent)->size;
+    for (int i = 0; i < DC_NUM_SHARDS && nBytes > 0; i++) {
+      CDataCacheLRU &lru =
+          m_pSharedCache->m_Shards[(iFirst + i) & (DC_NUM_SHARDS - 1)].m_LRU;
+      unsigned nItems;
+      unsigned nBytesCurrent =
+          PurgeShard(lru, std::min(nSlice, nBytes), (unsigned)-1, &nItems);
 
-    if (DiscardItem(hCurrent, DC_FLUSH_DISCARD)) {
       nBytesPurged += nBytesCurrent;
       nBytes -= std::min(nBytesCurrent, nBytes);
+      nItemsPurged += nItems;
     }
-    hCurrent = hNext;
   }
 
   return nBytesPurged;
@@ -601,21 +622,25 @@ unsigned CDataCacheSection::Purge(unsigned nBytes) {
 // number actually freed
 //-----------------------------------------------------------------------------
 unsigned CDataCacheSection::PurgeItems(unsigned nItems) {
-  AUTO_LOCK(m_mutex);
-
   unsigned nPurged = 0;
+  unsigned nPurgedRound = 1;
 
-  ResourceMemHandle hCurrent = GetFirstUnlockedItem();
-  ResourceMemHandle hNext;
+  const int iFirst = m_pSharedCache->m_iPurgeShard++;
 
-  while (hCurrent != INVALID_MEMHANDLE && nItems) {
-    hNext = GetNextItem(hCurrent);
+  while (nItems > 0 && nPurgedRound > 0) {
+    const unsigned nSlice = nItems / DC_NUM_SHARDS + 1;
+    nPurgedRound = 0;
 
-    if (DiscardItem(hCurrent, DC_FLUSH_DISCARD)) {
-      nItems--;
-      nPurged++;
+    for (int i = 0; i < DC_NUM_SHARDS && nItems > 0; i++) {
+      CDataCacheLRU &lru =
+          m_pSharedCache->m_Shards[(iFirst + i) & (DC_NUM_SHARDS - 1)].m_LRU;
+      unsigned nItemsCurrent;
+      PurgeShard(lru, (unsigned)-1, std::min(nSlice, nItems), &nItemsCurrent);
+
+      nPurged += nItemsCurrent;
+      nItems -= nItemsCurrent;
+      nPurgedRound += nItemsCurrent;
     }
-    hCurrent = hNext;
   }
 
   return nPurged;
@@ -635,7 +660,9 @@ void CDataCacheSection::OutputReport(DataCacheReportType_t reportType) {
 //-----------------------------------------------------------------------------
 void CDataCacheSection::UpdateSize(DataCacheHandle_t handle,
                                    unsigned int nNewSize) {
-  DataCacheItem_t *pItem = m_LRU.LockResource((ResourceMemHandle)handle);
+  ResourceMemHandle hLRU;
+  CDataCacheLRU &lru = GetLRU(handle, &hLRU);
+  DataCacheItem_t *pItem = lru.LockResource(hLRU);
   if (!pItem) {
     // If it's gone from memory, size is already irrelevant
     return;
@@ -653,62 +680,63 @@ void CDataCacheSection::UpdateSize(DataCacheHandle_t handle,
       m_pSharedCache->EnsureCapacity(bytesAdded);
     }
 
-    m_LRU.NotifySizeChanged((ResourceMemHandle)handle, oldSize, nNewSize);
+    lru.NotifySizeChanged(hLRU, oldSize, nNewSize);
     NoteSizeChanged(oldSize, nNewSize);
   }
 
-  m_LRU.UnlockResource((ResourceMemHandle)handle);
+  lru.UnlockResource(hLRU);
 }
 
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
-ResourceMemHandle CDataCacheSection::GetFirstUnlockedItem() {
+ResourceMemHandle CDataCacheSection::GetFirstUnlockedItem(CDataCacheLRU &lru) {
   ResourceMemHandle hCurrent;
 
-  hCurrent = m_LRU.GetFirstUnlocked();
+  hCurrent = lru.GetFirstUnlocked();
 
   while (hCurrent != INVALID_MEMHANDLE) {
-    if (AccessItem(hCurrent)->pSection == this) {
+    if (lru.GetResource_NoLockNoLRUTouch(hCurrent)->pSection == this) {
       return hCurrent;
     }
-    hCurrent = m_LRU.GetNext(hCurrent);
+    hCurrent = lru.GetNext(hCurrent);
   }
   return INVALID_MEMHANDLE;
 }
 
-ResourceMemHandle CDataCacheSection::GetFirstLockedItem() {
+ResourceMemHandle CDataCacheSection::GetFirstLockedItem(CDataCacheLRU &lru) {
   ResourceMemHandle hCurrent;
 
-  hCurrent = m_LRU.GetFirstLocked();
+  hCurrent = lru.GetFirstLocked();
 
   while (hCurrent != INVALID_MEMHANDLE) {
-    if (AccessItem(hCurrent)->pSection == this) {
+    if (lru.GetResource_NoLockNoLRUTouch(hCurrent)->pSection == this) {
       return hCurrent;
     }
-    hCurrent = m_LRU.GetNext(hCurrent);
+    hCurrent = lru.GetNext(hCurrent);
   }
   return INVALID_MEMHANDLE;
 }
 
-ResourceMemHandle CDataCacheSection::GetNextItem(ResourceMemHandle hCurrent) {
-  hCurrent = m_LRU.GetNext(hCurrent);
+ResourceMemHandle CDataCacheSection::GetNextItem(CDataCacheLRU &lru,
+                                                 ResourceMemHandle hCurrent) {
+  hCurrent = lru.GetNext(hCurrent);
 
   while (hCurrent != INVALID_MEMHANDLE) {
-    if (AccessItem(hCurrent)->pSection == this) {
+    if (lru.GetResource_NoLockNoLRUTouch(hCurrent)->pSection == this) {
       return hCurrent;
     }
-    hCurrent = m_LRU.GetNext(hCurrent);
+    hCurrent = lru.GetNext(hCurrent);
   }
   return INVALID_MEMHANDLE;
 }
 
-bool CDataCacheSection::DiscardItem(ResourceMemHandle hItem,
+bool CDataCacheSection::DiscardItem(CDataCacheLRU &lru, ResourceMemHandle hItem,
                                     DataCacheNotificationType_t type) {
-  DataCacheItem_t *pItem = AccessItem(hItem);
+  DataCacheItem_t *pItem = lru.GetResource_NoLockNoLRUTouch(hItem);
   if (DiscardItemData(pItem, type)) {
-    if (m_LRU.LockCount(hItem)) {
-      m_LRU.BreakLock(hItem);
+    if (lru.LockCount(hItem)) {
+      lru.BreakLock(hItem);
       NoteUnlock(pItem->size);
     }
 
@@ -743,12 +771,86 @@ bool CDataCacheSection::DiscardItem(ResourceMemHandle hItem,
 
     // inhibit callbacks from lower level resource system
     pItem->pSection = NULL;
-    m_LRU.DestroyResource(hItem);
+    lru.DestroyResource(hItem);
     return true;
   }
   return false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Discards this section's items in one shard, returns bytes released
+//-----------------------------------------------------------------------------
+unsigned CDataCacheSection::DiscardAll(CDataCacheLRU &lru, bool bUnlockedOnly,
+                                       DataCacheNotificationType_t type) {
+  AUTO_LOCK(lru.AccessMutex());
+
+  ResourceMemHandle hCurrent;
+  ResourceMemHandle hNext;
+
+  unsigned nBytesFlushed = 0;
+  unsigned nBytesCurrent = 0;
+
+  hCurrent = GetFirstUnlockedItem(lru);
+
+  while (hCurrent != INVALID_MEMHANDLE) {
+    hNext = GetNextItem(lru, hCurrent);
+    nBytesCurrent = lru.GetResource_NoLockNoLRUTouch(hCurrent)->size;
+
+    if (DiscardItem(lru, hCurrent, type)) {
+      nBytesFlushed += nBytesCurrent;
+    }
+    hCurrent = hNext;
+  }
+
+  if (!bUnlockedOnly) {
+    hCurrent = GetFirstLockedItem(lru);
+
+    while (hCurrent != INVALID_MEMHANDLE) {
+      hNext = GetNextItem(lru, hCurrent);
+      nBytesCurrent = lru.GetResource_NoLockNoLRUTouch(hCurrent)->size;
+
+      if (DiscardItem(lru, hCurrent, type)) {
+        nBytesFlushed += nBytesCurrent;
+      }
+      hCurrent = hNext;
+    }
+  }
+
+  return nBytesFlushed;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Discards the oldest unlocked items of this section in one shard
+// until nBytes or nItems are released. Returns bytes released
+//-----------------------------------------------------------------------------
+unsigned CDataCacheSection::PurgeShard(CDataCacheLRU &lru, unsigned nBytes,
+                                       unsigned nItems,
+                                       unsigned *pnItemsPurged) {
+  AUTO_LOCK(lru.AccessMutex());
+
+  unsigned nBytesPurged = 0;
+  unsigned nItemsPurged = 0;
+  unsigned nBytesCurrent = 0;
+
+  ResourceMemHandle hCurrent = GetFirstUnlockedItem(lru);
+  ResourceMemHandle hNext;
+
+  while (hCurrent != INVALID_MEMHANDLE && nBytesPurged < nBytes &&
+         nItemsPurged < nItems) {
+    hNext = GetNextItem(lru, hCurrent);
+    nBytesCurrent = lru.GetResource_NoLockNoLRUTouch(hCurrent)->size;
+
+    if (DiscardItem(lru, hCurrent, DC_FLUSH_DISCARD)) {
+      nBytesPurged += nBytesCurrent;
+      nItemsPurged++;
+    }
+    hCurrent = hNext;
+  }
+
+  *pnItemsPurged = nItemsPurged;
+  return nBytesPurged;
+}
+
 bool CDataCacheSection::DiscardItemData(DataCacheItem_t *pItem,
                                         DataCacheNotificationType_t type) {
   if (pItem) {
@@ -789,7 +891,7 @@ bool CDataCacheSection::DiscardItemData(DataCacheItem_t *pItem,
 //-----------------------------------------------------------------------------
 DataCacheHandle_t CDataCacheSectionFastFind::DoFind(
     DataCacheClientID_t clientId) {
-  AUTO_LOCK(m_mutex);
+  AUTO_LOCK(m_HandlesMutex);
   UtlHashFastHandle_t hHash = m_Handles.Find(Hash4(&clientId));
   if (hHash != m_Handles.InvalidHandle()) return m_Handles[hHash];
   return DC_INVALID_HANDLE;
@@ -797,13 +899,13 @@ DataCacheHandle_t CDataCacheSectionFastFind::DoFind(
 
 void CDataCacheSectionFastFind::OnAdd(DataCacheClientID_t clientId,
                                       DataCacheHandle_t hCacheItem) {
-  AUTO_LOCK(m_mutex);
+  AUTO_LOCK(m_HandlesMutex);
   Assert(m_Handles.Find(Hash4(&clientId)) == m_Handles.InvalidHandle());
   m_Handles.FastInsert(Hash4(&clientId), hCacheItem);
 }
 
 void CDataCacheSectionFastFind::OnRemove(DataCacheClientID_t clientId) {
-  AUTO_LOCK(m_mutex);
+  AUTO_LOCK(m_HandlesMutex);
   UtlHashFastHandle_t hHash = m_Handles.Find(Hash4(&clientId));
   Assert(hHash != m_Handles.InvalidHandle());
   if (hHash != m_Handles.InvalidHandle()) return m_Handles.Remove(hHash);
@@ -869,17 +971,18 @@ void *CDataCache::QueryInterface(const char *pInterfaceName) {
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
-CDataCache::CDataCache() : m_mutex(m_LRU.AccessMutex()) {
+CDataCache::CDataCache() : m_nTargetBytes((unsigned)-1) {
   memset(&m_status, 0, sizeof(m_status));
   m_bInFlush = false;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Controls cache size.
+// Purpose: Controls cache size. The shards have no budget of their own, the
+// cache keeps their sum under the target.
 //-----------------------------------------------------------------------------
 void CDataCache::SetSize(int nMaxBytes) {
-  m_LRU.SetTargetSize(nMaxBytes);
-  m_LRU.FlushToTargetSize();
+  m_nTargetBytes = nMaxBytes;
+  EnsureCapacity(0);
 }
 
 //-----------------------------------------------------------------------------
@@ -917,7 +1020,7 @@ void CDataCache::GetStatus(DataCacheStatus_t *pStatus,
 
   if (pLimits) {
     Construct(pLimits);
-    pLimits->nMaxBytes = m_LRU.TargetSize();
+    pLimits->nMaxBytes = m_nTargetBytes;
   }
 }
 
@@ -982,7 +1085,12 @@ IDataCacheSection *CDataCache::FindSection(const char *pszClientName) {
 void CDataCache::EnsureCapacity(unsigned nBytes) {
   VPROF("CDataCache::EnsureCapacity");
 
-  m_LRU.EnsureCapacity(nBytes);
+  // shard sizes are read without their locks, the budget is approximate
+  const u64 nNeeded = (u64)GetLRUBytes() + nBytes;
+
+  if (nNeeded > m_nTargetBytes) {
+    PurgeShards((unsigned)(nNeeded - m_nTargetBytes));
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -992,7 +1100,91 @@ void CDataCache::EnsureCapacity(unsigned nBytes) {
 unsigned CDataCache::Purge(unsigned nBytes) {
   VPROF("CDataCache::Purge");
 
-  return m_LRU.Purge(nBytes);
+  return PurgeShards(nBytes);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Every shard gives up its oldest items in proportion to its share of
+// the cache, about the items a single LRU would have dropped.
+//-----------------------------------------------------------------------------
+unsigned CDataCache::PurgeShards(unsigned nBytes) {
+  const unsigned nUsed = GetLRUBytes();
+  if (!nUsed) return 0;
+
+  const int iFirst = m_iPurgeShard++;
+  unsigned nPurged = 0;
+
+  // the second pass covers shards that couldn't give their share because of
+  // locked items
+  for (int pass = 0; pass < 2 && nPurged < nBytes; pass++) {
+    for (int i = 0; i < DC_NUM_SHARDS && nPurged < nBytes; i++) {
+      CDataCacheLRU &lru = m_Shards[(iFirst + i) & (DC_NUM_SHARDS - 1)].m_LRU;
+      const unsigned nShardUsed = lru.UsedSize();
+      if (!nShardUsed) continue;
+
+      unsigned nShare = nBytes - nPurged;
+      if (pass == 0) {
+        nShare = std::min(nShare,
+                          (unsigned)((u64)nBytes * nShardUsed / nUsed) + 1);
+      }
+
+      nPurged += lru.Purge(std::min(nShare, nShardUsed));
+    }
+  }
+
+  return nPurged;
+}
+
+//-----------------------------------------------------------------------------
+//
+//-----------------------------------------------------------------------------
+unsigned CDataCache::GetLRUBytes() {
+  unsigned nBytes = 0;
+
+  for (int i = 0; i < DC_NUM_SHARDS; i++) {
+    nBytes += m_Shards[i].m_LRU.UsedSize();
+  }
+
+  return nBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reserves room for an item in the client's home shard, or the next
+// one that isn't full
+//-----------------------------------------------------------------------------
+int CDataCache::ReserveShardItem(DataCacheClientID_t clientId) {
+  const int iHome = GetHomeShard(clientId);
+
+  for (int i = 0; i < DC_NUM_SHARDS; i++) {
+    const int iShard = (iHome + i) & (DC_NUM_SHARDS - 1);
+
+    if (++m_Shards[iShard].m_nItems <= DC_MAX_SHARD_ITEMS) {
+      return iShard;
+    }
+    --m_Shards[iShard].m_nItems;
+  }
+
+  return -1;
+}
+
+void CDataCache::ReleaseShardItem(int iShard) {
+  Assert(m_Shards[iShard].m_nItems > 0);
+  --m_Shards[iShard].m_nItems;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Shard locks are always taken in index order
+//-----------------------------------------------------------------------------
+void CDataCache::LockAllShards() {
+  for (int i = 0; i < DC_NUM_SHARDS; i++) {
+    m_Shards[i].m_LRU.AccessMutex().Lock();
+  }
+}
+
+void CDataCache::UnlockAllShards() {
+  for (int i = DC_NUM_SHARDS - 1; i >= 0; i--) {
+    m_Shards[i].m_LRU.AccessMutex().Unlock();
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -1010,10 +1202,14 @@ unsigned CDataCache::Flush(bool bUnlockedOnly, bool bNotify) {
 
   m_bInFlush = true;
 
-  if (bUnlockedOnly) {
-    result = m_LRU.FlushAllUnlocked();
-  } else {
-    result = m_LRU.FlushAll();
+  result = 0;
+
+  for (int i = 0; i < DC_NUM_SHARDS; i++) {
+    if (bUnlockedOnly) {
+      result += m_Shards[i].m_LRU.FlushAllUnlocked();
+    } else {
+      result += m_Shards[i].m_LRU.FlushAll();
+    }
   }
 
   m_bInFlush = false;
@@ -1026,17 +1222,6 @@ unsigned CDataCache::Flush(bool bUnlockedOnly, bool bNotify) {
 //-----------------------------------------------------------------------------
 void CDataCache::OutputReport(DataCacheReportType_t reportType,
                               const char *pszSection) {
-  AUTO_LOCK(m_mutex);
-  int bytesUsed = m_LRU.UsedSize();
-  int bytesTotal = m_LRU.TargetSize();
-
-  float percent = 100.0f * (float)bytesUsed / (float)bytesTotal;
-
-  CUtlVector<ResourceMemHandle> lruList, lockedlist;
-
-  m_LRU.GetLockHandleList(lockedlist);
-  m_LRU.GetLRUHandleList(lruList);
-
   CDataCacheSection *pSection = NULL;
   if (pszSection) {
     pSection = (CDataCacheSection *)FindSection(pszSection);
@@ -1046,6 +1231,28 @@ void CDataCache::OutputReport(DataCacheReportType_t reportType,
     }
   }
 
+  LockAllShards();
+  int bytesUsed = GetLRUBytes();
+  int bytesTotal = m_nTargetBytes;
+
+  float percent = 100.0f * (float)bytesUsed / (float)bytesTotal;
+
+  CUtlVector<ResourceMemHandle> lruList, lockedlist;
+  CUtlVector<ResourceMemHandle> shardList;
+
+  // gather the shards' lists as cache handles
+  for (int iShard = 0; iShard < DC_NUM_SHARDS; iShard++) {
+    shardList.RemoveAll();
+    m_Shards[iShard].m_LRU.GetLockHandleList(shardList);
+    for (int i = 0; i < shardList.Count(); ++i)
+      lockedlist.AddToTail(ToCacheHandle(iShard, shardList[i]));
+
+    shardList.RemoveAll();
+    m_Shards[iShard].m_LRU.GetLRUHandleList(shardList);
+    for (int i = 0; i < shardList.Count(); ++i)
+      lruList.AddToTail(ToCacheHandle(iShard, shardList[i]));
+  }
+
   if (reportType == DC_DETAIL_REPORT) {
     CUtlRBTree<ResourceMemHandle, int> sortedbysize(0, 0,
                                               SortMemhandlesBySizeLessFunc);
@@ -1093,14 +1300,14 @@ void CDataCache::OutputReport(DataCacheReportType_t reportType,
       int sectionCount = 0;
       for (int i = 0; i < lockedlist.Count(); ++i) {
         if (AccessItem(lockedlist[i])->pSection == pSection) {
-          pItem = g_DataCache.m_LRU.GetResource_NoLockNoLRUTouch(lockedlist[i]);
+          pItem = AccessItem(lockedlist[i]);
           sectionBytes += pItem->size;
           sectionCount++;
         }
       }
       for (int i = 0; i < lruList.Count(); ++i) {
         if (AccessItem(lruList[i])->pSection == pSection) {
-          pItem = g_DataCache.m_LRU.GetResource_NoLockNoLRUTouch(lruList[i]);
+          pItem = AccessItem(lruList[i]);
           sectionBytes += pItem->size;
           sectionCount++;
         }
@@ -1119,13 +1326,17 @@ void CDataCache::OutputReport(DataCacheReportType_t reportType,
           sectionPercent, Q_pretifymem(sectionSize, 2, true));
     }
   }
+
+  UnlockAllShards();
 }
 
 //-------------------------------------
 
 void CDataCache::OutputItemReport(ResourceMemHandle hItem) {
-  AUTO_LOCK(m_mutex);
-  DataCacheItem_t *pItem = m_LRU.GetResource_NoLockNoLRUTouch(hItem);
+  ResourceMemHandle hLRU;
+  CDataCacheLRU &lru = GetShard(hItem, &hLRU).m_LRU;
+  AUTO_LOCK(lru.AccessMutex());
+  DataCacheItem_t *pItem = lru.GetResource_NoLockNoLRUTouch(hLRU);
   if (!pItem) return;
 
   CDataCacheSection *pSection = pItem->pSection;
@@ -1139,8 +1350,8 @@ void CDataCache::OutputItemReport(ResourceMemHandle hItem) {
   Msg("\t%16.16s : %12s : 0x%08x, 0x%08x, 0x%08x : %s : %s\n",
       Q_pretifymem(pItem->size, 2, true), pSection->GetName(), pItem->clientId,
       pItem->pItemData, hItem, (name[0]) ? name : "unknown",
-      (m_LRU.LockCount(hItem))
-          ? CFmtStr("Locked %d", m_LRU.LockCount(hItem)).operator const char *()
+      (lru.LockCount(hLRU))
+          ? CFmtStr("Locked %d", lru.LockCount(hLRU)).operator const char *()
           : "");
 }
 
@@ -1159,11 +1370,136 @@ int CDataCache::FindSectionIndex(const char *pszSection) {
 //-----------------------------------------------------------------------------
 bool CDataCache::SortMemhandlesBySizeLessFunc(const ResourceMemHandle &lhs,
                                               const ResourceMemHandle &rhs) {
-  DataCacheItem_t *pItem1 = g_DataCache.m_LRU.GetResource_NoLockNoLRUTouch(lhs);
-  DataCacheItem_t *pItem2 = g_DataCache.m_LRU.GetResource_NoLockNoLRUTouch(rhs);
+  DataCacheItem_t *pItem1 = g_DataCache.AccessItem(lhs);
+  DataCacheItem_t *pItem2 = g_DataCache.AccessItem(rhs);
 
   Assert(pItem1);
   Assert(pItem2);
 
   return pItem1->size < pItem2->size;
 }
+
+//-----------------------------------------------------------------------------
+// Lookup benchmark: threads hammer Get, Lock and Unlock on random items of a
+// scratch section, once per thread count.
+//-----------------------------------------------------------------------------
+class CDataCacheBenchClient : public IDataCacheClient {
+ public:
+  virtual bool HandleCacheNotification(
+      const DataCacheNotification_t &notification) {
+    return true;
+  }
+
+  virtual bool GetItemName(DataCacheClientID_t clientId, const void *pItem,
+                           char *pDest, unsigned nMaxLen) {
+    return false;
+  }
+};
+
+struct DataCacheBenchThread_t {
+  IDataCacheSection *m_pSection;
+  const DataCacheHandle_t *m_pHandles;
+  int m_nHandles;
+  int m_nLookups;
+  u32 m_nSeed;
+  int m_nMisses;
+};
+
+static u32 DataCacheBenchThread(void *pParam) {
+  DataCacheBenchThread_t *pThread = (DataCacheBenchThread_t *)pParam;
+  u32 nSeed = pThread->m_nSeed;
+
+  for (int i = 0; i < pThread->m_nLookups; i++) {
+    nSeed = nSeed * 1664525 + 1013904223;
+    DataCacheHandle_t handle = pThread->m_pHandles[(nSeed >> 8) %
+                                                   pThread->m_nHandles];
+
+    // one in eight lookups pins the item like a model load would
+    if ((nSeed & 7) == 0) {
+      if (pThread->m_pSection->Lock(handle)) {
+        pThread->m_pSection->Unlock(handle);
+      } else {
+        pThread->m_nMisses++;
+      }
+    } else if (!pThread->m_pSection->Get(handle)) {
+      pThread->m_nMisses++;
+    }
+  }
+
+  return 0;
+}
+
+CON_COMMAND(datacache_bench,
+            "Multithreaded data cache lookups: datacache_bench [max threads] "
+            "[lookups per thread] [items]") {
+  const int nMaxThreads =
+      std::clamp(args.ArgC() > 1 ? atoi(args[1]) : 16, 1, 64);
+  const int nLookups = std::max(args.ArgC() > 2 ? atoi(args[2]) : 1000000, 1);
+  const int nItems = std::clamp(args.ArgC() > 3 ? atoi(args[3]) : 4096, 1,
+                                DC_NUM_SHARDS * DC_MAX_SHARD_ITEMS / 2);
+
+  static CDataCacheBenchClient s_Client;
+  static u8 s_Data[1];
+
+  IDataCacheSection *pSection =
+      g_DataCache.AddSection(&s_Client, "bench", DataCacheLimits_t());
+
+  CUtlVector<DataCacheHandle_t> handles;
+  handles.EnsureCapacity(nItems);
+
+  for (int i = 0; i < nItems; i++) {
+    DataCacheHandle_t handle;
+    if (!pSection->Add((DataCacheClientID_t)(i + 1), s_Data, 1, &handle)) {
+      break;
+    }
+    handles.AddToTail(handle);
+  }
+
+  if (!handles.Count()) {
+    Msg("datacache_bench: couldn't add items\n");
+    g_DataCache.RemoveSection("bench");
+    return;
+  }
+
+  DataCacheBenchThread_t threads[64];
+  ThreadHandle_t hThreads[64];
+  double flBaseRate = 0;
+
+  for (int nStep = 1;; nStep *= 2) {
+    const int nThreads = std::min(nStep, nMaxThreads);
+
+    CFastTimer timer;
+    timer.Start();
+
+    for (int i = 0; i < nThreads; i++) {
+      threads[i].m_pSection = pSection;
+      threads[i].m_pHandles = handles.Base();
+      threads[i].m_nHandles = handles.Count();
+      threads[i].m_nLookups = nLookups;
+      threads[i].m_nSeed = 0x9e3779b9 * (i + 1);
+      threads[i].m_nMisses = 0;
+      hThreads[i] = CreateSimpleThread(DataCacheBenchThread, &threads[i]);
+    }
+
+    int nMisses = 0;
+    for (int i = 0; i < nThreads; i++) {
+      ThreadJoin(hThreads[i]);
+      ReleaseThreadHandle(hThreads[i]);
+      nMisses += threads[i].m_nMisses;
+    }
+
+    timer.End();
+
+    const double flSeconds = timer.GetDuration().GetSeconds();
+    const double flRate =
+        flSeconds > 0 ? (double)nThreads * nLookups / flSeconds : 0;
+    if (nThreads == 1) flBaseRate = flRate;
+
+    Msg("%2d threads: %8.2f M lookups/s, %5.2fx, %d misses\n", nThreads,
+        flRate / 1e6, flBaseRate > 0 ? flRate / flBaseRate : 0.0, nMisses);
+
+    if (nThreads == nMaxThreads) break;
+  }
+
+  g_DataCache.RemoveSection("bench");
+}
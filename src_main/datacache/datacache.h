@@ -10,6 +10,7 @@
 #include "datacache_common.h"
 #include "tier0/include/tslist.h"
 #include "tier1/datamanager.h"
+#include "tier1/generichash.h"
 #include "tier1/mempool.h"
 #include "tier1/utlhash.h"
 #include "tier3/tier3.h"
@@ -28,9 +29,17 @@ struct DataCacheItemData_t {
 #define DC_NO_NEXT_LOCKED ((DataCacheItem_t *)(intptr_t)-1)
 #define DC_MAX_THREADS_FRAMELOCKED 4
 
+// The cache is split into lock striped shards, each with its own LRU. A cache
+// handle is the shard's LRU handle with the shard number folded into the low
+// bits of the 16 bit index, so a shard holds at most DC_MAX_SHARD_ITEMS items
+// and the cache as a whole as many as a single LRU did.
+#define DC_SHARD_BITS 4
+#define DC_NUM_SHARDS (1 << DC_SHARD_BITS)
+#define DC_MAX_SHARD_ITEMS (0xffff >> DC_SHARD_BITS)
+
 struct DataCacheItem_t : DataCacheItemData_t {
   DataCacheItem_t(const DataCacheItemData_t &data)
-      : DataCacheItemData_t(data), hLRU(INVALID_MEMHANDLE) {
+      : DataCacheItemData_t(data), hLRU(INVALID_MEMHANDLE), iShard(-1) {
     memset(pNextFrameLocked, 0xff, sizeof(pNextFrameLocked));
   }
 
@@ -44,7 +53,8 @@ struct DataCacheItem_t : DataCacheItemData_t {
   DataCacheItem_t *GetData() { return this; }
   usize Size() { return size; }
 
-  ResourceMemHandle hLRU;
+  DataCacheHandle_t hLRU;  // cache handle, shard bits included
+  int iShard;
   DataCacheItem_t *pNextFrameLocked[DC_MAX_THREADS_FRAMELOCKED];
 
   DECLARE_FIXEDSIZE_ALLOCATOR_MT(DataCacheItem_t);
@@ -54,6 +64,12 @@ typedef CDataManager<DataCacheItem_t, DataCacheItemData_t, DataCacheItem_t *,
                      CThreadFastMutex>
     CDataCacheLRU;
 
+// One stripe of the cache, aligned so stripes don't share cache lines.
+struct alignas(128) DataCacheShard_t {
+  CDataCacheLRU m_LRU;
+  CInterlockedInt m_nItems;  // live items, bounds the LRU handle index
+};
+
 // CDataCacheSection
 //
 // Purpose: Implements a sub-section of the global cache. Subsections are
@@ -158,11 +174,19 @@ class CDataCacheSection : public IDataCacheSection {
   virtual DataCacheHandle_t DoFind(DataCacheClientID_t clientId);
   virtual void OnRemove(DataCacheClientID_t clientId) {}
 
-  ResourceMemHandle GetFirstUnlockedItem();
-  ResourceMemHandle GetFirstLockedItem();
-  ResourceMemHandle GetNextItem(ResourceMemHandle);
-  DataCacheItem_t *AccessItem(ResourceMemHandle hCurrent);
-  bool DiscardItem(ResourceMemHandle hItem, DataCacheNotificationType_t type);
+  // Iteration over this section's items of one shard, the shard must be
+  // locked. Handles are the shard's LRU handles.
+  ResourceMemHandle GetFirstUnlockedItem(CDataCacheLRU &lru);
+  ResourceMemHandle GetFirstLockedItem(CDataCacheLRU &lru);
+  ResourceMemHandle GetNextItem(CDataCacheLRU &lru, ResourceMemHandle);
+  DataCacheItem_t *AccessItem(DataCacheHandle_t handle);
+  CDataCacheLRU &GetLRU(DataCacheHandle_t handle, ResourceMemHandle *phLRU);
+  bool DiscardItem(CDataCacheLRU &lru, ResourceMemHandle hItem,
+                   DataCacheNotificationType_t type);
+  unsigned DiscardAll(CDataCacheLRU &lru, bool bUnlockedOnly,
+                      DataCacheNotificationType_t type);
+  unsigned PurgeShard(CDataCacheLRU &lru, unsigned nBytes, unsigned nItems,
+                      unsigned *pnItemsPurged);
   bool DiscardItemData(DataCacheItem_t *pItem,
                        DataCacheNotificationType_t type);
   void NoteAdd(int size);
@@ -178,7 +202,6 @@ class CDataCacheSection : public IDataCacheSection {
   };
   typedef CThreadLocal<FrameLock_t *> CThreadFrameLock;
 
-  CDataCacheLRU &m_LRU;
   CThreadFrameLock m_ThreadFrameLock;
   DataCacheStatus_t m_status;
   DataCacheLimits_t m_limits;
@@ -187,9 +210,6 @@ class CDataCacheSection : public IDataCacheSection {
   CDataCache *m_pSharedCache;
   char szName[DC_MAX_CLIENT_NAME + 1];
   CTSSimpleList<FrameLock_t> m_FreeFrameLocks;
-
- protected:
-  CThreadFastMutex &m_mutex;
 };
 
 //-----------------------------------------------------------------------------
@@ -213,6 +233,7 @@ class CDataCacheSectionFastFind : public CDataCacheSection {
   virtual void OnRemove(DataCacheClientID_t clientId);
 
   CUtlHashFast<DataCacheHandle_t> m_Handles;
+  CThreadFastMutex m_HandlesMutex;
 };
 
 //-----------------------------------------------------------------------------
@@ -287,10 +308,33 @@ class CDataCache : public CTier3AppSystem<IDataCache> {
   //-----------------------------------------------------
 
   friend class CDataCacheSection;
+  friend struct DataCacheItem_t;
 
   //-----------------------------------------------------
 
-  DataCacheItem_t *AccessItem(ResourceMemHandle hCurrent);
+  DataCacheItem_t *AccessItem(DataCacheHandle_t handle);
+
+  // Shard of a cache handle, *phLRU gets the handle within the shard's LRU.
+  DataCacheShard_t &GetShard(DataCacheHandle_t handle,
+                             ResourceMemHandle *phLRU);
+  static DataCacheHandle_t ToCacheHandle(int iShard, ResourceMemHandle hLRU);
+
+  // Shard new items of a client go to first, Find looks there first.
+  static int GetHomeShard(DataCacheClientID_t clientId) {
+    return Hash4(&clientId) & (DC_NUM_SHARDS - 1);
+  }
+
+  // Picks the shard for a new item and reserves an item slot in it, -1 if
+  // every shard is full.
+  int ReserveShardItem(DataCacheClientID_t clientId);
+  void ReleaseShardItem(int iShard);
+
+  // Takes the shard locks in order, for operations that span the cache.
+  void LockAllShards();
+  void UnlockAllShards();
+
+  unsigned GetLRUBytes();
+  unsigned PurgeShards(unsigned nBytes);
 
   bool IsInFlush() { return m_bInFlush; }
   int FindSectionIndex(const char *pszSection);
@@ -302,11 +346,12 @@ class CDataCache : public CTier3AppSystem<IDataCache> {
 
   //-----------------------------------------------------
 
-  CDataCacheLRU m_LRU;
+  DataCacheShard_t m_Shards[DC_NUM_SHARDS];
+  unsigned m_nTargetBytes;
+  CInterlockedInt m_iPurgeShard;  // rotates where purges start
   DataCacheStatus_t m_status;
   CUtlVector<CDataCacheSection *> m_Sections;
   bool m_bInFlush;
-  CThreadFastMutex &m_mutex;
 };
 
 //---------------------------------------------------------
@@ -315,8 +360,35 @@ extern CDataCache g_DataCache;
 
 //-----------------------------------------------------------------------------
 
-inline DataCacheItem_t *CDataCache::AccessItem(ResourceMemHandle hCurrent) {
-  return m_LRU.GetResource_NoLockNoLRUTouch(hCurrent);
+inline DataCacheShard_t &CDataCache::GetShard(DataCacheHandle_t handle,
+                                              ResourceMemHandle *phLRU) {
+  const uintptr_t word = (uintptr_t)handle & 0xffffffff;
+
+  if (!(word & 0xffff)) {
+    *phLRU = (ResourceMemHandle)INVALID_MEMHANDLE;
+    return m_Shards[0];
+  }
+
+  const uintptr_t index = (word & 0xffff) - 1;
+  *phLRU = (ResourceMemHandle)((word & 0xffff0000) |
+                               ((index >> DC_SHARD_BITS) + 1));
+  return m_Shards[index & (DC_NUM_SHARDS - 1)];
+}
+
+inline DataCacheHandle_t CDataCache::ToCacheHandle(int iShard,
+                                                   ResourceMemHandle hLRU) {
+  const uintptr_t word = (uintptr_t)hLRU & 0xffffffff;
+  const uintptr_t index = (word & 0xffff) - 1;
+
+  Assert(index < DC_MAX_SHARD_ITEMS && iShard >= 0 && iShard < DC_NUM_SHARDS);
+  return (DataCacheHandle_t)((word & 0xffff0000) |
+                             (((index << DC_SHARD_BITS) | iShard) + 1));
+}
+
+inline DataCacheItem_t *CDataCache::AccessItem(DataCacheHandle_t handle) {
+  ResourceMemHandle hLRU;
+  DataCacheShard_t &shard = GetShard(handle, &hLRU);
+  return shard.m_LRU.GetResource_NoLockNoLRUTouch(hLRU);
 }
 
 //-----------------------------------------------------------------------------
@@ -325,49 +397,56 @@ inline IDataCache *CDataCacheSection::GetSharedCache() {
   return m_pSharedCache;
 }
 
-inline DataCacheItem_t *CDataCacheSection::AccessItem(ResourceMemHandle hCurrent) {
-  return m_pSharedCache->AccessItem(hCurrent);
+inline DataCacheItem_t *CDataCacheSection::AccessItem(
+    DataCacheHandle_t handle) {
+  return m_pSharedCache->AccessItem(handle);
+}
+
+inline CDataCacheLRU &CDataCacheSection::GetLRU(DataCacheHandle_t handle,
+                                                ResourceMemHandle *phLRU) {
+  return m_pSharedCache->GetShard(handle, phLRU).m_LRU;
 }
 
-// Note: if status updates are moved out of a mutexed section, will need to
-// change these to use interlocked instructions
+// Items of one section live in different shards, which are locked
+// independently, so the section status is updated with interlocked
+// instructions too.
 
 inline void CDataCacheSection::NoteSizeChanged(int oldSize, int newSize) {
   int nBytes = (newSize - oldSize);
 
-  m_status.nBytes += nBytes;
-  m_status.nBytesLocked += nBytes;
+  ThreadInterlockedExchangeAdd(&m_status.nBytes, nBytes);
+  ThreadInterlockedExchangeAdd(&m_status.nBytesLocked, nBytes);
   ThreadInterlockedExchangeAdd(&m_pSharedCache->m_status.nBytes, nBytes);
   ThreadInterlockedExchangeAdd(&m_pSharedCache->m_status.nBytesLocked, nBytes);
 }
 
 inline void CDataCacheSection::NoteAdd(int size) {
-  m_status.nBytes += size;
-  m_status.nItems++;
+  ThreadInterlockedExchangeAdd(&m_status.nBytes, size);
+  ThreadInterlockedIncrement(&m_status.nItems);
 
   ThreadInterlockedExchangeAdd(&m_pSharedCache->m_status.nBytes, size);
   ThreadInterlockedIncrement(&m_pSharedCache->m_status.nItems);
 }
 
 inline void CDataCacheSection::NoteRemove(int size) {
-  m_status.nBytes -= size;
-  m_status.nItems--;
+  ThreadInterlockedExchangeAdd(&m_status.nBytes, -size);
+  ThreadInterlockedDecrement(&m_status.nItems);
 
   ThreadInterlockedExchangeAdd(&m_pSharedCache->m_status.nBytes, -size);
   ThreadInterlockedDecrement(&m_pSharedCache->m_status.nItems);
 }
 
 inline void CDataCacheSection::NoteLock(int size) {
-  m_status.nBytesLocked += size;
-  m_status.nItemsLocked++;
+  ThreadInterlockedExchangeAdd(&m_status.nBytesLocked, size);
+  ThreadInterlockedIncrement(&m_status.nItemsLocked);
 
   ThreadInterlockedExchangeAdd(&m_pSharedCache->m_status.nBytesLocked, size);
   ThreadInterlockedIncrement(&m_pSharedCache->m_status.nItemsLocked);
 }
 
 inline void CDataCacheSection::NoteUnlock(int size) {
-  m_status.nBytesLocked -= size;
-  m_status.nItemsLocked--;
+  ThreadInterlockedExchangeAdd(&m_status.nBytesLocked, -size);
+  ThreadInterlockedDecrement(&m_status.nItemsLocked);
 
   ThreadInterlockedExchangeAdd(&m_pSharedCache->m_status.nBytesLocked, -size);
   ThreadInterlockedDecrement(&m_pSharedCache->m_status.nItemsLocked);
@@ -0,0 +1,101 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+
+#include "mappedfile.h"
+
+#include "build/include/build_config.h"
+
+#ifdef OS_WIN
+#include "base/include/windows/windows_light.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <climits>
+
+#include "tier0/include/memdbgon.h"
+
+static usize GetPageSize() {
+#ifdef OS_WIN
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwPageSize;
+#else
+  return (usize)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+CMappedFile::CMappedFile() : m_pBase(nullptr), m_nSize(0) {}
+
+CMappedFile::~CMappedFile() { Close(); }
+
+bool CMappedFile::Open(const ch *pFullPath) {
+  Close();
+
+#ifdef OS_WIN
+  HANDLE hFile = CreateFileA(pFullPath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 ||
+      (u64)size.QuadPart > (u64)INT_MAX) {
+    CloseHandle(hFile);
+    return false;
+  }
+
+  // PAGE_WRITECOPY + FILE_MAP_COPY, writes never reach the file.
+  HANDLE hMapping =
+      CreateFileMappingA(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  CloseHandle(hFile);
+  if (!hMapping) return false;
+
+  void *pBase = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, 0);
+  // The view keeps the mapping object alive.
+  CloseHandle(hMapping);
+  if (!pBase) return false;
+
+  m_nSize = (usize)size.QuadPart;
+#else
+  int fd = open(pFullPath, O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size > INT_MAX) {
+    close(fd);
+    return false;
+  }
+
+  void *pBase = mmap(nullptr, (usize)st.st_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pBase == MAP_FAILED) return false;
+
+  m_nSize = (usize)st.st_size;
+#endif
+
+  m_pBase = pBase;
+  return true;
+}
+
+void CMappedFile::Close() {
+  if (!m_pBase) return;
+
+#ifdef OS_WIN
+  UnmapViewOfFile(m_pBase);
+#else
+  munmap(m_pBase, m_nSize);
+#endif
+
+  m_pBase = nullptr;
+  m_nSize = 0;
+}
+
+usize CMappedFile::Slack() const {
+  if (!m_pBase) return 0;
+
+  const usize nPageSize = GetPageSize();
+  return (nPageSize - m_nSize % nPageSize) % nPageSize;
+}
@@ -0,0 +1,40 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// Private, copy-on-write file mapping. Pages that are only read stay backed
+// by the OS page cache and are shared with every other process mapping the
+// same file, pages written to get a private copy.
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "base/include/base_types.h"
+
+class CMappedFile {
+ public:
+  CMappedFile();
+  ~CMappedFile();
+
+  // Maps a file by absolute path, false if it can't be opened or is empty.
+  bool Open(const ch *pFullPath);
+  void Close();
+
+  bool IsOpen() const { return m_pBase != nullptr; }
+  void *Base() const { return m_pBase; }
+  usize Size() const { return m_nSize; }
+
+  // Bytes readable past the end of the file, the tail of the last page.
+  usize Slack() const;
+
+ private:
+  void *m_pBase;
+  usize m_nSize;
+
+  CMappedFile(const CMappedFile &) = delete;
+  CMappedFile &operator=(const CMappedFile &) = delete;
+};
+
+#endif  // MAPPEDFILE_H
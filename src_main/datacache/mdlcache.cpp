@@ -10,6 +10,7 @@
 #include "filesystem.h"
 #include "filesystem/IQueuedLoader.h"
 #include "istudiorender.h"
+#include "mappedfile.h"
 #include "materialsystem/imaterialsystemhardwareconfig.h"
 #include "materialsystem/imesh.h"
 #include "optimize.h"
@@ -152,6 +153,9 @@ static ConVar mod_lock_mdls_on_load("mod_lock_mdls_on_load", "0");
 static ConVar mod_load_fakestall(
     "mod_load_fakestall", "0", 0,
     "Forces all ANI file loading to stall for specified ms\n");
+static ConVar mod_mmap_models(
+    "mod_mmap_models", "1", 0,
+    "Maps loose .mdl and .vvd files in place when they need no fixups.");
 
 //-----------------------------------------------------------------------------
 // Utility functions
@@ -186,6 +190,52 @@ static void MakeFilename(char szFileName[SOURCE_MAX_PATH],
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// Finds the GAME search path a normal open of pFileName reads from. True if
+// that is a loose file, pFullPath is its path then. False if the file isn't
+// there or a pack (a map's pakfile or a zip) comes first.
+//-----------------------------------------------------------------------------
+static bool ResolveLooseGameFile(const char *pFileName, char *pFullPath,
+                                 int nMaxLen) {
+  if (!g_pFullFileSystem->RelativePathToFullPath(
+          pFileName, "GAME", pFullPath, nMaxLen, FILTER_CULLPACK)) {
+    return false;
+  }
+
+  char pPackPath[SOURCE_MAX_PATH];
+  if (!g_pFullFileSystem->RelativePathToFullPath(pFileName, "GAME", pPackPath,
+                                                 sizeof(pPackPath),
+                                                 FILTER_CULLNONPACK)) {
+    return true;
+  }
+
+  // Both exist, the first search path that yields either one wins.
+  CUtlVector<char> searchPaths;
+  searchPaths.SetCount(
+      g_pFullFileSystem->GetSearchPath("GAME", true, NULL, 0));
+  g_pFullFileSystem->GetSearchPath("GAME", true, searchPaths.Base(),
+                                   searchPaths.Count());
+
+  Q_FixSlashes(pFullPath);
+  Q_FixSlashes(pPackPath);
+
+  for (char *pPath = searchPaths.Base(); pPath && *pPath;) {
+    char *pNext = strchr(pPath, ';');
+    if (pNext) *pNext++ = '\0';
+
+    char pCandidate[SOURCE_MAX_PATH];
+    Q_snprintf(pCandidate, sizeof(pCandidate), "%s%s", pPath, pFileName);
+    Q_FixSlashes(pCandidate);
+
+    if (!Q_stricmp(pCandidate, pPackPath)) return false;
+    if (!Q_stricmp(pCandidate, pFullPath)) return true;
+
+    pPath = pNext;
+  }
+
+  return false;
+}
+
 //-----------------------------------------------------------------------------
 // Async support
 //-----------------------------------------------------------------------------
@@ -352,6 +402,13 @@ class CMDLCache : public CTier3AppSystem<IMDLCache>,
 
   void *AllocData(MDLCacheDataType_t type, int size);
   void FreeData(MDLCacheDataType_t type, void *pData);
+
+  // Copy-on-write mappings of loose game files, cached as is. The mapping is
+  // owned by the cache once its base is added, FreeData() unmaps it.
+  CMappedFile *MapGameFile(const char *pFileName);
+  bool IsMappedData(const void *pData);
+  bool UnmapData(const void *pData);
+
   void CacheData(DataCacheHandle_t *c, void *pData, int size, const char *name,
                  MDLCacheDataType_t type,
                  DataCacheClientID_t id = (DataCacheClientID_t)-1);
@@ -412,6 +469,9 @@ class CMDLCache : public CTier3AppSystem<IMDLCache>,
   bool ReadMDLFile(MDLHandle_t handle, const char *pMDLFileName,
                    CUtlBuffer &buf);
 
+  // Maps a MDL file that can be used without conversion, NULL otherwise.
+  studiohdr_t *MapMDLFile(MDLHandle_t handle, const char *pMDLFileName);
+
   // Unserializes the VCollide file associated w/ models (the vphysics
   // representation)
   void UnserializeVCollide(MDLHandle_t handle, bool synchronousLoad);
@@ -454,6 +514,8 @@ class CMDLCache : public CTier3AppSystem<IMDLCache>,
                            void *pDest, int nBytes, int nOffset, bool bAsync,
                            FSAsyncControl_t *pControl);
   vertexFileHeader_t *LoadVertexData(studiohdr_t *pStudioHdr);
+  vertexFileHeader_t *MapVertexData(studiohdr_t *pStudioHdr,
+                                    const char *pFileName);
   vertexFileHeader_t *BuildAndCacheVertexData(studiohdr_t *pStudioHdr,
                                               vertexFileHeader_t *pRawVvdHdr);
   bool BuildHardwareData(MDLHandle_t handle, studiodata_t *pStudioData,
@@ -518,6 +580,9 @@ class CMDLCache : public CTier3AppSystem<IMDLCache>,
   CThreadFastMutex m_QueuedLoadingMutex;
   CThreadFastMutex m_AsyncMutex;
 
+  CUtlMap<const void *, CMappedFile *> m_MappedFiles;
+  CThreadFastMutex m_MappedFileMutex;
+
   bool m_bLostVideoMemory : 1;
   bool m_bConnected : 1;
   bool m_bInitialized : 1;
@@ -547,7 +612,8 @@ static void RestoreMaterialSystemObjects(int nChangeFlags) {
 //-----------------------------------------------------------------------------
 // Constructor
 //-----------------------------------------------------------------------------
-CMDLCache::CMDLCache() : BaseClass(false) {
+CMDLCache::CMDLCache()
+    : BaseClass(false), m_MappedFiles(DefLessFunc(const void *)) {
   m_bLostVideoMemory = false;
   m_bConnected = false;
   m_bInitialized = false;
@@ -1635,14 +1701,18 @@ studiohdr_t *CMDLCache::UnserializeMDL(MDLHandle_t handle, void *pData,
   // this is fetched when re-establishing dependent cached data (vtx/vvd)
   pStudioHdrIn->virtualModel = (void *)handle;
 
-  MdlCacheMsg("MDLCache: Alloc studiohdr %s\n", GetModelName(handle));
+  // a mapped file is cached in place, see MapMDLFile()
+  const bool bMapped = IsMappedData(pStudioHdrIn);
+  studiohdr_t *pHdr = pStudioHdrIn;
+  if (!bMapped) {
+    MdlCacheMsg("MDLCache: Alloc studiohdr %s\n", GetModelName(handle));
 
-  // allocate cache space
-  MemAlloc_PushAllocDbgInfo("Models:StudioHdr", 0);
-  studiohdr_t *pHdr =
-      (studiohdr_t *)AllocData(MDLCACHE_STUDIOHDR, pStudioHdrIn->length);
-  MemAlloc_PopAllocDbgInfo();
-  if (!pHdr) return NULL;
+    // allocate cache space
+    MemAlloc_PushAllocDbgInfo("Models:StudioHdr", 0);
+    pHdr = (studiohdr_t *)AllocData(MDLCACHE_STUDIOHDR, pStudioHdrIn->length);
+    MemAlloc_PopAllocDbgInfo();
+    if (!pHdr) return NULL;
+  }
 
   CacheData(&m_MDLDict[handle]->m_MDLCache, pHdr, pStudioHdrIn->length,
             GetModelName(handle), MDLCACHE_STUDIOHDR,
@@ -1656,7 +1726,9 @@ studiohdr_t *CMDLCache::UnserializeMDL(MDLHandle_t handle, void *pData,
   // TODO(d.rattman): Is there any way we can compute the size to load *before*
   // loading in and read directly into cache memory? It would be nice to reduce
   // cache overhead here. move the complete, relocatable model to the cache
-  memcpy(pHdr, pStudioHdrIn, pStudioHdrIn->length);
+  if (!bMapped) {
+    memcpy(pHdr, pStudioHdrIn, pStudioHdrIn->length);
+  }
 
   // On first load, convert the flex deltas from fp16 to 16-bit fixed-point
   if ((pHdr->flags & STUDIOHDR_FLAGS_FLEXES_CONVERTED) == 0) {
@@ -1716,6 +1788,48 @@ bool CMDLCache::ReadMDLFile(MDLHandle_t handle, const char *pMDLFileName,
   return true;
 }
 
+//-----------------------------------------------------------------------------
+// Maps a MDL file in place. Only files in the current version with no root
+// lod to apply qualify, everything else is read and converted in a copy.
+//-----------------------------------------------------------------------------
+studiohdr_t *CMDLCache::MapMDLFile(MDLHandle_t handle,
+                                   const char *pMDLFileName) {
+  if (r_rootlod.GetInt() > 0) return NULL;
+
+  char pFileName[SOURCE_MAX_PATH];
+  Q_strncpy(pFileName, pMDLFileName, sizeof(pFileName));
+  Q_FixSlashes(pFileName);
+#ifdef OS_POSIX
+  Q_strlower(pFileName);
+#endif
+
+  CMappedFile *pFile = MapGameFile(pFileName);
+  if (!pFile) return NULL;
+
+  studiohdr_t *pStudioHdr = (studiohdr_t *)pFile->Base();
+  if (pFile->Size() < sizeof(studiohdr_t) ||
+      pStudioHdr->id != IDSTUDIOHEADER ||
+      pStudioHdr->version != STUDIO_VERSION || pStudioHdr->length <= 0 ||
+      (size_t)pStudioHdr->length > pFile->Size()) {
+    UnmapData(pStudioHdr);
+    return NULL;
+  }
+
+  MdlCacheMsg("MDLCache: Map studiohdr %s\n", pFileName);
+
+  // critical! store a back link to our data
+  // this only dirties the header page, the rest stays shared
+  pStudioHdr->virtualModel = (void *)handle;
+
+  // let ReadMDLFile() report mismatched files
+  if (!VerifyHeaders(pStudioHdr)) {
+    UnmapData(pStudioHdr);
+    return NULL;
+  }
+
+  return pStudioHdr;
+}
+
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
@@ -1776,9 +1890,10 @@ studiohdr_t *CMDLCache::GetStudioHdr(MDLHandle_t handle) {
       DevMsg("Loading %s\n", pModelName);
     }
 
-    // Load file to temporary space
+    // Map the file in place, or load it to temporary space
     CUtlBuffer buf;
-    if (!ReadMDLFile(handle, pModelName, buf)) {
+    studiohdr_t *pMappedHdr = MapMDLFile(handle, pModelName);
+    if (!pMappedHdr && !ReadMDLFile(handle, pModelName, buf)) {
       bool bOk = false;
       if ((m_MDLDict[handle]->m_nFlags & STUDIODATA_ERROR_MODEL) == 0) {
         buf.Clear();  // clear buffer for next file read
@@ -1795,10 +1910,14 @@ studiohdr_t *CMDLCache::GetStudioHdr(MDLHandle_t handle) {
     }
 
     // put it in the cache
-    if (ProcessDataIntoCache(handle, MDLCACHE_STUDIOHDR, 0, buf.Base(),
-                             buf.TellMaxPut(), true)) {
+    void *pData = pMappedHdr ? (void *)pMappedHdr : buf.Base();
+    int nDataSize = pMappedHdr ? pMappedHdr->length : buf.TellMaxPut();
+    if (ProcessDataIntoCache(handle, MDLCACHE_STUDIOHDR, 0, pData, nDataSize,
+                             true)) {
       pHdr = (studiohdr_t *)CheckData(m_MDLDict[handle]->m_MDLCache,
                                       MDLCACHE_STUDIOHDR);
+    } else if (pMappedHdr) {
+      UnmapData(pMappedHdr);
     }
   }
 
@@ -2718,12 +2837,18 @@ vertexFileHeader_t *CMDLCache::BuildAndCacheVertexData(
   // determine final cache footprint, possibly truncated due to lod
   int cacheLength = Studio_VertexDataSize(pRawVvdHdr, rootLOD, bNeedsTangentS);
 
-  MdlCacheMsg("MDLCache: Alloc VVD %s\n", GetModelName(handle));
+  // a mapped file is cached in place, see MapVertexData()
+  const bool bMapped = IsMappedData(pRawVvdHdr);
+  if (bMapped) {
+    pVvdHdr = pRawVvdHdr;
+  } else {
+    MdlCacheMsg("MDLCache: Alloc VVD %s\n", GetModelName(handle));
 
-  // allocate cache space
-  MemAlloc_PushAllocDbgInfo("Models:Vertex data", 0);
-  pVvdHdr = (vertexFileHeader_t *)AllocData(MDLCACHE_VERTEXES, cacheLength);
-  MemAlloc_PopAllocDbgInfo();
+    // allocate cache space
+    MemAlloc_PushAllocDbgInfo("Models:Vertex data", 0);
+    pVvdHdr = (vertexFileHeader_t *)AllocData(MDLCACHE_VERTEXES, cacheLength);
+    MemAlloc_PopAllocDbgInfo();
+  }
 
   GetCacheSection(MDLCACHE_VERTEXES)->BeginFrameLocking();
 
@@ -2735,7 +2860,9 @@ vertexFileHeader_t *CMDLCache::BuildAndCacheVertexData(
   Assert(((int64_t)pVvdHdr & 0x1F) == 0);
 
   // load minimum vertexes and fixup
-  Studio_LoadVertexes(pRawVvdHdr, pVvdHdr, rootLOD, bNeedsTangentS);
+  if (!bMapped) {
+    Studio_LoadVertexes(pRawVvdHdr, pVvdHdr, rootLOD, bNeedsTangentS);
+  }
 
   GetCacheSection(MDLCACHE_VERTEXES)->EndFrameLocking();
 
@@ -2765,6 +2892,12 @@ vertexFileHeader_t *CMDLCache::LoadVertexData(studiohdr_t *pStudioHdr) {
     // load the VVD file
     // use model name for correct path
     MakeFilename(pFileName, pStudioHdr, ".vvd");
+
+    vertexFileHeader_t *pVvdHdr = MapVertexData(pStudioHdr, pFileName);
+    if (pVvdHdr) {
+      return pVvdHdr;
+    }
+
     MdlCacheMsg("MDLCache: Begin load VVD %s\n", pFileName);
 
     AsyncInfo_t info;
@@ -2789,6 +2922,42 @@ vertexFileHeader_t *CMDLCache::LoadVertexData(studiohdr_t *pStudioHdr) {
                                          MDLCACHE_VERTEXES);
 }
 
+//-----------------------------------------------------------------------------
+// Maps a VVD file whose layout already matches what Studio_LoadVertexes()
+// builds: no fixups, root lod 0, tangents right behind the vertexes and room
+// for the prefetch vertex in the last page. NULL if the copy path is needed.
+//-----------------------------------------------------------------------------
+vertexFileHeader_t *CMDLCache::MapVertexData(studiohdr_t *pStudioHdr,
+                                             const char *pFileName) {
+  bool bNeedsTangentS =
+      (g_pMaterialSystemHardwareConfig->GetDXSupportLevel() >= 80);
+  if (!bNeedsTangentS || pStudioHdr->rootLOD != 0) return NULL;
+
+  CMappedFile *pFile = MapGameFile(pFileName);
+  if (!pFile) return NULL;
+
+  vertexFileHeader_t *pVvdHdr = (vertexFileHeader_t *)pFile->Base();
+  bool bInPlace =
+      pFile->Size() >= sizeof(vertexFileHeader_t) &&
+      pVvdHdr->id == MODEL_VERTEX_FILE_ID &&
+      pVvdHdr->version == MODEL_VERTEX_FILE_VERSION &&
+      pVvdHdr->checksum == pStudioHdr->checksum && pVvdHdr->numLODs > 0 &&
+      pVvdHdr->numFixups == 0 && pVvdHdr->vertexDataStart > 0 &&
+      pVvdHdr->tangentDataStart ==
+          pVvdHdr->vertexDataStart +
+              pVvdHdr->numLODVertexes[0] * (int)sizeof(mstudiovertex_t) &&
+      (size_t)Studio_VertexDataSize(pVvdHdr, 0, true) <=
+          pFile->Size() + pFile->Slack();
+  if (!bInPlace) {
+    UnmapData(pVvdHdr);
+    return NULL;
+  }
+
+  MdlCacheMsg("MDLCache: Map VVD %s\n", pFileName);
+
+  return BuildAndCacheVertexData(pStudioHdr, pVvdHdr);
+}
+
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
@@ -2869,6 +3038,8 @@ void CMDLCache::UncacheData(DataCacheHandle_t c, MDLCacheDataType_t type,
 // Frees memory for an item
 //-----------------------------------------------------------------------------
 void CMDLCache::FreeData(MDLCacheDataType_t type, void *pData) {
+  if (UnmapData(pData)) return;
+
   if (type != MDLCACHE_ANIMBLOCK) {
     _aligned_free((void *)pData);
   } else {
@@ -2876,6 +3047,49 @@ void CMDLCache::FreeData(MDLCacheDataType_t type, void *pData) {
   }
 }
 
+//-----------------------------------------------------------------------------
+// Maps a file from the GAME path when a normal open would read the loose
+// file, files that resolve to a pack are read through it instead
+//-----------------------------------------------------------------------------
+CMappedFile *CMDLCache::MapGameFile(const char *pFileName) {
+  if (!mod_mmap_models.GetBool()) return NULL;
+
+  char pFullPath[SOURCE_MAX_PATH];
+  if (!ResolveLooseGameFile(pFileName, pFullPath, sizeof(pFullPath))) {
+    return NULL;
+  }
+
+  CMappedFile *pFile = new CMappedFile;
+  if (!pFile->Open(pFullPath)) {
+    delete pFile;
+    return NULL;
+  }
+
+  AUTO_LOCK_FM(m_MappedFileMutex);
+  m_MappedFiles.Insert(pFile->Base(), pFile);
+  return pFile;
+}
+
+bool CMDLCache::IsMappedData(const void *pData) {
+  AUTO_LOCK_FM(m_MappedFileMutex);
+  return m_MappedFiles.Find(pData) != m_MappedFiles.InvalidIndex();
+}
+
+bool CMDLCache::UnmapData(const void *pData) {
+  CMappedFile *pFile;
+  {
+    AUTO_LOCK_FM(m_MappedFileMutex);
+    unsigned short i = m_MappedFiles.Find(pData);
+    if (i == m_MappedFiles.InvalidIndex()) return false;
+
+    pFile = m_MappedFiles[i];
+    m_MappedFiles.RemoveAt(i);
+  }
+
+  delete pFile;
+  return true;
+}
+
 void CMDLCache::InitPreloadData(bool rebuild) {}
 
 void CMDLCache::ShutdownPreloadData() {}
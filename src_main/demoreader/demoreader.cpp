@@ -0,0 +1,999 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// CDemoReader decodes with the engine's datatable, string table and net
+// message code, modules linking demoreader.lib also build those sources.
+
+#include "demoreader/demoreader.h"
+
+#include <algorithm>
+
+#include "GameEventManager.h"
+#include "bitvec.h"
+#include "clientframe.h"
+#include "const.h"
+#include "demofile.h"
+#include "dt.h"
+#include "igameevents.h"
+#include "net.h"
+#include "netmessages.h"
+#include "networkstringtable.h"
+#include "packed_entity.h"
+#include "protocol.h"
+#include "tier0/include/dbg.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+
+#include "tier0/include/memdbgon.h"
+
+class CDemoReader : public IDemoReader {
+ public:
+  CDemoReader();
+  ~CDemoReader() override;
+
+  bool Open(const ch *pFilename, IDemoReaderListener *pListener) override;
+  void Close() override;
+  bool ReadCommand() override;
+  bool ReadAll() override;
+
+  bool IsCorrupt() const override { return m_bCorrupt; }
+  const demoheader_t &GetHeader() const override {
+    return m_DemoFile.m_DemoHeader;
+  }
+  int GetTick() const override { return m_nTick; }
+  int GetNumTicksRead() const override { return m_nTicksRead; }
+  float GetTickInterval() const override { return m_flTickInterval; }
+
+  int GetNumServerClasses() const override {
+    return m_ServerClasses.Count();
+  }
+  const ch *GetServerClassName(int iClass) const override;
+  int GetNumProps(int iClass) const override;
+  const SendProp *GetProp(int iClass, int iProp) const override;
+  int GetEntityClass(int nEntity) const override;
+  INetworkStringTable *FindStringTable(const ch *pName) const override;
+
+ private:
+  struct ServerClass_t {
+    ch *m_pClassName;
+    ch *m_pTableName;
+    CSendTablePrecalc *m_pPrecalc;
+    int m_iInstanceBaseline;  // lazily looked up string index
+  };
+
+  struct Entity_t {
+    short m_iClass;  // -1 if not created
+    short m_nSerial;
+  };
+
+  struct EntityBaseline_t {
+    int m_iClass;  // -1 if unset
+    CUtlVector<u8> m_Data;
+  };
+
+  struct Frame_t {
+    int m_nTick;
+    int m_nLastEntity;
+    CBitVec<MAX_EDICTS> m_Transmit;
+  };
+
+  struct EventDescriptor_t {
+    ch m_Name[MAX_EVENT_NAME_LENGTH];
+    int m_iFirstKey;  // into m_EventKeyNames
+    int m_nKeys;      // -1 if the id isn't used
+  };
+
+  struct EventKeyName_t {
+    ch m_Name[MAX_EVENT_NAME_LENGTH];
+    int m_Type;  // CGameEventManager::TYPE_*
+  };
+
+  bool ReadPacket();
+  bool ReadDataTables();
+  bool ProcessMessages(bf_read &buf);
+  bool ReadPacketEntities(SVC_PacketEntities &msg);
+  bool ReadEnterPVS(bf_read &buf, int nEntity, bool bAsDelta, int iBaseline,
+                    bool bUpdateBaselines);
+  void DeleteEntity(int nEntity);
+  bool DecodeProps(int nEntity, const CSendTablePrecalc *pPrecalc,
+                   bf_read *pIn);
+  bool MergeDeltas(const CSendTablePrecalc *pPrecalc, bf_read *pOldState,
+                   bf_read *pNewState, bf_write *pOut);
+  bool GetClassBaseline(int iClass, const void **ppData, int *pnBytes);
+  void ParseEventList(SVC_GameEventList &msg);
+  void ParseGameEvent(SVC_GameEvent &msg);
+  void FreeTables();
+  void Reset();
+
+  static void OnStringChanged(void *object, INetworkStringTable *pTable,
+                              int nIndex, const ch *pString,
+                              const void *pUserData);
+
+  CDemoFile m_DemoFile;
+  IDemoReaderListener *m_pListener;
+  bool m_bCorrupt;
+  int m_nTick;
+  int m_nTicksRead;
+  float m_flTickInterval;
+
+  CUtlVector<SendTable *> m_SendTables;
+  CUtlVector<ServerClass_t> m_ServerClasses;
+  int m_nServerClassBits;
+
+  CNetworkStringTableContainer m_StringTables;
+  INetworkStringTable *m_pInstanceBaselines;
+
+  Entity_t m_Entities[MAX_EDICTS];
+  EntityBaseline_t m_EntityBaselines[2][MAX_EDICTS];
+
+  // Delta sources, the server may delta against any acked snapshot.
+  Frame_t m_Frames[MAX_CLIENT_FRAMES];
+  int m_iNextFrame;
+  Frame_t m_FromFrame;
+
+  EventDescriptor_t m_EventDescriptors[1 << MAX_EVENT_BITS];
+  CUtlVector<EventKeyName_t> m_EventKeyNames;
+  CUtlVector<DemoEventKey_t> m_EventKeys;  // sized for the widest event
+  ch m_EventStrings[MAX_EVENT_BYTES];
+
+  // Scratch space for packets, merged baselines and decoded values.
+  ch m_PacketData[NET_MAX_PAYLOAD];
+  ch m_PackedData[MAX_PACKEDENTITY_DATA];
+  DecodeInfo m_DecodeInfo;
+};
+
+// Next entity set in pTransmit after nEntity, ENTITY_SENTINEL at the end.
+static inline int DemoReader_NextEntity(const CBitVec<MAX_EDICTS> *pTransmit,
+                                        int nEntity) {
+  if (!pTransmit) return ENTITY_SENTINEL;
+
+  int nNext = pTransmit->FindNextSetBit(nEntity + 1);
+  return nNext < 0 ? ENTITY_SENTINEL : nNext;
+}
+
+// Copies one prop's encoded state, same as CopyPropState in dt_recv_eng.cpp.
+static void DemoReader_CopyProp(const SendProp *pProp, int iProp, bf_read *pIn,
+                                CDeltaBitsWriter *pOut) {
+  int iStartBit = pIn->GetNumBitsRead();
+  SkipPropData(pIn, pProp);
+  int nBits = pIn->GetNumBitsRead() - iStartBit;
+  pIn->Seek(iStartBit);
+
+  pOut->WritePropIndex(iProp);
+  pOut->GetBitBuf()->WriteBitsFromBuffer(pIn, nBits);
+}
+
+// Messages the reader has no use for still have to be parsed to get past them.
+template <class T>
+static inline bool DemoReader_SkipMessage(bf_read &buf) {
+  T msg;
+  return msg.ReadFromBuffer(buf);
+}
+
+CDemoReader::CDemoReader() : m_pListener{nullptr} {
+  m_DecodeInfo.m_pRecvProp = NULL;
+  m_DecodeInfo.m_pStruct = NULL;
+  m_DecodeInfo.m_pData = NULL;
+  m_DecodeInfo.m_iElement = 0;
+
+  Reset();
+}
+
+CDemoReader::~CDemoReader() { Close(); }
+
+bool CDemoReader::Open(const ch *pFilename, IDemoReaderListener *pListener) {
+  Assert(pListener);
+
+  Close();
+
+  if (!m_DemoFile.Open(pFilename, true)) return false;
+
+  if (!m_DemoFile.ReadDemoHeader()) {
+    m_DemoFile.Close();
+    return false;
+  }
+
+  m_pListener = pListener;
+  return true;
+}
+
+void CDemoReader::Close() {
+  if (m_DemoFile.IsOpen()) m_DemoFile.Close();
+
+  Reset();
+}
+
+void CDemoReader::Reset() {
+  FreeTables();
+
+  m_pListener = nullptr;
+  m_bCorrupt = false;
+  m_nTick = 0;
+  m_nTicksRead = 0;
+  m_flTickInterval = 0;
+
+  m_StringTables.RemoveAllTables();
+  m_pInstanceBaselines = nullptr;
+
+  for (int i = 0; i < MAX_EDICTS; i++) {
+    m_Entities[i].m_iClass = -1;
+    m_Entities[i].m_nSerial = 0;
+    m_EntityBaselines[0][i].m_iClass = -1;
+    m_EntityBaselines[1][i].m_iClass = -1;
+  }
+
+  for (int i = 0; i < MAX_CLIENT_FRAMES; i++) {
+    m_Frames[i].m_nTick = -1;
+  }
+  m_iNextFrame = 0;
+
+  for (int i = 0; i < ARRAYSIZE(m_EventDescriptors); i++) {
+    m_EventDescriptors[i].m_nKeys = -1;
+  }
+  m_EventKeyNames.RemoveAll();
+  m_EventKeys.RemoveAll();
+}
+
+void CDemoReader::FreeTables() {
+  // The precalcs point into the tables, free them first.
+  for (int i = 0; i < m_ServerClasses.Count(); i++) {
+    delete m_ServerClasses[i].m_pPrecalc;
+    delete[] m_ServerClasses[i].m_pClassName;
+    delete[] m_ServerClasses[i].m_pTableName;
+  }
+  m_ServerClasses.RemoveAll();
+
+  for (int i = 0; i < m_SendTables.Count(); i++) {
+    RecvTable_FreeSendTable(m_SendTables[i]);
+  }
+  m_SendTables.RemoveAll();
+
+  m_nServerClassBits = 0;
+}
+
+bool CDemoReader::ReadCommand() {
+  if (m_bCorrupt || !m_DemoFile.IsOpen()) return false;
+
+  unsigned char cmd;
+  int tick;
+  m_DemoFile.ReadCmdHeader(cmd, tick);
+
+  switch (cmd) {
+    case dem_stop:
+      return false;
+    case dem_synctick:
+      break;
+    case dem_consolecmd:
+      m_DemoFile.ReadRawData(NULL, 0);
+      break;
+    case dem_datatables:
+      m_bCorrupt = !ReadDataTables();
+      break;
+    case dem_usercmd: {
+      int nSize = 0;
+      m_DemoFile.ReadUserCmd(NULL, nSize);
+    } break;
+    case dem_keyframe:
+      // The regular packets carry the same state.
+      m_DemoFile.SkipPacket();
+      break;
+    case dem_signon:
+    case dem_packet:
+      m_bCorrupt = !ReadPacket();
+      break;
+    default:
+      m_bCorrupt = true;
+      break;
+  }
+
+  if (m_bCorrupt) {
+    Warning("CDemoReader: %s is corrupt at tick %d.\n", m_DemoFile.m_szFileName,
+            m_nTick);
+  }
+
+  return !m_bCorrupt;
+}
+
+bool CDemoReader::ReadAll() {
+  while (ReadCommand()) {
+  }
+
+  return !m_bCorrupt;
+}
+
+bool CDemoReader::ReadPacket() {
+  democmdinfo_t info;
+  int nSeqNrIn, nSeqNrOutAck;
+  m_DemoFile.ReadCmdInfo(info);
+  m_DemoFile.ReadSequenceInfo(nSeqNrIn, nSeqNrOutAck);
+
+  int nLength = m_DemoFile.ReadRawData(m_PacketData, sizeof(m_PacketData));
+  if (nLength < 0) return false;
+
+  bf_read buf("CDemoReader::ReadPacket", m_PacketData, nLength);
+  return ProcessMessages(buf);
+}
+
+bool CDemoReader::ReadDataTables() {
+  FreeTables();
+
+  // Only read once per demo, not worth keeping around.
+  CUtlMemory<u8> data(0, 256 * 1024);
+  bf_read buf("CDemoReader::ReadDataTables", data.Base(), data.Count());
+
+  if (m_DemoFile.ReadNetworkDataTables(&buf) < 0) return false;
+
+  while (buf.ReadOneBit() != 0) {
+    buf.ReadOneBit();  // needs decoder, every table here gets one
+
+    m_SendTables.AddToTail(
+        RecvTable_ReadInfos(&buf, m_DemoFile.m_DemoHeader.demoprotocol));
+  }
+
+  // Point the datatable props at their tables, see
+  // SetupClientSendTableHierarchy.
+  for (int iTable = 0; iTable < m_SendTables.Count(); iTable++) {
+    SendTable *pTable = m_SendTables[iTable];
+
+    for (int iProp = 0; iProp < pTable->m_nProps; iProp++) {
+      SendProp *pProp = &pTable->m_pProps[iProp];
+      if (pProp->m_Type != DPT_DataTable) continue;
+
+      SendTable *pChild = NULL;
+      for (int i = 0; i < m_SendTables.Count(); i++) {
+        if (!Q_stricmp(m_SendTables[i]->m_pNetTableName,
+                       pProp->m_pExcludeDTName)) {
+          pChild = m_SendTables[i];
+          break;
+        }
+      }
+
+      if (!pChild) {
+        Warning("CDemoReader: missing SendTable '%s' (referenced by '%s').\n",
+                pProp->m_pExcludeDTName, pTable->m_pNetTableName);
+        return false;
+      }
+
+      pProp->SetDataTable(pChild);
+    }
+  }
+
+  // Server classes, see DataTable_ParseClassInfosFromBuffer.
+  int nClasses = buf.ReadShort();
+  if (nClasses <= 0) return false;
+
+  m_ServerClasses.SetCount(nClasses);
+  for (int i = 0; i < nClasses; i++) {
+    ServerClass_t &serverClass = m_ServerClasses[i];
+    serverClass.m_pClassName = NULL;
+    serverClass.m_pTableName = NULL;
+    serverClass.m_pPrecalc = NULL;
+    serverClass.m_iInstanceBaseline = INVALID_STRING_INDEX;
+  }
+
+  for (int i = 0; i < nClasses; i++) {
+    int iClass = buf.ReadShort();
+    if (iClass < 0 || iClass >= nClasses) return false;
+
+    ServerClass_t &serverClass = m_ServerClasses[iClass];
+    delete[] serverClass.m_pClassName;
+    delete[] serverClass.m_pTableName;
+    serverClass.m_pClassName = buf.ReadAndAllocateString();
+    serverClass.m_pTableName = buf.ReadAndAllocateString();
+  }
+
+  if (buf.IsOverflowed()) return false;
+
+  for (int iClass = 0; iClass < nClasses; iClass++) {
+    ServerClass_t &serverClass = m_ServerClasses[iClass];
+    if (!serverClass.m_pTableName) return false;
+
+    SendTable *pTable = NULL;
+    for (int i = 0; i < m_SendTables.Count(); i++) {
+      if (!Q_stricmp(m_SendTables[i]->m_pNetTableName,
+                     serverClass.m_pTableName)) {
+        pTable = m_SendTables[i];
+        break;
+      }
+    }
+
+    if (!pTable) {
+      Warning("CDemoReader: missing SendTable '%s' for class '%s'.\n",
+              serverClass.m_pTableName, serverClass.m_pClassName);
+      return false;
+    }
+
+    // Same flat prop order and compiled program the client decoders use.
+    serverClass.m_pPrecalc = new CSendTablePrecalc;
+    serverClass.m_pPrecalc->m_pSendTable = pTable;
+    if (!serverClass.m_pPrecalc->SetupFlatPropertyArray()) return false;
+  }
+
+  m_nServerClassBits = Q_log2(nClasses) + 1;
+  return true;
+}
+
+bool CDemoReader::ProcessMessages(bf_read &buf) {
+  while (buf.GetNumBitsLeft() >= NETMSG_TYPE_BITS) {
+    int cmd = buf.ReadUBitLong(NETMSG_TYPE_BITS);
+    bool bOk = true;
+
+    switch (cmd) {
+      case net_NOP:
+        break;
+      case net_Disconnect: {
+        ch reason[1024];
+        buf.ReadString(reason, sizeof(reason));
+      } break;
+      case net_File: {
+        ch filename[1024];
+        buf.ReadUBitLong(32);
+        buf.ReadString(filename, sizeof(filename));
+        buf.ReadOneBit();
+      } break;
+      case net_Tick: {
+        NET_Tick msg;
+        bOk = msg.ReadFromBuffer(buf);
+        m_nTick = msg.m_nTick;
+        m_nTicksRead++;
+        m_pListener->OnTick(this, m_nTick);
+      } break;
+      case net_StringCmd:
+        bOk = DemoReader_SkipMessage<NET_StringCmd>(buf);
+        break;
+      case net_SetConVar:
+        bOk = DemoReader_SkipMessage<NET_SetConVar>(buf);
+        break;
+      case net_SignonState:
+        bOk = DemoReader_SkipMessage<NET_SignonState>(buf);
+        break;
+      case svc_Print:
+        bOk = DemoReader_SkipMessage<SVC_Print>(buf);
+        break;
+      case svc_ServerInfo: {
+        SVC_ServerInfo msg;
+        bOk = msg.ReadFromBuffer(buf);
+        m_flTickInterval = msg.m_fTickInterval;
+      } break;
+      case svc_SendTable:
+        // dem_datatables has all of them.
+        bOk = DemoReader_SkipMessage<SVC_SendTable>(buf);
+        break;
+      case svc_ClassInfo:
+        bOk = DemoReader_SkipMessage<SVC_ClassInfo>(buf);
+        break;
+      case svc_SetPause:
+        bOk = DemoReader_SkipMessage<SVC_SetPause>(buf);
+        break;
+      case svc_CreateStringTable: {
+        SVC_CreateStringTable msg;
+        bOk = msg.ReadFromBuffer(buf);
+        if (!bOk) break;
+
+        m_StringTables.AllowCreation(true);
+        CNetworkStringTable *pTable =
+            (CNetworkStringTable *)m_StringTables.CreateStringTableEx(
+                msg.m_szTableName, msg.m_nMaxEntries, msg.m_nUserDataSize,
+                msg.m_nUserDataSizeBits, msg.m_bIsFilenames);
+        m_StringTables.AllowCreation(false);
+
+        pTable->SetTick(m_nTick);
+        pTable->SetStringChangedCallback(this, &CDemoReader::OnStringChanged);
+        pTable->ParseUpdate(msg.m_DataIn, msg.m_nNumEntries);
+
+        if (!Q_strcmp(msg.m_szTableName, INSTANCE_BASELINE_TABLENAME)) {
+          m_pInstanceBaselines = pTable;
+        }
+      } break;
+      case svc_UpdateStringTable:
+      case svc_UpdateStringTableDelta: {
+        SVC_UpdateStringTable updateMsg;
+        SVC_UpdateStringTableDelta deltaMsg;
+        const bool bDelta = cmd == svc_UpdateStringTableDelta;
+        SVC_UpdateStringTable &msg = bDelta ? deltaMsg : updateMsg;
+        bOk = msg.ReadFromBuffer(buf);
+        if (!bOk) break;
+
+        CNetworkStringTable *pTable =
+            (CNetworkStringTable *)m_StringTables.GetTable(msg.m_nTableID);
+        bOk = pTable != NULL;
+        if (pTable) {
+          pTable->SetTick(m_nTick);
+          pTable->ParseUpdate(msg.m_DataIn, msg.m_nChangedEntries, bDelta);
+        }
+      } break;
+      case svc_VoiceInit:
+        bOk = DemoReader_SkipMessage<SVC_VoiceInit>(buf);
+        break;
+      case svc_VoiceData:
+        bOk = DemoReader_SkipMessage<SVC_VoiceData>(buf);
+        break;
+      case svc_Sounds:
+        bOk = DemoReader_SkipMessage<SVC_Sounds>(buf);
+        break;
+      case svc_SetView:
+        bOk = DemoReader_SkipMessage<SVC_SetView>(buf);
+        break;
+      case svc_FixAngle:
+        bOk = DemoReader_SkipMessage<SVC_FixAngle>(buf);
+        break;
+      case svc_CrosshairAngle:
+        bOk = DemoReader_SkipMessage<SVC_CrosshairAngle>(buf);
+        break;
+      case svc_BSPDecal:
+        bOk = DemoReader_SkipMessage<SVC_BSPDecal>(buf);
+        break;
+      case svc_UserMessage:
+        bOk = DemoReader_SkipMessage<SVC_UserMessage>(buf);
+        break;
+      case svc_EntityMessage:
+        bOk = DemoReader_SkipMessage<SVC_EntityMessage>(buf);
+        break;
+      case svc_GameEvent: {
+        SVC_GameEvent msg;
+        bOk = msg.ReadFromBuffer(buf);
+        if (bOk) ParseGameEvent(msg);
+      } break;
+      case svc_PacketEntities: {
+        SVC_PacketEntities msg;
+        bOk = msg.ReadFromBuffer(buf) && ReadPacketEntities(msg);
+      } break;
+      case svc_TempEntities:
+        bOk = DemoReader_SkipMessage<SVC_TempEntities>(buf);
+        break;
+      case svc_Prefetch:
+        bOk = DemoReader_SkipMessage<SVC_Prefetch>(buf);
+        break;
+      case svc_Menu:
+        bOk = DemoReader_SkipMessage<SVC_Menu>(buf);
+        break;
+      case svc_GameEventList: {
+        SVC_GameEventList msg;
+        bOk = msg.ReadFromBuffer(buf);
+        if (bOk) ParseEventList(msg);
+      } break;
+      case svc_GetCvarValue:
+        bOk = DemoReader_SkipMessage<SVC_GetCvarValue>(buf);
+        break;
+      default:
+        Warning("CDemoReader: unknown net message %d.\n", cmd);
+        bOk = false;
+        break;
+    }
+
+    if (!bOk || buf.IsOverflowed()) return false;
+  }
+
+  return true;
+}
+
+// Walks the entity headers like CBaseClientState::ReadPacketEntities, with a
+// transmit bit vector per received snapshot standing in for CClientFrame.
+bool CDemoReader::ReadPacketEntities(SVC_PacketEntities &msg) {
+  if (!m_ServerClasses.Count()) return false;
+
+  const bool bAsDelta = msg.m_bIsDelta;
+  const Frame_t *pFrom = NULL;
+
+  if (bAsDelta) {
+    for (int i = 0; i < MAX_CLIENT_FRAMES; i++) {
+      if (m_Frames[i].m_nTick == msg.m_nDeltaFrom) {
+        // Copy it, the new frame may reuse the slot.
+        m_FromFrame = m_Frames[i];
+        pFrom = &m_FromFrame;
+        break;
+      }
+    }
+
+    if (!pFrom) {
+      // The client flushes these too and waits for a full update.
+      DevMsg("CDemoReader: delta from tick %d not found.\n", msg.m_nDeltaFrom);
+      return true;
+    }
+  } else {
+    for (int i = 0; i < MAX_EDICTS; i++) {
+      DeleteEntity(i);
+    }
+  }
+
+  const int iBaseline = msg.m_nBaseline;
+  if (msg.m_bUpdateBaseline) {
+    // See CBaseClientState::CopyEntityBaseline.
+    const int iUpdateBaseline = (iBaseline == 0) ? 1 : 0;
+    for (int i = 0; i < MAX_EDICTS; i++) {
+      const EntityBaseline_t &from = m_EntityBaselines[iBaseline][i];
+      EntityBaseline_t &to = m_EntityBaselines[iUpdateBaseline][i];
+
+      to.m_iClass = from.m_iClass;
+      if (from.m_iClass >= 0) {
+        to.m_Data.CopyArray(from.m_Data.Base(), from.m_Data.Count());
+      }
+    }
+  }
+
+  Frame_t *pTo = &m_Frames[m_iNextFrame];
+  m_iNextFrame = (m_iNextFrame + 1) % MAX_CLIENT_FRAMES;
+  pTo->m_nTick = m_nTick;
+  pTo->m_nLastEntity = -1;
+  pTo->m_Transmit.ClearAll();
+
+  const CBitVec<MAX_EDICTS> *pFromTransmit = pFrom ? &pFrom->m_Transmit : NULL;
+  bf_read &buf = msg.m_DataIn;
+  int nHeaderCount = msg.m_nUpdatedEntries;
+  int nHeaderBase = -1;
+  int nNewEntity = -1;
+  int nOldEntity = DemoReader_NextEntity(pFromTransmit, -1);
+
+  while (true) {
+    const bool bIsEntity = --nHeaderCount >= 0;
+    int nUpdateFlags = FHDR_ZERO;
+
+    if (bIsEntity) {
+      nNewEntity = nHeaderBase + 1 + buf.ReadUBitVar();
+      nHeaderBase = nNewEntity;
+
+      if (buf.ReadOneBit() == 0) {
+        if (buf.ReadOneBit() != 0) nUpdateFlags |= FHDR_ENTERPVS;
+      } else {
+        nUpdateFlags |= FHDR_LEAVEPVS;
+        if (buf.ReadOneBit() != 0) nUpdateFlags |= FHDR_DELETE;
+      }
+
+      if (nNewEntity >= MAX_EDICTS || buf.IsOverflowed()) return false;
+    }
+
+    // Entities the server didn't mention keep their state.
+    while ((!bIsEntity || nNewEntity > nOldEntity) && pFrom &&
+           nOldEntity <= pFrom->m_nLastEntity) {
+      pTo->m_nLastEntity = nOldEntity;
+      pTo->m_Transmit.Set(nOldEntity);
+      nOldEntity = DemoReader_NextEntity(pFromTransmit, nOldEntity);
+    }
+
+    if (!bIsEntity) break;
+
+    if (nUpdateFlags & FHDR_ENTERPVS) {
+      if (!ReadEnterPVS(buf, nNewEntity, bAsDelta, iBaseline,
+                        msg.m_bUpdateBaseline))
+        return false;
+
+      pTo->m_nLastEntity = nNewEntity;
+      pTo->m_Transmit.Set(nNewEntity);
+
+      // That was a recreate.
+      if (nNewEntity == nOldEntity) {
+        nOldEntity = DemoReader_NextEntity(pFromTransmit, nOldEntity);
+      }
+    } else if (nUpdateFlags & FHDR_LEAVEPVS) {
+      if (!bAsDelta) return false;
+
+      if (nUpdateFlags & FHDR_DELETE) DeleteEntity(nOldEntity);
+
+      nOldEntity = DemoReader_NextEntity(pFromTransmit, nOldEntity);
+    } else {
+      const int iClass = m_Entities[nNewEntity].m_iClass;
+      if (iClass < 0 ||
+          !DecodeProps(nNewEntity, m_ServerClasses[iClass].m_pPrecalc, &buf))
+        return false;
+
+      pTo->m_nLastEntity = nNewEntity;
+      pTo->m_Transmit.Set(nNewEntity);
+      nOldEntity = DemoReader_NextEntity(pFromTransmit, nOldEntity);
+    }
+  }
+
+  // Explicit deletes.
+  if (bAsDelta) {
+    while (buf.ReadOneBit() != 0) {
+      DeleteEntity(buf.ReadUBitLong(MAX_EDICT_BITS));
+    }
+  }
+
+  return !buf.IsOverflowed();
+}
+
+bool CDemoReader::ReadEnterPVS(bf_read &buf, int nEntity, bool bAsDelta,
+                               int iBaseline, bool bUpdateBaselines) {
+  const int iClass = buf.ReadUBitLong(m_nServerClassBits);
+  const int nSerial =
+      buf.ReadUBitLong(NUM_NETWORKED_EHANDLE_SERIAL_NUMBER_BITS);
+  if (iClass >= m_ServerClasses.Count()) return false;
+
+  Entity_t &entity = m_Entities[nEntity];
+  if (entity.m_iClass >= 0 && entity.m_nSerial != nSerial) {
+    DeleteEntity(nEntity);
+  }
+
+  if (entity.m_iClass < 0) {
+    entity.m_iClass = iClass;
+    entity.m_nSerial = nSerial;
+    m_pListener->OnEntityCreated(this, nEntity, iClass, nSerial);
+  }
+
+  // Either the entity's own or the class' instance baseline.
+  const void *pFromData;
+  int nFromBytes;
+  const EntityBaseline_t *pBaseline =
+      bAsDelta ? &m_EntityBaselines[iBaseline][nEntity] : NULL;
+  if (pBaseline && pBaseline->m_iClass == iClass) {
+    pFromData = pBaseline->m_Data.Base();
+    nFromBytes = pBaseline->m_Data.Count();
+  } else if (!GetClassBaseline(iClass, &pFromData, &nFromBytes)) {
+    return false;
+  }
+
+  bf_read fromBuf("CDemoReader::ReadEnterPVS", pFromData, nFromBytes);
+  const CSendTablePrecalc *pPrecalc = m_ServerClasses[iClass].m_pPrecalc;
+
+  if (!bUpdateBaselines) {
+    return DecodeProps(nEntity, pPrecalc, &fromBuf) &&
+           DecodeProps(nEntity, pPrecalc, &buf);
+  }
+
+  // The merged state becomes the entity's baseline in the other slot.
+  bf_write writeBuf("CDemoReader::ReadEnterPVS", m_PackedData,
+                    sizeof(m_PackedData));
+  if (!MergeDeltas(pPrecalc, &fromBuf, &buf, &writeBuf)) return false;
+
+  EntityBaseline_t &update =
+      m_EntityBaselines[(iBaseline == 0) ? 1 : 0][nEntity];
+  update.m_iClass = iClass;
+  update.m_Data.CopyArray((const u8 *)m_PackedData,
+                          writeBuf.GetNumBytesWritten());
+
+  fromBuf.StartReading(m_PackedData, writeBuf.GetNumBytesWritten());
+  return DecodeProps(nEntity, pPrecalc, &fromBuf);
+}
+
+void CDemoReader::DeleteEntity(int nEntity) {
+  if (nEntity < 0 || nEntity >= MAX_EDICTS) return;
+
+  Entity_t &entity = m_Entities[nEntity];
+  if (entity.m_iClass < 0) return;
+
+  entity.m_iClass = -1;
+  m_pListener->OnEntityDeleted(this, nEntity);
+}
+
+// RecvTable_Decode without a RecvTable, the values go to the listener.
+bool CDemoReader::DecodeProps(int nEntity, const CSendTablePrecalc *pPrecalc,
+                              bf_read *pIn) {
+  DecodeInfo &info = m_DecodeInfo;
+  info.m_pIn = pIn;
+  info.m_ObjectID = nEntity;
+
+  const int nProps = pPrecalc->GetNumProps();
+  CDeltaBitsReader deltaBitsReader(pIn);
+  int iProp;
+
+  while (-1 != (iProp = deltaBitsReader.ReadNextPropIndex())) {
+    if (iProp >= nProps) {
+      deltaBitsReader.ForceFinished();
+      return false;
+    }
+
+    const SendProp *pProp = pPrecalc->GetProp(iProp);
+
+    if (pProp->GetType() != DPT_Array) {
+      info.m_pProp = pProp;
+      RecvTable_ExecuteProp(&pPrecalc->m_Program[iProp], &info);
+      info.m_Value.m_Type = pProp->GetType();
+      m_pListener->OnPropChanged(this, nEntity, iProp, -1, info.m_Value);
+      continue;
+    }
+
+    // Report each element, the int run encoding Array_Encode uses for int
+    // elements reads the same as one Int_Decode per element.
+    const SendProp *pArrayProp = pProp->GetArrayProp();
+    const int nElements = pIn->ReadUBitLong(pProp->GetNumArrayLengthBits());
+
+    info.m_pProp = pArrayProp;
+    for (info.m_iElement = 0; info.m_iElement < nElements; info.m_iElement++) {
+      g_PropTypeFns[pArrayProp->GetType()].Decode(&info);
+      info.m_Value.m_Type = pArrayProp->GetType();
+      m_pListener->OnPropChanged(this, nEntity, iProp, info.m_iElement,
+                                 info.m_Value);
+    }
+    info.m_iElement = 0;
+  }
+
+  return !pIn->IsOverflowed();
+}
+
+// RecvTable_MergeDeltas on the reader's own flat prop list.
+bool CDemoReader::MergeDeltas(const CSendTablePrecalc *pPrecalc,
+                              bf_read *pOldState, bf_read *pNewState,
+                              bf_write *pOut) {
+  const int nProps = pPrecalc->GetNumProps();
+  bool bOk = true;
+
+  {
+    CDeltaBitsReader oldStateReader(pOldState);
+    CDeltaBitsReader newStateReader(pNewState);
+    CDeltaBitsWriter deltaBitsWriter(pOut);
+
+    int iOldProp = NextProp(&oldStateReader);
+    int iNewProp = NextProp(&newStateReader);
+
+    while (bOk) {
+      // Props in the old state that aren't in the new one.
+      while (iOldProp < iNewProp && iOldProp < nProps) {
+        DemoReader_CopyProp(pPrecalc->GetProp(iOldProp), iOldProp, pOldState,
+                            &deltaBitsWriter);
+        iOldProp = NextProp(&oldStateReader);
+      }
+
+      if (iNewProp == PROP_SENTINEL) break;
+
+      if (iNewProp >= nProps || (iOldProp < iNewProp)) {
+        bOk = false;
+        break;
+      }
+
+      if (iOldProp == iNewProp) {
+        SkipPropData(pOldState, pPrecalc->GetProp(iOldProp));
+        iOldProp = NextProp(&oldStateReader);
+      }
+
+      DemoReader_CopyProp(pPrecalc->GetProp(iNewProp), iNewProp, pNewState,
+                          &deltaBitsWriter);
+      iNewProp = NextProp(&newStateReader);
+    }
+
+    if (!bOk || iOldProp != PROP_SENTINEL) {
+      bOk = false;
+      oldStateReader.ForceFinished();
+      newStateReader.ForceFinished();
+    }
+  }
+
+  return bOk && !pOldState->IsOverflowed() && !pNewState->IsOverflowed() &&
+         !pOut->IsOverflowed();
+}
+
+bool CDemoReader::GetClassBaseline(int iClass, const void **ppData,
+                                   int *pnBytes) {
+  if (!m_pInstanceBaselines) return false;
+
+  ServerClass_t &serverClass = m_ServerClasses[iClass];
+
+  if (serverClass.m_iInstanceBaseline == INVALID_STRING_INDEX) {
+    // The key is the class index string.
+    ch str[16];
+    Q_snprintf(str, sizeof(str), "%d", iClass);
+
+    serverClass.m_iInstanceBaseline =
+        m_pInstanceBaselines->FindStringIndex(str);
+    if (serverClass.m_iInstanceBaseline == INVALID_STRING_INDEX) return false;
+  }
+
+  *ppData = m_pInstanceBaselines->GetStringUserData(
+      serverClass.m_iInstanceBaseline, pnBytes);
+  return *ppData != NULL;
+}
+
+// See CGameEventManager::ParseEventList, the reader keeps every event.
+void CDemoReader::ParseEventList(SVC_GameEventList &msg) {
+  for (int i = 0; i < ARRAYSIZE(m_EventDescriptors); i++) {
+    m_EventDescriptors[i].m_nKeys = -1;
+  }
+  m_EventKeyNames.RemoveAll();
+
+  bf_read &buf = msg.m_DataIn;
+  int nMaxKeys = 0;
+
+  for (int i = 0; i < msg.m_nNumEvents; i++) {
+    EventDescriptor_t &descriptor =
+        m_EventDescriptors[buf.ReadUBitLong(MAX_EVENT_BITS)];
+    buf.ReadString(descriptor.m_Name, sizeof(descriptor.m_Name));
+    descriptor.m_iFirstKey = m_EventKeyNames.Count();
+    descriptor.m_nKeys = 0;
+
+    int nType = buf.ReadUBitLong(3);
+    while (nType != CGameEventManager::TYPE_LOCAL) {
+      EventKeyName_t &keyName = m_EventKeyNames[m_EventKeyNames.AddToTail()];
+      buf.ReadString(keyName.m_Name, sizeof(keyName.m_Name));
+      keyName.m_Type = nType;
+      descriptor.m_nKeys++;
+
+      nType = buf.ReadUBitLong(3);
+    }
+
+    nMaxKeys = std::max(nMaxKeys, descriptor.m_nKeys);
+  }
+
+  m_EventKeys.SetCount(nMaxKeys);
+}
+
+// See CGameEventManager::UnserializeEvent.
+void CDemoReader::ParseGameEvent(SVC_GameEvent &msg) {
+  bf_read &buf = msg.m_DataIn;
+  const EventDescriptor_t &descriptor =
+      m_EventDescriptors[buf.ReadUBitLong(MAX_EVENT_BITS)];
+
+  // Unknown id, the message length already got us past it.
+  if (descriptor.m_nKeys < 0) return;
+
+  ch *pString = m_EventStrings;
+  int nStringBytes = sizeof(m_EventStrings);
+
+  for (int i = 0; i < descriptor.m_nKeys; i++) {
+    const EventKeyName_t &keyName = m_EventKeyNames[descriptor.m_iFirstKey + i];
+    DemoEventKey_t &key = m_EventKeys[i];
+    key.m_pName = keyName.m_Name;
+    key.m_Value.m_Type = DPT_Int;
+
+    switch (keyName.m_Type) {
+      case CGameEventManager::TYPE_STRING: {
+        key.m_Value.m_Type = DPT_String;
+        key.m_Value.m_pString = pString;
+
+        if (nStringBytes > 1) {
+          buf.ReadString(pString, nStringBytes);
+          int nLength = Q_strlen(pString) + 1;
+          pString += nLength;
+          nStringBytes -= nLength;
+        } else {
+          key.m_Value.m_pString = "";
+        }
+      } break;
+      case CGameEventManager::TYPE_FLOAT:
+        key.m_Value.m_Type = DPT_Float;
+        key.m_Value.m_Float = buf.ReadFloat();
+        break;
+      case CGameEventManager::TYPE_LONG:
+        key.m_Value.m_Int = buf.ReadLong();
+        break;
+      case CGameEventManager::TYPE_SHORT:
+        key.m_Value.m_Int = buf.ReadShort();
+        break;
+      case CGameEventManager::TYPE_BYTE:
+        key.m_Value.m_Int = buf.ReadByte();
+        break;
+      case CGameEventManager::TYPE_BOOL:
+        key.m_Value.m_Int = buf.ReadOneBit();
+        break;
+      default:
+        key.m_Value.m_Int = 0;
+        break;
+    }
+  }
+
+  m_pListener->OnGameEvent(this, descriptor.m_Name, m_EventKeys.Base(),
+                           descriptor.m_nKeys);
+}
+
+void CDemoReader::OnStringChanged(void *object, INetworkStringTable *pTable,
+                                  int nIndex, const ch *pString,
+                                  const void *pUserData) {
+  CDemoReader *pReader = (CDemoReader *)object;
+  pReader->m_pListener->OnStringTableChanged(pReader, pTable, nIndex, pString,
+                                             pUserData);
+}
+
+const ch *CDemoReader::GetServerClassName(int iClass) const {
+  Assert(iClass >= 0 && iClass < m_ServerClasses.Count());
+  return m_ServerClasses[iClass].m_pClassName;
+}
+
+int CDemoReader::GetNumProps(int iClass) const {
+  Assert(iClass >= 0 && iClass < m_ServerClasses.Count());
+  return m_ServerClasses[iClass].m_pPrecalc->GetNumProps();
+}
+
+const SendProp *CDemoReader::GetProp(int iClass, int iProp) const {
+  Assert(iClass >= 0 && iClass < m_ServerClasses.Count());
+  return m_ServerClasses[iClass].m_pPrecalc->GetProp(iProp);
+}
+
+int CDemoReader::GetEntityClass(int nEntity) const {
+  Assert(nEntity >= 0 && nEntity < MAX_EDICTS);
+  return m_Entities[nEntity].m_iClass;
+}
+
+INetworkStringTable *CDemoReader::FindStringTable(const ch *pName) const {
+  return m_StringTables.FindTable(pName);
+}
+
+IDemoReader *CreateDemoReader() { return new CDemoReader; }
+
+void DestroyDemoReader(IDemoReader *pReader) { delete pReader; }
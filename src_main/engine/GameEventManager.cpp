@@ -2,10 +2,18 @@
 
 #include "GameEventManager.h"
 
+#include <algorithm>
+
 #include "client.h"
 #include "filesystem_engine.h"
 #include "server.h"
+#include "tier0/include/fasttimer.h"
+#include "tier0/include/memalloc.h"
+#include "tier0/include/threadtools.h"
+#include "tier0/include/tslist.h"
 #include "tier0/include/vprof.h"
+#include "tier1/delegates.h"
+#include "tier1/generichash.h"
 
 #include "tier0/include/memdbgon.h"
 
@@ -36,52 +44,320 @@ EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CGameEventManager, IGameEventManager2,
                                   INTERFACEVERSION_GAMEEVENTSMANAGER2,
                                   s_GameEventManager);
 
-CGameEvent::CGameEvent(CGameEventDescriptor *descriptor) {
+static CTSPool<CGameEvent> s_GameEventPool;
+
+// Room for GetString of a number, KeyValues formats them into as much.
+#define GAMEEVENT_NUMBER_TEXT 64
+
+void CGameEventDescriptor::CompileSlots() {
+  slots.RemoveAll();
+
+  if (!keys) return;
+
+  for (KeyValues *key = keys->GetFirstSubKey(); key; key = key->GetNextKey()) {
+    CGameEventKey &slot = slots[slots.AddToTail()];
+    Q_strncpy(slot.name, key->GetName(), sizeof(slot.name));
+    slot.hash = HashStringCaselessConventional(slot.name);
+    slot.type = key->GetInt();
+  }
+}
+
+int CGameEventDescriptor::FindSlot(const char *keyName) const {
+  if (!keyName) return -1;
+
+  const unsigned int hash = HashStringCaselessConventional(keyName);
+
+  for (int i = 0; i < slots.Count(); i++) {
+    if (slots[i].hash == hash && !Q_stricmp(slots[i].name, keyName)) return i;
+  }
+
+  return -1;
+}
+
+CGameEvent::CGameEvent() : m_pDescriptor{nullptr}, m_pDataKeys{nullptr} {}
+
+CGameEvent::~CGameEvent() { Clear(); }
+
+void CGameEvent::Init(CGameEventDescriptor *descriptor) {
   Assert(descriptor);
   m_pDescriptor = descriptor;
-  m_pDataKeys = new KeyValues(descriptor->name);
+
+  const int count = descriptor->slots.Count();
+  m_Values.SetCount(count);
+
+  if (m_Strings.Count() < count) {
+    m_Strings.AddMultipleToTail(count - m_Strings.Count());
+  }
+
+  for (int i = 0; i < count; i++) {
+    m_Values[i].type = VALUE_NONE;
+  }
 }
 
-CGameEvent::~CGameEvent() { m_pDataKeys->deleteThis(); }
+void CGameEvent::Clear() {
+  if (m_pDataKeys) {
+    m_pDataKeys->deleteThis();
+    m_pDataKeys = NULL;
+  }
+
+  // keep the memory for the next use
+  m_Values.RemoveAll();
+}
 
 bool CGameEvent::GetBool(const char *keyName, bool defaultValue) {
-  return m_pDataKeys->GetInt(keyName, defaultValue) != 0;
+  return GetInt(keyName, defaultValue) != 0;
 }
 
 int CGameEvent::GetInt(const char *keyName, int defaultValue) {
-  return m_pDataKeys->GetInt(keyName, defaultValue);
+  if (m_pDataKeys) return m_pDataKeys->GetInt(keyName, defaultValue);
+
+  return GetIntAt(m_pDescriptor->FindSlot(keyName), defaultValue);
 }
 
 float CGameEvent::GetFloat(const char *keyName, float defaultValue) {
-  return m_pDataKeys->GetFloat(keyName, defaultValue);
+  if (m_pDataKeys) return m_pDataKeys->GetFloat(keyName, defaultValue);
+
+  return GetFloatAt(m_pDescriptor->FindSlot(keyName), defaultValue);
 }
 
 const char *CGameEvent::GetString(const char *keyName,
                                   const char *defaultValue) {
-  return m_pDataKeys->GetString(keyName, defaultValue);
+  if (m_pDataKeys) return m_pDataKeys->GetString(keyName, defaultValue);
+
+  return GetStringAt(m_pDescriptor->FindSlot(keyName), defaultValue);
 }
 
 void CGameEvent::SetBool(const char *keyName, bool value) {
-  m_pDataKeys->SetInt(keyName, value ? 1 : 0);
+  SetInt(keyName, value ? 1 : 0);
 }
 
 void CGameEvent::SetInt(const char *keyName, int value) {
-  m_pDataKeys->SetInt(keyName, value);
+  const int slot = m_pDataKeys ? -1 : m_pDescriptor->FindSlot(keyName);
+
+  // keys the descriptor doesn't have go to KeyValues
+  if (slot < 0 || slot >= m_Values.Count()) {
+    GetDataKeys()->SetInt(keyName, value);
+  } else {
+    SetIntAt(slot, value);
+  }
 }
 
 void CGameEvent::SetFloat(const char *keyName, float value) {
-  m_pDataKeys->SetFloat(keyName, value);
+  const int slot = m_pDataKeys ? -1 : m_pDescriptor->FindSlot(keyName);
+
+  // keys the descriptor doesn't have go to KeyValues
+  if (slot < 0 || slot >= m_Values.Count()) {
+    GetDataKeys()->SetFloat(keyName, value);
+  } else {
+    SetFloatAt(slot, value);
+  }
 }
 
 void CGameEvent::SetString(const char *keyName, const char *value) {
-  m_pDataKeys->SetString(keyName, value);
+  const int slot = m_pDataKeys ? -1 : m_pDescriptor->FindSlot(keyName);
+
+  // keys the descriptor doesn't have go to KeyValues
+  if (slot < 0 || slot >= m_Values.Count()) {
+    GetDataKeys()->SetString(keyName, value);
+  } else {
+    SetStringAt(slot, value);
+  }
+}
+
+// The slot calls convert between types like KeyValues does.
+
+int CGameEvent::GetIntAt(int slot, int defaultValue) {
+  if (slot < 0 || slot >= m_pDescriptor->slots.Count()) return defaultValue;
+
+  if (m_pDataKeys) {
+    return m_pDataKeys->GetInt(m_pDescriptor->slots[slot].name, defaultValue);
+  }
+
+  if (slot >= m_Values.Count()) return defaultValue;
+
+  const Value_t &value = m_Values[slot];
+  switch (value.type) {
+    case VALUE_INT:
+      return value.intValue;
+    case VALUE_FLOAT:
+      return (int)value.floatValue;
+    case VALUE_STRING:
+      return Q_atoi(m_Strings[slot].Base());
+    default:
+      return defaultValue;
+  }
+}
+
+float CGameEvent::GetFloatAt(int slot, float defaultValue) {
+  if (slot < 0 || slot >= m_pDescriptor->slots.Count()) return defaultValue;
+
+  if (m_pDataKeys) {
+    return m_pDataKeys->GetFloat(m_pDescriptor->slots[slot].name,
+                                 defaultValue);
+  }
+
+  if (slot >= m_Values.Count()) return defaultValue;
+
+  const Value_t &value = m_Values[slot];
+  switch (value.type) {
+    case VALUE_INT:
+      return (float)value.intValue;
+    case VALUE_FLOAT:
+      return value.floatValue;
+    case VALUE_STRING:
+      return (float)Q_atof(m_Strings[slot].Base());
+    default:
+      return defaultValue;
+  }
+}
+
+const char *CGameEvent::GetStringAt(int slot, const char *defaultValue) {
+  if (slot < 0 || slot >= m_pDescriptor->slots.Count()) return defaultValue;
+
+  if (m_pDataKeys) {
+    return m_pDataKeys->GetString(m_pDescriptor->slots[slot].name,
+                                  defaultValue);
+  }
+
+  if (slot >= m_Values.Count()) return defaultValue;
+
+  const Value_t &value = m_Values[slot];
+  CUtlMemory<char> &text = m_Strings[slot];
+
+  switch (value.type) {
+    case VALUE_INT:
+      text.EnsureCapacity(GAMEEVENT_NUMBER_TEXT);
+      Q_snprintf(text.Base(), text.NumAllocated(), "%d", value.intValue);
+      return text.Base();
+    case VALUE_FLOAT:
+      text.EnsureCapacity(GAMEEVENT_NUMBER_TEXT);
+      Q_snprintf(text.Base(), text.NumAllocated(), "%f", value.floatValue);
+      return text.Base();
+    case VALUE_STRING:
+      return text.Base();
+    default:
+      return defaultValue;
+  }
+}
+
+void CGameEvent::SetIntAt(int slot, int value) {
+  if (slot < 0 || slot >= m_pDescriptor->slots.Count()) return;
+
+  if (m_pDataKeys) {
+    m_pDataKeys->SetInt(m_pDescriptor->slots[slot].name, value);
+    return;
+  }
+
+  if (slot >= m_Values.Count()) return;
+
+  Value_t &data = m_Values[slot];
+  data.type = VALUE_INT;
+  data.intValue = value;
+}
+
+void CGameEvent::SetFloatAt(int slot, float value) {
+  if (slot < 0 || slot >= m_pDescriptor->slots.Count()) return;
+
+  if (m_pDataKeys) {
+    m_pDataKeys->SetFloat(m_pDescriptor->slots[slot].name, value);
+    return;
+  }
+
+  if (slot >= m_Values.Count()) return;
+
+  Value_t &data = m_Values[slot];
+  data.type = VALUE_FLOAT;
+  data.floatValue = value;
+}
+
+void CGameEvent::SetStringAt(int slot, const char *value) {
+  if (slot < 0 || slot >= m_pDescriptor->slots.Count()) return;
+
+  if (!value) value = "";
+
+  if (m_pDataKeys) {
+    m_pDataKeys->SetString(m_pDescriptor->slots[slot].name, value);
+    return;
+  }
+
+  if (slot >= m_Values.Count()) return;
+
+  // Other slots' text stays put. value may be this slot's own text, which
+  // already fits and gets moved in place.
+  CUtlMemory<char> &text = m_Strings[slot];
+  const int length = Q_strlen(value) + 1;
+  text.EnsureCapacity(length);
+  memmove(text.Base(), value, length);
+
+  m_Values[slot].type = VALUE_STRING;
+}
+
+KeyValues *CGameEvent::GetDataKeys() {
+  if (m_pDataKeys) return m_pDataKeys;
+
+  KeyValues *keys = new KeyValues(m_pDescriptor->name);
+
+  const int count = std::min(m_Values.Count(), m_pDescriptor->slots.Count());
+  for (int i = 0; i < count; i++) {
+    const char *keyName = m_pDescriptor->slots[i].name;
+    const Value_t &value = m_Values[i];
+
+    switch (value.type) {
+      case VALUE_INT:
+        keys->SetInt(keyName, value.intValue);
+        break;
+      case VALUE_FLOAT:
+        keys->SetFloat(keyName, value.floatValue);
+        break;
+      case VALUE_STRING:
+        keys->SetString(keyName, m_Strings[i].Base());
+        break;
+    }
+  }
+
+  m_pDataKeys = keys;
+  return keys;
+}
+
+void CGameEvent::SetDataKeys(KeyValues *keys) {
+  if (m_pDataKeys) m_pDataKeys->deleteThis();
+
+  m_pDataKeys = keys;
+}
+
+void CGameEvent::CopyFrom(const CGameEvent *event) {
+  Assert(event && event->m_pDescriptor == m_pDescriptor);
+
+  if (event->m_pDataKeys) {
+    SetDataKeys(event->m_pDataKeys->MakeCopy());
+    return;
+  }
+
+  m_Values.CopyArray(event->m_Values.Base(), event->m_Values.Count());
+
+  for (int i = 0; i < m_Values.Count(); i++) {
+    if (m_Values[i].type == VALUE_STRING) {
+      SetStringAt(i, event->m_Strings[i].Base());
+    }
+  }
 }
 
 bool CGameEvent::IsEmpty(const char *keyName) {
-  return m_pDataKeys->IsEmpty(keyName);
+  if (m_pDataKeys) return m_pDataKeys->IsEmpty(keyName);
+
+  if (!keyName) {
+    for (int i = 0; i < m_Values.Count(); i++) {
+      if (m_Values[i].type != VALUE_NONE) return false;
+    }
+    return true;
+  }
+
+  const int slot = m_pDescriptor->FindSlot(keyName);
+  return slot < 0 || slot >= m_Values.Count() ||
+         m_Values[slot].type == VALUE_NONE;
 }
 
-const char *CGameEvent::GetName() const { return m_pDataKeys->GetName(); }
+const char *CGameEvent::GetName() const { return m_pDescriptor->name; }
 
 bool CGameEvent::IsLocal() const { return m_pDescriptor->local; }
 
@@ -147,17 +423,13 @@ void CGameEventManager::WriteEventList(SVC_GameEventList *msg) {
     msg->m_DataOut.WriteUBitLong(descriptor.eventid, MAX_EVENT_BITS);
     msg->m_DataOut.WriteString(descriptor.name);
 
-    KeyValues *key = descriptor.keys->GetFirstSubKey();
+    for (int j = 0; j < descriptor.slots.Count(); j++) {
+      const CGameEventKey &key = descriptor.slots[j];
 
-    while (key) {
-      int type = key->GetInt();
-
-      if (type != TYPE_LOCAL) {
-        msg->m_DataOut.WriteUBitLong(type, 3);
-        msg->m_DataOut.WriteString(key->GetName());
+      if (key.type != TYPE_LOCAL) {
+        msg->m_DataOut.WriteUBitLong(key.type, 3);
+        msg->m_DataOut.WriteString(key.name);
       }
-
-      key = key->GetNextKey();
     }
 
     msg->m_DataOut.WriteUBitLong(TYPE_LOCAL, 3);  // end marker
@@ -205,6 +477,7 @@ bool CGameEventManager::ParseEventList(SVC_GameEventList *msg) {
       datatype = msg->m_DataIn.ReadUBitLong(3);
     }
 
+    descriptor->CompileSlots();
     descriptor->eventid = id;
   }
 
@@ -247,7 +520,10 @@ void CGameEventManager::WriteListenEventList(CLC_ListenEvents *msg) {
 }
 
 IGameEvent *CGameEventManager::CreateEvent(CGameEventDescriptor *descriptor) {
-  return new CGameEvent(descriptor);
+  CGameEvent *event = s_GameEventPool.GetObject();
+
+  event->Init(descriptor);
+  return event;
 }
 
 IGameEvent *CGameEventManager::CreateEvent(const char *name, bool bForce) {
@@ -267,7 +543,7 @@ IGameEvent *CGameEventManager::CreateEvent(const char *name, bool bForce) {
   }
 
   // create & return the new event
-  return new CGameEvent(descriptor);
+  return CreateEvent(descriptor);
 }
 
 bool CGameEventManager::FireEvent(IGameEvent *event, bool bServerOnly) {
@@ -284,13 +560,11 @@ IGameEvent *CGameEventManager::DuplicateEvent(IGameEvent *event) {
   if (!gameEvent) return NULL;
 
   // create new instance
-  CGameEvent *newEvent = new CGameEvent(gameEvent->m_pDescriptor);
-
-  // free keys
-  newEvent->m_pDataKeys->deleteThis();
+  CGameEvent *newEvent =
+      static_cast<CGameEvent *>(CreateEvent(gameEvent->m_pDescriptor));
 
   // and make copy
-  newEvent->m_pDataKeys = gameEvent->m_pDataKeys->MakeCopy();
+  newEvent->CopyFrom(gameEvent);
 
   return newEvent;
 }
@@ -300,29 +574,26 @@ void CGameEventManager::ConPrintEvent(IGameEvent *event) {
 
   if (!descriptor) return;
 
-  KeyValues *key = descriptor->keys->GetFirstSubKey();
+  CGameEvent *gameEvent = static_cast<CGameEvent *>(event);
 
-  while (key) {
-    const char *keyName = key->GetName();
+  for (int i = 0; i < descriptor->slots.Count(); i++) {
+    const char *keyName = descriptor->slots[i].name;
 
-    int type = key->GetInt();
-
-    switch (type) {
+    switch (descriptor->slots[i].type) {
       case TYPE_LOCAL:
         ConMsg("- \"%s\" = \"%s\" (local)\n", keyName,
-               event->GetString(keyName));
+               gameEvent->GetStringAt(i));
         break;
       case TYPE_STRING:
-        ConMsg("- \"%s\" = \"%s\"\n", keyName, event->GetString(keyName));
+        ConMsg("- \"%s\" = \"%s\"\n", keyName, gameEvent->GetStringAt(i));
         break;
       case TYPE_FLOAT:
-        ConMsg("- \"%s\" = \"%.2f\"\n", keyName, event->GetFloat(keyName));
+        ConMsg("- \"%s\" = \"%.2f\"\n", keyName, gameEvent->GetFloatAt(i));
         break;
       default:
-        ConMsg("- \"%s\" = \"%i\"\n", keyName, event->GetInt(keyName));
+        ConMsg("- \"%s\" = \"%i\"\n", keyName, gameEvent->GetIntAt(i));
         break;
     }
-    key = key->GetNextKey();
   }
 }
 
@@ -389,7 +660,7 @@ bool CGameEventManager::FireEventIntern(IGameEvent *event, bool bServerOnly,
           static_cast<IGameEventListener *>(listener->m_pCallback);
       CGameEvent *pEvent = static_cast<CGameEvent *>(event);
 
-      pCallback->FireGameEvent(pEvent->m_pDataKeys);
+      pCallback->FireGameEvent(pEvent->GetDataKeys());
     } else {
       // new system
       IGameEventListener2 *pCallback =
@@ -413,57 +684,50 @@ bool CGameEventManager::SerializeEvent(IGameEvent *event, bf_write *buf) {
   buf->WriteUBitLong(descriptor->eventid, MAX_EVENT_BITS);
 
   // now iterate trough all fields described in gameevents.res and put them in
-  // the buffer
+  // the buffer, slots are in descriptor order so no key lookups are needed
 
-  KeyValues *key = descriptor->keys->GetFirstSubKey();
+  CGameEvent *gameEvent = static_cast<CGameEvent *>(event);
+  const bool bShowKeys = net_showevents.GetInt() > 2;
 
-  if (net_showevents.GetInt() > 2) {
+  if (bShowKeys) {
     DevMsg("Serializing event '%s' (%i):\n", descriptor->name,
            descriptor->eventid);
   }
 
-  while (key) {
-    const char *keyName = key->GetName();
-
-    int type = key->GetInt();
+  for (int i = 0; i < descriptor->slots.Count(); i++) {
+    const CGameEventKey &key = descriptor->slots[i];
 
-    if (net_showevents.GetInt() > 2) {
-      DevMsg(" - %s (%i)\n", keyName, type);
+    if (bShowKeys) {
+      DevMsg(" - %s (%i)\n", key.name, key.type);
     }
 
-    // Make sure every key is used in the event
-    // Assert( event->FindKey(keyName) && "GameEvent field not found in passed
-    // KeyValues" );
-
     // see s_GameEnventTypeMap for index
-    switch (type) {
+    switch (key.type) {
       case TYPE_LOCAL:
         break;  // don't network this guy
       case TYPE_STRING:
-        buf->WriteString(event->GetString(keyName, ""));
+        buf->WriteString(gameEvent->GetStringAt(i, ""));
         break;
       case TYPE_FLOAT:
-        buf->WriteFloat(event->GetFloat(keyName, 0.0f));
+        buf->WriteFloat(gameEvent->GetFloatAt(i, 0.0f));
         break;
       case TYPE_LONG:
-        buf->WriteLong(event->GetInt(keyName, 0));
+        buf->WriteLong(gameEvent->GetIntAt(i, 0));
         break;
       case TYPE_SHORT:
-        buf->WriteShort(event->GetInt(keyName, 0));
+        buf->WriteShort(gameEvent->GetIntAt(i, 0));
         break;
       case TYPE_BYTE:
-        buf->WriteByte(event->GetInt(keyName, 0));
+        buf->WriteByte(gameEvent->GetIntAt(i, 0));
         break;
       case TYPE_BOOL:
-        buf->WriteOneBit(event->GetInt(keyName, 0));
+        buf->WriteOneBit(gameEvent->GetIntAt(i, 0));
         break;
       default:
-        DevMsg(1, "Game Event Manager: Unknown type %i for key '%s'.\n", type,
-               key->GetName());
+        DevMsg(1, "Game Event Manager: Unknown type %i for key '%s'.\n",
+               key.type, key.name);
         break;
     }
-
-    key = key->GetNextKey();
   }
 
   return !buf->IsOverflowed();
@@ -486,7 +750,7 @@ IGameEvent *CGameEventManager::UnserializeEvent(bf_read *buf) {
   }
 
   // create new event
-  IGameEvent *event = CreateEvent(descriptor);
+  CGameEvent *event = static_cast<CGameEvent *>(CreateEvent(descriptor));
 
   if (!event) {
     DevMsg("Game Event Manager::UnserializeEvent: Failed to create event %s.\n",
@@ -494,42 +758,36 @@ IGameEvent *CGameEventManager::UnserializeEvent(bf_read *buf) {
     return NULL;
   }
 
-  KeyValues *key = descriptor->keys->GetFirstSubKey();
-
-  while (key) {
-    const char *keyName = key->GetName();
-
-    int type = key->GetInt();
+  for (int i = 0; i < descriptor->slots.Count(); i++) {
+    const CGameEventKey &key = descriptor->slots[i];
 
-    switch (type) {
+    switch (key.type) {
       case TYPE_LOCAL:
         break;  // ignore
       case TYPE_STRING:
         if (buf->ReadString(databuf, sizeof(databuf)))
-          event->SetString(keyName, databuf);
+          event->SetStringAt(i, databuf);
         break;
       case TYPE_FLOAT:
-        event->SetFloat(keyName, buf->ReadFloat());
+        event->SetFloatAt(i, buf->ReadFloat());
         break;
       case TYPE_LONG:
-        event->SetInt(keyName, buf->ReadLong());
+        event->SetIntAt(i, buf->ReadLong());
         break;
       case TYPE_SHORT:
-        event->SetInt(keyName, buf->ReadShort());
+        event->SetIntAt(i, buf->ReadShort());
         break;
       case TYPE_BYTE:
-        event->SetInt(keyName, buf->ReadByte());
+        event->SetIntAt(i, buf->ReadByte());
         break;
       case TYPE_BOOL:
-        event->SetInt(keyName, buf->ReadOneBit());
+        event->SetIntAt(i, buf->ReadOneBit());
         break;
       default:
-        DevMsg(1, "Game Event Manager: Unknown type %i for key '%s'.\n", type,
-               key->GetName());
+        DevMsg(1, "Game Event Manager: Unknown type %i for key '%s'.\n",
+               key.type, key.name);
         break;
     }
-
-    key = key->GetNextKey();
   }
 
   return event;
@@ -742,6 +1000,8 @@ bool CGameEventManager::RegisterEvent(KeyValues *event) {
     subkey = subkey->GetNextKey();
   }
 
+  descriptor->CompileSlots();
+
   return true;
 }
 
@@ -770,7 +1030,11 @@ CGameEventDescriptor *CGameEventManager::GetEventDescriptor(
 void CGameEventManager::FreeEvent(IGameEvent *event) {
   if (!event) return;
 
-  delete event;
+  CGameEvent *gameEvent = static_cast<CGameEvent *>(event);
+
+  // events are recycled, the pool keeps their buffers
+  gameEvent->Clear();
+  s_GameEventPool.PutObject(gameEvent);
 }
 
 CGameEventDescriptor *CGameEventManager::GetEventDescriptor(const char *name) {
@@ -824,3 +1088,174 @@ void CGameEventManager::RemoveListenerOld(void *listener) {
 
   delete pCallback;
 }
+
+// Stands in for g_pMemAlloc during gameevent_bench and counts the Alloc and
+// Realloc calls of the benchmarking thread, see CLoaderMemAlloc.
+class CGameEventBenchMemAlloc : public IMemAlloc {
+ public:
+  void *Alloc(usize size) override {
+    CountAlloc();
+    return m_pMemAlloc->Alloc(size);
+  }
+  void *Realloc(void *memory, usize size) override {
+    CountAlloc();
+    return m_pMemAlloc->Realloc(memory, size);
+  }
+  DELEGATE_TO_OBJECT_1V(Free, void *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_2(void *, Expand_NoLongerSupported, void *, usize,
+                       m_pMemAlloc);
+  void *Alloc(usize size, const ch *file_name, i32 line_no) override {
+    CountAlloc();
+    return m_pMemAlloc->Alloc(size, file_name, line_no);
+  }
+  void *Realloc(void *memory, usize size, const ch *file_name,
+                i32 line_no) override {
+    CountAlloc();
+    return m_pMemAlloc->Realloc(memory, size, file_name, line_no);
+  }
+  DELEGATE_TO_OBJECT_3V(Free, void *, const ch *, i32, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_4(void *, Expand_NoLongerSupported, void *, usize,
+                       const ch *, i32, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1(usize, GetSize, void *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_2V(PushAllocDbgInfo, const ch *, i32, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0V(PopAllocDbgInfo, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1(long, CrtSetBreakAlloc, long, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_2(i32, CrtSetReportMode, i32, i32, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1(i32, CrtIsValidHeapPointer, const void *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_3(i32, CrtIsValidPointer, const void *, u32, i32,
+                       m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0(i32, CrtCheckMemory, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1(i32, CrtSetDbgFlag, i32, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1V(CrtMemCheckpoint, _CrtMemState *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0V(DumpStats, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1V(DumpStatsFileBase, const ch *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_2(void *, CrtSetReportFile, i32, void *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1(void *, CrtSetReportHook, void *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_5(i32, CrtDbgReport, i32, const ch *, i32, const ch *,
+                       const ch *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0(i32, heapchk, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0(bool, IsDebugHeap, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_2V(GetActualDbgInfo, const ch *&, i32 &, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_5V(RegisterAllocation, const ch *, i32, usize, usize, u32,
+                        m_pMemAlloc);
+  DELEGATE_TO_OBJECT_5V(RegisterDeallocation, const ch *, i32, usize, usize,
+                        u32, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0(i32, GetVersion, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0V(CompactHeap, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1(MemAllocFailHandler_t, SetAllocFailHandler,
+                       MemAllocFailHandler_t, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_1V(DumpBlockStats, void *, m_pMemAlloc);
+  DELEGATE_TO_OBJECT_0(usize, MemoryAllocFailed, m_pMemAlloc);
+
+  void Start() {
+    m_nAllocs = 0;
+    m_nThreadId = ThreadGetCurrentId();
+    m_pMemAlloc = g_pMemAlloc;
+    g_pMemAlloc = this;
+  }
+
+  // Allocator calls since Start.
+  int Stop() {
+    g_pMemAlloc = m_pMemAlloc;
+    return m_nAllocs;
+  }
+
+ private:
+  void CountAlloc() {
+    if (ThreadGetCurrentId() == m_nThreadId) m_nAllocs++;
+  }
+
+  IMemAlloc *m_pMemAlloc;
+  ThreadId_t m_nThreadId;
+  int m_nAllocs;
+};
+
+static CGameEventBenchMemAlloc s_GameEventBenchMemAlloc;
+
+// Runs count events through create, set, serialize, unserialize and read, once
+// on the compiled slots and once through the KeyValues shim old listeners use.
+CON_COMMAND(gameevent_bench,
+            "Benchmark game event serialization: gameevent_bench [event] "
+            "[count]") {
+  const char *name = args.ArgC() > 1 ? args[1] : "player_hurt";
+  const int count = args.ArgC() > 2 ? std::max(1, atoi(args[2])) : 100000;
+
+  CGameEventDescriptor *descriptor =
+      g_GameEventManager.GetEventDescriptor(name);
+  if (!descriptor) {
+    ConMsg("gameevent_bench: unknown event '%s'.\n", name);
+    return;
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    const bool bKeyValues = pass == 1;
+    int checksum = 0;
+
+    // Timed with the counting allocator in place, both passes pay for it.
+    s_GameEventBenchMemAlloc.Start();
+
+    CFastTimer timer;
+    timer.Start();
+
+    for (int i = 0; i < count; i++) {
+      IGameEvent *event = g_GameEventManager.CreateEvent(name, true);
+      if (!event) break;
+
+      if (bKeyValues) static_cast<CGameEvent *>(event)->GetDataKeys();
+
+      for (int j = 0; j < descriptor->slots.Count(); j++) {
+        const CGameEventKey &key = descriptor->slots[j];
+
+        switch (key.type) {
+          case CGameEventManager::TYPE_STRING:
+            event->SetString(key.name, "bench");
+            break;
+          case CGameEventManager::TYPE_FLOAT:
+            event->SetFloat(key.name, (float)i);
+            break;
+          default:
+            event->SetInt(key.name, i & 1);
+            break;
+        }
+      }
+
+      u8 data[MAX_EVENT_BYTES];
+      bf_write out(data, sizeof(data));
+      g_GameEventManager.SerializeEvent(event, &out);
+      g_GameEventManager.FreeEvent(event);
+
+      bf_read in(data, out.GetNumBytesWritten());
+      event = g_GameEventManager.UnserializeEvent(&in);
+      if (!event) break;
+
+      if (bKeyValues) static_cast<CGameEvent *>(event)->GetDataKeys();
+
+      for (int j = 0; j < descriptor->slots.Count(); j++) {
+        const CGameEventKey &key = descriptor->slots[j];
+
+        switch (key.type) {
+          case CGameEventManager::TYPE_STRING:
+            checksum += event->GetString(key.name)[0];
+            break;
+          case CGameEventManager::TYPE_FLOAT:
+            checksum += (int)event->GetFloat(key.name);
+            break;
+          default:
+            checksum += event->GetInt(key.name);
+            break;
+        }
+      }
+
+      g_GameEventManager.FreeEvent(event);
+    }
+
+    timer.End();
+    const int allocs = s_GameEventBenchMemAlloc.Stop();
+
+    const float ms = timer.GetDuration().GetMillisecondsF();
+    ConMsg("%-10s %d x '%s': %.2f ms, %.0f events/s, %.2f allocs/event (%d)\n",
+           bKeyValues ? "keyvalues" : "compiled", count, name, ms,
+           ms > 0 ? count * 1000.0f / ms : 0.0f,
+           (float)allocs / count, checksum);
+  }
+}
@@ -20,6 +20,14 @@ class CGameEventCallback {
   int m_nListenerType;  // client or server side ?
 };
 
+// A descriptor key compiled into the value slot of the same index.
+class CGameEventKey {
+ public:
+  char name[MAX_EVENT_NAME_LENGTH];
+  unsigned int hash;  // caseless, KeyValues key names are
+  int type;           // CGameEventManager::TYPE_*
+};
+
 class CGameEventDescriptor {
  public:
   CGameEventDescriptor() {
@@ -30,6 +38,11 @@ class CGameEventDescriptor {
     reliable = true;
   }
 
+  // Rebuilds slots from keys.
+  void CompileSlots();
+  // Slot of keyName, -1 if the descriptor doesn't have it.
+  int FindSlot(const char *keyName) const;
+
  public:
   char name[MAX_EVENT_NAME_LENGTH];  // name of this event
   int eventid;                       // network index number, -1 = not networked
@@ -37,13 +50,21 @@ class CGameEventDescriptor {
   bool local;       // local event, never tell clients about that
   bool reliable;    // send this event as reliable message
   CUtlVector<CGameEventCallback *> listeners;  // registered listeners
+  CUtlVector<CGameEventKey> slots;             // keys in serialization order
 };
 
+// Event data lives in one typed value per descriptor slot, strings in a
+// per-event buffer. Instances are pooled by CGameEventManager, a reused event
+// keeps its buffers. Keys the descriptor doesn't know and the legacy
+// KeyValues interface switch the event to a KeyValues copy of its data.
 class CGameEvent : public IGameEvent {
  public:
-  CGameEvent(CGameEventDescriptor *descriptor);
+  CGameEvent();
   virtual ~CGameEvent();
 
+  void Init(CGameEventDescriptor *descriptor);
+  void Clear();
+
   const char *GetName() const;
   bool IsEmpty(const char *keyName = NULL);
   bool IsLocal() const;
@@ -60,8 +81,43 @@ class CGameEvent : public IGameEvent {
   void SetFloat(const char *keyName, float value);
   void SetString(const char *keyName, const char *value);
 
+  // Slot access for serialization, same conversions as the named calls.
+  int GetIntAt(int slot, int defaultValue = 0);
+  float GetFloatAt(int slot, float defaultValue = 0.0f);
+  const char *GetStringAt(int slot, const char *defaultValue = "");
+  void SetIntAt(int slot, int value);
+  void SetFloatAt(int slot, float value);
+  void SetStringAt(int slot, const char *value);
+
+  // Compatibility shim for IGameEventListener and IGameEventManager: the data
+  // as KeyValues, owned by the event. From then on the event reads and writes
+  // the KeyValues.
+  KeyValues *GetDataKeys();
+  // Takes ownership of keys and uses them as the event data.
+  void SetDataKeys(KeyValues *keys);
+
+  // Copies the data of an event with the same descriptor.
+  void CopyFrom(const CGameEvent *event);
+
   CGameEventDescriptor *m_pDescriptor;
-  KeyValues *m_pDataKeys;
+
+ private:
+  enum { VALUE_NONE = 0, VALUE_INT, VALUE_FLOAT, VALUE_STRING };
+
+  struct Value_t {
+    int type;  // VALUE_*
+    union {
+      int intValue;
+      float floatValue;
+    };
+  };
+
+  KeyValues *m_pDataKeys;  // NULL while the slots hold the data
+  CUtlVector<Value_t> m_Values;
+
+  // Text of each slot, its string or GetString of its number. Like a KeyValues
+  // key, only setting the same slot again moves it. Kept across uses.
+  CUtlVector<CUtlMemory<char>> m_Strings;
 };
 
 class CGameEventManager : public IGameEventManager2 {
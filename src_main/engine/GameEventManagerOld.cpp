@@ -101,8 +101,7 @@ bool CGameEventManagerOld::FireEventIntern(KeyValues *keys,
 
   if (!event) return false;
 
-  event->m_pDataKeys->deleteThis();
-  event->m_pDataKeys = keys;
+  event->SetDataKeys(keys);
 
   if (bClientSideOnly) {
     return g_GameEventManager.FireEventClientSide(event);
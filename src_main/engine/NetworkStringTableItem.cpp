@@ -16,6 +16,9 @@ CNetworkStringTableItem::CNetworkStringTableItem() {
 #ifndef SHARED_NET_STRING_TABLES
   m_nTickCreated = 0;
   m_pChangeList = NULL;
+  m_pPrevUserData = NULL;
+  m_nPrevUserDataLength = 0;
+  m_nTickPrevChanged = -1;
 #endif
 }
 
@@ -36,6 +39,8 @@ CNetworkStringTableItem::~CNetworkStringTableItem() {
     delete m_pChangeList;  // destructor calls Purge()
     m_pUserData = NULL;
   }
+
+  delete[] m_pPrevUserData;
 #endif
 
   delete[] m_pUserData;
@@ -152,7 +157,19 @@ bool CNetworkStringTableItem::SetUserData(int tick, int length,
     return false;  // old & new data are equal
   }
 
+#ifndef SHARED_NET_STRING_TABLES
+  if (m_nTickChanged != tick) {
+    // keep the old version around, clients may have acked it
+    delete[] m_pPrevUserData;
+    m_pPrevUserData = m_pUserData;
+    m_nPrevUserDataLength = m_nUserDataLength;
+    m_nTickPrevChanged = m_nTickChanged;
+  } else {
+    delete[] m_pUserData;
+  }
+#else
   delete[] m_pUserData;
+#endif
 
   m_nUserDataLength = length;
 
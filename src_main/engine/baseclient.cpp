@@ -20,6 +20,7 @@
 #include "MapReslistGenerator.h"
 #include "iregistry.h"
 #include "matchmaking.h"
+#include "net_chan.h"
 #include "sv_main.h"
 #include "sv_remoteaccess.h"  // NotifyDedicatedServerUI()
 #include "sv_steamauth.h"
@@ -39,7 +40,9 @@ CBaseClient::CBaseClient() {
   m_ConVars = NULL;
   m_Server = NULL;
   m_pBaseline = NULL;
+  m_nBaselineCRC = 0;
   m_bIsHLTV = false;
+  m_bStringTableDeltas = false;
   m_bConVarsChanged = false;
   m_bSendServerInfo = false;
   m_SteamID = NULL;
@@ -165,6 +168,7 @@ void CBaseClient::FreeBaselines() {
 
   m_nBaselineUpdateTick = -1;
   m_nBaselineUsed = 0;
+  m_nBaselineCRC = 0;
   m_BaselinesSent.ClearAll();
 }
 
@@ -191,6 +195,7 @@ void CBaseClient::Clear() {
   m_nForceWaitForTick = -1;
   m_bFakePlayer = false;
   m_bIsHLTV = false;
+  m_bStringTableDeltas = false;
   m_fNextMessageTime = 0;
   m_fSnapshotInterval = 0;
   m_bReceivedPacket = false;
@@ -733,6 +738,17 @@ bool CBaseClient::ProcessBaselineAck(CLC_BaselineAck *msg) {
 
   m_pBaseline->m_nTickCount = m_nBaselineUpdateTick;
 
+  // fold this update into the baseline identity
+  CRC32_t crc;
+  CRC32_Init(&crc);
+  CRC32_ProcessBuffer(&crc, &m_nBaselineCRC, sizeof(m_nBaselineCRC));
+  CRC32_ProcessBuffer(&crc, &m_nBaselineUpdateTick,
+                      sizeof(m_nBaselineUpdateTick));
+  CRC32_ProcessBuffer(&crc, m_BaselinesSent.Base(),
+                      m_BaselinesSent.GetNumDWords() * sizeof(u32));
+  CRC32_Final(&crc);
+  m_nBaselineCRC = crc;
+
   // flip used baseline flag
   m_nBaselineUsed = (m_nBaselineUsed == 1) ? 0 : 1;
 
@@ -1049,6 +1065,16 @@ void CBaseClient::UpdateUserSettings() {
   SetMaxRoutablePayloadSize(
       m_ConVars->GetInt("net_maxroutable", MAX_ROUTABLE_PAYLOAD));
 
+  // codecs the client can decode, old clients only know LZSS
+  CNetChan *pNetChannel = dynamic_cast<CNetChan *>(m_NetChannel);
+  if (pNetChannel) {
+    pNetChannel->SetRemoteCompressors(
+        m_ConVars->GetInt("net_compressors", 1 << NET_COMPRESSOR_LZSS));
+  }
+
+  // old clients only know svc_UpdateStringTable
+  m_bStringTableDeltas = m_ConVars->GetInt("net_stringtable_deltas", 0) != 0;
+
   m_Server->UserInfoChanged(m_nClientSlot);
 
   m_bConVarsChanged = false;
@@ -175,6 +175,8 @@ class CBaseClient : public IGameEventListener2,
                            // start connect
   CBaseServer *m_Server;   // pointer to server object
   bool m_bIsHLTV;          // if this a HLTV proxy ?
+  // client parses svc_UpdateStringTableDelta, see net_stringtable_deltas
+  bool m_bStringTableDeltas;
 
   // Client sends this during connection, so we can see if
   //  we need to send sendtable info or if the .dll matches
@@ -202,6 +204,9 @@ class CBaseClient : public IGameEventListener2,
   CBitVec<MAX_EDICTS> m_BaselinesSent;  // baselines sent with last update
   int m_nBaselineUsed;  // 0/1 toggling flag, singaling client what baseline to
                         // use
+  // CRC of the baseline update history, clients with equal CRCs have equal
+  // m_pBaseline contents
+  CRC32_t m_nBaselineCRC;
 
   // This is used when we send out a nodelta packet to put the client in a state
   // where we wait until we get an ack from them on this packet. This is for 3
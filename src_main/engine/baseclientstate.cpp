@@ -297,6 +297,7 @@ void CBaseClientState::ConnectionStart(INetChannel *chan) {
   REGISTER_SVC_MSG(SetPause);
   REGISTER_SVC_MSG(CreateStringTable);
   REGISTER_SVC_MSG(UpdateStringTable);
+  REGISTER_SVC_MSG(UpdateStringTableDelta);
   REGISTER_SVC_MSG(VoiceInit);
   REGISTER_SVC_MSG(VoiceData);
   REGISTER_SVC_MSG(Sounds);
@@ -1089,7 +1090,8 @@ bool CBaseClientState::ProcessUpdateStringTable(SVC_UpdateStringTable *msg) {
   CNetworkStringTable *table =
       (CNetworkStringTable *)m_StringTableContainer->GetTable(msg->m_nTableID);
 
-  table->ParseUpdate(msg->m_DataIn, msg->m_nChangedEntries);
+  table->ParseUpdate(msg->m_DataIn, msg->m_nChangedEntries,
+                     msg->GetType() == svc_UpdateStringTableDelta);
 
 #endif
 
@@ -1098,6 +1100,11 @@ bool CBaseClientState::ProcessUpdateStringTable(SVC_UpdateStringTable *msg) {
   return (endbit - startbit) == msg->m_nLength;
 }
 
+bool CBaseClientState::ProcessUpdateStringTableDelta(
+    SVC_UpdateStringTableDelta *msg) {
+  return ProcessUpdateStringTable(msg);
+}
+
 bool CBaseClientState::ProcessSetView(SVC_SetView *msg) {
   VPROF("ProcessSetView");
 
@@ -86,6 +86,7 @@ the_interface CBaseClientState : public INetChannelHandler,
   PROCESS_SVC_MESSAGE(SetPause);
   PROCESS_SVC_MESSAGE(CreateStringTable);
   PROCESS_SVC_MESSAGE(UpdateStringTable);
+  PROCESS_SVC_MESSAGE(UpdateStringTableDelta);
   PROCESS_SVC_MESSAGE(SetView);
   PROCESS_SVC_MESSAGE(PacketEntities);
   PROCESS_SVC_MESSAGE(Menu);
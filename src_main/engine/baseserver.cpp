@@ -1346,6 +1346,8 @@ CBaseClient *CBaseServer::GetFreeClient(netadr_t &adr) {
 void CBaseServer::SendClientMessages(bool bSendSnapshots) {
   VPROF_BUDGET("SendClientMessages", VPROF_BUDGETGROUP_OTHER_NETWORKING);
 
+  NET_BeginSendBatch();
+
   for (int i = 0; i < m_Clients.Count(); i++) {
     CBaseClient *client = m_Clients[i];
 
@@ -1360,6 +1362,8 @@ void CBaseServer::SendClientMessages(bool bSendSnapshots) {
       Msg("Client has no netchannel.\n");
     }
   }
+
+  NET_EndSendBatch();
 }
 
 CBaseClient *CBaseServer::CreateFakeClient(const char *name) {
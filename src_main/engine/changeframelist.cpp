@@ -2,17 +2,37 @@
 
 #include "changeframelist.h"
 
+#include <algorithm>
 #include "dt.h"
 #include "tier0/include/basetypes.h"
+#include "tier0/include/threadtools.h"
 #include "tier1/UtlVector.h"
+#include "tier1/convar.h"
 
 #include "tier0/include/memdbgon.h"
 
+static ConVar sv_changeframelist_compact(
+    "sv_changeframelist_compact", "1", 0,
+    "Store prop change ticks in chunks shared between snapshots instead of a "
+    "flat tick per prop. Applies to entities packed from now on.");
+
+// Live list counts, for sv_changeframelist_stats. Entities are packed in
+// parallel, so these are interlocked.
+static CInterlockedInt s_nFlatLists;
+static CInterlockedInt s_nFlatProps;
+static CInterlockedInt s_nCompactLists;
+static CInterlockedInt s_nCompactProps;
+static CInterlockedInt s_nCompactChunkRefs;
+static CInterlockedInt s_nCompactChunks;
+
 class CChangeFrameList : public IChangeFrameList {
  public:
+  CChangeFrameList() { ++s_nFlatLists; }
+
   void Init(int nProperties, int iCurTick) {
     m_ChangeTicks.SetSize(nProperties);
     for (int i = 0; i < nProperties; i++) m_ChangeTicks[i] = iCurTick;
+    s_nFlatProps += nProperties;
   }
 
   // IChangeFrameList implementation.
@@ -30,6 +50,7 @@ class CChangeFrameList : public IChangeFrameList {
       pRet->m_ChangeTicks[i] = m_ChangeTicks[i];
     }
 
+    s_nFlatProps += numProps;
     return pRet;
   }
 
@@ -62,15 +83,210 @@ class CChangeFrameList : public IChangeFrameList {
 
   // IChangeFrameList implementation.
  protected:
-  virtual ~CChangeFrameList() {}
+  virtual ~CChangeFrameList() {
+    --s_nFlatLists;
+    s_nFlatProps -= m_ChangeTicks.Count();
+  }
 
  private:
   // Change frames for each property.
   CUtlVector<int> m_ChangeTicks;
 };
 
+#define CHANGEFRAME_CHUNK_PROPS 16
+
+// Change ticks of CHANGEFRAME_CHUNK_PROPS consecutive props. Copies of a list
+// share their chunks and a chunk is only duplicated when a list writes to it,
+// so the HLTV history, which keeps a list per snapshot, only pays for the
+// chunks that changed between snapshots.
+class CChangeTickChunk {
+ public:
+  CChangeTickChunk() : m_nRefs(1) { ++s_nCompactChunks; }
+  ~CChangeTickChunk() { --s_nCompactChunks; }
+
+  void AddRef() { ++m_nRefs; }
+  void Release() {
+    if (--m_nRefs == 0) delete this;
+  }
+  bool IsShared() const { return m_nRefs > 1; }
+
+  int m_Ticks[CHANGEFRAME_CHUNK_PROPS];
+
+ private:
+  CInterlockedInt m_nRefs;
+};
+
+// A chunk without tick storage has every prop at m_iMaxTick, which is how
+// props that never changed since the entity was created cost no storage.
+struct ChangeTickChunkRef_t {
+  CChangeTickChunk *m_pTicks;
+  int m_iMaxTick;
+};
+
+class CCompactChangeFrameList : public IChangeFrameList {
+ public:
+  CCompactChangeFrameList() : m_nProps(0) { ++s_nCompactLists; }
+
+  void Init(int nProperties, int iCurTick) {
+    m_nProps = nProperties;
+    m_Chunks.SetSize(NumChunks(nProperties));
+    for (int i = 0; i < m_Chunks.Count(); i++) {
+      m_Chunks[i].m_pTicks = NULL;
+      m_Chunks[i].m_iMaxTick = iCurTick;
+    }
+    s_nCompactProps += nProperties;
+    s_nCompactChunkRefs += m_Chunks.Count();
+  }
+
+  // IChangeFrameList implementation.
+ public:
+  virtual void Release() { delete this; }
+
+  virtual IChangeFrameList *Copy() {
+    CCompactChangeFrameList *pRet = new CCompactChangeFrameList;
+
+    pRet->m_nProps = m_nProps;
+    pRet->m_Chunks.CopyArray(m_Chunks.Base(), m_Chunks.Count());
+    for (int i = 0; i < m_Chunks.Count(); i++) {
+      if (m_Chunks[i].m_pTicks) m_Chunks[i].m_pTicks->AddRef();
+    }
+
+    s_nCompactProps += m_nProps;
+    s_nCompactChunkRefs += m_Chunks.Count();
+    return pRet;
+  }
+
+  virtual int GetNumProps() { return m_nProps; }
+
+  virtual void SetChangeTick(const int *pPropIndices, int nPropIndices,
+                             const int iTick) {
+    for (int i = 0; i < nPropIndices; i++) {
+      const int iProp = pPropIndices[i];
+      Assert(iProp >= 0 && iProp < m_nProps);
+
+      ChangeTickChunkRef_t &chunk = m_Chunks[iProp / CHANGEFRAME_CHUNK_PROPS];
+
+      // A uniform chunk already at iTick stays uniform.
+      if (!chunk.m_pTicks && chunk.m_iMaxTick == iTick) continue;
+
+      int *pTicks = GetWritableTicks(chunk);
+      pTicks[iProp % CHANGEFRAME_CHUNK_PROPS] = iTick;
+      chunk.m_iMaxTick = std::max(chunk.m_iMaxTick, iTick);
+    }
+  }
+
+  virtual int GetPropsChangedAfterTick(int iTick, int *iOutProps,
+                                       int nMaxOutProps) {
+    Assert(m_nProps <= nMaxOutProps);
+
+    int nOutProps = 0;
+
+    for (int iChunk = 0; iChunk < m_Chunks.Count(); iChunk++) {
+      const ChangeTickChunkRef_t &chunk = m_Chunks[iChunk];
+
+      // m_iMaxTick is an upper bound, so whole chunks are skipped here.
+      if (chunk.m_iMaxTick <= iTick) continue;
+
+      const int iFirstProp = iChunk * CHANGEFRAME_CHUNK_PROPS;
+      const int nChunkProps =
+          std::min(CHANGEFRAME_CHUNK_PROPS, m_nProps - iFirstProp);
+
+      if (!chunk.m_pTicks) {
+        for (int i = 0; i < nChunkProps; i++) {
+          iOutProps[nOutProps++] = iFirstProp + i;
+        }
+        continue;
+      }
+
+      const int *pTicks = chunk.m_pTicks->m_Ticks;
+      for (int i = 0; i < nChunkProps; i++) {
+        if (pTicks[i] > iTick) iOutProps[nOutProps++] = iFirstProp + i;
+      }
+    }
+
+    return nOutProps;
+  }
+
+  // IChangeFrameList implementation.
+ protected:
+  virtual ~CCompactChangeFrameList() {
+    for (int i = 0; i < m_Chunks.Count(); i++) {
+      if (m_Chunks[i].m_pTicks) m_Chunks[i].m_pTicks->Release();
+    }
+
+    --s_nCompactLists;
+    s_nCompactProps -= m_nProps;
+    s_nCompactChunkRefs -= m_Chunks.Count();
+  }
+
+ private:
+  static int NumChunks(int nProps) {
+    return (nProps + CHANGEFRAME_CHUNK_PROPS - 1) / CHANGEFRAME_CHUNK_PROPS;
+  }
+
+  // Gives the chunk tick storage this list owns alone.
+  int *GetWritableTicks(ChangeTickChunkRef_t &chunk) {
+    if (!chunk.m_pTicks) {
+      chunk.m_pTicks = new CChangeTickChunk;
+      for (int i = 0; i < CHANGEFRAME_CHUNK_PROPS; i++)
+        chunk.m_pTicks->m_Ticks[i] = chunk.m_iMaxTick;
+    } else if (chunk.m_pTicks->IsShared()) {
+      CChangeTickChunk *pCopy = new CChangeTickChunk;
+      memcpy(pCopy->m_Ticks, chunk.m_pTicks->m_Ticks, sizeof(pCopy->m_Ticks));
+      chunk.m_pTicks->Release();
+      chunk.m_pTicks = pCopy;
+    }
+
+    return chunk.m_pTicks->m_Ticks;
+  }
+
+  int m_nProps;
+  CUtlVector<ChangeTickChunkRef_t> m_Chunks;
+};
+
 IChangeFrameList *AllocChangeFrameList(int nProperties, int iCurTick) {
+  if (sv_changeframelist_compact.GetBool()) {
+    CCompactChangeFrameList *pRet = new CCompactChangeFrameList;
+    pRet->Init(nProperties, iCurTick);
+    return pRet;
+  }
+
   CChangeFrameList *pRet = new CChangeFrameList;
   pRet->Init(nProperties, iCurTick);
   return pRet;
 }
+
+CON_COMMAND(sv_changeframelist_stats,
+            "Reports memory used by the live change frame lists, and what the "
+            "compact ones would take as flat tick arrays.") {
+  // Heap block overheads aren't counted. A flat list is the object plus one
+  // int per prop. A compact list is the object plus one chunk ref per chunk,
+  // and chunk storage is counted once no matter how many lists share it.
+  const int nFlatLists = s_nFlatLists, nFlatProps = s_nFlatProps;
+  const int nCompactLists = s_nCompactLists, nCompactProps = s_nCompactProps;
+  const int nChunks = s_nCompactChunks;
+
+  const i64 nFlatBytes = (i64)nFlatLists * sizeof(CChangeFrameList) +
+                         (i64)nFlatProps * sizeof(int);
+  const i64 nCompactBytes =
+      (i64)nCompactLists * sizeof(CCompactChangeFrameList) +
+      (i64)s_nCompactChunkRefs * sizeof(ChangeTickChunkRef_t) +
+      (i64)nChunks * sizeof(CChangeTickChunk);
+  const i64 nCompactAsFlatBytes =
+      (i64)nCompactLists * sizeof(CChangeFrameList) +
+      (i64)nCompactProps * sizeof(int);
+
+  Msg("flat:    %d lists, %d props, %.1f KB, %.0f bytes/entity\n", nFlatLists,
+      nFlatProps, nFlatBytes / 1024.0,
+      nFlatLists ? (f64)nFlatBytes / nFlatLists : 0.0);
+  Msg("compact: %d lists, %d props, %d tick chunks, %.1f KB, %.0f "
+      "bytes/entity\n",
+      nCompactLists, nCompactProps, nChunks, nCompactBytes / 1024.0,
+      nCompactLists ? (f64)nCompactBytes / nCompactLists : 0.0);
+  if (nCompactLists) {
+    Msg("compact lists stored flat: %.1f KB, %.0f bytes/entity, %.1fx the "
+        "compact size\n",
+        nCompactAsFlatBytes / 1024.0, (f64)nCompactAsFlatBytes / nCompactLists,
+        (f64)nCompactAsFlatBytes / std::max<i64>(nCompactBytes, 1));
+  }
+}
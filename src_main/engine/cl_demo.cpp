@@ -557,6 +557,11 @@ void CDemoRecorder::CloseDemoFile() {
           host_state.interval_per_tick * GetRecordingTick();
       m_DemoFile.m_DemoHeader.playback_frames = m_nFrameCount;
 
+      if (m_bStringTableDeltas) {
+        m_DemoFile.m_DemoHeader.demoprotocol =
+            DEMO_PROTOCOL_STRINGTABLE_DELTAS;
+      }
+
       // go back to header and write demoHeader with correct time and #frame
       // again
       m_DemoFile.WriteDemoHeader();
@@ -679,6 +684,7 @@ void CDemoRecorder::StartRecording(const ch *name, bool bContinuously) {
   m_bRecording = true;
   m_nDemoNumber = 1;
   m_bResetInterpolation = false;
+  m_bStringTableDeltas = false;
 
   g_DemoOverlay.Tick();
 
@@ -763,6 +769,22 @@ void CDemoPlayer::SkipToTick(int tick, bool bRelative, bool bPause) {
 
   if (tick < 0) return;
 
+  // Seek to the last keyframe before tick if that beats reading on from here,
+  // the full update there replaces all entities.
+  const demokeyframe_t *pKeyframe = m_DemoFile.FindKeyframe(tick);
+  if (pKeyframe && cl.IsActive() &&
+      (tick < GetPlaybackTick() || pKeyframe->tick > GetPlaybackTick())) {
+    m_DemoFile.SeekTo(pKeyframe->fileoffset, true);
+    m_nStartTick = host_tickcount - pKeyframe->tick;
+    m_bReadKeyframe = true;
+    m_DestCmdInfo.RemoveAll();
+
+    m_nSkipToTick = tick;
+
+    if (bPause) PausePlayback(-1);
+    return;
+  }
+
   if (tick < GetPlaybackTick()) {
     // we have to reload the whole demo file
     // we need to create a temp copy of the filename
@@ -829,6 +851,9 @@ bool CDemoPlayer::ParseAheadForInterval(int curtick, int intervalticks) {
         case dem_usercmd: {
           m_DemoFile.ReadUserCmd(NULL, dummy);
         } break;
+        case dem_keyframe: {
+          m_DemoFile.SkipPacket();
+        } break;
         default: { swallowmessages = false; } break;
       }
     } while (swallowmessages);
@@ -1006,6 +1031,21 @@ netpacket_t *CDemoPlayer::ReadPacket() {
         cl.lastoutgoingcommand = outgoing_sequence;
 
       } break;
+      case dem_keyframe: {
+        if (!m_bReadKeyframe) {
+          // the packets around it carry the same state
+          m_DemoFile.SkipPacket();
+          break;
+        }
+
+        if (demo_debug.GetBool()) {
+          Msg("%d dem_keyframe\n", tick);
+        }
+
+        // read like a dem_packet, it's a full update
+        m_bReadKeyframe = false;
+        bStopReading = true;
+      } break;
       default: {
         bStopReading = true;
 
@@ -1287,6 +1327,7 @@ CDemoPlayer::CDemoPlayer() {
   m_bPlayingBack = false;
   m_bPlaybackPaused = false;
   m_nSkipToTick = -1;
+  m_bReadKeyframe = false;
   m_nSnapshotTick = 0;
   m_SnapshotFilename[0] = 0;
   m_bInterpolateView = false;
@@ -1355,6 +1396,7 @@ bool CDemoPlayer::StartPlayback(const ch *filename, bool bAsTimeDemo) {
   cl.m_flNextCmdTime = net_time;
 
   m_bTimeDemo = bAsTimeDemo;
+  m_bReadKeyframe = false;
   m_nTimeDemoCurrentFrame = -1;
   m_nTimeDemoStartFrame = -1;
 
@@ -1635,6 +1677,7 @@ void CL_ListDemo_f(const CCommand &args) {
   ConMsg("Ticks           : %i\n", header->playback_ticks);
   ConMsg("Frames          : %i\n", header->playback_frames);
   ConMsg("Signon size     : %i\n", header->signonlength);
+  ConMsg("Keyframes       : %i\n", demofile.m_Keyframes.Count());
 }
 
 //-----------------------------------------------------------------------------
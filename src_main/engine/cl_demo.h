@@ -34,7 +34,8 @@ class CDemoPlayer : public IDemoPlayer {
   bool IsPlaybackPaused(void);
   bool IsPlayingTimeDemo(void);
   bool IsSkipping(void);
-  bool CanSkipBackwards() { return false; }
+  // by seeking to a keyframe instead of reloading the demo
+  bool CanSkipBackwards() { return m_DemoFile.m_Keyframes.Count() > 0; }
 
   void SetPlaybackTimeScale(float timescale);
   void InterpolateViewpoint();  // override viewpoint
@@ -64,6 +65,7 @@ class CDemoPlayer : public IDemoPlayer {
   float m_flAutoResumeTime;  // how long do we pause demo playback
   float m_flPlaybackRateModifier;
   int m_nSkipToTick;  // skip to tick ASAP, -1 = off
+  bool m_bReadKeyframe;  // read the next dem_keyframe instead of skipping it
 
   // view origin/angle interpolation:
   CUtlVector<DemoCommandQueue> m_DestCmdInfo;
@@ -141,6 +143,10 @@ class CDemoRecorder : public IDemoRecorder {
   bf_write m_MessageData;  // temp buffer for all network messages
 
   bool m_bResetInterpolation;
+
+  // Set once a svc_UpdateStringTableDelta got recorded, older readers don't
+  // know the message.
+  bool m_bStringTableDeltas;
 };
 
 extern CDemoPlayer *g_pClientDemoPlayer;
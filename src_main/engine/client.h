@@ -95,6 +95,7 @@ class CClientState : public CBaseClientState, public CClientFrameManager {
   PROCESS_SVC_MESSAGE(ServerInfo);
   PROCESS_SVC_MESSAGE(ClassInfo);
   PROCESS_SVC_MESSAGE(SetPause);
+  PROCESS_SVC_MESSAGE(UpdateStringTableDelta);
   PROCESS_SVC_MESSAGE(VoiceInit);
   PROCESS_SVC_MESSAGE(VoiceData);
   PROCESS_SVC_MESSAGE(Sounds);
@@ -13,6 +13,7 @@
 #include "netmessages.h"
 #include "quakedef.h"
 #include "server.h"
+#include "sv_main.h"
 #include "sv_plugin.h"
 #include "sys.h"
 #include "tier0/include/icommandline.h"
@@ -217,6 +218,9 @@ void Cbuf_Execute() {
   // be the the number of times Cbuf_Execute is called.
   s_CommandBuffer.BeginProcessingCommands(1);
   while (s_CommandBuffer.DequeueNextCommand()) {
+    // Commands can kick or message clients whose snapshots are still being
+    // sent.
+    SV_FinishPipelinedSnapshots();
     Cbuf_ExecuteCommand(s_CommandBuffer.GetCommand(), src_command);
   }
   s_CommandBuffer.EndProcessingCommands();
@@ -4,6 +4,7 @@
 
 #include "cmodel_engine.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include "cmodel_private.h"
@@ -996,6 +997,110 @@ bool IntersectRayWithBox(const Ray_t &ray, const VectorAligned &inInvDelta,
   return false;
 }
 
+static ConVar cm_simd_brushsides(
+    "cm_simd_brushsides", "1", 0,
+    "Clip traces against four brush sides at a time.");
+
+// The first n lanes of a group of four brush sides.
+alignas(16) static const int32_t g_BrushSideLaneMasks[5][4] = {
+    {0, 0, 0, 0},
+    {-1, 0, 0, 0},
+    {-1, -1, 0, 0},
+    {-1, -1, -1, 0},
+    {-1, -1, -1, -1}};
+
+/*
+================
+CM_ClipBoxToBrushSidesSIMD
+
+The side loop of CM_ClipBoxToBrush, four sides at a time out of
+map_brushsideplanes. The math is done in the same order as the scalar loop so
+the fractions come out the same, and ties on enterfrac still go to the first
+side. Returns false if the trace misses the brush.
+================
+*/
+template <bool IS_POINT>
+static bool SOURCE_FASTCALL CM_ClipBoxToBrushSidesSIMD(
+    TraceInfo_t *SOURCE_RESTRICT pTraceInfo,
+    const cbrush_t *SOURCE_RESTRICT brush, float &enterfrac, float &leavefrac,
+    bool &startout, bool &getout, cbrushside_t *&leadside) {
+  const cbrushsideplanes_t &planes =
+      pTraceInfo->m_pBSPData->map_brushsideplanes;
+  cbrushside_t *pSides =
+      &pTraceInfo->m_pBSPData->map_brushsides[brush->firstbrushside];
+
+  const Vector &p1 = pTraceInfo->m_start;
+  const Vector &p2 = pTraceInfo->m_end;
+  fltx4 p1x = ReplicateX4(p1.x), p1y = ReplicateX4(p1.y),
+        p1z = ReplicateX4(p1.z);
+  fltx4 p2x = ReplicateX4(p2.x), p2y = ReplicateX4(p2.y),
+        p2z = ReplicateX4(p2.z);
+
+  const Vector &extents = pTraceInfo->m_extents;
+  fltx4 extentx = ReplicateX4(extents.x), extenty = ReplicateX4(extents.y),
+        extentz = ReplicateX4(extents.z);
+
+  for (int i = 0; i < brush->numsides; i += 4) {
+    int iSide = brush->firstbrushside + i;
+    fltx4 nx = LoadUnalignedSIMD(planes.normalx + iSide);
+    fltx4 ny = LoadUnalignedSIMD(planes.normaly + iSide);
+    fltx4 nz = LoadUnalignedSIMD(planes.normalz + iSide);
+    fltx4 dist = LoadUnalignedSIMD(planes.dist + iSide);
+    fltx4 active = LoadAlignedSIMD(
+        (const float *)g_BrushSideLaneMasks[std::min(brush->numsides - i, 4)]);
+
+    if (!IS_POINT) {
+      // general box case
+      // push the planes out apropriately for mins/maxs
+      fltx4 offset = AddSIMD(
+          AddSIMD(fabs(MulSIMD(nx, extentx)), fabs(MulSIMD(ny, extenty))),
+          fabs(MulSIMD(nz, extentz)));
+      dist = AddSIMD(dist, offset);
+    } else {
+      // don't trace rays against bevel planes
+      active = AndNotSIMD(
+          LoadUnalignedSIMD((const float *)(planes.bevelmask + iSide)), active);
+    }
+
+    fltx4 d1 = SubSIMD(
+        MaddSIMD(p1z, nz, MaddSIMD(p1y, ny, MulSIMD(p1x, nx))), dist);
+    fltx4 d2 = SubSIMD(
+        MaddSIMD(p2z, nz, MaddSIMD(p2y, ny, MulSIMD(p2x, nx))), dist);
+
+    fltx4 front1 = AndSIMD(active, CmpGtSIMD(d1, Four_Zeros));
+    fltx4 front2 = CmpGtSIMD(d2, Four_Zeros);
+
+    // if completely in front of a face, no intersection
+    if (TestSignSIMD(AndSIMD(front1, front2))) return false;
+
+    // d1 > 0.f enters, d2 > 0.f leaves, the rest is behind the face
+    int nEnter = TestSignSIMD(front1);
+    int nLeave = TestSignSIMD(AndNotSIMD(front1, AndSIMD(active, front2)));
+    if (nEnter) startout = true;
+    if (nLeave) getout = true;
+    if (!(nEnter | nLeave)) continue;
+
+    fltx4 denom = SubSIMD(d1, d2);
+    fltx4 enter = DivSIMD(
+        MaxSIMD(SubSIMD(d1, Four_DistEpsilons), Four_Zeros), denom);
+    fltx4 leave = DivSIMD(AddSIMD(d1, Four_DistEpsilons), denom);
+    for (int j = 0; j < 4; ++j) {
+      if (nEnter & (1 << j)) {
+        float f = SubFloat(enter, j);
+        if (f > enterfrac) {
+          enterfrac = f;
+          leadside = pSides + i + j;
+        }
+      } else if (nLeave & (1 << j)) {
+        float f = SubFloat(leave, j);
+        if (f < leavefrac) leavefrac = f;
+      }
+    }
+  }
+
+  return true;
+}
+
 /*
 ================
 CM_ClipBoxToBrush
@@ -1028,61 +1133,68 @@ void SOURCE_FASTCALL CM_ClipBoxToBrush(TraceInfo_t *SOURCE_RESTRICT pTraceInfo,
   bool startout = false;
   cbrushside_t *leadside = NULL;
 
-  float dist;
+  if (cm_simd_brushsides.GetBool()) {
+    if (!CM_ClipBoxToBrushSidesSIMD<IS_POINT>(pTraceInfo, brush, enterfrac,
+                                              leavefrac, startout, getout,
+                                              leadside))
+      return;
+  } else {
+    float dist;
 
-  cbrushside_t *SOURCE_RESTRICT side =
-      &pTraceInfo->m_pBSPData->map_brushsides[brush->firstbrushside];
-  for (const cbrushside_t *const sidelimit = side + brush->numsides;
-       side < sidelimit; side++) {
-    cplane_t *plane = side->plane;
-    const Vector &planeNormal = plane->normal;
+    cbrushside_t *SOURCE_RESTRICT side =
+        &pTraceInfo->m_pBSPData->map_brushsides[brush->firstbrushside];
+    for (const cbrushside_t *const sidelimit = side + brush->numsides;
+         side < sidelimit; side++) {
+      cplane_t *plane = side->plane;
+      const Vector &planeNormal = plane->normal;
 
-    if (!IS_POINT) {
-      // general box case
-      // push the plane out apropriately for mins/maxs
+      if (!IS_POINT) {
+        // general box case
+        // push the plane out apropriately for mins/maxs
 
-      dist = DotProductAbs(planeNormal, pTraceInfo->m_extents);
-      dist = plane->dist + dist;
-    } else {
-      // special point case
-      dist = plane->dist;
-      // don't trace rays against bevel planes
-      if (side->bBevel) continue;
-    }
+        dist = DotProductAbs(planeNormal, pTraceInfo->m_extents);
+        dist = plane->dist + dist;
+      } else {
+        // special point case
+        dist = plane->dist;
+        // don't trace rays against bevel planes
+        if (side->bBevel) continue;
+      }
 
-    float d1 = DotProduct(p1, planeNormal) - dist;
-    float d2 = DotProduct(p2, planeNormal) - dist;
+      float d1 = DotProduct(p1, planeNormal) - dist;
+      float d2 = DotProduct(p2, planeNormal) - dist;
 
-    // if completely in front of face, no intersection
-    if (d1 > 0.f) {
-      startout = true;
+      // if completely in front of face, no intersection
+      if (d1 > 0.f) {
+        startout = true;
 
-      // d1 > 0.f && d2 > 0.f
-      if (d2 > 0.f) return;
+        // d1 > 0.f && d2 > 0.f
+        if (d2 > 0.f) return;
 
-    } else {
-      // d1 <= 0.f && d2 <= 0.f
-      if (d2 <= 0.f) continue;
+      } else {
+        // d1 <= 0.f && d2 <= 0.f
+        if (d2 <= 0.f) continue;
 
-      // d2 > 0.f
-      getout = true;
-    }
+        // d2 > 0.f
+        getout = true;
+      }
 
-    // crosses face
-    if (d1 > d2) {  // enter
-      // NOTE: This could be negative if d1 is less than the epsilon.
-      // If the trace is short (d1-d2 is small) then it could produce a large
-      // negative fraction.
-      float f = (d1 - DIST_EPSILON);
-      if (f < 0.f) f = 0.f;
-      f = f / (d1 - d2);
-      if (f > enterfrac) {
-        enterfrac = f;
-        leadside = side;
+      // crosses face
+      if (d1 > d2) {  // enter
+        // NOTE: This could be negative if d1 is less than the epsilon.
+        // If the trace is short (d1-d2 is small) then it could produce a large
+        // negative fraction.
+        float f = (d1 - DIST_EPSILON);
+        if (f < 0.f) f = 0.f;
+        f = f / (d1 - d2);
+        if (f > enterfrac) {
+          enterfrac = f;
+          leadside = side;
+        }
+      } else {  // leave
+        float f = (d1 + DIST_EPSILON) / (d1 - d2);
+        if (f < leavefrac) leavefrac = f;
       }
-    } else {  // leave
-      float f = (d1 + DIST_EPSILON) / (d1 - d2);
-      if (f < leavefrac) leavefrac = f;
     }
   }
 
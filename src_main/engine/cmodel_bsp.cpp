@@ -134,6 +134,9 @@ void CollisionBSPData_Destroy(CCollisionBSPData *pBSPData) {
     pBSPData->map_brushsides.Detach();
   }
 
+  memset(&pBSPData->map_brushsideplanes, 0,
+         sizeof(pBSPData->map_brushsideplanes));
+
   if (pBSPData->map_vis) {
     pBSPData->map_vis = NULL;
   }
@@ -733,6 +736,32 @@ void CollisionBSPData_LoadBrushSides(CCollisionBSPData *pBSPData,
   }
   Assert(outBrushSide == pBSPData->numbrushsides &&
          outBoxBrush == pBSPData->numboxbrushes);
+
+  // Split the side planes into per component arrays for CM_ClipBoxToBrush.
+  // The padding keeps the loads for the last brush in bounds, the lanes past a
+  // brush's sides are masked off anyway.
+  int nPlaneCount = brushSideCount + 3;
+  float *pPlaneData = (float *)Hunk_Alloc(5 * nPlaneCount * sizeof(float));
+  cbrushsideplanes_t &planes = pBSPData->map_brushsideplanes;
+  planes.normalx = pPlaneData;
+  planes.normaly = planes.normalx + nPlaneCount;
+  planes.normalz = planes.normaly + nPlaneCount;
+  planes.dist = planes.normalz + nPlaneCount;
+  planes.bevelmask = (u32 *)(planes.dist + nPlaneCount);
+  for (i = 0; i < nPlaneCount; i++) {
+    if (i < brushSideCount) {
+      const cbrushside_t &side = pBSPData->map_brushsides[i];
+      planes.normalx[i] = side.plane->normal.x;
+      planes.normaly[i] = side.plane->normal.y;
+      planes.normalz[i] = side.plane->normal.z;
+      planes.dist[i] = side.plane->dist;
+      planes.bevelmask[i] = side.bBevel ? ~0u : 0;
+    } else {
+      planes.normalx[i] = planes.normaly[i] = planes.normalz[i] = 0;
+      planes.dist[i] = 0;
+      planes.bevelmask[i] = 0;
+    }
+  }
 }
 
 //-----------------------------------------------------------------------------
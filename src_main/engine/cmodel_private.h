@@ -92,6 +92,16 @@ struct cbrushside_t {
   u16 bBevel;  // is the side a bevel plane?
 };
 
+// Brush side planes with one array per component, parallel to map_brushsides
+// and padded by 3 entries, so that four consecutive sides load as one fltx4.
+struct cbrushsideplanes_t {
+  float *normalx;
+  float *normaly;
+  float *normalz;
+  float *dist;
+  u32 *bevelmask;  // ~0 for bevel planes
+};
+
 #define NUMSIDES_BOXBRUSH 0xFFFF
 
 struct cbrush_t {
@@ -278,6 +288,7 @@ class CCollisionBSPData {
 
   int numbrushsides;
   CRangeValidatedArray<cbrushside_t> map_brushsides;
+  cbrushsideplanes_t map_brushsideplanes;
   int numboxbrushes;
   CRangeValidatedArray<cboxbrush_t> map_boxbrushes;
   int numplanes;
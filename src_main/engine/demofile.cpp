@@ -128,6 +128,12 @@ void CDemoFile::ReadCmdInfo(democmdinfo_t &info) {
 void CDemoFile::WriteCmdHeader(unsigned char cmd, int tick) {
   Assert(cmd >= dem_signon && cmd <= dem_lastcmd);
 
+  if (cmd == dem_keyframe) {
+    demokeyframe_t &keyframe = m_Keyframes[m_Keyframes.AddToTail()];
+    keyframe.tick = tick;
+    keyframe.fileoffset = GetCurPos(false);
+  }
+
 #ifdef DEMO_FILE_UTLBUFFER
   Assert(m_Buffer.IsOpen());
   m_Buffer.PutUnsignedChar(cmd);
@@ -150,7 +156,8 @@ void CDemoFile::WriteCmdHeader(unsigned char cmd, int tick) {
           "dem_consolecmd",
           "dem_usercmd",
           "dem_datatables",
-          "dem_stop"
+          "dem_stop",
+          "dem_keyframe"
   };
 
   DevMsg( "Demo Write: tick %i, cmd %s \n", tick, cmdname[cmd] );*/
@@ -467,14 +474,21 @@ demoheader_t *CDemoFile::ReadDemoHeader() {
     return NULL;
   }
 
-  if ((m_DemoHeader.demoprotocol > DEMO_PROTOCOL) ||
+  if ((m_DemoHeader.demoprotocol > DEMO_PROTOCOL_STRINGTABLE_DELTAS) ||
       (m_DemoHeader.demoprotocol < 2)) {
     ConMsg("ERROR: demo file protocol %i outdated, engine version is %i \n",
-           m_DemoHeader.demoprotocol, DEMO_PROTOCOL);
+           m_DemoHeader.demoprotocol, DEMO_PROTOCOL_STRINGTABLE_DELTAS);
 
     return NULL;
   }
 
+  if (m_DemoHeader.demoprotocol >= DEMO_PROTOCOL_KEYFRAMES &&
+      !ReadKeyframeIndex() &&
+      m_DemoHeader.demoprotocol < DEMO_PROTOCOL_STRINGTABLE_DELTAS) {
+    // still playable from the start
+    ConMsg("%s has a broken keyframe index.\n", m_szFileName);
+  }
+
   return &m_DemoHeader;
 }
 
@@ -498,6 +512,130 @@ void CDemoFile::WriteFileBytes(FileHandle_t fh, int length) {
 #endif
 }
 
+void CDemoFile::SkipPacket() {
+  democmdinfo_t info;
+  int nSeqNrIn, nSeqNrOutAck;
+
+  ReadCmdInfo(info);
+  ReadSequenceInfo(nSeqNrIn, nSeqNrOutAck);
+  ReadRawData(NULL, 0);
+}
+
+void CDemoFile::WriteKeyframeIndex() {
+  if (m_Keyframes.Count() == 0) return;
+
+  demoindexfooter_t footer;
+  footer.indexoffset = LittleDWord(GetCurPos(false));
+  Q_strncpy(footer.id, DEMO_INDEX_ID, sizeof(footer.id));
+
+  CUtlBuffer index;
+  index.PutInt(LittleDWord(m_Keyframes.Count()));
+  for (int i = 0; i < m_Keyframes.Count(); i++) {
+    index.PutInt(LittleDWord(m_Keyframes[i].tick));
+    index.PutInt(LittleDWord(m_Keyframes[i].fileoffset));
+  }
+
+  WriteRawData((const ch *)index.Base(), index.TellPut());
+
+#ifdef DEMO_FILE_UTLBUFFER
+  m_Buffer.Put(&footer, sizeof(footer));
+#else
+  g_pFileSystem->Write(&footer, sizeof(footer), m_hDemoFile);
+#endif
+
+  // readers without keyframe support must not take this file
+  m_DemoHeader.demoprotocol =
+      std::max(m_DemoHeader.demoprotocol, DEMO_PROTOCOL_KEYFRAMES);
+}
+
+bool CDemoFile::ReadKeyframeIndex() {
+  m_Keyframes.RemoveAll();
+
+  unsigned int nStart = GetCurPos(true);
+  int nSize = GetSize();
+
+  if (nSize < (int)(sizeof(demoheader_t) + sizeof(demoindexfooter_t))) {
+    SeekTo(nStart, true);
+    return false;
+  }
+
+  demoindexfooter_t footer;
+  SeekTo(nSize - sizeof(footer), true);
+
+  bool bOk;
+#ifdef DEMO_FILE_UTLBUFFER
+  m_Buffer.Get(&footer, sizeof(footer));
+  bOk = m_Buffer.IsValid();
+#else
+  bOk = g_pFileSystem->Read(&footer, sizeof(footer), m_hDemoFile) ==
+        sizeof(footer);
+#endif
+
+  footer.indexoffset = LittleDWord(footer.indexoffset);
+  footer.id[sizeof(footer.id) - 1] = '\0';
+
+  bOk = bOk && !Q_strcmp(footer.id, DEMO_INDEX_ID) &&
+        footer.indexoffset >= (int)sizeof(demoheader_t) &&
+        footer.indexoffset < nSize;
+
+  if (bOk) {
+    SeekTo(footer.indexoffset, true);
+    int nIndexSize = ReadRawData(NULL, 0);
+
+    CUtlVector<ch> data;
+    data.SetCount(std::max(nIndexSize, 0));
+
+    SeekTo(footer.indexoffset, true);
+    bOk = nIndexSize >= (int)sizeof(int) &&
+          ReadRawData(data.Base(), data.Count()) == nIndexSize;
+
+    if (bOk) {
+      CUtlBuffer index(data.Base(), data.Count(), CUtlBuffer::READ_ONLY);
+      int nCount = LittleDWord(index.GetInt());
+      bOk = nCount >= 0 &&
+            nCount <= (nIndexSize - (int)sizeof(int)) /
+                          (int)sizeof(demokeyframe_t);
+
+      for (int i = 0; bOk && i < nCount; i++) {
+        demokeyframe_t keyframe;
+        keyframe.tick = LittleDWord(index.GetInt());
+        keyframe.fileoffset = LittleDWord(index.GetInt());
+
+        // must be sorted and inside the file
+        bOk = keyframe.fileoffset >= (int)sizeof(demoheader_t) &&
+              keyframe.fileoffset < footer.indexoffset &&
+              (i == 0 || keyframe.tick >= m_Keyframes.Tail().tick);
+
+        m_Keyframes.AddToTail(keyframe);
+      }
+    }
+  }
+
+  if (!bOk) m_Keyframes.RemoveAll();
+
+  SeekTo(nStart, true);
+  return bOk;
+}
+
+const demokeyframe_t *CDemoFile::FindKeyframe(int tick) const {
+  int lo = 0;
+  int hi = m_Keyframes.Count() - 1;
+  const demokeyframe_t *pFound = NULL;
+
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+
+    if (m_Keyframes[mid].tick <= tick) {
+      pFound = &m_Keyframes[mid];
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  return pFound;
+}
+
 bool CDemoFile::Open(const ch *name, bool bReadOnly) {
 #ifdef DEMO_FILE_UTLBUFFER
   if (m_Buffer.IsOpen())
@@ -511,6 +649,7 @@ bool CDemoFile::Open(const ch *name, bool bReadOnly) {
 
   m_szFileName[0] = 0;                               // clear name
   Q_memset(&m_DemoHeader, 0, sizeof(m_DemoHeader));  // and demo header
+  m_Keyframes.RemoveAll();
 
   bool bOk;
 #ifdef DEMO_FILE_UTLBUFFER
@@ -58,9 +58,21 @@ class CDemoFile {
 
   void WriteFileBytes(FileHandle_t fh, int length);
 
+  // Skips the rest of a dem_packet, dem_signon or dem_keyframe command.
+  void SkipPacket();
+
+  // Appends the index of all dem_keyframe commands written so far, call after
+  // dem_stop.
+  void WriteKeyframeIndex();
+  bool ReadKeyframeIndex();
+
+  // Last keyframe at or before tick, NULL if there is none.
+  const demokeyframe_t *FindKeyframe(int tick) const;
+
  public:
   char m_szFileName[SOURCE_MAX_PATH];  // name of current demo file
   demoheader_t m_DemoHeader;    // general demo info
+  CUtlVector<demokeyframe_t> m_Keyframes;  // sorted by tick
 
  private:
 #ifdef DEMO_FILE_UTLBUFFER
@@ -0,0 +1,122 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// demo_parse_bench, times the demoreader library on a set of demos.
+
+#include "demoreader/demoreader.h"
+
+#include "tier0/include/fasttimer.h"
+#include "tier1/convar.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "vstdlib/jobthread.h"
+
+#include "tier0/include/memdbgon.h"
+
+// Counts what a reader streams out, stands in for an analysis pass.
+class CDemoReaderCounter : public IDemoReaderListener {
+ public:
+  void OnTick(IDemoReader *pReader, int nTick) override {}
+  void OnEntityCreated(IDemoReader *pReader, int nEntity, int iClass,
+                       int nSerial) override {
+    m_nEntitiesCreated++;
+  }
+  void OnEntityDeleted(IDemoReader *pReader, int nEntity) override {}
+  void OnPropChanged(IDemoReader *pReader, int nEntity, int iProp,
+                     int iElement, const DVariant &value) override {
+    m_nPropsDecoded++;
+  }
+  void OnGameEvent(IDemoReader *pReader, const ch *pName,
+                   const DemoEventKey_t *pKeys, int nKeys) override {
+    m_nGameEvents++;
+  }
+  void OnStringTableChanged(IDemoReader *pReader, INetworkStringTable *pTable,
+                            int nIndex, const ch *pString,
+                            const void *pUserData) override {
+    m_nStringChanges++;
+  }
+
+  i64 m_nPropsDecoded = 0;
+  i32 m_nEntitiesCreated = 0;
+  i32 m_nGameEvents = 0;
+  i32 m_nStringChanges = 0;
+};
+
+struct DemoParseWork_t {
+  ch m_Filename[SOURCE_MAX_PATH];
+  CDemoReaderCounter m_Counter;
+  i32 m_nTicks;
+  f64 m_flMilliseconds;
+  bool m_bOk;
+
+  static void Process(DemoParseWork_t &work) {
+    CFastTimer timer;
+    timer.Start();
+
+    IDemoReader *pReader = CreateDemoReader();
+    work.m_bOk = pReader->Open(work.m_Filename, &work.m_Counter) &&
+                 pReader->ReadAll();
+    work.m_nTicks = pReader->GetNumTicksRead();
+    DestroyDemoReader(pReader);
+
+    timer.End();
+    work.m_flMilliseconds = timer.GetDuration().GetMillisecondsF();
+  }
+};
+
+CON_COMMAND(demo_parse_bench,
+            "Parses demos with the headless demo reader, one after the other "
+            "and then in parallel, and reports ticks/sec. Usage: "
+            "demo_parse_bench <demo> [demo...]") {
+  if (args.ArgC() < 2) {
+    ConMsg("Usage: demo_parse_bench <demo> [demo...]\n");
+    return;
+  }
+
+  CUtlVector<DemoParseWork_t> work;
+
+  for (int pass = 0; pass < 2; pass++) {
+    const bool bParallel = pass == 1;
+
+    work.SetCount(args.ArgC() - 1);
+    for (int i = 0; i < work.Count(); i++) {
+      work[i] = DemoParseWork_t();
+      Q_strncpy(work[i].m_Filename, args[i + 1], sizeof(work[i].m_Filename));
+      Q_DefaultExtension(work[i].m_Filename, ".dem",
+                         sizeof(work[i].m_Filename));
+    }
+
+    CFastTimer timer;
+    timer.Start();
+
+    if (bParallel) {
+      ParallelProcess(work.Base(), work.Count(), &DemoParseWork_t::Process);
+    } else {
+      for (int i = 0; i < work.Count(); i++) {
+        DemoParseWork_t::Process(work[i]);
+      }
+    }
+
+    timer.End();
+
+    i64 nTicks = 0;
+    for (int i = 0; i < work.Count(); i++) {
+      const DemoParseWork_t &w = work[i];
+      nTicks += w.m_nTicks;
+
+      if (!bParallel) {
+        ConMsg("  %s: %s%d ticks, %lld props, %d entities, %d events, "
+               "%d string changes, %.1f ms\n",
+               w.m_Filename, w.m_bOk ? "" : "FAILED ", w.m_nTicks,
+               w.m_Counter.m_nPropsDecoded, w.m_Counter.m_nEntitiesCreated,
+               w.m_Counter.m_nGameEvents, w.m_Counter.m_nStringChanges,
+               w.m_flMilliseconds);
+      }
+    }
+
+    const f64 flMilliseconds = timer.GetDuration().GetMillisecondsF();
+    ConMsg("%s: %d demos, %lld ticks in %.1f ms, %.0f ticks/sec\n",
+           bParallel ? "parallel" : "serial", work.Count(), nTicks,
+           flMilliseconds,
+           flMilliseconds > 0 ? nTicks * 1000.0 / flMilliseconds : 0.0);
+  }
+}
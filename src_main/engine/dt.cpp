@@ -454,6 +454,57 @@ void SendTable_GenerateProxyPaths(CSendTablePrecalc *pPrecalc,
   FillPathEntries_R(pPrecalc, pPrecalc->GetRootNode(), NULL, iCurEntry);
 }
 
+static PropOp_t SendTable_GetPropOp(const SendProp *pProp) {
+  int flags = pProp->GetFlags();
+
+  if (pProp->GetType() == DPT_Int) {
+    return (flags & SPROP_UNSIGNED) ? PROPOP_INT_UNSIGNED : PROPOP_INT_SIGNED;
+  }
+
+  if (pProp->GetType() == DPT_Float) {
+    // Same precedence as EncodeSpecialFloat / DecodeSpecialFloat.
+    if (flags & SPROP_COORD) return PROPOP_FLOAT_COORD;
+
+    if (!(flags & (SPROP_COORD_MP | SPROP_COORD_MP_LOWPRECISION |
+                   SPROP_COORD_MP_INTEGRAL)) &&
+        (flags & SPROP_NOSCALE))
+      return PROPOP_FLOAT_NOSCALE;
+  }
+
+  return PROPOP_GENERIC;
+}
+
+// Flattens the sorted prop list into m_Program. Decoding reads props by index
+// so only the encoder uses the runs.
+static void SendTable_CompileProgram(CSendTablePrecalc *pPrecalc) {
+  int nProps = pPrecalc->GetNumProps();
+
+  MEM_ALLOC_CREDIT();
+  pPrecalc->m_Program.SetSize(nProps);
+
+  int iRunStart = 0;
+  for (int i = 0; i < nProps; i++) {
+    const SendProp *pProp = pPrecalc->GetProp(i);
+    CPropInstruction *pInstr = &pPrecalc->m_Program[i];
+
+    pInstr->m_Op = (u8)SendTable_GetPropOp(pProp);
+    pInstr->m_Load = PROPLOAD_PROXY;
+    pInstr->m_nBits = (u8)pProp->m_nBits;
+    pInstr->m_iProxy = pPrecalc->m_PropProxyIndices[i];
+    pInstr->m_nRun = 0;
+    pInstr->m_Type = (u16)pProp->GetType();
+    pInstr->m_Offset = pProp->GetOffset();
+    pInstr->m_pProp = pProp;
+
+    if (pInstr->m_iProxy != pPrecalc->m_Program[iRunStart].m_iProxy) {
+      pPrecalc->m_Program[iRunStart].m_nRun = (u16)(i - iRunStart);
+      iRunStart = i;
+    }
+  }
+
+  if (nProps) pPrecalc->m_Program[iRunStart].m_nRun = (u16)(nProps - iRunStart);
+}
+
 bool CSendTablePrecalc::SetupFlatPropertyArray() {
   SendTable *pTable = GetSendTable();
 
@@ -492,6 +543,8 @@ bool CSendTablePrecalc::SetupFlatPropertyArray() {
   SetRecursiveProxyIndices_R(pTable, GetRootNode(), nProxyIndices);
 
   SendTable_GenerateProxyPaths(this, nProxyIndices);
+
+  SendTable_CompileProgram(this);
   return true;
 }
 
@@ -193,6 +193,52 @@ class CFastLocalTransferInfo {
       m_OtherProps;  // Props that must be copied slowly (proxies and all).
 };
 
+// -----------------------------------------------------------------------------
+// // CPropInstruction
+// -----------------------------------------------------------------------------
+// //
+
+// What a compiled prop does with the bit buffer. The common int and float
+// layouts are handled inline by the encoder and decoder, everything else
+// dispatches through g_PropTypeFns like before.
+enum PropOp_t {
+  PROPOP_GENERIC = 0,
+  PROPOP_INT_UNSIGNED,  // DPT_Int with SPROP_UNSIGNED
+  PROPOP_INT_SIGNED,    // DPT_Int, n-bit two's complement
+  PROPOP_FLOAT_COORD,   // DPT_Float with SPROP_COORD
+  PROPOP_FLOAT_NOSCALE  // DPT_Float with SPROP_NOSCALE, raw 32 bits
+};
+
+// Where the encoder gets a prop's value from. Props whose send proxy is one of
+// the standard copy proxies are loaded straight from the entity.
+enum PropLoad_t {
+  PROPLOAD_PROXY = 0,  // call the SendProp's proxy
+  PROPLOAD_INT8,
+  PROPLOAD_INT16,
+  PROPLOAD_INT32,
+  PROPLOAD_UINT8,
+  PROPLOAD_UINT16,
+  PROPLOAD_FLOAT
+};
+
+// One step of a table's encode program, there is one per flat prop in the
+// same order as CSendTablePrecalc::m_Props.
+class CPropInstruction {
+ public:
+  u8 m_Op;      // PropOp_t
+  u8 m_Load;    // PropLoad_t, only set up for tables the server encodes
+  u8 m_nBits;   // SendProp::m_nBits
+  u8 m_iProxy;  // CSendTablePrecalc::m_PropProxyIndices
+
+  // Number of instructions starting here that share m_iProxy, so an encoder
+  // looks up the struct base once per run. Only valid at run starts.
+  u16 m_nRun;
+  u16 m_Type;  // SendPropType
+
+  int m_Offset;
+  const SendProp *m_pProp;
+};
+
 // -----------------------------------------------------------------------------
 // // CSendTablePrecalc
 // -----------------------------------------------------------------------------
@@ -202,7 +248,8 @@ class CSendTablePrecalc {
   CSendTablePrecalc();
   virtual ~CSendTablePrecalc();
 
-  // This function builds the flat property array given a SendTable.
+  // This function builds the flat property array given a SendTable, and
+  // compiles m_Program from it.
   bool SetupFlatPropertyArray();
 
   int GetNumProps() const;
@@ -243,6 +290,9 @@ class CSendTablePrecalc {
   // reference that.
   CUtlVector<unsigned char> m_PropProxyIndices;
 
+  // m_Props flattened into encoder/decoder instructions.
+  CUtlVector<CPropInstruction> m_Program;
+
   // CSendNode::m_iDatatableProp indexes this.
   // These are the datatable properties (SendPropDataTable).
   CUtlVector<const SendProp *> m_DatatableProps;
@@ -326,6 +376,34 @@ inline void SkipPropData(bf_read *pIn, const SendProp *pProp) {
   g_PropTypeFns[pProp->GetType()].SkipProp(pProp, pIn);
 }
 
+// Runs one instruction of the decoder's compiled program, reads exactly what
+// g_PropTypeFns[type].Decode would. Leaves the value in pInfo->m_Value when
+// pInfo->m_pRecvProp is NULL.
+inline void RecvTable_ExecuteProp(const CPropInstruction *pInstr,
+                                  DecodeInfo *pInfo) {
+  switch (pInstr->m_Op) {
+    case PROPOP_INT_UNSIGNED:
+      pInfo->m_Value.m_Int = pInfo->m_pIn->ReadUBitLong(pInstr->m_nBits);
+      break;
+    case PROPOP_INT_SIGNED:
+      pInfo->m_Value.m_Int = pInfo->m_pIn->ReadSBitLong(pInstr->m_nBits);
+      break;
+    case PROPOP_FLOAT_COORD:
+      pInfo->m_Value.m_Float = pInfo->m_pIn->ReadBitCoord();
+      break;
+    case PROPOP_FLOAT_NOSCALE:
+      pInfo->m_Value.m_Float = pInfo->m_pIn->ReadBitFloat();
+      break;
+    default:
+      g_PropTypeFns[pInstr->m_Type].Decode(pInfo);
+      return;
+  }
+
+  if (pInfo->m_pRecvProp) {
+    pInfo->m_pRecvProp->GetProxyFn()(pInfo, pInfo->m_pStruct, pInfo->m_pData);
+  }
+}
+
 // This is to be called on SendTables and RecvTables to setup array properties
 // to point at their property templates and to set the SPROP_INSIDEARRAY flag
 // on the properties inside arrays.
@@ -0,0 +1,327 @@
+// Copyright  1996-2018, Valve Corporation, All rights reserved.
+//
+// dt_encode_bench: encodes, deltas and decodes a SendTable laid out like
+// DT_BasePlayer (with its local player data) and reports the cost per prop.
+// The table is precalculated on its own and never registered, so it can run
+// on a live server.
+
+#include "dt.h"
+#include "dt_encode.h"
+#include "dt_send.h"
+#include "dt_send_eng.h"
+#include "quakedef.h"
+#include "tier0/include/dbg.h"
+#include "tier0/include/fasttimer.h"
+#include "tier1/convar.h"
+#include "vstdlib/random.h"
+
+#include "tier0/include/memdbgon.h"
+
+#define DTBENCH_AMMO_SLOTS 32
+#define DTBENCH_WEAPON_SLOTS 48
+// Players encoded round robin, each one changes a little per encode.
+#define DTBENCH_PLAYERS 32
+#define DTBENCH_ENCODE_BYTES 2048
+
+class DTBenchPlayer {
+ public:
+  // DT_BaseEntity / DT_BaseAnimating
+  Vector m_vecOrigin;
+  int m_nModelIndex;
+  int m_flAnimTime;
+  int m_flSimulationTime;
+  int m_nSequence;
+  float m_flCycle;
+  int m_nNewSequenceParity;
+
+  // DT_BasePlayer
+  float m_angEyeAngles[2];
+  int m_iHealth;
+  int m_lifeState;
+  int m_fFlags;
+  int m_iFOV;
+  int m_iObserverMode;
+  int m_hObserverTarget;
+  int m_hActiveWeapon;
+  int m_hViewModel;
+  int m_hGroundEntity;
+  int m_nWaterLevel;
+  float m_flMaxspeed;
+  char m_szLastPlaceName[18];
+  int m_hMyWeapons[DTBENCH_WEAPON_SLOTS];
+
+  // DT_LocalPlayerExclusive
+  Vector m_vecVelocity;
+  Vector m_vecBaseVelocity;
+  float m_flViewOffsetZ;
+  float m_flFriction;
+  float m_flFallVelocity;
+  float m_flDucktime;
+  int m_bDucked;
+  int m_bDucking;
+  int m_nTickBase;
+  int m_iBonusProgress;
+  int m_iAmmo[DTBENCH_AMMO_SLOTS];
+};
+
+BEGIN_SEND_TABLE_NOBASE(DTBenchPlayer, DT_BenchPlayer)
+  SendPropVector(SENDINFO_NOCHECK(m_vecOrigin), -1, SPROP_COORD),
+      SendPropInt(SENDINFO_NOCHECK(m_nModelIndex), 11),
+      SendPropInt(SENDINFO_NOCHECK(m_flAnimTime), 8, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_flSimulationTime), 8, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_nSequence), 9, SPROP_UNSIGNED),
+      SendPropFloat(SENDINFO_NOCHECK(m_flCycle), 15, SPROP_ROUNDDOWN, 0.0f,
+                    1.0f),
+      SendPropInt(SENDINFO_NOCHECK(m_nNewSequenceParity), 3, SPROP_UNSIGNED),
+
+      SendPropAngle(SENDINFO_NOCHECK(m_angEyeAngles[0]), 11,
+                    SPROP_CHANGES_OFTEN),
+      SendPropAngle(SENDINFO_NOCHECK(m_angEyeAngles[1]), 11,
+                    SPROP_CHANGES_OFTEN),
+      SendPropInt(SENDINFO_NOCHECK(m_iHealth), 10),
+      SendPropInt(SENDINFO_NOCHECK(m_lifeState), 3, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_fFlags), 10, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_iFOV), 8, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_iObserverMode), 3, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_hObserverTarget), 21, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_hActiveWeapon), 21, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_hViewModel), 21, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_hGroundEntity), 21, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_nWaterLevel), 2, SPROP_UNSIGNED),
+      SendPropFloat(SENDINFO_NOCHECK(m_flMaxspeed), 32, SPROP_NOSCALE),
+      SendPropString(SENDINFO_NOCHECK(m_szLastPlaceName)),
+      SendPropArray(
+          SendPropInt(SENDINFO_NOCHECK(m_hMyWeapons[0]), 21, SPROP_UNSIGNED),
+          m_hMyWeapons),
+
+      SendPropVector(SENDINFO_NOCHECK(m_vecVelocity), 32, SPROP_NOSCALE),
+      SendPropVector(SENDINFO_NOCHECK(m_vecBaseVelocity), 20, 0, -1000.0f,
+                     1000.0f),
+      SendPropFloat(SENDINFO_NOCHECK(m_flViewOffsetZ), 10, SPROP_CHANGES_OFTEN,
+                    0.0f, 128.0f),
+      SendPropFloat(SENDINFO_NOCHECK(m_flFriction), 8, SPROP_ROUNDDOWN, 0.0f,
+                    4.0f),
+      SendPropFloat(SENDINFO_NOCHECK(m_flFallVelocity), 17, 0, -4096.0f,
+                    4096.0f),
+      SendPropFloat(SENDINFO_NOCHECK(m_flDucktime), 12, SPROP_ROUNDDOWN, 0.0f,
+                    2048.0f),
+      SendPropInt(SENDINFO_NOCHECK(m_bDucked), 1, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_bDucking), 1, SPROP_UNSIGNED),
+      SendPropInt(SENDINFO_NOCHECK(m_nTickBase), -1, SPROP_CHANGES_OFTEN),
+      SendPropInt(SENDINFO_NOCHECK(m_iBonusProgress), 15),
+      SendPropArray(
+          SendPropInt(SENDINFO_NOCHECK(m_iAmmo[0]), 10, SPROP_UNSIGNED),
+          m_iAmmo),
+END_SEND_TABLE()
+
+static void DTBench_Spawn(DTBenchPlayer *pPlayer, int iPlayer) {
+  memset(pPlayer, 0, sizeof(*pPlayer));
+
+  pPlayer->m_vecOrigin.Init(RandomFloat(-4096, 4096),
+                            RandomFloat(-4096, 4096), RandomFloat(-512, 512));
+  pPlayer->m_nModelIndex = 100 + iPlayer % 8;
+  pPlayer->m_iHealth = 100;
+  pPlayer->m_fFlags = 1;
+  pPlayer->m_iFOV = 90;
+  pPlayer->m_hViewModel = RandomInt(0, (1 << 21) - 1);
+  pPlayer->m_hActiveWeapon = RandomInt(0, (1 << 21) - 1);
+  pPlayer->m_flMaxspeed = 320.0f;
+  pPlayer->m_flViewOffsetZ = 64.0f;
+  pPlayer->m_flFriction = 1.0f;
+  Q_strncpy(pPlayer->m_szLastPlaceName, "BombsiteA",
+            sizeof(pPlayer->m_szLastPlaceName));
+
+  for (int i = 0; i < 4; i++) {
+    pPlayer->m_hMyWeapons[i] = RandomInt(0, (1 << 21) - 1);
+  }
+
+  for (int i = 0; i < DTBENCH_AMMO_SLOTS; i += 3) {
+    pPlayer->m_iAmmo[i] = RandomInt(0, 1023);
+  }
+}
+
+// What a running player changes between two snapshots, plus the occasional
+// shot, hit or weapon switch.
+static void DTBench_Think(DTBenchPlayer *pPlayer) {
+  for (int i = 0; i < 3; i++) {
+    pPlayer->m_vecVelocity[i] = RandomFloat(-320, 320);
+    pPlayer->m_vecOrigin[i] += pPlayer->m_vecVelocity[i] * 0.015f;
+  }
+
+  pPlayer->m_angEyeAngles[0] = RandomFloat(-89, 89);
+  pPlayer->m_angEyeAngles[1] = RandomFloat(0, 360);
+  pPlayer->m_flAnimTime = (pPlayer->m_flAnimTime + 1) & 255;
+  pPlayer->m_flSimulationTime = pPlayer->m_flAnimTime;
+  pPlayer->m_flCycle = RandomFloat(0, 1);
+  pPlayer->m_nTickBase++;
+
+  if (RandomInt(0, 3) == 0) {
+    pPlayer->m_iAmmo[RandomInt(0, DTBENCH_AMMO_SLOTS - 1)] =
+        RandomInt(0, 1023);
+  }
+
+  if (RandomInt(0, 15) == 0) {
+    pPlayer->m_iHealth = RandomInt(1, 100);
+    pPlayer->m_flFallVelocity = RandomFloat(-600, 600);
+  }
+
+  if (RandomInt(0, 63) == 0) {
+    pPlayer->m_hActiveWeapon =
+        pPlayer->m_hMyWeapons[RandomInt(0, 3)] = RandomInt(0, (1 << 21) - 1);
+  }
+}
+
+// Decodes every prop of a full encoding without a RecvTable, the values are
+// unpacked but not stored. Returns the number of props.
+static int DTBench_Decode(const SendTable *pTable, const void *pData,
+                          int nBits, bool *pbOverflowed) {
+  bf_read buf("DTBench_Decode", pData, BitByte(nBits), nBits);
+  CDeltaBitsReader bitsReader(&buf);
+
+  DecodeInfo info;
+  info.m_pStruct = NULL;
+  info.m_pData = NULL;
+  info.m_pRecvProp = NULL;
+  info.m_pIn = &buf;
+  info.m_ObjectID = -1;
+  info.m_iElement = 0;
+
+  int nProps = 0;
+  int iProp;
+  while ((iProp = bitsReader.ReadNextPropIndex()) != -1) {
+    info.m_pProp = pTable->m_pPrecalc->GetProp(iProp);
+    g_PropTypeFns[info.m_pProp->GetType()].Decode(&info);
+    nProps++;
+  }
+
+  *pbOverflowed |= buf.IsOverflowed();
+  return nProps;
+}
+
+CON_COMMAND(dt_encode_bench,
+            "Encodes, deltas and decodes a DT_BasePlayer shaped SendTable and "
+            "reports ns per prop: [entities]") {
+  const int nEntities = args.ArgC() > 1 ? std::max(1, atoi(args[1])) : 10000;
+
+  SendTable *pTable = &REFERENCE_SEND_TABLE(DT_BenchPlayer);
+  if (!SendTable_InitTable(pTable)) {
+    Warning("dt_encode_bench: SendTable_InitTable failed.\n");
+    SendTable_TermTable(pTable);
+    return;
+  }
+
+  static DTBenchPlayer s_Players[DTBENCH_PLAYERS];
+  static u8 s_PrevEncoded[DTBENCH_PLAYERS][DTBENCH_ENCODE_BYTES];
+  static int s_nPrevBits[DTBENCH_PLAYERS];
+
+  alignas(4) u8 encoded[DTBENCH_ENCODE_BYTES];
+  alignas(4) u8 interpreted[DTBENCH_ENCODE_BYTES];
+  alignas(4) u8 delta[DTBENCH_ENCODE_BYTES];
+  int deltaProps[MAX_DATATABLE_PROPS];
+
+  for (int i = 0; i < DTBENCH_PLAYERS; i++) {
+    DTBench_Spawn(&s_Players[i], i);
+
+    bf_write buf("dt_encode_bench", s_PrevEncoded[i], DTBENCH_ENCODE_BYTES);
+    SendTable_Encode(pTable, &s_Players[i], &buf);
+    s_nPrevBits[i] = buf.GetNumBitsWritten();
+  }
+
+  CCycleCount encodeTime, interpretTime, deltaTime, decodeTime;
+  i64 nEncodedProps = 0, nDeltaProps = 0, nDecodedProps = 0;
+  i64 nEncodedBits = 0, nDeltaBits = 0;
+  int nMismatches = 0;
+  bool bOverflowed = false;
+
+  for (int iEntity = 0; iEntity < nEntities; iEntity++) {
+    const int iPlayer = iEntity % DTBENCH_PLAYERS;
+    DTBenchPlayer *pPlayer = &s_Players[iPlayer];
+    DTBench_Think(pPlayer);
+
+    CFastTimer timer;
+
+    // Full encode, what PackEntity does for every changed entity.
+    bf_write encodeBuf("dt_encode_bench", encoded, sizeof(encoded));
+    timer.Start();
+    SendTable_Encode(pTable, pPlayer, &encodeBuf);
+    timer.End();
+    encodeTime += timer.GetDuration();
+
+    const int nBits = encodeBuf.GetNumBitsWritten();
+    bOverflowed |= encodeBuf.IsOverflowed();
+    nEncodedBits += nBits;
+
+    // Same encode through g_PropTypeFns, to see what the compiled program
+    // buys and that it wrote the same bits.
+    bf_write interpretBuf("dt_encode_bench", interpreted, sizeof(interpreted));
+    timer.Start();
+    SendTable_EncodeInterpreted(pTable, pPlayer, &interpretBuf);
+    timer.End();
+    interpretTime += timer.GetDuration();
+
+    if (!CompareBitArrays(encoded, interpreted, nBits,
+                          interpretBuf.GetNumBitsWritten()))
+      ++nMismatches;
+
+    // Delta against the last snapshot, what each client's update gets.
+    bf_write deltaBuf("dt_encode_bench", delta, sizeof(delta));
+    timer.Start();
+    const int nChanged = SendTable_CalcDelta(
+        pTable, s_PrevEncoded[iPlayer], s_nPrevBits[iPlayer], encoded, nBits,
+        deltaProps, std::size(deltaProps), -1);
+    SendTable_WritePropList(pTable, encoded, nBits, &deltaBuf, -1, deltaProps,
+                            nChanged);
+    timer.End();
+    deltaTime += timer.GetDuration();
+
+    bOverflowed |= deltaBuf.IsOverflowed();
+    nDeltaProps += nChanged;
+    nDeltaBits += deltaBuf.GetNumBitsWritten();
+
+    // Unpack the full encoding, the client side of a full update.
+    timer.Start();
+    const int nDecoded = DTBench_Decode(pTable, encoded, nBits, &bOverflowed);
+    timer.End();
+    decodeTime += timer.GetDuration();
+
+    nDecodedProps += nDecoded;
+    nEncodedProps += nDecoded;
+
+    Q_memcpy(s_PrevEncoded[iPlayer], encoded, BitByte(nBits));
+    s_nPrevBits[iPlayer] = nBits;
+  }
+
+  const int nFlatProps = pTable->m_pPrecalc->GetNumProps();
+  SendTable_TermTable(pTable);
+
+  const f64 flTotalUs = encodeTime.GetMicrosecondsF() +
+                        deltaTime.GetMicrosecondsF() +
+                        decodeTime.GetMicrosecondsF();
+
+  Msg("%d entities, %d flat props, %.1f props and %.0f bits per full "
+      "encode, %.1f props and %.0f bits per delta\n",
+      nEntities, nFlatProps,
+      (f64)nEncodedProps / nEntities, (f64)nEncodedBits / nEntities,
+      (f64)nDeltaProps / nEntities, (f64)nDeltaBits / nEntities);
+  Msg("encode  %8.1f ns/prop  %8.2f us/entity\n",
+      encodeTime.GetMicrosecondsF() * 1000.0 / std::max<i64>(1, nEncodedProps),
+      encodeTime.GetMicrosecondsF() / nEntities);
+  Msg("interp  %8.1f ns/prop  %8.2f us/entity\n",
+      interpretTime.GetMicrosecondsF() * 1000.0 /
+          std::max<i64>(1, nEncodedProps),
+      interpretTime.GetMicrosecondsF() / nEntities);
+  Msg("delta   %8.1f ns/prop  %8.2f us/entity\n",
+      deltaTime.GetMicrosecondsF() * 1000.0 / std::max<i64>(1, nDeltaProps),
+      deltaTime.GetMicrosecondsF() / nEntities);
+  Msg("decode  %8.1f ns/prop  %8.2f us/entity\n",
+      decodeTime.GetMicrosecondsF() * 1000.0 / std::max<i64>(1, nDecodedProps),
+      decodeTime.GetMicrosecondsF() / nEntities);
+  Msg("%.0f entities/sec through all three%s\n",
+      nEntities * 1000000.0 / std::max(flTotalUs, 1.0),
+      bOverflowed ? ", BUFFER OVERFLOWED" : "");
+  if (nMismatches) {
+    Warning("dt_encode_bench: %d encodes differ from the interpreted "
+            "encoder.\n",
+            nMismatches);
+  }
+}
@@ -634,6 +634,40 @@ int Array_GetLength(const unsigned char *pStruct, const SendProp *pProp,
   }
 }
 
+// Int elements are a run of fixed width fields, skips and delta compares
+// take the whole run at once instead of one Int_* call per element.
+static inline bool Array_IsIntRun(const SendProp *pArrayProp, int nElements) {
+  return pArrayProp->GetType() == DPT_Int && pArrayProp->m_nBits >= 1 &&
+         pArrayProp->m_nBits <= 32 && nElements <= MAX_ARRAY_ELEMENTS;
+}
+
+// Unsigned runs also encode and decode through the bulk bit buffer calls.
+// Signed elements stay on WriteSBitLong, which writes n-1 bits plus a sign
+// bit, so out of range values keep their old encoding.
+static inline bool Array_IsUnsignedIntRun(const SendProp *pArrayProp,
+                                          int nElements) {
+  return Array_IsIntRun(pArrayProp, nElements) &&
+         (pArrayProp->GetFlags() & SPROP_UNSIGNED);
+}
+
+static void Array_DecodeIntRun(DecodeInfo *pInfo, int nElements,
+                               int elementStride) {
+  unsigned int values[MAX_ARRAY_ELEMENTS];
+  pInfo->m_pIn->ReadUBitLongArray(values, nElements, pInfo->m_pProp->m_nBits);
+
+  for (pInfo->m_iElement = 0; pInfo->m_iElement < nElements;
+       pInfo->m_iElement++) {
+    pInfo->m_Value.m_Int = (int)values[pInfo->m_iElement];
+
+    if (pInfo->m_pRecvProp) {
+      pInfo->m_pRecvProp->GetProxyFn()(pInfo, pInfo->m_pStruct,
+                                       pInfo->m_pData);
+    }
+
+    pInfo->m_pData = (char *)pInfo->m_pData + elementStride;
+  }
+}
+
 void Array_Encode(const unsigned char *pStruct, DVariant *pVar,
                   const SendProp *pProp, bf_write *pOut, int objectID) {
   SendProp *pArrayProp = pProp->GetArrayProp();
@@ -648,6 +682,23 @@ void Array_Encode(const unsigned char *pStruct, DVariant *pVar,
 
   unsigned char *pCurStructOffset =
       (unsigned char *)pStruct + pArrayProp->GetOffset();
+
+  if (Array_IsUnsignedIntRun(pArrayProp, nElements)) {
+    unsigned int values[MAX_ARRAY_ELEMENTS];
+
+    for (int iElement = 0; iElement < nElements; iElement++) {
+      DVariant var;
+      pArrayProp->GetProxyFn()(pArrayProp, pStruct, pCurStructOffset, &var,
+                               iElement, objectID);
+      values[iElement] = (unsigned int)var.m_Int;
+
+      pCurStructOffset += pProp->GetElementStride();
+    }
+
+    pOut->WriteUBitLongArray(values, nElements, pArrayProp->m_nBits);
+    return;
+  }
+
   for (int iElement = 0; iElement < nElements; iElement++) {
     DVariant var;
 
@@ -691,6 +742,11 @@ void Array_Decode(DecodeInfo *pInfo) {
 
   if (lengthProxy) lengthProxy(pInfo->m_pStruct, pInfo->m_ObjectID, nElements);
 
+  if (Array_IsUnsignedIntRun(pArrayProp, nElements)) {
+    Array_DecodeIntRun(&subDecodeInfo, nElements, elementStride);
+    return;
+  }
+
   for (subDecodeInfo.m_iElement = 0; subDecodeInfo.m_iElement < nElements;
        subDecodeInfo.m_iElement++) {
     g_PropTypeFns[pArrayProp->GetType()].Decode(&subDecodeInfo);
@@ -712,9 +768,17 @@ int Array_CompareDeltas(const SendProp *pProp, bf_read *p1, bf_read *p2) {
 
   // Compare deltas on the props that are the same.
   int nSame = std::min(length1, length2);
-  for (int iElement = 0; iElement < nSame; iElement++) {
-    bDifferent |=
-        g_PropTypeFns[pArrayProp->GetType()].CompareDeltas(pArrayProp, p1, p2);
+  const bool bIntRun = Array_IsIntRun(pArrayProp, nSame);
+  if (bIntRun) {
+    // Equal ints are equal bits, compare the whole run at once.
+    if (nSame > 0) {
+      bDifferent |= AreBitsDifferent(p1, p2, nSame * pArrayProp->m_nBits);
+    }
+  } else {
+    for (int iElement = 0; iElement < nSame; iElement++) {
+      bDifferent |= g_PropTypeFns[pArrayProp->GetType()].CompareDeltas(
+          pArrayProp, p1, p2);
+    }
   }
 
   // Now just eat up the remaining properties in whichever buffer was larger.
@@ -722,6 +786,11 @@ int Array_CompareDeltas(const SendProp *pProp, bf_read *p1, bf_read *p2) {
     bf_read *buffer = (length1 > length2) ? p1 : p2;
 
     int nExtra = std::max(length1, length2) - nSame;
+    if (bIntRun) {
+      buffer->SeekRelative(nExtra * pArrayProp->m_nBits);
+      return bDifferent;
+    }
+
     for (int iEatUp = 0; iEatUp < nExtra; iEatUp++) {
       SkipPropData(buffer, pArrayProp);
     }
@@ -782,6 +851,11 @@ bool Array_IsEncodedZero(const SendProp *pProp, bf_read *pIn) {
 
   int nElements = pIn->ReadUBitLong(pProp->GetNumArrayLengthBits());
 
+  if (Array_IsIntRun(pArrayProp, nElements)) {
+    pIn->SeekRelative(nElements * pArrayProp->m_nBits);
+    return nElements == 0;
+  }
+
   for (int i = 0; i < nElements; i++) {
     // skip over data
     g_PropTypeFns[pArrayProp->GetType()].IsEncodedZero(pArrayProp, pIn);
@@ -798,6 +872,11 @@ void Array_SkipProp(const SendProp *pProp, bf_read *pIn) {
 
   int nElements = pIn->ReadUBitLong(pProp->GetNumArrayLengthBits());
 
+  if (Array_IsIntRun(pArrayProp, nElements)) {
+    pIn->SeekRelative(nElements * pArrayProp->m_nBits);
+    return;
+  }
+
   for (int i = 0; i < nElements; i++) {
     // skip over data
     g_PropTypeFns[pArrayProp->GetType()].SkipProp(pArrayProp, pIn);
@@ -407,7 +407,7 @@ bool RecvTable_Decode(RecvTable *pTable, void *pStruct, bf_read *pIn,
     decodeInfo.m_pIn = pIn;
     decodeInfo.m_ObjectID = objectID;
 
-    g_PropTypeFns[pProp->GetType()].Decode(&decodeInfo);
+    RecvTable_ExecuteProp(&pDecoder->m_Precalc.m_Program[iProp], &decodeInfo);
     ++g_nPropsDecoded;
 
     // Instrumentation (store # bits for the encoded property).
@@ -8,6 +8,7 @@
 #include "dt_instrumentation_server.h"
 #include "dt_stack.h"
 #include "packed_entity.h"
+#include "server.h"
 #include "base/include/macros.h"
 #include "tier0/include/dbg.h"
 #include "tier0/include/icommandline.h"
@@ -452,6 +453,81 @@ static bool SendTable_IsPropZero(CEncodeInfo *pInfo, unsigned long iProp) {
                                              pProp);
 }
 
+// Fetches the value a compiled prop encodes, same result as its proxy.
+static inline void SendTable_LoadProp(const CPropInstruction *pInstr,
+                                      const unsigned char *pStructBase,
+                                      DVariant *pVar, int objectID) {
+  const unsigned char *pData = pStructBase + pInstr->m_Offset;
+
+  switch (pInstr->m_Load) {
+    case PROPLOAD_INT8:
+      pVar->m_Int = *(const char *)pData;
+      break;
+    case PROPLOAD_INT16:
+      pVar->m_Int = *(const short *)pData;
+      break;
+    case PROPLOAD_INT32:
+      pVar->m_Int = *(const int *)pData;
+      break;
+    case PROPLOAD_UINT8:
+      pVar->m_Int = *(const unsigned char *)pData;
+      break;
+    case PROPLOAD_UINT16:
+      pVar->m_Int = *(const unsigned short *)pData;
+      break;
+    case PROPLOAD_FLOAT:
+      pVar->m_Float = *(const float *)pData;
+      break;
+    default: {
+      const SendProp *pProp = pInstr->m_pProp;
+      pProp->GetProxyFn()(pProp, pStructBase, pData, pVar,
+                          0,  // iElement
+                          objectID);
+    } break;
+  }
+}
+
+static inline bool SendTable_IsValueZero(const CPropInstruction *pInstr,
+                                         const unsigned char *pStructBase,
+                                         DVariant *pVar) {
+  switch (pInstr->m_Op) {
+    case PROPOP_INT_UNSIGNED:
+    case PROPOP_INT_SIGNED:
+      return pVar->m_Int == 0;
+    case PROPOP_FLOAT_COORD:
+    case PROPOP_FLOAT_NOSCALE:
+      return pVar->m_Float == 0;
+    default:
+      return g_PropTypeFns[pInstr->m_Type].IsZero(pStructBase, pVar,
+                                                  pInstr->m_pProp);
+  }
+}
+
+// Bit for bit what g_PropTypeFns[type].Encode writes.
+static inline void SendTable_ExecuteProp(const CPropInstruction *pInstr,
+                                         const unsigned char *pStructBase,
+                                         DVariant *pVar, bf_write *pOut,
+                                         int objectID) {
+  switch (pInstr->m_Op) {
+    case PROPOP_INT_UNSIGNED:
+      pOut->WriteUBitLong((unsigned int)pVar->m_Int, pInstr->m_nBits);
+      break;
+    case PROPOP_INT_SIGNED:
+      pOut->WriteSBitLong(pVar->m_Int, pInstr->m_nBits);
+      break;
+    case PROPOP_FLOAT_COORD:
+      pOut->WriteBitCoord(pVar->m_Float);
+      break;
+    case PROPOP_FLOAT_NOSCALE:
+      pOut->WriteBitFloat(pVar->m_Float);
+      break;
+    default:
+      g_PropTypeFns[pInstr->m_Type].Encode(pStructBase, pVar, pInstr->m_pProp,
+                                           pOut, objectID);
+      break;
+  }
+}
+
 int SendTable_CullPropsFromProxies(const SendTable *pTable,
 
                                    const int *pStartProps, int nStartProps,
@@ -519,6 +595,72 @@ bool SendTable_Encode(const SendTable *pTable, const void *pStruct,
   // This writes and delta-compresses the delta bits.
   CDeltaBitsWriter deltaBitsWriter(pOut);
 
+  // Calls the datatable proxies, the props only need the struct bases.
+  CEncodeInfo info(pPrecalc, (unsigned char *)pStruct, objectID);
+
+  info.m_pOut = pOut;
+  info.m_ObjectID = objectID;
+  info.m_nDataBits = 0;
+  info.m_nOverheadBits = 0;  // unused
+  info.m_pDeltaBitsWriter = &deltaBitsWriter;
+  info.m_pRecipients = pRecipients;  // optional buffer to store the bits for
+                                     // which clients get what data.
+
+  info.Init();
+
+  const CPropInstruction *pProgram = pPrecalc->m_Program.Base();
+  int iNumProps = pPrecalc->m_Program.Count();
+
+  for (int iProp = 0; iProp < iNumProps;) {
+    int iRunEnd = iProp + pProgram[iProp].m_nRun;
+
+    // skip the whole run if we don't have a valid prop proxy
+    const unsigned char *pStructBase =
+        info.m_pProxies[pProgram[iProp].m_iProxy];
+    if (!pStructBase) {
+      iProp = iRunEnd;
+      continue;
+    }
+
+    for (; iProp < iRunEnd; iProp++) {
+      const CPropInstruction *pInstr = &pProgram[iProp];
+
+      DVariant var;
+      SendTable_LoadProp(pInstr, pStructBase, &var, objectID);
+
+      // skip empty prop if we only encode non-zero values
+      if (bNonZeroOnly && SendTable_IsValueZero(pInstr, pStructBase, &var))
+        continue;
+
+      deltaBitsWriter.WritePropIndex(iProp);
+
+      int iStartPos = pOut->GetNumBitsWritten();
+      SendTable_ExecuteProp(pInstr, pStructBase, &var, pOut, objectID);
+      info.m_nDataBits += pOut->GetNumBitsWritten() - iStartPos;
+    }
+  }
+
+  return !pOut->IsOverflowed();
+}
+
+bool SendTable_EncodeInterpreted(const SendTable *pTable, const void *pStruct,
+                                 bf_write *pOut, int objectID,
+                                 CUtlMemory<CSendProxyRecipients> *pRecipients,
+                                 bool bNonZeroOnly) {
+  CSendTablePrecalc *pPrecalc = pTable->m_pPrecalc;
+  ErrorIfNot(pPrecalc,
+             ("SendTable_EncodeInterpreted: Missing m_pPrecalc for SendTable "
+              "%s.",
+              pTable->m_pNetTableName));
+  if (pRecipients) {
+    ErrorIfNot(
+        pRecipients->NumAllocated() >= pPrecalc->GetNumDataTableProxies(),
+        ("SendTable_EncodeInterpreted: pRecipients array too small."));
+  }
+
+  // This writes and delta-compresses the delta bits.
+  CDeltaBitsWriter deltaBitsWriter(pOut);
+
   // Setup all the info we'll be walking the tree with.
   CEncodeInfo info(pPrecalc, (unsigned char *)pStruct, objectID);
 
@@ -746,7 +888,44 @@ static void SendTable_CalcNextVectorElems(SendTable *pTable) {
   }
 }
 
-static bool SendTable_InitTable(SendTable *pTable) {
+static PropLoad_t SendTable_GetPropLoad(const SendProp *pProp,
+                                        const CStandardSendProxiesV1 *pProxies) {
+  SendVarProxyFn fn = pProp->GetProxyFn();
+
+  if (pProp->GetType() == DPT_Int) {
+    if (fn == pProxies->m_Int32ToInt32 || fn == pProxies->m_UInt32ToInt32)
+      return PROPLOAD_INT32;
+    if (fn == pProxies->m_Int16ToInt32) return PROPLOAD_INT16;
+    if (fn == pProxies->m_UInt16ToInt32) return PROPLOAD_UINT16;
+    if (fn == pProxies->m_Int8ToInt32) return PROPLOAD_INT8;
+    if (fn == pProxies->m_UInt8ToInt32) return PROPLOAD_UINT8;
+  } else if (pProp->GetType() == DPT_Float) {
+    if (fn == pProxies->m_FloatToFloat) return PROPLOAD_FLOAT;
+  }
+
+  return PROPLOAD_PROXY;
+}
+
+// Lets SendTable_Encode read props that use the standard copy proxies
+// straight out of the entity. The game DLL has its own copies of the proxies,
+// engine tables (dt_test, dt_encode_bench) use the engine's.
+static void SendTable_BindProgramLoads(CSendTablePrecalc *pPrecalc) {
+  const CStandardSendProxiesV1 *pGameProxies =
+      serverGameDLL ? serverGameDLL->GetStandardSendProxies() : NULL;
+
+  for (int i = 0; i < pPrecalc->m_Program.Count(); i++) {
+    CPropInstruction *pInstr = &pPrecalc->m_Program[i];
+
+    PropLoad_t load =
+        SendTable_GetPropLoad(pInstr->m_pProp, &g_StandardSendProxies);
+    if (load == PROPLOAD_PROXY && pGameProxies)
+      load = SendTable_GetPropLoad(pInstr->m_pProp, pGameProxies);
+
+    pInstr->m_Load = (u8)load;
+  }
+}
+
+bool SendTable_InitTable(SendTable *pTable) {
   if (pTable->m_pPrecalc) return true;
 
   // Create the CSendTablePrecalc.
@@ -765,10 +944,11 @@ static bool SendTable_InitTable(SendTable *pTable) {
   if (!pPrecalc->SetupFlatPropertyArray()) return false;
 
   SendTable_Validate(pPrecalc);
+  SendTable_BindProgramLoads(pPrecalc);
   return true;
 }
 
-static void SendTable_TermTable(SendTable *pTable) {
+void SendTable_TermTable(SendTable *pTable) {
   if (!pTable->m_pPrecalc) return;
 
   delete pTable->m_pPrecalc;
@@ -24,6 +24,11 @@ CRC32_t SendTable_GetCRC();
 int SendTable_GetNum();
 SendTable *SendTabe_GetTable(int index);
 
+// Precalculate a single table without registering it, for tables that must
+// not show up in the server's class list (benchmarks, tools).
+bool SendTable_InitTable(SendTable *pTable);
+void SendTable_TermTable(SendTable *pTable);
+
 // Return the number of unique properties in the table.
 int SendTable_GetNumFlatProps(SendTable *pTable);
 
@@ -87,6 +92,14 @@ bool SendTable_Encode(
                // nonzero values.
 );
 
+// Same output as SendTable_Encode, but walks the SendProps through
+// g_PropTypeFns instead of running the table's compiled program. Kept as the
+// reference the program is checked against.
+bool SendTable_EncodeInterpreted(
+    const SendTable *pTable, const void *pStruct, bf_write *pOut,
+    int objectID = -1, CUtlMemory<CSendProxyRecipients> *pRecipients = NULL,
+    bool bNonZeroOnly = false);
+
 // In order to receive a table, you must send it from the server and receive its
 // info on the client so the client knows how to unpack it.
 bool SendTable_WriteInfos(SendTable *pTable, bf_write *pBuf);
@@ -19,6 +19,7 @@
 // - Recursive datatables.
 // - Datatable proxies returning false.
 // - CUtlVectors of regular types (like floats) and data tables.
+// - Compiled encode programs writing the same bits as the interpreted encoder.
 // ----------------------------------------------------------------------------------------
 // // Things it does not test:
 // - Quantization.
@@ -46,6 +47,7 @@
 #include "dt_utlvector_send.h"
 #include "quakedef.h"
 #include "tier0/include/dbg.h"
+#include "tier0/include/fasttimer.h"
 
 #include "tier0/include/memdbgon.h"
 
@@ -154,6 +156,7 @@ class DTTestServer {
   int m_IntArray[32];  // Note that the server and client array length are
                        // different.
   char m_CharArray[8];
+  int m_SignedArray[6];  // 8 bit signed, holds out of range values too
 
   int m_VLALength;
   int m_VLA[16];
@@ -226,6 +229,9 @@ BEGIN_SEND_TABLE_NOBASE(DTTestServer, DT_DTTest)
       SendPropArray(
           SendPropInt(SENDINFO_NOCHECK(m_IntArray[0]), 23, SPROP_UNSIGNED),
           m_IntArray),
+
+      SendPropArray(SendPropInt(SENDINFO_NOCHECK(m_SignedArray[0]), 8),
+                    m_SignedArray),
 #if defined(SUPPORT_ARRAYS_OF_DATATABLES)
       SendPropArray(SendPropDataTable(SENDINFO_DT(m_SubArray[0]),
                                       &REFERENCE_SEND_TABLE(DT_DTTestSub),
@@ -325,6 +331,9 @@ END_RECV_TABLE()
   char m_CharArray[8];
   long m_Guard9;
 
+  int m_SignedArray[6];
+  long m_Guard10;
+
   int m_VLALength;
   int m_VLA[16];
 };
@@ -363,6 +372,8 @@ RecvPropArray(RecvPropDataTable(RECVINFO_DT(m_SubArray[0]), 0,
     // -	Array size mismatches between the client and the server.
     RecvPropArray(RecvPropInt(RECVINFO(m_IntArray[0]), 0), m_IntArray),
 
+    RecvPropArray(RecvPropInt(RECVINFO(m_SignedArray[0]), 0), m_SignedArray),
+
     RecvPropInt(RECVINFO(m_VLALength)),
 
     RecvPropVariableLengthArray(RecvProxyArrayLength_VLA,
@@ -498,6 +509,27 @@ void RandomlyChangeCharArray(DTTestServer *pServer) {
     pServer->m_CharArray[i] = (char)rand();
 }
 
+// Array elements must decode to what a lone signed int prop would, including
+// values that don't fit the prop's bits.
+bool CompareSignedArray(DTTestClient *pClient, DTTestServer *pServer) {
+  for (int i = 0; i < std::size(pServer->m_SignedArray); i++) {
+    unsigned char buf[8];
+    bf_write bfWrite("CompareSignedArray->buf", buf, sizeof(buf));
+    bfWrite.WriteSBitLong(pServer->m_SignedArray[i], 8);
+
+    bf_read bfRead("CompareSignedArray->buf", buf, sizeof(buf));
+    if (pClient->m_SignedArray[i] != bfRead.ReadSBitLong(8)) return false;
+  }
+  return true;
+}
+void RandomlyChangeSignedArray(DTTestServer *pServer) {
+  // Only too large values, WriteSBitLong asserts on too small ones.
+  for (int i = 0; i < std::size(pServer->m_SignedArray); i++) {
+    pServer->m_SignedArray[i] = rand() % 429 - 128;
+  }
+  pServer->m_SignedArray[0] = 200;
+}
+
 bool CompareSubArray(DTTestClient *pClient, DTTestServer *pServer) {
 #if defined(SUPPORT_ARRAYS_OF_DATATABLES)
   for (int i = 0; i < 2; i++) {
@@ -678,6 +710,7 @@ VarTestInfo g_VarTestInfos[] = {
     {CompareVector, RandomlyChangeVector},
     {CompareString, RandomlyChangeString},
     {CompareIntArray, RandomlyChangeIntArray},
+    {CompareSignedArray, RandomlyChangeSignedArray},
     {CompareSubArray, RandomlyChangeSubArray}};
 #define NUMVARTESTINFOS (sizeof(g_VarTestInfos) / sizeof(g_VarTestInfos[0]))
 
@@ -686,7 +719,7 @@ int g_GuardOffsets[] = {
     offsetof(DTTestClient, m_Guard3), offsetof(DTTestClient, m_Guard4),
     offsetof(DTTestClient, m_Guard5), offsetof(DTTestClient, m_Guard6),
     offsetof(DTTestClient, m_Guard7), offsetof(DTTestClient, m_Guard8),
-    offsetof(DTTestClient, m_Guard9)};
+    offsetof(DTTestClient, m_Guard9), offsetof(DTTestClient, m_Guard10)};
 int g_nGuardOffsets = sizeof(g_GuardOffsets) / sizeof(g_GuardOffsets[0]);
 
 void SetGuardBytes(DTTestClient *pClient) {
@@ -719,6 +752,57 @@ bool CompareDTTest(DTTestClient *pClient, DTTestServer *pServer) {
   return true;
 }
 
+// Encodes pServer with the table's compiled program and with the interpreted
+// encoder and checks they wrote the same bits.
+void CompareEncoders(SendTable *pTable, DTTestServer *pServer,
+                     bool bNonZeroOnly) {
+  unsigned char compiled[4096], interpreted[4096];
+  bf_write bfCompiled("CompareEncoders->compiled", compiled, sizeof(compiled));
+  bf_write bfInterpreted("CompareEncoders->interpreted", interpreted,
+                         sizeof(interpreted));
+
+  SendTable_Encode(pTable, pServer, &bfCompiled, -1, NULL, bNonZeroOnly);
+  SendTable_EncodeInterpreted(pTable, pServer, &bfInterpreted, -1, NULL,
+                              bNonZeroOnly);
+
+  if (!CompareBitArrays(compiled, interpreted, bfCompiled.GetNumBitsWritten(),
+                        bfInterpreted.GetNumBitsWritten())) {
+    Assert(!"CompareEncoders: compiled program and interpreted encoder "
+            "differ.");
+  }
+}
+
+// Reports how long both encoders take on the test table.
+void TimeEncoders(SendTable *pTable, DTTestServer *pServer) {
+  const int nEncodes = 2000;
+  unsigned char encoded[4096];
+
+  CCycleCount compiledTime, interpretedTime;
+  CFastTimer timer;
+
+  timer.Start();
+  for (int i = 0; i < nEncodes; i++) {
+    bf_write bf("TimeEncoders->encoded", encoded, sizeof(encoded));
+    SendTable_Encode(pTable, pServer, &bf, -1, NULL);
+  }
+  timer.End();
+  compiledTime = timer.GetDuration();
+
+  timer.Start();
+  for (int i = 0; i < nEncodes; i++) {
+    bf_write bf("TimeEncoders->encoded", encoded, sizeof(encoded));
+    SendTable_EncodeInterpreted(pTable, pServer, &bf, -1, NULL);
+  }
+  timer.End();
+  interpretedTime = timer.GetDuration();
+
+  DevMsg("RunDataTableTest: %.2f us/encode compiled, %.2f us/encode "
+         "interpreted (%d props)\n",
+         compiledTime.GetMicrosecondsF() / nEncodes,
+         interpretedTime.GetMicrosecondsF() / nEncodes,
+         pTable->m_pPrecalc->GetNumProps());
+}
+
 bool WriteSendTable_R(SendTable *pTable, bf_write &bfWrite,
                       bool bNeedsDecoder) {
   if (pTable->GetWriteFlag()) return true;
@@ -819,6 +903,9 @@ void RunDataTableTest() {
       Assert(false);
     }
 
+    CompareEncoders(pSendTable, &dtServer, false);
+    CompareEncoders(pSendTable, &dtServer, true);
+
     unsigned char deltaEncoded[4096];
     bf_write bfDeltaEncoded("RunDataTableTest->bfDeltaEncoded", deltaEncoded,
                             sizeof(deltaEncoded));
@@ -881,6 +968,8 @@ void RunDataTableTest() {
     CompareDTTest(&dtClient, &dtServer);
   }
 
+  TimeEncoders(pSendTable, &dtServer);
+
   SendTable_Term();
   RecvTable_Term();
 }
@@ -2,9 +2,12 @@
 
 #include "enginetrace.h"
 
+#include <algorithm>
+
 #include "client_class.h"
 #include "cmodel_engine.h"
 #include "collisionutils.h"
+#include "datacache/imdlcache.h"
 #include "debugoverlay.h"
 #include "dispcoll_common.h"
 #include "edict.h"
@@ -22,6 +25,7 @@
 #include "tier1/convar.h"
 #include "vphysics/virtualmesh.h"
 #include "vphysics_interface.h"
+#include "vstdlib/jobthread.h"
 #include "world.h"
 
 #include "tier0/include/memdbgon.h"
@@ -54,16 +58,23 @@ static CUtlVector<Ray_t> s_FrameRays;
 
 #define BENCHMARK_RAY_TEST 0
 
+// Rays a trace job takes at a time, TraceRays groups within them.
+#define TRACE_JOB_RAYS 32
+
 #if BENCHMARK_RAY_TEST
 static CUtlVector<Ray_t> s_BenchmarkRays;
 #endif
 
+// Set while tracing against or sweeping a FSOLID_ROOT_PARENT_ALIGNED
+// collideable, boxes are then clipped in its root parent's space. Per thread,
+// trace jobs run on pool threads while the main thread traces.
+static thread_local const matrix3x4_t *s_pRootMoveParent = nullptr;
+
 //-----------------------------------------------------------------------------
 // Implementation of IEngineTrace
 //-----------------------------------------------------------------------------
 the_interface CEngineTrace : public IEngineTrace {
  public:
-  CEngineTrace() { m_pRootMoveParent = NULL; }
   // Returns the contents mask at a particular world-space position
   virtual int GetPointContents(const Vector &vecAbsPosition,
                                IHandleEntity **ppEntity);
@@ -145,6 +156,18 @@ the_interface CEngineTrace : public IEngineTrace {
   // Walks bsp to find the leaf containing the specified point
   virtual int GetLeafContainingPoint(const Vector &ptTest);
 
+  // Traces a group of rays, sharing the world and partition queries
+  virtual void TraceRays(const Ray_t *pRays, int nRayCount, unsigned int fMask,
+                         ITraceFilter *pTraceFilter, trace_t *pTraces);
+
+  // Traces a group of rays on the job pool
+  virtual TraceJobHandle_t TraceRaysAsync(const Ray_t *pRays, int nRayCount,
+                                          unsigned int fMask,
+                                          ITraceFilter *pTraceFilter,
+                                          trace_t *pTraces);
+  virtual bool IsTraceJobDone(TraceJobHandle_t hJob);
+  virtual void FinishTraceJob(TraceJobHandle_t hJob);
+
  private:
   // TODO(d.rattman): Different versions for client + server. Eventually we need
   // to make these go away
@@ -189,10 +212,24 @@ the_interface CEngineTrace : public IEngineTrace {
   // Clips a trace to another trace
   bool ClipTraceToTrace(trace_t & clipTrace, trace_t * pFinalTrace);
 
+  // Traces rays starting in the same leaf with one leaf list and one entity
+  // list for all of them. Returns false, tracing nothing, if the rays are
+  // too far apart for that to pay off.
+  bool TraceRayBatch(const Ray_t *pRays, const int *pRayIndices, int nRayCount,
+                     unsigned int fMask, ITraceFilter *pTraceFilter,
+                     trace_t *pTraces);
+
+  // Queues an async trace over nJobs jobs, 0 runs it right here.
+  TraceJobHandle_t QueueTraceJob(const Ray_t *pRays, int nRayCount,
+                                 unsigned int fMask, ITraceFilter *pTraceFilter,
+                                 trace_t *pTraces, int nJobs);
+  void RunTraceJob(TraceJob_t *pJob);
+
  private:
-  int m_traceStatCounters[NUM_TRACE_STAT_COUNTER];
-  const matrix3x4_t *m_pRootMoveParent;
+  // Trace jobs bump these from pool threads.
+  CInterlockedInt m_traceStatCounters[NUM_TRACE_STAT_COUNTER];
   friend void RayBench(const CCommand &args);
+  friend void RayBenchThreads(const CCommand &args);
 };
 
 class CEngineTraceServer : public CEngineTrace {
@@ -205,6 +242,7 @@ class CEngineTraceServer : public CEngineTrace {
   virtual int SpatialPartitionTriggerMask() const;
   virtual ICollideable *GetWorldCollideable();
   friend void RayBench(const CCommand &args);
+  friend void RayBenchThreads(const CCommand &args);
 
  public:
   // IEngineTrace
@@ -905,20 +943,20 @@ bool CEngineTrace::ClipRayToBBox(const Ray_t &ray, unsigned int fMask,
 
   VectorAligned vecAbsMins, vecAbsMaxs;
   VectorAligned vecInvDelta;
-  // NOTE: If m_pRootMoveParent is set, then the boxes should be rotated into
+  // NOTE: If s_pRootMoveParent is set, then the boxes should be rotated into
   // the root parent's space
-  if (!ray.m_IsRay && m_pRootMoveParent) {
+  if (!ray.m_IsRay && s_pRootMoveParent) {
     Ray_t ray_l;
 
     ray_l.m_Extents = ray.m_Extents;
 
-    VectorIRotate(ray.m_Delta, *m_pRootMoveParent, ray_l.m_Delta);
+    VectorIRotate(ray.m_Delta, *s_pRootMoveParent, ray_l.m_Delta);
     ray_l.m_StartOffset.Init();
-    VectorITransform(ray.m_Start, *m_pRootMoveParent, ray_l.m_Start);
+    VectorITransform(ray.m_Start, *s_pRootMoveParent, ray_l.m_Start);
 
     vecInvDelta = ray_l.InvDelta();
     Vector localEntityOrigin;
-    VectorITransform(pEntity->GetCollisionOrigin(), *m_pRootMoveParent,
+    VectorITransform(pEntity->GetCollisionOrigin(), *s_pRootMoveParent,
                      localEntityOrigin);
     ray_l.m_IsRay = ray.m_IsRay;
     ray_l.m_IsSwept = ray.m_IsSwept;
@@ -930,7 +968,7 @@ bool CEngineTrace::ClipRayToBBox(const Ray_t &ray, unsigned int fMask,
     if (pTrace->DidHit()) {
       Vector temp;
       VectorCopy(pTrace->plane.normal, temp);
-      VectorRotate(temp, *m_pRootMoveParent, pTrace->plane.normal);
+      VectorRotate(temp, *s_pRootMoveParent, pTrace->plane.normal);
       VectorAdd(ray.m_Start, ray.m_StartOffset, pTrace->startpos);
 
       if (pTrace->fraction == 1) {
@@ -1031,9 +1069,9 @@ void CEngineTrace::ClipRayToCollideable(const Ray_t &ray, unsigned int fMask,
     }
   }
 
-  const matrix3x4_t *pOldRoot = m_pRootMoveParent;
+  const matrix3x4_t *pOldRoot = s_pRootMoveParent;
   if (pEntity->GetSolidFlags() & FSOLID_ROOT_PARENT_ALIGNED) {
-    m_pRootMoveParent = pEntity->GetRootParentToWorldTransform();
+    s_pRootMoveParent = pEntity->GetRootParentToWorldTransform();
   }
   bool bTraced = false;
   bool bCustomPerformed = false;
@@ -1095,7 +1133,7 @@ void CEngineTrace::ClipRayToCollideable(const Ray_t &ray, unsigned int fMask,
   VectorMA(vecOffset, pTrace->fraction, ray.m_Delta, vecEndTest);
   Assert(VectorsAreEqual(vecEndTest, pTrace->endpos, 0.1f));
 #endif
-  m_pRootMoveParent = pOldRoot;
+  s_pRootMoveParent = pOldRoot;
 }
 
 //-----------------------------------------------------------------------------
@@ -1471,7 +1509,8 @@ CON_COMMAND(ray_clear, "Clear the current rays") {
   Msg("Reset rays!\n");
 }
 
-CON_COMMAND_EXTERN(ray_bench, RayBench, "Time the rays") {
+CON_COMMAND_EXTERN(ray_bench, RayBench,
+                   "Time the rays, arg is the TraceRays batch size") {
 #if VPROF_LEVEL > 0
   g_VProfCurrentProfile.Start();
   g_VProfCurrentProfile.Reset();
@@ -1542,27 +1581,222 @@ CON_COMMAND_EXTERN(ray_bench, RayBench, "Time the rays") {
         "ray/prop, %d box/prop)\n",
         hit, miss, ms, point, swept, rayVsProp, boxVsProp);
   }
+
+  // TraceRay one at a time against TraceRays over consecutive groups of the
+  // saved rays, which come in the order the game issued them. Works on a copy,
+  // TraceRay appends to s_BenchmarkRays while it isn't full.
+  {
+    int nBatchSize = args.ArgC() > 1 ? std::max(1, atoi(args[1])) : 32;
+    int nRays = s_BenchmarkRays.Count();
+    CUtlVector<Ray_t> rays;
+    rays.CopyArray(s_BenchmarkRays.Base(), nRays);
+    CUtlVector<trace_t> scalarTraces, batchTraces;
+    scalarTraces.SetCount(nRays);
+    batchTraces.SetCount(nRays);
+
+    double tStart = Plat_FloatTime();
+    for (int i = 0; i < nRays; i++) {
+      s_EngineTraceServer.TraceRay(rays[i], MASK_SOLID, NULL, &scalarTraces[i]);
+    }
+    double tScalar = Plat_FloatTime() - tStart;
+
+    tStart = Plat_FloatTime();
+    for (int i = 0; i < nRays; i += nBatchSize) {
+      s_EngineTraceServer.TraceRays(rays.Base() + i,
+                                    std::min(nBatchSize, nRays - i),
+                                    MASK_SOLID, NULL, batchTraces.Base() + i);
+    }
+    double tBatch = Plat_FloatTime() - tStart;
+
+    int nMismatches = 0;
+    for (int i = 0; i < nRays; i++) {
+      if (fabsf(scalarTraces[i].fraction - batchTraces[i].fraction) > 1e-4f ||
+          scalarTraces[i].m_pEnt != batchTraces[i].m_pEnt ||
+          scalarTraces[i].startsolid != batchTraces[i].startsolid)
+        nMismatches++;
+    }
+
+    Msg("TraceRay: %.2fms   TraceRays (batches of %d): %.2fms   %d "
+        "mismatches\n",
+        tScalar * 1000.0, nBatchSize, tBatch * 1000.0, nMismatches);
+  }
 #if VPROF_LEVEL > 0
   g_VProfCurrentProfile.MarkFrame();
   g_VProfCurrentProfile.Stop();
   g_VProfCurrentProfile.OutputReport(VPRT_FULL & ~VPRT_HIERARCHY, NULL);
 #endif
 }
+
+// World traces of the saved rays with the scalar and the SIMD brush side loop
+// (cm_simd_brushsides), checks they agree and times both.
+CON_COMMAND(ray_bench_brushsides, "Compare scalar and SIMD brush clipping") {
+  ConVarRef cm_simd_brushsides("cm_simd_brushsides");
+  bool bOldSIMD = cm_simd_brushsides.GetBool();
+
+  int nRays = s_BenchmarkRays.Count();
+  CUtlVector<trace_t> traces[2];
+  double tElapsed[2];
+  for (int nSIMD = 0; nSIMD < 2; nSIMD++) {
+    cm_simd_brushsides.SetValue(nSIMD);
+    traces[nSIMD].SetCount(nRays);
+
+    double tStart = Plat_FloatTime();
+    for (int i = 0; i < nRays; i++) {
+      CM_BoxTrace(s_BenchmarkRays[i], 0, MASK_SOLID, true, traces[nSIMD][i]);
+    }
+    tElapsed[nSIMD] = Plat_FloatTime() - tStart;
+  }
+  cm_simd_brushsides.SetValue(bOldSIMD);
+
+  int nMismatches = 0;
+  float flMaxError = 0;
+  for (int i = 0; i < nRays; i++) {
+    const trace_t &scalar = traces[0][i];
+    const trace_t &simd = traces[1][i];
+    flMaxError = std::max(flMaxError, fabsf(scalar.fraction - simd.fraction));
+    if (scalar.fraction != simd.fraction ||
+        scalar.startsolid != simd.startsolid ||
+        scalar.allsolid != simd.allsolid || scalar.contents != simd.contents ||
+        scalar.plane.normal != simd.plane.normal)
+      nMismatches++;
+  }
+
+  Msg("%d rays, scalar: %.2fms   SIMD: %.2fms   %d mismatches (max fraction "
+      "error %f)\n",
+      nRays, tElapsed[0] * 1000.0, tElapsed[1] * 1000.0, nMismatches,
+      flMaxError);
+}
+
+// Runs the saved rays through TraceRaysAsync on 1, 2, 4... jobs, checks every
+// trace against a serial run and reports the speedup.
+CON_COMMAND_EXTERN(ray_bench_threads, RayBenchThreads,
+                   "Time the rays on the job pool, arg is the max job count") {
+  int nMaxJobs = g_pThreadPool ? g_pThreadPool->NumThreads() : 0;
+  if (args.ArgC() > 1) nMaxJobs = std::max(1, atoi(args[1]));
+
+  // Works on a copy, TraceRay appends to s_BenchmarkRays while it isn't full.
+  int nRays = s_BenchmarkRays.Count();
+  CUtlVector<Ray_t> rays;
+  rays.CopyArray(s_BenchmarkRays.Base(), nRays);
+
+  // Same TRACE_JOB_RAYS chunks as the jobs, so batching can't differ.
+  CUtlVector<trace_t> serialTraces, asyncTraces;
+  serialTraces.SetCount(nRays);
+  asyncTraces.SetCount(nRays);
+
+  double tStart = Plat_FloatTime();
+  for (int i = 0; i < nRays; i += TRACE_JOB_RAYS) {
+    s_EngineTraceServer.TraceRays(rays.Base() + i,
+                                  std::min(TRACE_JOB_RAYS, nRays - i),
+                                  MASK_SOLID, NULL, serialTraces.Base() + i);
+  }
+  double tSerial = Plat_FloatTime() - tStart;
+  Msg("%d rays, serial: %.2fms\n", nRays, tSerial * 1000.0);
+
+  for (int nJobs = 1; nJobs <= nMaxJobs; nJobs *= 2) {
+    tStart = Plat_FloatTime();
+    TraceJobHandle_t hJob = s_EngineTraceServer.QueueTraceJob(
+        rays.Base(), nRays, MASK_SOLID, NULL, asyncTraces.Base(), nJobs);
+    s_EngineTraceServer.FinishTraceJob(hJob);
+    double tAsync = Plat_FloatTime() - tStart;
+
+    int nMismatches = 0;
+    for (int i = 0; i < nRays; i++) {
+      const trace_t &serial = serialTraces[i];
+      const trace_t &async = asyncTraces[i];
+      if (serial.fraction != async.fraction || serial.m_pEnt != async.m_pEnt ||
+          serial.startsolid != async.startsolid ||
+          serial.hitbox != async.hitbox)
+        nMismatches++;
+    }
+
+    Msg("%2d jobs: %.2fms (%.2fx)   %d mismatches\n", nJobs, tAsync * 1000.0,
+        tAsync > 0 ? tSerial / tAsync : 0.0, nMismatches);
+  }
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Shortens a ray to the point where it hit the world, so entities behind the
+// hit are skipped, and rescales the trace to the shortened ray.
+//-----------------------------------------------------------------------------
+static void SetupEntityRay(const Ray_t &ray, trace_t *pTrace, Ray_t &entityRay,
+                           float &flWorldFraction,
+                           float &flWorldFractionLeftSolidScale) {
+  // Save the world collision fraction.
+  flWorldFraction = pTrace->fraction;
+  flWorldFractionLeftSolidScale = flWorldFraction;
+
+  entityRay = ray;
+
+  if (pTrace->fraction == 0) {
+    entityRay.m_Delta.Init();
+    flWorldFractionLeftSolidScale = pTrace->fractionleftsolid;
+    pTrace->fractionleftsolid = 1.0f;
+    pTrace->fraction = 1.0f;
+  } else {
+    // Explicitly compute end so that this computation happens at the
+    // quantization of the output (endpos).  That way we won't miss any
+    // intersections we would get by feeding these results back in to the tracer
+    // This is not the same as entityRay.m_Delta *= pTrace->fraction which
+    // happens at a quantization that is more precise as m_Start moves away from
+    // the origin
+    Vector end;
+    VectorMA(entityRay.m_Start, pTrace->fraction, entityRay.m_Delta, end);
+    VectorSubtract(end, entityRay.m_Start, entityRay.m_Delta);
+    // We know this is safe because pTrace->fraction != 0
+    pTrace->fractionleftsolid /= pTrace->fraction;
+    pTrace->fraction = 1.0;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Maps a trace clipped against entities along the shortened ray back onto the
+// original ray.
+//-----------------------------------------------------------------------------
+static void FinishEntityTrace(const Ray_t &ray, float flWorldFraction,
+                              float flWorldFractionLeftSolidScale,
+                              trace_t *pTrace) {
+  // Fix up the fractions so they are appropriate given the original
+  // unclipped-to-world ray
+  pTrace->fraction *= flWorldFraction;
+  pTrace->fractionleftsolid *= flWorldFractionLeftSolidScale;
+
+#ifdef _DEBUG
+  Vector vecOffset, vecEndTest;
+  VectorAdd(ray.m_Start, ray.m_StartOffset, vecOffset);
+  VectorMA(vecOffset, pTrace->fractionleftsolid, ray.m_Delta, vecEndTest);
+  Assert(VectorsAreEqual(vecEndTest, pTrace->startpos, 0.1f));
+  VectorMA(vecOffset, pTrace->fraction, ray.m_Delta, vecEndTest);
+  Assert(VectorsAreEqual(vecEndTest, pTrace->endpos, 0.1f));
+//	Assert( !ray.m_IsRay || pTrace->allsolid || pTrace->fraction >=
+// pTrace->fractionleftsolid );
 #endif
 
+  if (!ray.m_IsRay) {
+    // Make sure no fractionleftsolid can be used with box sweeps
+    VectorAdd(ray.m_Start, ray.m_StartOffset, pTrace->startpos);
+    pTrace->fractionleftsolid = 0;
+
+#ifdef _DEBUG
+    pTrace->fractionleftsolid = FLOAT32_NAN;
+#endif
+  }
+}
+
 //-----------------------------------------------------------------------------
 // A version that simply accepts a ray (can work as a traceline or tracehull)
 //-----------------------------------------------------------------------------
 void CEngineTrace::TraceRay(const Ray_t &ray, unsigned int fMask,
                             ITraceFilter *pTraceFilter, trace_t *pTrace) {
 #if defined _DEBUG && !defined SWDS
-  if (debugrayenable.GetBool()) {
+  if (debugrayenable.GetBool() && ThreadInMainThread()) {
     s_FrameRays.AddToTail(ray);
   }
 #endif
 
 #if BENCHMARK_RAY_TEST
-  if (s_BenchmarkRays.Count() < 15000) {
+  if (s_BenchmarkRays.Count() < 15000 && ThreadInMainThread()) {
     s_BenchmarkRays.EnsureCapacity(15000);
     s_BenchmarkRays.AddToTail(ray);
   }
@@ -1606,33 +1840,12 @@ void CEngineTrace::TraceRay(const Ray_t &ray, unsigned int fMask,
     VectorAdd(pTrace->startpos, ray.m_Delta, pTrace->endpos);
   }
 
-  // Save the world collision fraction.
-  float flWorldFraction = pTrace->fraction;
-  float flWorldFractionLeftSolidScale = flWorldFraction;
-
   // Create a ray that extends only until we hit the world
   // and adjust the trace accordingly
-  Ray_t entityRay = ray;
-
-  if (pTrace->fraction == 0) {
-    entityRay.m_Delta.Init();
-    flWorldFractionLeftSolidScale = pTrace->fractionleftsolid;
-    pTrace->fractionleftsolid = 1.0f;
-    pTrace->fraction = 1.0f;
-  } else {
-    // Explicitly compute end so that this computation happens at the
-    // quantization of the output (endpos).  That way we won't miss any
-    // intersections we would get by feeding these results back in to the tracer
-    // This is not the same as entityRay.m_Delta *= pTrace->fraction which
-    // happens at a quantization that is more precise as m_Start moves away from
-    // the origin
-    Vector end;
-    VectorMA(entityRay.m_Start, pTrace->fraction, entityRay.m_Delta, end);
-    VectorSubtract(end, entityRay.m_Start, entityRay.m_Delta);
-    // We know this is safe because pTrace->fraction != 0
-    pTrace->fractionleftsolid /= pTrace->fraction;
-    pTrace->fraction = 1.0;
-  }
+  Ray_t entityRay;
+  float flWorldFraction, flWorldFractionLeftSolidScale;
+  SetupEntityRay(ray, pTrace, entityRay, flWorldFraction,
+                 flWorldFractionLeftSolidScale);
 
   // Collide with entities along the ray
   // TODO(d.rattman): Hitbox code causes this to be re-entrant for the IK stuff.
@@ -1687,31 +1900,410 @@ void CEngineTrace::TraceRay(const Ray_t &ray, unsigned int fMask,
     if (pTrace->allsolid) break;
   }
 
-  // Fix up the fractions so they are appropriate given the original
-  // unclipped-to-world ray
-  pTrace->fraction *= flWorldFraction;
-  pTrace->fractionleftsolid *= flWorldFractionLeftSolidScale;
+  FinishEntityTrace(ray, flWorldFraction, flWorldFractionLeftSolidScale,
+                    pTrace);
+}
 
-#ifdef _DEBUG
-  Vector vecOffset, vecEndTest;
-  VectorAdd(ray.m_Start, ray.m_StartOffset, vecOffset);
-  VectorMA(vecOffset, pTrace->fractionleftsolid, ray.m_Delta, vecEndTest);
-  Assert(VectorsAreEqual(vecEndTest, pTrace->startpos, 0.1f));
-  VectorMA(vecOffset, pTrace->fraction, ray.m_Delta, vecEndTest);
-  Assert(VectorsAreEqual(vecEndTest, pTrace->endpos, 0.1f));
-//	Assert( !ray.m_IsRay || pTrace->allsolid || pTrace->fraction >=
-// pTrace->fractionleftsolid );
+static ConVar trace_batch(
+    "trace_batch", "1", 0,
+    "TraceRays shares one world leaf list and one entity list between the "
+    "rays that start in the same leaf.");
+
+// A ray of a TraceRays call and the leaf it starts in, for grouping.
+struct TraceBatchRay_t {
+  int m_nLeaf;
+  int m_iRay;
+};
+
+static int __cdecl TraceBatchRayCompare(const TraceBatchRay_t *pLeft,
+                                        const TraceBatchRay_t *pRight) {
+  if (pLeft->m_nLeaf != pRight->m_nLeaf)
+    return pLeft->m_nLeaf - pRight->m_nLeaf;
+  return pLeft->m_iRay - pRight->m_iRay;
+}
+
+// Four entity rays in SIMD lanes, culled against an entity's bounds at once.
+struct FourRays_t {
+  FourVectors m_Start;
+  FourVectors m_InvDelta;
+  FourVectors m_Extents;
+};
+
+//-----------------------------------------------------------------------------
+// Returns a bit per lane whose swept box touches [vecMins, vecMaxs]. The ray
+// extents are padded by a unit, so an entity the partition would have
+// returned along a ray is never culled; the clip does the exact test.
+//-----------------------------------------------------------------------------
+static int FourRaysIntersectBox(const FourRays_t &rays, const Vector &vecMins,
+                                const Vector &vecMaxs) {
+  fltx4 tMin = Four_Zeros;
+  fltx4 tMax = Four_Ones;
+  for (int iAxis = 0; iAxis < 3; ++iAxis) {
+    // A zero delta has an inverse of FLT_MAX, which sends both slab ends to the
+    // same side unless the start is inside the slab.
+    fltx4 lo = SubSIMD(ReplicateX4(vecMins[iAxis]), rays.m_Extents[iAxis]);
+    fltx4 hi = AddSIMD(ReplicateX4(vecMaxs[iAxis]), rays.m_Extents[iAxis]);
+    fltx4 t1 =
+        MulSIMD(SubSIMD(lo, rays.m_Start[iAxis]), rays.m_InvDelta[iAxis]);
+    fltx4 t2 =
+        MulSIMD(SubSIMD(hi, rays.m_Start[iAxis]), rays.m_InvDelta[iAxis]);
+    tMin = MaxSIMD(tMin, MinSIMD(t1, t2));
+    tMax = MinSIMD(tMax, MaxSIMD(t1, t2));
+  }
+  return TestSignSIMD(CmpLeSIMD(tMin, tMax));
+}
+
+//-----------------------------------------------------------------------------
+// Traces a group of rays. Swept rays are grouped by the leaf they start in,
+// each group shares a leaf list and an entity list; everything else goes
+// through TraceRay.
+//-----------------------------------------------------------------------------
+void CEngineTrace::TraceRays(const Ray_t *pRays, int nRayCount,
+                             unsigned int fMask, ITraceFilter *pTraceFilter,
+                             trace_t *pTraces) {
+  CUtlVector<TraceBatchRay_t> order;
+  if (trace_batch.GetBool() && nRayCount > 1) {
+    order.EnsureCapacity(nRayCount);
+    for (int i = 0; i < nRayCount; ++i) {
+      if (!pRays[i].m_IsSwept) {
+        TraceRay(pRays[i], fMask, pTraceFilter, &pTraces[i]);
+        continue;
+      }
+
+      TraceBatchRay_t &entry = order[order.AddToTail()];
+      entry.m_nLeaf = CM_PointLeafnum(pRays[i].m_Start);
+      entry.m_iRay = i;
+    }
+    order.Sort(TraceBatchRayCompare);
+  } else {
+    for (int i = 0; i < nRayCount; ++i) {
+      TraceRay(pRays[i], fMask, pTraceFilter, &pTraces[i]);
+    }
+  }
+
+  CUtlVector<int> batch;
+  for (int i = 0; i < order.Count();) {
+    batch.RemoveAll();
+    int nLeaf = order[i].m_nLeaf;
+    for (; i < order.Count() && order[i].m_nLeaf == nLeaf; ++i) {
+      batch.AddToTail(order[i].m_iRay);
+    }
+
+    if (batch.Count() > 1 &&
+        TraceRayBatch(pRays, batch.Base(), batch.Count(), fMask, pTraceFilter,
+                      pTraces))
+      continue;
+
+    for (int j = 0; j < batch.Count(); ++j) {
+      TraceRay(pRays[batch[j]], fMask, pTraceFilter, &pTraces[batch[j]]);
+    }
+  }
+}
+
+bool CEngineTrace::TraceRayBatch(const Ray_t *pRays, const int *pRayIndices,
+                                 int nRayCount, unsigned int fMask,
+                                 ITraceFilter *pTraceFilter, trace_t *pTraces) {
+  // Only worth it if the rays overlap. When the joint bounds are bigger than
+  // the bounds of the rays put together, the shared lists hold leaves and
+  // entities none of the rays go near.
+  Vector vecBatchMins, vecBatchMaxs;
+  ClearBounds(vecBatchMins, vecBatchMaxs);
+  float flRaySize = 0;
+  for (int i = 0; i < nRayCount; ++i) {
+    const Ray_t &ray = pRays[pRayIndices[i]];
+    Vector vecEnd, vecMins, vecMaxs;
+    VectorAdd(ray.m_Start, ray.m_Delta, vecEnd);
+    VectorMin(ray.m_Start, vecEnd, vecMins);
+    VectorMax(ray.m_Start, vecEnd, vecMaxs);
+    vecMins -= ray.m_Extents;
+    vecMaxs += ray.m_Extents;
+    AddPointToBounds(vecMins, vecBatchMins, vecBatchMaxs);
+    AddPointToBounds(vecMaxs, vecBatchMins, vecBatchMaxs);
+
+    Vector vecSize = vecMaxs - vecMins;
+    flRaySize += vecSize.x + vecSize.y + vecSize.z;
+  }
+
+  Vector vecBatchSize = vecBatchMaxs - vecBatchMins;
+  if (vecBatchSize.x + vecBatchSize.y + vecBatchSize.z > flRaySize)
+    return false;
+
+  vecBatchMins -= Vector(1, 1, 1);
+  vecBatchMaxs += Vector(1, 1, 1);
+
+  CTraceFilterHitAll traceFilter;
+  if (!pTraceFilter) {
+    pTraceFilter = &traceFilter;
+  }
+
+  bool bTraceWorld = pTraceFilter->GetTraceType() != TRACE_ENTITIES_ONLY;
+  bool bTraceEntities = pTraceFilter->GetTraceType() != TRACE_WORLD_ONLY;
+
+  // NOTE: Local, hitbox traces can re-enter through the IK code.
+  CTraceListData traceData;
+  if (bTraceWorld) {
+    int iTopNode = -1;
+    traceData.m_nLeafCount =
+        CM_BoxLeafnums(vecBatchMins, vecBatchMaxs, traceData.m_aLeafList.Base(),
+                       traceData.LeafCountMax(), &iTopNode);
+
+    // A full list may have been cut short.
+    if (traceData.LeafCount() >= traceData.LeafCountMax()) return false;
+  }
+
+#if defined _DEBUG && !defined SWDS
+  if (debugrayenable.GetBool() && ThreadInMainThread()) {
+    for (int i = 0; i < nRayCount; ++i) {
+      s_FrameRays.AddToTail(pRays[pRayIndices[i]]);
+    }
+  }
 #endif
 
-  if (!ray.m_IsRay) {
-    // Make sure no fractionleftsolid can be used with box sweeps
-    VectorAdd(ray.m_Start, ray.m_StartOffset, pTrace->startpos);
-    pTrace->fractionleftsolid = 0;
+  VPROF_INCREMENT_COUNTER("TraceRay", nRayCount);
+  m_traceStatCounters[TRACE_STAT_COUNTER_TRACERAY] += nRayCount;
+
+  // Collide with the world, one leaf list for all rays.
+  CUtlVector<Ray_t> entityRays;
+  CUtlVector<int> entityRayIndices;
+  CUtlVector<float> worldFractions;
+  entityRays.EnsureCapacity(nRayCount);
+  entityRayIndices.EnsureCapacity(nRayCount);
+  worldFractions.EnsureCapacity(2 * nRayCount);
+
+  ICollideable *pWorldCollide = bTraceWorld ? GetWorldCollideable() : NULL;
+  for (int i = 0; i < nRayCount; ++i) {
+    const Ray_t &ray = pRays[pRayIndices[i]];
+    trace_t *pTrace = &pTraces[pRayIndices[i]];
+
+    CM_ClearTrace(pTrace);
+
+    if (bTraceWorld) {
+      Assert(!pWorldCollide ||
+             pWorldCollide->GetCollisionOrigin() == vec3_origin);
+      Assert(!pWorldCollide ||
+             pWorldCollide->GetCollisionAngles() == vec3_angle);
+
+      CM_BoxTraceAgainstLeafList(ray, traceData.m_aLeafList.Base(),
+                                 traceData.LeafCount(), fMask, true, *pTrace);
+      SetTraceEntity(pWorldCollide, pTrace);
+
+      // inside world, no need to check being inside anything else
+      if (pTrace->startsolid || !bTraceEntities) continue;
+    } else {
+      VectorAdd(ray.m_Start, ray.m_StartOffset, pTrace->startpos);
+      VectorAdd(pTrace->startpos, ray.m_Delta, pTrace->endpos);
+    }
+
+    float flWorldFraction, flWorldFractionLeftSolidScale;
+    SetupEntityRay(ray, pTrace, entityRays[entityRays.AddToTail()],
+                   flWorldFraction, flWorldFractionLeftSolidScale);
+    entityRayIndices.AddToTail(pRayIndices[i]);
+    worldFractions.AddToTail(flWorldFraction);
+    worldFractions.AddToTail(flWorldFractionLeftSolidScale);
+  }
+
+  int nEntityRays = entityRays.Count();
+  if (!nEntityRays) return true;
+
+  // Pack the shortened rays four to a lane group, padding the last group with
+  // copies of its final ray.
+  int nGroups = (nEntityRays + 3) / 4;
+  CUtlVector<FourRays_t, CUtlMemoryAligned<FourRays_t, 16> > groups;
+  CUtlVector<int> groupMasks;
+  groups.SetCount(nGroups);
+  groupMasks.SetCount(nGroups);
+  for (int g = 0; g < nGroups; ++g) {
+    const Ray_t *pLane[4];
+    VectorAligned vecInvDelta[4], vecExtents[4];
+    groupMasks[g] = 0;
+    for (int j = 0; j < 4; ++j) {
+      int k = std::min(4 * g + j, nEntityRays - 1);
+      if (4 * g + j < nEntityRays) groupMasks[g] |= 1 << j;
+      pLane[j] = &entityRays[k];
+      vecInvDelta[j] = pLane[j]->InvDelta();
+      VectorAdd(pLane[j]->m_Extents, Vector(1, 1, 1), vecExtents[j]);
+    }
+    groups[g].m_Start.LoadAndSwizzle(pLane[0]->m_Start, pLane[1]->m_Start,
+                                     pLane[2]->m_Start, pLane[3]->m_Start);
+    groups[g].m_InvDelta.LoadAndSwizzle(vecInvDelta[0], vecInvDelta[1],
+                                        vecInvDelta[2], vecInvDelta[3]);
+    groups[g].m_Extents.LoadAndSwizzle(vecExtents[0], vecExtents[1],
+                                       vecExtents[2], vecExtents[3]);
+  }
+
+  // Collide with the entities near any of the rays. The filter is asked once
+  // per entity, the clip only runs for rays whose lanes touch its bounds.
+  SpatialPartition()->EnumerateElementsInBox(
+      SpatialPartitionMask(), vecBatchMins, vecBatchMaxs, false, &traceData);
+
+  bool bNoStaticProps = pTraceFilter->GetTraceType() == TRACE_ENTITIES_ONLY;
+  bool bFilterStaticProps =
+      pTraceFilter->GetTraceType() == TRACE_EVERYTHING_FILTER_PROPS;
+
+  trace_t tr;
+  ICollideable *pCollideable;
+  const char *pDebugName;
+  for (int iEntity = 0; iEntity < traceData.m_nEntityCount; ++iEntity) {
+    IHandleEntity *pHandleEntity = traceData.m_aEntityList[iEntity];
+    HandleEntityToCollideable(pHandleEntity, &pCollideable, &pDebugName);
 
 #ifdef _DEBUG
-    pTrace->fractionleftsolid = FLOAT32_NAN;
+    // Check for error condition
+    if (!IsSolid(pCollideable->GetSolid(), pCollideable->GetSolidFlags())) {
+      Assert(0);
+      Msg("%s in solid list (not solid)\n", pDebugName);
+      continue;
+    }
 #endif
+
+    if (!StaticPropMgr()->IsStaticProp(pHandleEntity)) {
+      if (!pTraceFilter->ShouldHitEntity(pHandleEntity, fMask)) continue;
+    } else {
+      if (bNoStaticProps) continue;
+
+      if (bFilterStaticProps) {
+        if (!pTraceFilter->ShouldHitEntity(pHandleEntity, fMask)) continue;
+      }
+    }
+
+    Vector vecMins, vecMaxs;
+    pCollideable->WorldSpaceSurroundingBounds(&vecMins, &vecMaxs);
+
+    for (int g = 0; g < nGroups; ++g) {
+      int nLanes = groupMasks[g] & FourRaysIntersectBox(groups[g], vecMins,
+                                                         vecMaxs);
+      for (int j = 0; nLanes; ++j, nLanes >>= 1) {
+        if (!(nLanes & 1)) continue;
+
+        int k = 4 * g + j;
+        trace_t *pTrace = &pTraces[entityRayIndices[k]];
+        ClipRayToCollideable(entityRays[k], fMask, pCollideable, &tr);
+
+        // Make sure the ray is always shorter than it currently is
+        ClipTraceToTrace(tr, pTrace);
+
+        // Stop this ray if we're in allsolid
+        if (pTrace->allsolid) groupMasks[g] &= ~(1 << j);
+      }
+    }
+  }
+
+  for (int k = 0; k < nEntityRays; ++k) {
+    int iRay = entityRayIndices[k];
+    FinishEntityTrace(pRays[iRay], worldFractions[2 * k],
+                      worldFractions[2 * k + 1], &pTraces[iRay]);
+  }
+
+  return true;
+}
+
+static ConVar trace_async_jobs(
+    "trace_async_jobs", "0", 0,
+    "Jobs per TraceRaysAsync call, 0 uses one per thread pool thread.");
+
+struct TraceJob_t {
+  const Ray_t *m_pRays;
+  trace_t *m_pTraces;
+  ITraceFilter *m_pTraceFilter;
+  unsigned int m_fMask;
+  int m_nRayCount;
+  SpatialPartitionListMask_t m_nListMask;
+
+  CInterlockedInt m_nNextChunk;
+  CInterlockedInt m_nJobsRunning;
+  CUtlVector<CJob *> m_Jobs;
+};
+
+//-----------------------------------------------------------------------------
+// Async traces. The partition is read shared for the whole job: the read lock
+// is taken once at submission and dropped by the last job to finish, the job
+// threads query without touching it.
+//-----------------------------------------------------------------------------
+TraceJobHandle_t CEngineTrace::TraceRaysAsync(const Ray_t *pRays,
+                                              int nRayCount, unsigned int fMask,
+                                              ITraceFilter *pTraceFilter,
+                                              trace_t *pTraces) {
+  int nJobs = trace_async_jobs.GetInt();
+  if (nJobs <= 0) nJobs = g_pThreadPool ? g_pThreadPool->NumThreads() : 0;
+  return QueueTraceJob(pRays, nRayCount, fMask, pTraceFilter, pTraces, nJobs);
+}
+
+TraceJobHandle_t CEngineTrace::QueueTraceJob(const Ray_t *pRays, int nRayCount,
+                                             unsigned int fMask,
+                                             ITraceFilter *pTraceFilter,
+                                             trace_t *pTraces, int nJobs) {
+  TraceJob_t *pJob = new TraceJob_t;
+  pJob->m_pRays = pRays;
+  pJob->m_pTraces = pTraces;
+  pJob->m_pTraceFilter = pTraceFilter;
+  pJob->m_fMask = fMask;
+  pJob->m_nRayCount = nRayCount;
+  pJob->m_nListMask = SpatialPartitionMask();
+  pJob->m_nNextChunk = 0;
+
+  int nChunks = (nRayCount + TRACE_JOB_RAYS - 1) / TRACE_JOB_RAYS;
+  // Without pool threads queued jobs would only run in FinishTraceJob, and
+  // the shared read would block partition writers until then.
+  if (!g_pThreadPool || g_pThreadPool->NumThreads() <= 0) nJobs = 0;
+  nJobs = std::min(nJobs, nChunks);
+
+  SpatialPartition()->BeginSharedRead(pJob->m_nListMask);
+
+  if (nJobs <= 0) {
+    pJob->m_nJobsRunning = 1;
+    RunTraceJob(pJob);
+    return pJob;
+  }
+
+  pJob->m_nJobsRunning = nJobs;
+  pJob->m_Jobs.EnsureCapacity(nJobs);
+  for (int i = 0; i < nJobs; ++i) {
+    pJob->m_Jobs.AddToTail(
+        g_pThreadPool->QueueCall(this, &CEngineTrace::RunTraceJob, pJob));
+  }
+  return pJob;
+}
+
+void CEngineTrace::RunTraceJob(TraceJob_t *pJob) {
+  SpatialPartition()->JoinSharedRead(pJob->m_nListMask, true);
+
+  {
+    // Traces read studio and collision data the MDL cache could evict.
+    MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
+
+    while (true) {
+      int iFirstRay = (pJob->m_nNextChunk++) * TRACE_JOB_RAYS;
+      if (iFirstRay >= pJob->m_nRayCount) break;
+
+      TraceRays(pJob->m_pRays + iFirstRay,
+                std::min(TRACE_JOB_RAYS, pJob->m_nRayCount - iFirstRay),
+                pJob->m_fMask, pJob->m_pTraceFilter,
+                pJob->m_pTraces + iFirstRay);
+    }
+  }
+
+  SpatialPartition()->JoinSharedRead(pJob->m_nListMask, false);
+
+  // The last job out lets partition writers back in.
+  if (--pJob->m_nJobsRunning == 0) {
+    SpatialPartition()->EndSharedRead(pJob->m_nListMask);
+  }
+}
+
+bool CEngineTrace::IsTraceJobDone(TraceJobHandle_t hJob) {
+  return hJob->m_nJobsRunning == 0;
+}
+
+void CEngineTrace::FinishTraceJob(TraceJobHandle_t hJob) {
+  if (hJob->m_Jobs.Count()) {
+    g_pThreadPool->YieldWait(hJob->m_Jobs.Base(), hJob->m_Jobs.Count());
+    for (int i = 0; i < hJob->m_Jobs.Count(); ++i) {
+      hJob->m_Jobs[i]->Release();
+    }
   }
+
+  Assert(IsTraceJobDone(hJob));
+  delete hJob;
 }
 
 //-----------------------------------------------------------------------------
@@ -1723,15 +2315,15 @@ void CEngineTrace::SweepCollideable(ICollideable *pCollide,
                                     const QAngle &vecAngles, unsigned int fMask,
                                     ITraceFilter *pTraceFilter,
                                     trace_t *pTrace) {
-  const matrix3x4_t *pOldRoot = m_pRootMoveParent;
+  const matrix3x4_t *pOldRoot = s_pRootMoveParent;
   Ray_t ray;
   Assert(vecAngles == vec3_angle);
   if (pCollide->GetSolidFlags() & FSOLID_ROOT_PARENT_ALIGNED) {
-    m_pRootMoveParent = pCollide->GetRootParentToWorldTransform();
+    s_pRootMoveParent = pCollide->GetRootParentToWorldTransform();
   }
   ray.Init(vecAbsStart, vecAbsEnd, pCollide->OBBMins(), pCollide->OBBMaxs());
   TraceRay(ray, fMask, pTraceFilter, pTrace);
-  m_pRootMoveParent = pOldRoot;
+  s_pRootMoveParent = pOldRoot;
 }
 
 //-----------------------------------------------------------------------------
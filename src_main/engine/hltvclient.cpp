@@ -346,9 +346,6 @@ void CHLTVClient::UpdateUserSettings() {
 void CHLTVClient::SendSnapshot(CClientFrame *pFrame) {
   VPROF_BUDGET("CHLTVClient::SendSnapshot", "HLTV");
 
-  byte buf[NET_MAX_PAYLOAD];
-  bf_write msg("CHLTVClient::SendSnapshot", buf, sizeof(buf));
-
   // if we send a full snapshot (no delta-compression) before, wait until client
   // received and acknowledge that update. don't spam client with full updates
 
@@ -388,34 +385,28 @@ void CHLTVClient::SendSnapshot(CClientFrame *pFrame) {
     pLastFrame = (CHLTVFrame *)pLastFrame->m_pNext;
   }
 
-  // now create client snapshot packet
-
-  // send tick time
-  NET_Tick tickmsg(pFrame->tick_count, host_frametime_unbounded,
-                   host_frametime_stddeviation);
-  tickmsg.WriteToBuffer(msg);
-
-  // Update shared client/server string tables. Must be done before sending
-  // entities
-  m_Server->m_StringTables->WriteUpdateMessage(NULL, GetMaxAckTickCount(), msg);
-
-  // TODO delta cache whole snapshots, not just packet entities. then use
-  // net_Align send entity update, delta compressed if deltaFrame != NULL
-  m_Server->WriteDeltaEntities(this, pFrame, pDeltaFrame, msg);
+  // now create client snapshot packet, or pick up the one already encoded
+  // for another client in the same state
+  CHLTVSnapshotMsg *pMsg = m_pHLTV->GetSnapshotMsg(
+      this, pFrame, pDeltaFrame, tv_sharedframes.GetBool());
 
   // write message to packet and check for overflow
-  if (msg.IsOverflowed()) {
+  if (pMsg->m_bOverflowed) {
     if (!pDeltaFrame) {
       // if this is a reliable snapshot, drop the client
+      pMsg->Release();
       Disconnect("ERROR! Reliable snapshot overflow.");
       return;
     } else {
       // unreliable snapshots may be dropped
       ConMsg("WARNING: msg overflowed for %s\n", m_Name);
-      msg.Reset();
     }
   }
 
+  // the shared bytes are only ever read from here on
+  bf_write msg("CHLTVClient::SendSnapshot", pMsg->m_pData, pMsg->m_nBytes);
+  msg.SeekToBit(pMsg->m_nBits);
+
   // remember this snapshot
   m_pLastSnapshot = pFrame->GetSnapshot();
   m_nLastSendTick = pFrame->tick_count;
@@ -423,6 +414,7 @@ void CHLTVClient::SendSnapshot(CClientFrame *pFrame) {
   // Don't send the datagram to fakeplayers
   if (m_bFakePlayer) {
     m_nDeltaTick = pFrame->tick_count;
+    pMsg->Release();
     return;
   }
 
@@ -442,6 +434,8 @@ void CHLTVClient::SendSnapshot(CClientFrame *pFrame) {
     bSendOK = m_NetChannel->SendDatagram(&msg) > 0;
   }
 
+  pMsg->Release();
+
   if (!bSendOK) {
     Disconnect("ERROR! Couldn't send snapshot.");
   }
@@ -21,6 +21,12 @@
  
 #include "tier0/include/memdbgon.h"
 
+static ConVar tv_demo_keyframe_interval(
+    "tv_demo_keyframe_interval", "0", 0,
+    "Seconds between seekable keyframes in SourceTV demos, 0 = off. Demos with "
+    "keyframes need an engine that knows demo protocol 4.",
+    true, 0.0f, false, 0.0f);
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
@@ -90,6 +96,7 @@ void CHLTVDemoRecorder::StartRecording(const char *filename,
 
   m_SequenceInfo = 1;
   m_nDeltaTick = -1;
+  m_nNextKeyframeTick = 0;
 }
 
 bool CHLTVDemoRecorder::IsRecording() { return m_bIsRecording; }
@@ -100,6 +107,9 @@ void CHLTVDemoRecorder::StopRecording() {
   // Demo playback should read this as an incoming message.
   m_DemoFile.WriteCmdHeader(dem_stop, GetRecordingTick());
 
+  // seek index goes after dem_stop, readers stop before it
+  m_DemoFile.WriteKeyframeIndex();
+
   // update demo header info
   m_DemoFile.m_DemoHeader.playback_ticks = GetRecordingTick();
   m_DemoFile.m_DemoHeader.playback_time =
@@ -301,6 +311,41 @@ void CHLTVDemoRecorder::WriteFrame(CHLTVFrame *pFrame) {
 
   // write packet to demo file
   WriteMessages(dem_packet, msg);
+
+  float flInterval = tv_demo_keyframe_interval.GetFloat();
+  if (flInterval > 0 && GetRecordingTick() >= m_nNextKeyframeTick) {
+    // after the packet, so the next packet deltas from the keyframe's tick
+    WriteKeyframe(pFrame);
+    m_nNextKeyframeTick =
+        GetRecordingTick() +
+        std::max(1, (int)(flInterval / host_state.interval_per_tick));
+  }
+}
+
+void CHLTVDemoRecorder::WriteKeyframe(CHLTVFrame *pFrame) {
+  byte buffer[NET_MAX_PAYLOAD];
+  bf_write msg("CHLTVDemo::WriteKeyframe", buffer, sizeof(buffer));
+
+  // send tick time
+  NET_Tick tickmsg(pFrame->tick_count, host_frametime_unbounded,
+                   host_frametime_stddeviation);
+  tickmsg.WriteToBuffer(msg);
+
+#ifndef SHARED_NET_STRING_TABLES
+  // everything that changed since the signon baselines
+  sv.m_StringTables->WriteUpdateMessage(NULL, m_nSignonTick, msg);
+#endif
+
+  // full entity update
+  sv.WriteDeltaEntities(hltv->m_MasterClient, pFrame, NULL, msg);
+
+  if (msg.IsOverflowed()) {
+    DevMsg("CHLTVDemoRecorder::WriteKeyframe: tick %i doesn't fit.\n",
+           pFrame->tick_count);
+    return;
+  }
+
+  WriteMessages(dem_keyframe, msg);
 }
 
 void CHLTVDemoRecorder::WriteMessages(unsigned char cmd, bf_write &message) {
@@ -36,6 +36,8 @@ class CHLTVDemoRecorder : public IDemoRecorder {
 
  public:
   void WriteFrame(CHLTVFrame *pFrame);
+  // Full entity and string table state of pFrame as a dem_keyframe.
+  void WriteKeyframe(CHLTVFrame *pFrame);
   void CloseFile();
   void Reset();
 
@@ -53,6 +55,7 @@ class CHLTVDemoRecorder : public IDemoRecorder {
   int m_SequenceInfo;
   int m_nDeltaTick;
   int m_nSignonTick;
+  int m_nNextKeyframeTick;  // recording tick of the next dem_keyframe
   bf_write m_MessageData;  // temp buffer for all network messages
 };
 
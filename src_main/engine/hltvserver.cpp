@@ -27,6 +27,7 @@
 #include "sv_main.h"
 #include "sv_master_legacy.h"
 #include "sv_steamauth.h"
+#include "tier0/include/fasttimer.h"
 #include "tier0/include/icommandline.h"
 #include "tier0/include/vcrmode.h"
 #include "tier0/include/vprof.h"
@@ -78,6 +79,9 @@ static ConVar tv_deltacache("tv_deltacache", "2", 0,
                             "Enable delta entity bit stream cache");
 static ConVar tv_relayvoice("tv_relayvoice", "1", 0,
                             "Relay voice data: 0=off, 1=on");
+ConVar tv_sharedframes("tv_sharedframes", "1", 0,
+                       "Encode each snapshot once per delta state and send "
+                       "the same bytes to all matching clients");
 
 CDeltaEntityCache::CDeltaEntityCache() {
   Q_memset(m_Cache, 0, sizeof(m_Cache));
@@ -185,6 +189,38 @@ void CDeltaEntityCache::AddDeltaBits(int nEntityIndex, int nDeltaTick,
   }
 }
 
+bool CHLTVSnapshotMsg::Key_t::operator==(const Key_t &other) const {
+  return nTick == other.nTick && nDeltaTick == other.nDeltaTick &&
+         nAckTick == other.nAckTick && nBaselineCRC == other.nBaselineCRC &&
+         nBaselineUsed == other.nBaselineUsed &&
+         bBaselinePending == other.bBaselinePending;
+}
+
+CHLTVSnapshotMsg::CHLTVSnapshotMsg(const Key_t &key, bf_write &msg) {
+  m_Key = key;
+  m_bOverflowed = msg.IsOverflowed();
+  m_nBits = m_bOverflowed ? 0 : msg.GetNumBitsWritten();
+
+  // bf_write works on whole dwords
+  m_nBytes = std::max(SOURCE_PAD_NUMBER(Bits2Bytes(m_nBits), 4), 4);
+  m_pData = (u8 *)malloc(m_nBytes);
+  Q_memset(m_pData, 0, m_nBytes);
+  if (m_nBits > 0) Q_memcpy(m_pData, msg.GetData(), Bits2Bytes(m_nBits));
+
+  m_nBaselineUpdateTick = -1;
+}
+
+CHLTVSnapshotMsg::~CHLTVSnapshotMsg() { free(m_pData); }
+
+void CHLTVSnapshotMsg::ApplyBaselineState(CBaseClient *client) const {
+  // A pending baseline update isn't touched by WriteDeltaEntities, otherwise
+  // it clears m_BaselinesSent and may start a new update.
+  if (m_Key.bBaselinePending) return;
+
+  client->m_BaselinesSent = m_BaselinesSent;
+  client->m_nBaselineUpdateTick = m_nBaselineUpdateTick;
+}
+
 static RecvTable *FindRecvTable(const char *pName, RecvTable **pRecvTables,
                                 int nRecvTables) {
   for (int i = 0; i < nRecvTables; i++) {
@@ -418,6 +454,8 @@ CHLTVServer::CHLTVServer() {
   m_nGlobalSlots = 0;
   m_nGlobalClients = 0;
   m_nGlobalProxies = 0;
+  m_nSnapshotMsgsEncoded = 0;
+  m_nSnapshotMsgsShared = 0;
 }
 
 CHLTVServer::~CHLTVServer() {
@@ -1162,6 +1200,8 @@ CClientFrame *CHLTVServer::AddNewFrame(CClientFrame *clientFrame) {
 }
 
 void CHLTVServer::SendClientMessages(bool bSendSnapshots) {
+  NET_BeginSendBatch();
+
   // build individual updates
   for (int i = 0; i < m_Clients.Count(); i++) {
     CHLTVClient *client = Client(i);
@@ -1183,6 +1223,157 @@ void CHLTVServer::SendClientMessages(bool bSendSnapshots) {
     client->UpdateSendState();
     client->m_fLastSendTime = net_time;
   }
+
+  NET_EndSendBatch();
+
+  FlushSnapshotMsgs();
+}
+
+CHLTVSnapshotMsg *CHLTVServer::GetSnapshotMsg(CHLTVClient *client,
+                                              CClientFrame *pFrame,
+                                              CClientFrame *pDeltaFrame,
+                                              bool bShared) {
+  CHLTVSnapshotMsg::Key_t key;
+  key.nTick = pFrame->tick_count;
+  key.nDeltaTick = pDeltaFrame ? pDeltaFrame->tick_count : -1;
+  key.nAckTick = client->GetMaxAckTickCount();
+  key.nBaselineCRC = client->m_nBaselineCRC;
+  key.nBaselineUsed = client->m_nBaselineUsed;
+  key.bBaselinePending = client->m_nBaselineUpdateTick != -1;
+
+  if (bShared) {
+    for (int i = 0; i < m_SnapshotMsgs.Count(); i++) {
+      CHLTVSnapshotMsg *pMsg = m_SnapshotMsgs[i];
+
+      if (!(pMsg->m_Key == key)) continue;
+
+      pMsg->ApplyBaselineState(client);
+      pMsg->AddRef();
+      m_nSnapshotMsgsShared++;
+      return pMsg;
+    }
+  }
+
+  VPROF_BUDGET("CHLTVServer::GetSnapshotMsg", "HLTV");
+
+  byte buf[NET_MAX_PAYLOAD];
+  bf_write msg("CHLTVServer::GetSnapshotMsg", buf, sizeof(buf));
+
+  // send tick time
+  NET_Tick tickmsg(pFrame->tick_count, host_frametime_unbounded,
+                   host_frametime_stddeviation);
+  tickmsg.WriteToBuffer(msg);
+
+  // Update shared client/server string tables. Must be done before sending
+  // entities
+  m_StringTables->WriteUpdateMessage(NULL, key.nAckTick, msg);
+
+  // TODO delta cache whole snapshots, not just packet entities. then use
+  // net_Align send entity update, delta compressed if deltaFrame != NULL
+  WriteDeltaEntities(client, pFrame, pDeltaFrame, msg);
+
+  CHLTVSnapshotMsg *pMsg = new CHLTVSnapshotMsg(key, msg);
+  pMsg->m_nBaselineUpdateTick = client->m_nBaselineUpdateTick;
+  pMsg->m_BaselinesSent = client->m_BaselinesSent;
+  m_nSnapshotMsgsEncoded++;
+
+  if (bShared) {
+    // one reference for the cache, one for the caller
+    pMsg->AddRef();
+    m_SnapshotMsgs.AddToTail(pMsg);
+  }
+
+  return pMsg;
+}
+
+void CHLTVServer::FlushSnapshotMsgs() {
+  for (int i = 0; i < m_SnapshotMsgs.Count(); i++) {
+    m_SnapshotMsgs[i]->Release();
+  }
+
+  m_SnapshotMsgs.RemoveAll();
+}
+
+void CHLTVServer::BenchmarkSharedFrames(int nSpectators, int nDeltas) {
+  if (!m_CurrentFrame) {
+    ConMsg("No SourceTV frame to encode yet.\n");
+    return;
+  }
+
+  // stand-ins delta from the frames before the current one, like spectators
+  // that acknowledged different ticks
+  CUtlVector<CClientFrame *> deltaFrames;
+  CClientFrame *pDelta = m_CurrentFrame;
+  while (deltaFrames.Count() < nDeltas) {
+    pDelta = GetClientFrame(pDelta->tick_count - 1, false);
+    if (!pDelta) break;
+    deltaFrames.AddToTail(pDelta);
+  }
+
+  if (deltaFrames.Count() == 0) deltaFrames.AddToTail(NULL);  // full updates
+
+  // all stand-ins start from the same empty baseline
+  CFrameSnapshot *pBaseline =
+      framesnapshotmanager->CreateEmptySnapshot(0, MAX_EDICTS);
+
+  CUtlVector<CHLTVClient *> spectators;
+  for (int i = 0; i < nSpectators; i++) {
+    CHLTVClient *pClient = new CHLTVClient(i, this);
+    pBaseline->AddReference();
+    pClient->m_pBaseline = pBaseline;
+    spectators.AddToTail(pClient);
+  }
+
+  int nEncoded = m_nSnapshotMsgsEncoded;
+  int nShared = m_nSnapshotMsgsShared;
+  int nBits = 0;
+  double flTime[2];
+
+  for (int pass = 0; pass < 2; pass++) {
+    bool bShared = pass == 1;
+    nBits = 0;
+
+    CFastTimer timer;
+    timer.Start();
+
+    for (int i = 0; i < nSpectators; i++) {
+      CHLTVClient *pClient = spectators[i];
+      CClientFrame *pDeltaFrame = deltaFrames[i % deltaFrames.Count()];
+
+      pClient->m_nDeltaTick = pDeltaFrame ? pDeltaFrame->tick_count : -1;
+      pClient->m_nBaselineUpdateTick = -1;
+
+      CHLTVSnapshotMsg *pMsg =
+          GetSnapshotMsg(pClient, m_CurrentFrame, pDeltaFrame, bShared);
+      nBits += pMsg->m_nBits;
+      pMsg->Release();
+    }
+
+    FlushSnapshotMsgs();
+
+    timer.End();
+    flTime[pass] = timer.GetDuration().GetMillisecondsF();
+  }
+
+  ConMsg("%i spectators, %i delta ticks, %i bytes per snapshot\n", nSpectators,
+         deltaFrames.Count(), Bits2Bytes(nBits / std::max(nSpectators, 1)));
+  ConMsg("  per client: %.2f ms\n", flTime[0]);
+  ConMsg("  shared:     %.2f ms (%i encodes)\n", flTime[1],
+         m_nSnapshotMsgsEncoded - nEncoded - nSpectators);
+  ConMsg("Encoding only, the per client net channel sends are not included.\n");
+
+  m_nSnapshotMsgsEncoded = nEncoded;
+  m_nSnapshotMsgsShared = nShared;
+
+  // WriteDeltaEntities left a pointer to a stand-in here
+  m_CurrentFrame->from_baseline = NULL;
+
+  for (int i = 0; i < nSpectators; i++) {
+    spectators[i]->FreeBaselines();
+    delete spectators[i];
+  }
+
+  pBaseline->ReleaseReference();
 }
 
 void CHLTVServer::UpdateStats(void) {
@@ -1410,6 +1601,9 @@ void CHLTVServer::Clear(void) {
 
   m_DeltaCache.Flush();
   m_FrameCache.RemoveAll();
+  FlushSnapshotMsgs();
+  m_nSnapshotMsgsEncoded = 0;
+  m_nSnapshotMsgsShared = 0;
 }
 
 void CHLTVServer::Init(bool bIsDedicated) {
@@ -1576,6 +1770,10 @@ void CHLTVServer::ReadCompeleteDemoFile() {
         m_DemoFile.ReadUserCmd(user_cmd_buffer, length);
         // MOTODO HLTV must store user commands too
       } break;
+      case dem_keyframe:
+        // every frame is read anyway
+        m_DemoFile.SkipPacket();
+        break;
       case dem_signon:
       case dem_packet: {
         int inseq, outseqack = 0;
@@ -1694,6 +1892,11 @@ CON_COMMAND(tv_status, "Show SourceTV server status.") {
   ConMsg("Total Slots %i, Spectators %i, Proxies %i\n", slots,
          clients - proxies, proxies);
 
+  if (tv_sharedframes.GetBool()) {
+    ConMsg("Snapshots encoded %i, shared %i\n", hltv->m_nSnapshotMsgsEncoded,
+           hltv->m_nSnapshotMsgsShared);
+  }
+
   if (hltv->m_DemoRecorder.IsRecording()) {
     ConMsg("Recording to \"%s\", length %s.\n",
            hltv->m_DemoRecorder.GetDemoFile()->m_szFileName,
@@ -1844,6 +2047,21 @@ CON_COMMAND(tv_clients, "Shows list of connected SourceTV clients.") {
   ConMsg("--- Total %i connected clients ---\n", nCount);
 }
 
+CON_COMMAND(tv_sharedframes_bench,
+            "Times snapshot encoding for stand-in spectators with and without "
+            "tv_sharedframes.") {
+  if (!hltv || !hltv->IsActive()) {
+    ConMsg("SourceTV not active.\n");
+    return;
+  }
+
+  int nSpectators = args.ArgC() > 1 ? atoi(args[1]) : 1000;
+  int nDeltas = args.ArgC() > 2 ? atoi(args[2]) : 4;
+
+  hltv->BenchmarkSharedFrames(std::clamp(nSpectators, 1, 100000),
+                              std::clamp(nDeltas, 0, 64));
+}
+
 CON_COMMAND(tv_msg, "Send a screen message to all clients.") {
   if (!hltv || !hltv->IsActive()) {
     ConMsg("SourceTV not active.\n");
@@ -12,6 +12,7 @@
 #include "hltvdemo.h"
 #include "ihltv.h"
 #include "networkstringtable.h"
+#include "tier1/refcount.h"
 
 #define HLTV_BUFFER_DIRECTOR 0    // director commands
 #define HLTV_BUFFER_RELIABLE 1    // reliable messages
@@ -27,6 +28,7 @@
 #define DISPATCH_MODE_ALWAYS 2
 
 extern ConVar tv_debug;
+extern ConVar tv_sharedframes;
 
 class CHLTVFrame : public CClientFrame {
  public:
@@ -75,6 +77,40 @@ class CDeltaEntityCache {
   DeltaEntityEntry_s *m_Cache[MAX_EDICTS];
 };
 
+// A client snapshot message encoded once and sent unchanged to every client
+// with the same delta tick, string table ack tick and baselines. Immutable
+// once built, lives until the send pass that built it is over.
+class CHLTVSnapshotMsg : public CRefCounted<> {
+ public:
+  struct Key_t {
+    int nTick;           // snapshot tick
+    int nDeltaTick;      // delta frame tick or -1 for a full update
+    int nAckTick;        // string table changes are sent from here
+    CRC32_t nBaselineCRC;  // CBaseClient::m_nBaselineCRC
+    int nBaselineUsed;
+    bool bBaselinePending;  // baseline update still unacknowledged
+
+    bool operator==(const Key_t &other) const;
+  };
+
+  CHLTVSnapshotMsg(const Key_t &key, bf_write &msg);
+  ~CHLTVSnapshotMsg();
+
+  // Gives client the baseline state encoding this message left behind.
+  void ApplyBaselineState(CBaseClient *client) const;
+
+ public:
+  Key_t m_Key;
+  u8 *m_pData;
+  int m_nBytes;  // size of m_pData, whole dwords
+  int m_nBits;
+  bool m_bOverflowed;
+
+  // baseline state of the encoding client afterwards
+  int m_nBaselineUpdateTick;
+  CBitVec<MAX_EDICTS> m_BaselinesSent;
+};
+
 class CGameClient;
 class CGameServer;
 class IHLTVDirector;
@@ -180,6 +216,15 @@ class CHLTVServer : public IGameEventListener2,
   bf_write *GetBuffer(int nBuffer);
   CClientFrame *GetDeltaFrame(int nTick);
 
+  // Snapshot message from pDeltaFrame to pFrame for client. Shared with other
+  // clients in this send pass if bShared. Caller releases it.
+  CHLTVSnapshotMsg *GetSnapshotMsg(CHLTVClient *client, CClientFrame *pFrame,
+                                   CClientFrame *pDeltaFrame, bool bShared);
+  void FlushSnapshotMsgs();
+  // Encodes the current frame for nSpectators stand-in clients spread over
+  // nDeltas delta ticks, once per client and once shared, and prints timings.
+  void BenchmarkSharedFrames(int nSpectators, int nDeltas);
+
   inline CHLTVClient *Client(int i) {
     return static_cast<CHLTVClient *>(m_Clients[i]);
   }
@@ -234,6 +279,11 @@ class CHLTVServer : public IGameEventListener2,
   CDeltaEntityCache m_DeltaCache;
   CUtlVector<CFrameCacheEntry_s> m_FrameCache;
 
+  // snapshot messages encoded in the current send pass
+  CUtlVector<CHLTVSnapshotMsg *> m_SnapshotMsgs;
+  int m_nSnapshotMsgsEncoded;  // totals for tv_status
+  int m_nSnapshotMsgsShared;
+
   // demoplayer stuff:
   CDemoFile m_DemoFile;  // for demo playback
   int m_nStartTick;
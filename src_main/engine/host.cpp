@@ -1938,6 +1938,11 @@ void _Host_RunFrame(float time) {
       g_ServerGlobalVariables.simTicksThisFrame = 1;
       cl.SetFrameTime(host_frametime);
       for (int tick = 0; tick < numticks; tick++) {
+        // The last tick's pipelined snapshots go out during the frames that
+        // run no tick, they must be done before this one reads client packets
+        // or simulates.
+        SV_FinishPipelinedSnapshots();
+
         // process any asynchronous network traffic (TCP), set net_time
         NET_RunFrame(Plat_FloatTime());
 
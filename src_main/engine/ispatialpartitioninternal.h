@@ -15,6 +15,15 @@ the_interface ISpatialPartitionInternal : public ISpatialPartition {
   virtual void Init(const Vector& worldmin, const Vector& worldmax) = 0;
 
   virtual void DrawDebugOverlays() = 0;
+
+  // Lets a batch of jobs query the tree of listMask without touching its
+  // lock. BeginSharedRead takes the read lock once for the whole batch and
+  // EndSharedRead, from any thread, drops it; writers wait in between. Threads
+  // that joined skip the lock and the query callbacks, and must not write.
+  virtual void BeginSharedRead(SpatialPartitionListMask_t listMask) = 0;
+  virtual void EndSharedRead(SpatialPartitionListMask_t listMask) = 0;
+  virtual void JoinSharedRead(SpatialPartitionListMask_t listMask,
+                              bool bJoin) = 0;
 };
 
 //-----------------------------------------------------------------------------
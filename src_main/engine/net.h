@@ -7,6 +7,7 @@
 #define NET_H
 
 #include "common.h"
+#include "net_compress.h"
 #include "tier1/bitbuf.h"
 #include "tier1/netadr.h"
 
@@ -129,6 +130,10 @@ int NET_SendPacket(INetChannel *chan, int sock, const netadr_t &to,
                    bool bUseCompression = false);
 // Called periodically to maybe send any queued packets (up to 4 per frame)
 void NET_SendQueuedPackets();
+// Datagrams the calling thread sends until the matching NET_EndSendBatch are
+// handed to the OS in batches where supported (Linux). Scopes nest.
+void NET_BeginSendBatch();
+void NET_EndSendBatch();
 // Start set current network configuration
 void NET_SetMutiplayer(bool multiplayer);
 // Set net_time
@@ -170,8 +175,11 @@ const char *NET_ErrorString(
     int code);  // translate a socket error into a friendly string
 
 // Returns true if compression succeeded, false otherwise
-bool NET_BufferToBufferCompress(char *dest, unsigned int *destLen, char *source,
-                                unsigned int sourceLen);
+bool NET_BufferToBufferCompress(
+    char *dest, unsigned int *destLen, char *source, unsigned int sourceLen,
+    NetCompressor_t codec = NET_COMPRESSOR_LZSS);
+// Decodes any codec from net_compress.h, uncompressed data is copied as is.
+// Returns false on corrupt data
 bool NET_BufferToBufferDecompress(char *dest, unsigned int *destLen,
                                   char *source, unsigned int sourceLen);
 
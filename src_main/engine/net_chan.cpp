@@ -173,16 +173,20 @@ void CNetChan::CompressFragments() {
     if (data->ackedFragments > 0 || data->pendingFragments > 0) continue;
 
     // ok, compress it.
+    const NetCompressor_t codec =
+        NET_GetStreamCompressor(i, m_nRemoteCompressors);
 
     if (data->buffer) {
       // fragments data is in memory
+      NET_CaptureCompressionSample(data->buffer, data->bytes);
+
       unsigned int compressedSize = data->bytes;
       char *compressedData = new char[data->bytes];
 
       if (NET_BufferToBufferCompress(compressedData, &compressedSize,
-                                     data->buffer, data->bytes)) {
-        DevMsg("Compressing fragments (%d -> %d bytes)\n", data->bytes,
-               compressedSize);
+                                     data->buffer, data->bytes, codec)) {
+        DevMsg("Compressing fragments with %s (%d -> %d bytes)\n",
+               NET_CompressorName(codec), data->bytes, compressedSize);
 
         // copy compressed data but dont reallocate memory
         Q_memcpy(data->buffer, compressedData, compressedSize);
@@ -202,9 +206,15 @@ void CNetChan::CompressFragments() {
       int compressedFileSize = -1;
       FileHandle_t hZipFile = FILESYSTEM_INVALID_HANDLE;
 
-      // check to see if there is a compressed version of the file
-      Q_snprintf(compressedfilename, sizeof(compressedfilename), "%s.ztmp",
-                 data->filename);
+      // check to see if there is a compressed version of the file, each codec
+      // but LZSS keeps its own
+      if (codec == NET_COMPRESSOR_LZSS) {
+        Q_snprintf(compressedfilename, sizeof(compressedfilename), "%s.ztmp",
+                   data->filename);
+      } else {
+        Q_snprintf(compressedfilename, sizeof(compressedfilename),
+                   "%s.%s.ztmp", data->filename, NET_CompressorName(codec));
+      }
 
       // check the timestamps
       int compressedFileTime = g_pFileSystem->GetFileTime(compressedfilename);
@@ -230,7 +240,8 @@ void CNetChan::CompressFragments() {
 
         // compress into buffer
         if (NET_BufferToBufferCompress(compressed, &compressedSize,
-                                       uncompressed, uncompressedSize)) {
+                                       uncompressed, uncompressedSize,
+                                       codec)) {
           // write out to disk compressed version
           hZipFile = g_pFileSystem->Open(compressedfilename, "wb", NULL);
 
@@ -267,24 +278,28 @@ void CNetChan::CompressFragments() {
   }
 }
 
-void CNetChan::UncompressFragments(dataFragments_t *data) {
-  if (!data->isCompressed) return;
+bool CNetChan::UncompressFragments(dataFragments_t *data) {
+  if (!data->isCompressed) return true;
 
   // allocate buffer for uncompressed data, align to 4 bytes boundary
   char *newbuffer = new char[SOURCE_PAD_NUMBER(data->nUncompressedSize, 4)];
   unsigned int uncompressedSize = data->nUncompressedSize;
 
   // uncompress data
-  NET_BufferToBufferDecompress(newbuffer, &uncompressedSize, data->buffer,
-                               data->bytes);
-
-  Assert(uncompressedSize == data->nUncompressedSize);
+  if (!NET_BufferToBufferDecompress(newbuffer, &uncompressedSize, data->buffer,
+                                    data->bytes) ||
+      uncompressedSize != data->nUncompressedSize) {
+    delete[] newbuffer;
+    return false;
+  }
 
   // free old buffer and set new buffer
   delete[] data->buffer;
   data->buffer = newbuffer;
   data->bytes = uncompressedSize;
   data->isCompressed = false;
+
+  return true;
 }
 
 unsigned int CNetChan::RequestFile(const char *filename) {
@@ -424,6 +439,7 @@ CNetChan::CNetChan() {
   m_FileRequestCounter = 0;
   m_bFileBackgroundTranmission = true;
   m_bUseCompression = false;
+  m_nRemoteCompressors = 0;
   m_nQueuedPackets = 0;
 
   m_flRemoteFrameTime = 0;
@@ -643,6 +659,10 @@ void CNetChan::SetCompressionMode(bool bUseCompression) {
   m_bUseCompression = bUseCompression;
 }
 
+void CNetChan::SetRemoteCompressors(int nCompressors) {
+  m_nRemoteCompressors = nCompressors & NET_COMPRESSORS_SUPPORTED;
+}
+
 void CNetChan::SetDataRate(float rate) {
   m_Rate = std::clamp(rate, MIN_RATE * 1.0f, MAX_RATE * 1.0f);
 }
@@ -1803,8 +1823,10 @@ bool CNetChan::CheckReceivingList(int nList) {
     ConMsg("Receiving complete: %i fragments, %i bytes\n", data->numFragments,
            data->bytes);
 
-  if (data->isCompressed) {
-    UncompressFragments(data);
+  if (!UncompressFragments(data)) {
+    ConMsg("Receiving failed: corrupt compressed data (%i bytes)\n",
+           data->bytes);
+    return false;
   }
 
   if (!data->filename[0]) {
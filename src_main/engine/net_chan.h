@@ -151,6 +151,8 @@ class CNetChan : public INetChannel {
   void ProcessPacket(netpacket_t *packet, bool bHasHeader);
 
   void SetCompressionMode(bool bUseCompression);
+  // Codecs the remote end decodes, NET_COMPRESSOR_* bits. LZSS always works.
+  void SetRemoteCompressors(int nCompressors);
   void SetFileTransmissionMode(bool bBackgroundMode);
   bool SendNetMsg(INetMessage &msg, bool bForceReliable = false,
                   bool bVoice = false);                 // send a net message
@@ -221,7 +223,7 @@ class CNetChan : public INetChannel {
                                unsigned int transferID);
 
   void CompressFragments();
-  void UncompressFragments(dataFragments_t *data);
+  bool UncompressFragments(dataFragments_t *data);
 
   bool SendSubChannelData(bf_write &buf);
   bool ReadSubChannelData(bf_read &buf, int stream);
@@ -300,6 +302,7 @@ class CNetChan : public INetChannel {
       m_bFileBackgroundTranmission;  // if true, only send 1 fragment per packet
   bool m_bUseCompression;  // if true, larger reliable data will be bzip
                            // compressed
+  int m_nRemoteCompressors;  // NET_COMPRESSOR_* bits the remote end decodes
 
   // TCP stream state maschine:
   bool m_StreamActive;           // true if TCP is active
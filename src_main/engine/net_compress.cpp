@@ -0,0 +1,307 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+
+#include "net_compress.h"
+
+#include "deps/libbz2/bzlib.h"
+#include "net.h"
+#include "tier0/include/dbg.h"
+#include "tier0/include/fasttimer.h"
+#include "tier0/include/threadtools.h"
+#include "tier1/convar.h"
+#include "tier1/lzfast.h"
+#include "tier1/lzss.h"
+#include "tier1/strtools.h"
+#include "tier1/utlmemory.h"
+#include "tier1/utlvector.h"
+
+#include "tier0/include/memdbgon.h"
+
+#define LZFAST_ID (('1' << 24) | ('F' << 16) | ('Z' << 8) | ('L'))
+#define BZIP2_ID (('1' << 24) | ('2' << 16) | ('Z' << 8) | ('B'))
+
+// Same layout as lzss_header_t.
+struct netcompress_header_t {
+  u32 id;
+  u32 actualSize;  // Always little endian.
+};
+
+static const struct {
+  const ch *name;
+  u32 id;
+} s_Compressors[NET_COMPRESSOR_COUNT] = {
+    {"lzss", LZSS_ID},
+    {"lzfast", LZFAST_ID},
+    {"bzip2", BZIP2_ID},
+};
+
+static ConVar net_compressors(
+    "net_compressors", va("%d", NET_COMPRESSORS_SUPPORTED), FCVAR_USERINFO,
+    "Compressors the server may use on data sent to us (bit mask of "
+    "lzss=1, lzfast=2, bzip2=4).");
+static ConVar net_compress_reliable(
+    "net_compress_reliable", "lzfast", 0,
+    "Compressor for large reliable payloads (lzss, lzfast or bzip2), peers "
+    "that don't support it get lzss.");
+static ConVar net_compress_file(
+    "net_compress_file", "bzip2", 0,
+    "Compressor for file transfers (lzss, lzfast or bzip2), peers that don't "
+    "support it get lzss.");
+static ConVar net_compress_bzip2_level(
+    "net_compress_bzip2_level", "9", 0,
+    "bzip2 block size in 100 kB units, 1 is fastest, 9 compresses best.", true,
+    1, true, 9);
+
+const ch *NET_CompressorName(NetCompressor_t codec) {
+  return codec >= 0 && codec < NET_COMPRESSOR_COUNT ? s_Compressors[codec].name
+                                                    : "unknown";
+}
+
+static NetCompressor_t NET_CompressorFromName(const ch *name) {
+  for (i32 i = 0; i < NET_COMPRESSOR_COUNT; i++) {
+    if (!Q_stricmp(name, s_Compressors[i].name)) return (NetCompressor_t)i;
+  }
+
+  return NET_COMPRESSOR_LZSS;
+}
+
+NetCompressor_t NET_GetStreamCompressor(i32 nStream, i32 nRemoteCompressors) {
+  const ConVar &var = nStream == FRAG_FILE_STREAM ? net_compress_file
+                                                  : net_compress_reliable;
+  const NetCompressor_t codec = NET_CompressorFromName(var.GetString());
+
+  return (nRemoteCompressors & (1 << codec)) ? codec : NET_COMPRESSOR_LZSS;
+}
+
+//-----------------------------------------------------------------------------
+// Codec dispatch
+//-----------------------------------------------------------------------------
+bool NET_Compress(NetCompressor_t codec, u8 *dest, u32 *destLen,
+                  const u8 *source, u32 sourceLen) {
+  if (*destLen <= sizeof(netcompress_header_t)) return false;
+
+  if (codec == NET_COMPRESSOR_LZSS) {
+    CLZSS lzss;
+    u32 compressedLen = 0;
+    u8 *pOut = lzss.Compress((u8 *)source, sourceLen, &compressedLen);
+    const bool bFits = pOut && compressedLen > 0 && compressedLen <= *destLen;
+
+    if (bFits) {
+      memcpy(dest, pOut, compressedLen);
+      *destLen = compressedLen;
+    }
+
+    heap_free(pOut);
+    return bFits;
+  }
+
+  u8 *pPayload = dest + sizeof(netcompress_header_t);
+  u32 payloadLen = *destLen - sizeof(netcompress_header_t);
+
+  switch (codec) {
+    case NET_COMPRESSOR_LZFAST:
+      payloadLen = LZFast_Compress(pPayload, payloadLen, source, sourceLen);
+      if (!payloadLen) return false;
+      break;
+
+    case NET_COMPRESSOR_BZIP2:
+      if (BZ2_bzBuffToBuffCompress((char *)pPayload, &payloadLen,
+                                   (char *)source, sourceLen,
+                                   net_compress_bzip2_level.GetInt(), 0,
+                                   30) != BZ_OK) {
+        return false;
+      }
+      break;
+
+    default:
+      Assert(0);
+      return false;
+  }
+
+  netcompress_header_t *pHeader = (netcompress_header_t *)dest;
+  pHeader->id = LittleLong(s_Compressors[codec].id);
+  pHeader->actualSize = LittleLong(sourceLen);
+
+  *destLen = payloadLen + sizeof(netcompress_header_t);
+  return *destLen < sourceLen;
+}
+
+static bool NET_GetCompressor(const u8 *source, u32 sourceLen,
+                              NetCompressor_t *codec, u32 *actualSize) {
+  if (sourceLen < sizeof(netcompress_header_t)) return false;
+
+  netcompress_header_t header;
+  memcpy(&header, source, sizeof(header));
+
+  for (i32 i = 0; i < NET_COMPRESSOR_COUNT; i++) {
+    if (LittleLong(header.id) == s_Compressors[i].id) {
+      *codec = (NetCompressor_t)i;
+      *actualSize = LittleLong(header.actualSize);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool NET_IsCompressed(const u8 *source, u32 sourceLen, u32 *actualSize) {
+  NetCompressor_t codec;
+  return NET_GetCompressor(source, sourceLen, &codec, actualSize);
+}
+
+bool NET_Decompress(u8 *dest, u32 *destLen, const u8 *source, u32 sourceLen) {
+  NetCompressor_t codec;
+  u32 actualSize;
+  if (!NET_GetCompressor(source, sourceLen, &codec, &actualSize) ||
+      actualSize > *destLen) {
+    return false;
+  }
+
+  const u8 *pPayload = source + sizeof(netcompress_header_t);
+  const u32 payloadLen = sourceLen - sizeof(netcompress_header_t);
+  u32 decompressedLen = 0;
+
+  switch (codec) {
+    case NET_COMPRESSOR_LZSS: {
+      CLZSS lzss;
+      decompressedLen = lzss.SafeUncompress(source, sourceLen, dest, *destLen);
+      break;
+    }
+
+    case NET_COMPRESSOR_LZFAST:
+      decompressedLen =
+          LZFast_Decompress(dest, actualSize, pPayload, payloadLen);
+      break;
+
+    case NET_COMPRESSOR_BZIP2:
+      decompressedLen = actualSize;
+      if (BZ2_bzBuffToBuffDecompress((char *)dest, &decompressedLen,
+                                     (char *)pPayload, payloadLen, 0,
+                                     0) != BZ_OK) {
+        return false;
+      }
+      break;
+
+    default:
+      return false;
+  }
+
+  if (decompressedLen != actualSize) return false;
+
+  *destLen = decompressedLen;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Capture and benchmark
+//-----------------------------------------------------------------------------
+static CThreadFastMutex s_CaptureMutex;
+static CUtlVector<CUtlVector<u8> > s_CapturedSamples;
+static i32 s_nSamplesToCapture = 0;
+
+void NET_CaptureCompressionSample(const void *data, u32 size) {
+  // Unlocked peek, capturing is rare.
+  if (s_nSamplesToCapture <= 0) return;
+
+  AUTO_LOCK(s_CaptureMutex);
+
+  if (s_nSamplesToCapture <= 0) return;
+  s_nSamplesToCapture--;
+
+  CUtlVector<u8> &sample = s_CapturedSamples[s_CapturedSamples.AddToTail()];
+  sample.SetCount(size);
+  memcpy(sample.Base(), data, size);
+
+  if (!s_nSamplesToCapture) {
+    Msg("net_compress_capture: %d samples captured.\n",
+        s_CapturedSamples.Count());
+  }
+}
+
+CON_COMMAND(net_compress_capture,
+            "Keeps copies of the next N reliable payloads for "
+            "net_compress_bench (default 64), 0 clears the samples.") {
+  AUTO_LOCK(s_CaptureMutex);
+
+  s_nSamplesToCapture = args.ArgC() > 1 ? atoi(args[1]) : 64;
+  if (s_nSamplesToCapture <= 0) {
+    s_nSamplesToCapture = 0;
+    s_CapturedSamples.RemoveAll();
+  }
+}
+
+CON_COMMAND(net_compress_bench,
+            "Compresses the captured reliable payloads with every codec and "
+            "reports ratio and us/KB: [iterations]") {
+  AUTO_LOCK(s_CaptureMutex);
+
+  if (!s_CapturedSamples.Count()) {
+    Msg("No samples, run net_compress_capture and connect a client first.\n");
+    return;
+  }
+
+  const i32 nIterations = args.ArgC() > 1 ? std::max(1, atoi(args[1])) : 10;
+
+  u32 nMaxSize = 0;
+  u32 nTotalBytes = 0;
+  for (i32 i = 0; i < s_CapturedSamples.Count(); i++) {
+    nMaxSize = std::max(nMaxSize, (u32)s_CapturedSamples[i].Count());
+    nTotalBytes += s_CapturedSamples[i].Count();
+  }
+
+  CUtlMemory<u8> compressed(0, nMaxSize);
+  CUtlMemory<u8> decompressed(0, nMaxSize);
+
+  Msg("%d samples, %u bytes, %d iterations\n", s_CapturedSamples.Count(),
+      nTotalBytes, nIterations);
+  Msg("codec     ratio  compress us/KB  decompress us/KB\n");
+
+  for (i32 codec = 0; codec < NET_COMPRESSOR_COUNT; codec++) {
+    u32 nCompressedBytes = 0;
+    bool bRoundTrip = true;
+    CCycleCount compressTime, decompressTime;
+
+    for (i32 i = 0; i < s_CapturedSamples.Count(); i++) {
+      const CUtlVector<u8> &sample = s_CapturedSamples[i];
+      u32 compressedLen = 0;
+
+      for (i32 n = 0; n < nIterations; n++) {
+        compressedLen = compressed.Count();
+
+        CFastTimer timer;
+        timer.Start();
+        const bool bCompressed =
+            NET_Compress((NetCompressor_t)codec, compressed.Base(),
+                         &compressedLen, sample.Base(), sample.Count());
+        timer.End();
+        compressTime += timer.GetDuration();
+
+        // Incompressible, goes out as is.
+        if (!bCompressed) {
+          compressedLen = sample.Count();
+          continue;
+        }
+
+        u32 decompressedLen = decompressed.Count();
+
+        timer.Start();
+        bRoundTrip &= NET_Decompress(decompressed.Base(), &decompressedLen,
+                                     compressed.Base(), compressedLen) &&
+                      decompressedLen == (u32)sample.Count() &&
+                      !memcmp(decompressed.Base(), sample.Base(),
+                              decompressedLen);
+        timer.End();
+        decompressTime += timer.GetDuration();
+      }
+
+      nCompressedBytes += compressedLen;
+    }
+
+    const f64 flKBytes = nIterations * nTotalBytes / 1024.0;
+    Msg("%-8s  %5.2f  %14.2f  %16.2f%s\n",
+        NET_CompressorName((NetCompressor_t)codec),
+        (f64)nTotalBytes / std::max(1U, nCompressedBytes),
+        compressTime.GetMicrosecondsF() / flKBytes,
+        decompressTime.GetMicrosecondsF() / flKBytes,
+        bRoundTrip ? "" : "  ROUND TRIP FAILED");
+  }
+}
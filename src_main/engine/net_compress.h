@@ -0,0 +1,50 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// Codecs for reliable net channel payloads. Every compressed buffer starts
+// with a 4 byte codec id and the little endian uncompressed size (the LZSS
+// header layout), so the receiver picks the decoder from the data itself. An
+// id names one bitstream version: a format change gets a new codec and a new
+// capability bit, peers only ever receive codecs they announced.
+
+#ifndef NET_COMPRESS_H
+#define NET_COMPRESS_H
+
+#include "base/include/base_types.h"
+
+enum NetCompressor_t {
+  NET_COMPRESSOR_LZSS = 0,  // tier1 CLZSS, every peer decodes it
+  NET_COMPRESSOR_LZFAST,    // LZ4 style byte aligned LZ77, fast both ways
+  NET_COMPRESSOR_BZIP2,     // libbz2, level tunable by net_compress_bzip2_level
+
+  NET_COMPRESSOR_COUNT
+};
+
+// Bit mask of the codecs this build decodes, announced to servers through the
+// net_compressors userinfo cvar.
+#define NET_COMPRESSORS_SUPPORTED ((1 << NET_COMPRESSOR_COUNT) - 1)
+
+const ch *NET_CompressorName(NetCompressor_t codec);
+
+// Codec for the next payload of fragment stream nStream (FRAG_*_STREAM), out
+// of the ones in nRemoteCompressors.
+NetCompressor_t NET_GetStreamCompressor(i32 nStream, i32 nRemoteCompressors);
+
+// Compresses source into dest, which holds *destLen bytes. Fails if the output
+// doesn't fit, callers send the data uncompressed then.
+bool NET_Compress(NetCompressor_t codec, u8 *dest, u32 *destLen,
+                  const u8 *source, u32 sourceLen);
+
+// True if source starts with a known codec header, returns its uncompressed
+// size.
+bool NET_IsCompressed(const u8 *source, u32 sourceLen, u32 *actualSize);
+
+// Decodes a buffer produced by NET_Compress. Fails on unknown codecs, on
+// corrupt or truncated data and when the header size exceeds *destLen, every
+// decoder is bounded by *destLen so dest is never overrun.
+bool NET_Decompress(u8 *dest, u32 *destLen, const u8 *source, u32 sourceLen);
+
+// Keeps a copy of a reliable payload if net_compress_capture asked for it, so
+// net_compress_bench has real traffic to work on.
+void NET_CaptureCompressionSample(const void *data, u32 size);
+
+#endif  // NET_COMPRESS_H
@@ -2,14 +2,14 @@
 
 #include "net_ws_headers.h"
 
+#include <limits>
 #include "base/include/windows/scoped_winsock_initializer.h"
 #include "net_ws_queued_packet_sender.h"
+#include "tier0/include/fasttimer.h"
 #include "tier1/lzss.h"
 
 #include "tier0/include/memdbgon.h"
 
-#define NET_COMPRESSION_STACKBUF_SIZE 4096
-
 static ConVar net_showsplits("net_showsplits", "0", 0,
                              "Show info about packet splits");
 
@@ -335,6 +335,108 @@ int NET_GetLastError() {
   return net_error;
 }
 
+//-----------------------------------------------------------------------------
+// Packet storage pools. Lagged packets, split packet reassembly,
+// decompression scratch and the queued packet sender recycle their storage,
+// the heap is only touched while a pool grows to its working set.
+//-----------------------------------------------------------------------------
+// Small buffer class, holds any routable datagram.
+#define NET_PACKET_BUFFER_SMALL 2048
+
+struct netbuffersmall_t {
+  uint8_t data[NET_PACKET_BUFFER_SMALL];
+};
+
+struct netbufferlarge_t {
+  uint8_t data[NET_MAX_MESSAGE];
+};
+
+struct netpacketpool_t {
+  CTSPool<netpacket_t> packets;
+  CTSPool<netbuffersmall_t> small;
+  CTSPool<netbufferlarge_t> large;
+};
+
+// Extra sockets share the last pool, the pools are thread safe.
+static netpacketpool_t s_PacketPools[MAX_SOCKETS];
+// Times the packet path went to the heap.
+static CInterlockedInt s_nPacketAllocations;
+
+void NET_AddPacketAllocations(int nAllocations) {
+  s_nPacketAllocations += nAllocations;
+}
+
+static netpacketpool_t &NET_GetPacketPool(int sock) {
+  return s_PacketPools[std::clamp(sock, 0, MAX_SOCKETS - 1)];
+}
+
+template <typename T>
+static T *NET_GetPooled(CTSPool<T> &pool) {
+  bool bAllocated;
+  T *pObject = pool.GetObject(&bAllocated);
+  if (bAllocated) ++s_nPacketAllocations;
+  return pObject;
+}
+
+// Returns a buffer of at least size bytes, give it back with
+// NET_FreePacketBuffer and the same size.
+static uint8_t *NET_AllocPacketBuffer(int sock, int size) {
+  netpacketpool_t &pool = NET_GetPacketPool(sock);
+
+  if (size <= NET_PACKET_BUFFER_SMALL) return NET_GetPooled(pool.small)->data;
+  if (size <= NET_MAX_MESSAGE) return NET_GetPooled(pool.large)->data;
+
+  ++s_nPacketAllocations;
+  return new uint8_t[size];
+}
+
+static void NET_FreePacketBuffer(int sock, uint8_t *buffer, int size) {
+  netpacketpool_t &pool = NET_GetPacketPool(sock);
+
+  if (size <= NET_PACKET_BUFFER_SMALL) {
+    pool.small.PutObject((netbuffersmall_t *)buffer);
+  } else if (size <= NET_MAX_MESSAGE) {
+    pool.large.PutObject((netbufferlarge_t *)buffer);
+  } else {
+    delete[] buffer;
+  }
+}
+
+// Pooled stand-in for CUtlMemoryFixedGrowable scratch memory, returned to the
+// pool at scope exit. Growing doesn't keep the contents.
+class CNetPacketBuffer {
+ public:
+  explicit CNetPacketBuffer(int sock)
+      : m_nSock(sock), m_pData(nullptr), m_nSize(0) {}
+  ~CNetPacketBuffer() { Free(); }
+
+  void EnsureCapacity(int size) {
+    if (size <= m_nSize) return;
+
+    Free();
+    m_pData = NET_AllocPacketBuffer(m_nSock, size);
+    m_nSize = size;
+  }
+
+  uint8_t *Base() { return m_pData; }
+
+ private:
+  void Free() {
+    if (m_pData) NET_FreePacketBuffer(m_nSock, m_pData, m_nSize);
+    m_pData = nullptr;
+    m_nSize = 0;
+  }
+
+  int m_nSock;
+  uint8_t *m_pData;
+  int m_nSize;
+};
+
+static void NET_FreeLaggedPacket(netpacket_t *p) {
+  NET_FreePacketBuffer(p->source, p->data, p->size);
+  NET_GetPacketPool(p->source).packets.PutObject(p);
+}
+
 /*
 ==================
 NET_ClearLaggedList
@@ -347,11 +449,7 @@ void NET_ClearLaggedList(netpacket_t **pList) {
   while (p) {
     netpacket_t *n = p->pNext;
 
-    if (p->data) {
-      delete[] p->data;
-      p->data = nullptr;
-    }
-    delete p;
+    NET_FreeLaggedPacket(p);
     p = n;
   }
 
@@ -805,10 +903,12 @@ void NET_AddToLagged(netpacket_t **pList, netpacket_t *pPacket) {
 
   // first copy packet
 
-  netpacket_t *newPacket = new netpacket_t;
+  netpacket_t *newPacket =
+      NET_GetPooled(NET_GetPacketPool(pPacket->source).packets);
 
-  (*newPacket) = (*pPacket);                           // copy packet infos
-  newPacket->data = new unsigned char[pPacket->size];  // create new data buffer
+  (*newPacket) = (*pPacket);  // copy packet infos
+  newPacket->data = NET_AllocPacketBuffer(pPacket->source,
+                                          pPacket->size);  // new data buffer
   Q_memcpy(newPacket->data, pPacket->data, pPacket->size);  // copy packet data
   newPacket->pNext = nullptr;
 
@@ -957,8 +1057,7 @@ bool NET_LagPacket(bool newdata, netpacket_t *packet) {
 
   // free lag packet
 
-  delete[] p->data;
-  delete p;
+  NET_FreeLaggedPacket(p);
 
   return true;
 }
@@ -969,7 +1068,11 @@ bool NET_LagPacket(bool newdata, netpacket_t *packet) {
 
 class CSplitPacketEntry {
  public:
-  CSplitPacketEntry() {
+  CSplitPacketEntry() { Reset(); }
+
+  // Entries are pooled, this runs on every reuse. The reassembly buffer is
+  // always written before it's read and stays as is.
+  void Reset() {
     memset(&from, 0, sizeof(from));
 
     int i;
@@ -977,7 +1080,10 @@ class CSplitPacketEntry {
       splitflags[i] = -1;
     }
 
-    memset(&netsplit, 0, sizeof(netsplit));
+    netsplit.currentSequence = 0;
+    netsplit.splitCount = 0;
+    netsplit.totalSize = 0;
+    netsplit.nExpectedSplitSize = 0;
     lastactivetime = 0.0f;
   }
 
@@ -989,21 +1095,24 @@ class CSplitPacketEntry {
   float lastactivetime;
 };
 
-typedef CUtlVector<CSplitPacketEntry> vecSplitPacketEntries_t;
+typedef CUtlVector<CSplitPacketEntry *> vecSplitPacketEntries_t;
 static CUtlVector<vecSplitPacketEntries_t> net_splitpackets;
+static CTSPool<CSplitPacketEntry> s_SplitPacketEntryPool;
 
 //-----------------------------------------------------------------------------
-// Purpose:
+// Purpose: flNow is net_time on the host thread, the I/O thread keeps its own
+// clock for the sockets it owns.
 //-----------------------------------------------------------------------------
-void NET_DiscardStaleSplitpackets(const int sock) {
+void NET_DiscardStaleSplitpackets(const int sock, double flNow) {
   vecSplitPacketEntries_t &splitPacketEntries = net_splitpackets[sock];
   int i;
   for (i = splitPacketEntries.Count() - 1; i >= 0; i--) {
-    CSplitPacketEntry *entry = &splitPacketEntries[i];
+    CSplitPacketEntry *entry = splitPacketEntries[i];
     Assert(entry);
 
-    if (net_time < (entry->lastactivetime + SPLIT_PACKET_STALE_TIME)) continue;
+    if (flNow < (entry->lastactivetime + SPLIT_PACKET_STALE_TIME)) continue;
 
+    s_SplitPacketEntryPool.PutObject(entry);
     splitPacketEntries.Remove(i);
   }
 }
@@ -1019,19 +1128,18 @@ CSplitPacketEntry *NET_FindOrCreateSplitPacketEntry(const int sock,
   int i, count = splitPacketEntries.Count();
   CSplitPacketEntry *entry = nullptr;
   for (i = 0; i < count; i++) {
-    entry = &splitPacketEntries[i];
+    entry = splitPacketEntries[i];
     Assert(entry);
 
     if (from->CompareAdr(entry->from)) break;
   }
 
   if (i >= count) {
-    CSplitPacketEntry newentry;
-    newentry.from = *from;
+    entry = NET_GetPooled(s_SplitPacketEntryPool);
+    entry->Reset();
+    entry->from = *from;
 
-    splitPacketEntries.AddToTail(newentry);
-
-    entry = &splitPacketEntries[splitPacketEntries.Count() - 1];
+    splitPacketEntries.AddToTail(entry);
   }
 
   Assert(entry);
@@ -1064,7 +1172,7 @@ static char const *DescribeSocket(int sock) {
 //			*outSize -
 // Output : bool
 //-----------------------------------------------------------------------------
-bool NET_GetLong(const int sock, netpacket_t *packet) {
+bool NET_GetLong(const int sock, netpacket_t *packet, double flNow) {
   int packetNumber, packetCount, sequenceNumber, offset;
   short packetID;
   SPLITPACKET *pHeader;
@@ -1079,7 +1187,7 @@ bool NET_GetLong(const int sock, netpacket_t *packet) {
   Assert(entry);
   if (!entry) return false;
 
-  entry->lastactivetime = net_time;
+  entry->lastactivetime = flNow;
   Assert(packet->from.CompareAdr(entry->from));
 
   pHeader = (SPLITPACKET *)packet->data;
@@ -1209,10 +1317,263 @@ bool NET_GetLoopPacket(netpacket_t *packet) {
   return (NET_LagPacket(true, packet));
 }
 
-bool NET_ReceiveDatagram(const int sock, netpacket_t *packet) {
-  Assert(packet);
-  Assert(net_multiplayer);
+//-----------------------------------------------------------------------------
+// Batched UDP I/O. On Linux the sockets are drained with recvmmsg and
+// datagrams sent inside a NET_BeginSendBatch/NET_EndSendBatch scope leave
+// through sendmmsg, so a busy server makes a few syscalls per frame instead
+// of one per datagram. VCR record/playback keeps the per-datagram path.
+//-----------------------------------------------------------------------------
+static CInterlockedInt s_nUDPRecvCalls;
+static CInterlockedInt s_nUDPRecvDatagrams;
+static CInterlockedInt s_nUDPSendCalls;
+static CInterlockedInt s_nUDPSendDatagrams;
+
+static int NET_RecvFromImpl(SOCKET s, char *buf, int len, struct sockaddr *from,
+                            int *fromlen) {
+  ++s_nUDPRecvCalls;
+
+  int ret = VCRHook_recvfrom(s, buf, len, 0, from, fromlen);
+  if (ret > 0) ++s_nUDPRecvDatagrams;
+
+  return ret;
+}
+
+#if defined(OS_LINUX)
+
+static ConVar net_udp_batch(
+    "net_udp_batch", "1", 0,
+    "Receive and send UDP datagrams in batches with recvmmsg/sendmmsg.");
+
+#define NET_UDP_BATCH_SIZE 32
+// NET_SendPacket splits anything above MAX_USER_MAXROUTABLE_SIZE, so larger
+// datagrams don't come from a well behaved peer. They are reported as
+// oversize on receive and bypass the batch on send.
+#define NET_UDP_BATCH_SLOT_SIZE 4096
+
+class CNetRecvBatch {
+ public:
+  CNetRecvBatch() : m_Socket(-1), m_nCount(0), m_nNext(0) {}
+
+  // Same contract as recvfrom on a non-blocking socket. Datagrams queued by
+  // the previous recvmmsg are handed out first.
+  int RecvFrom(SOCKET s, char *buf, int len, struct sockaddr *from,
+               int *fromlen);
+
+  bool HasQueued(SOCKET s) const {
+    return s == m_Socket && m_nNext < m_nCount;
+  }
+  void Reset() { m_nCount = m_nNext = 0; }
+
+ private:
+  SOCKET m_Socket;
+  int m_nCount;
+  int m_nNext;
+  mmsghdr m_Msgs[NET_UDP_BATCH_SIZE];
+  iovec m_Iovs[NET_UDP_BATCH_SIZE];
+  sockaddr_storage m_Addrs[NET_UDP_BATCH_SIZE];
+  u8 m_Data[NET_UDP_BATCH_SIZE][NET_UDP_BATCH_SLOT_SIZE];
+};
+
+int CNetRecvBatch::RecvFrom(SOCKET s, char *buf, int len,
+                            struct sockaddr *from, int *fromlen) {
+  // Socket was reopened, whatever we hold belongs to the old one.
+  if (s != m_Socket) {
+    m_Socket = s;
+    Reset();
+  }
+
+  if (m_nNext >= m_nCount) {
+    Reset();
+
+    for (int i = 0; i < NET_UDP_BATCH_SIZE; i++) {
+      m_Iovs[i].iov_base = m_Data[i];
+      m_Iovs[i].iov_len = sizeof(m_Data[i]);
+
+      memset(&m_Msgs[i], 0, sizeof(m_Msgs[i]));
+      m_Msgs[i].msg_hdr.msg_name = &m_Addrs[i];
+      m_Msgs[i].msg_hdr.msg_namelen = sizeof(m_Addrs[i]);
+      m_Msgs[i].msg_hdr.msg_iov = &m_Iovs[i];
+      m_Msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    ++s_nUDPRecvCalls;
+
+    int ret = recvmmsg(s, m_Msgs, NET_UDP_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    if (ret <= 0) {
+      if (ret == 0) errno = EWOULDBLOCK;
+      return -1;
+    }
+
+    m_nCount = ret;
+    s_nUDPRecvDatagrams += ret;
+  }
+
+  const int i = m_nNext++;
+  const msghdr &hdr = m_Msgs[i].msg_hdr;
+  const int size = (int)m_Msgs[i].msg_len;
+
+  *fromlen = std::min(*fromlen, (int)hdr.msg_namelen);
+  memcpy(from, &m_Addrs[i], *fromlen);
 
+  // Truncated, let the caller treat it like any other oversize packet.
+  if ((hdr.msg_flags & MSG_TRUNC) || size > len) return len;
+
+  memcpy(buf, m_Data[i], size);
+  return size;
+}
+
+class CNetSendBatch {
+ public:
+  CNetSendBatch() : m_nDepth(0), m_nCount(0), m_Socket(-1) {}
+
+  // Scopes nest, the outermost End flushes.
+  void Begin() { ++m_nDepth; }
+  void End() {
+    if (--m_nDepth == 0) Flush();
+  }
+  bool IsOpen() const { return m_nDepth > 0; }
+
+  // Copies the datagram into the batch. Returns false if it has to be sent
+  // directly, in which case everything queued before it is already out.
+  bool Add(SOCKET s, const char *buf, int len, const struct sockaddr *to,
+           int tolen);
+  void Flush();
+
+ private:
+  int m_nDepth;
+  int m_nCount;
+  SOCKET m_Socket;
+  mmsghdr m_Msgs[NET_UDP_BATCH_SIZE];
+  iovec m_Iovs[NET_UDP_BATCH_SIZE];
+  sockaddr_storage m_Addrs[NET_UDP_BATCH_SIZE];
+  u8 m_Data[NET_UDP_BATCH_SIZE][NET_UDP_BATCH_SLOT_SIZE];
+};
+
+bool CNetSendBatch::Add(SOCKET s, const char *buf, int len,
+                        const struct sockaddr *to, int tolen) {
+  if (len > NET_UDP_BATCH_SLOT_SIZE || tolen > (int)sizeof(m_Addrs[0])) {
+    Flush();
+    return false;
+  }
+
+  // One sendmmsg call per socket.
+  if (m_nCount == NET_UDP_BATCH_SIZE || (m_nCount && s != m_Socket)) Flush();
+
+  const int i = m_nCount++;
+  m_Socket = s;
+
+  memcpy(m_Data[i], buf, len);
+  memcpy(&m_Addrs[i], to, tolen);
+
+  m_Iovs[i].iov_base = m_Data[i];
+  m_Iovs[i].iov_len = len;
+
+  memset(&m_Msgs[i], 0, sizeof(m_Msgs[i]));
+  m_Msgs[i].msg_hdr.msg_name = &m_Addrs[i];
+  m_Msgs[i].msg_hdr.msg_namelen = tolen;
+  m_Msgs[i].msg_hdr.msg_iov = &m_Iovs[i];
+  m_Msgs[i].msg_hdr.msg_iovlen = 1;
+
+  return true;
+}
+
+void CNetSendBatch::Flush() {
+  int nSent = 0;
+
+  while (nSent < m_nCount) {
+    ++s_nUDPSendCalls;
+
+    int ret = sendmmsg(m_Socket, m_Msgs + nSent, m_nCount - nSent, 0);
+    if (ret <= 0) {
+      // sendmmsg stops at the first datagram that fails, drop it like a
+      // failed sendto and carry on with the rest.
+      const int error = errno;
+      if (error != EWOULDBLOCK && error != EAGAIN && error != ECONNRESET &&
+          error != ECONNREFUSED) {
+        ConDMsg("NET_SendBatch: %s\n", NET_ErrorString(error));
+      }
+      ret = 1;
+    }
+
+    nSent += ret;
+  }
+
+  s_nUDPSendDatagrams += m_nCount;
+  m_nCount = 0;
+}
+
+// Lazily created per game socket, only the thread processing a socket touches
+// it. Extra sockets (NET_AddExtraSocket) stay on the scalar path.
+static CNetRecvBatch *s_pRecvBatches[MAX_SOCKETS];
+// Lazily created per sending thread, lives as long as the thread.
+static CThreadLocalPtr<CNetSendBatch> s_pSendBatch;
+
+static bool NET_UseUDPBatching() {
+  return net_udp_batch.GetBool() && VCRGetMode() == VCR_Disabled;
+}
+
+#endif  // OS_LINUX
+
+// Drops datagrams already pulled off the sockets, socket handles get reused.
+static void NET_DiscardRecvBatches() {
+#if defined(OS_LINUX)
+  for (int i = 0; i < MAX_SOCKETS; i++) {
+    if (s_pRecvBatches[i]) s_pRecvBatches[i]->Reset();
+  }
+#endif
+}
+
+void NET_BeginSendBatch() {
+#if defined(OS_LINUX)
+  if (!NET_UseUDPBatching()) return;
+
+  CNetSendBatch *pBatch = s_pSendBatch;
+  if (!pBatch) {
+    pBatch = new CNetSendBatch;
+    s_pSendBatch = pBatch;
+  }
+
+  pBatch->Begin();
+#endif
+}
+
+void NET_EndSendBatch() {
+#if defined(OS_LINUX)
+  CNetSendBatch *pBatch = s_pSendBatch;
+  if (pBatch && pBatch->IsOpen()) pBatch->End();
+#endif
+}
+
+// Reads the next datagram of a game socket, through its receive batch if
+// batching is on.
+static int NET_RecvFrom(int sock, SOCKET s, char *buf, int len,
+                        struct sockaddr *from, int *fromlen) {
+#if defined(OS_LINUX)
+  if (sock >= MAX_SOCKETS) return NET_RecvFromImpl(s, buf, len, from, fromlen);
+
+  if (NET_UseUDPBatching()) {
+    CNetRecvBatch *&pBatch = s_pRecvBatches[sock];
+    if (!pBatch) pBatch = new CNetRecvBatch;
+
+    return pBatch->RecvFrom(s, buf, len, from, fromlen);
+  }
+
+  // Switched off, hand out what is still queued before going scalar.
+  CNetRecvBatch *pBatch = s_pRecvBatches[sock];
+  if (pBatch && pBatch->HasQueued(s)) {
+    return pBatch->RecvFrom(s, buf, len, from, fromlen);
+  }
+#endif
+
+  return NET_RecvFromImpl(s, buf, len, from, fromlen);
+}
+
+// Reads the next datagram, reassembles split packets and decompresses. False
+// if nothing complete arrived, packet->wiresize tells whether the socket had
+// a datagram at all. flNow is the split packet clock, see
+// NET_DiscardStaleSplitpackets.
+static bool NET_ReceiveRawDatagram(const int sock, netpacket_t *packet,
+                                   double flNow) {
   struct sockaddr from;
   int fromlen = sizeof(from);
   int net_socket = net_sockets[packet->source].hUDP;
@@ -1231,22 +1592,18 @@ bool NET_ReceiveDatagram(const int sock, netpacket_t *packet) {
   }
 #endif
 
-  int ret = VCRHook_recvfrom(net_socket, (char *)packet->data, NET_MAX_MESSAGE,
-                             0, (struct sockaddr *)&from, (int *)&fromlen);
+  int ret = NET_RecvFrom(sock, net_socket, (char *)packet->data,
+                         NET_MAX_MESSAGE, (struct sockaddr *)&from, &fromlen);
   if (ret > 0) {
     packet->wiresize = ret;
 
-    MEM_ALLOC_CREDIT();
-    CUtlMemoryFixedGrowable<byte, NET_COMPRESSION_STACKBUF_SIZE> bufVoice(
-        NET_COMPRESSION_STACKBUF_SIZE);
-
     packet->from.SetFromSockadr(&from);
     packet->size = ret;
 
     if (ret < NET_MAX_MESSAGE) {
       // Check for split message
       if (LittleLong(*(int *)packet->data) == NET_HEADER_FLAG_SPLITPACKET) {
-        if (!NET_GetLong(sock, packet)) return false;
+        if (!NET_GetLong(sock, packet, flNow)) return false;
       }
 
       // Next check for compressed message
@@ -1257,15 +1614,15 @@ bool NET_ReceiveDatagram(const int sock, netpacket_t *packet) {
         CLZSS lzss;
         // Decompress
         int actualSize = lzss.GetActualSize(pCompressedData);
-        if (actualSize <= 0) return false;
+        if (actualSize <= 0 || actualSize > NET_MAX_MESSAGE) return false;
 
-        MEM_ALLOC_CREDIT();
-        CUtlMemoryFixedGrowable<byte, NET_COMPRESSION_STACKBUF_SIZE>
-            memDecompressed(NET_COMPRESSION_STACKBUF_SIZE);
+        CNetPacketBuffer memDecompressed(sock);
         memDecompressed.EnsureCapacity(actualSize);
 
-        unsigned int uDecompressedSize =
-            lzss.Uncompress(pCompressedData, memDecompressed.Base());
+        unsigned int uDecompressedSize = lzss.SafeUncompress(
+            pCompressedData, packet->size - sizeof(unsigned int),
+            memDecompressed.Base(), actualSize);
+        if (!uDecompressedSize) return false;
 
         // packet->wiresize is already set
         Q_memcpy(packet->data, memDecompressed.Base(), uDecompressedSize);
@@ -1273,7 +1630,7 @@ bool NET_ReceiveDatagram(const int sock, netpacket_t *packet) {
         packet->size = uDecompressedSize;
       }
 
-      return NET_LagPacket(true, packet);
+      return true;
     } else {
       ConDMsg("NET_ReceiveDatagram:  Oversize packet from %s\n",
               packet->from.ToString());
@@ -1299,6 +1656,15 @@ bool NET_ReceiveDatagram(const int sock, netpacket_t *packet) {
   return false;
 }
 
+bool NET_ReceiveDatagram(const int sock, netpacket_t *packet) {
+  Assert(packet);
+  Assert(net_multiplayer);
+
+  if (!NET_ReceiveRawDatagram(sock, packet, net_time)) return false;
+
+  return NET_LagPacket(true, packet);
+}
+
 // Changes n random bits in a data block
 void NET_AddNoise(u8 *data, int length, int number) {
   for (int i = 0; i < number; i++) {
@@ -1320,12 +1686,261 @@ void NET_AddNoise(u8 *data, int length, int number) {
   }
 }
 
+//-----------------------------------------------------------------------------
+// Network I/O thread. On a Linux dedicated server it services the game
+// sockets while the host frame runs: datagrams are received, reassembled,
+// decompressed and timestamped on arrival, the host frame only pops finished
+// packets. Fake lag and loss are still applied when a packet is popped.
+//-----------------------------------------------------------------------------
+#if defined(OS_LINUX)
+
+static ConVar net_io_thread(
+    "net_io_thread", "0", 0,
+    "Dedicated server: receive, reassemble and decompress datagrams on a "
+    "separate thread that keeps the sockets drained during the host frame.");
+
+// Packets waiting for the host frame, beyond this new ones are dropped as a
+// full socket buffer would.
+#define NET_IO_THREAD_MAX_QUEUED 4096
+// Longest poll sleep, bounds the time it takes to stop the thread.
+#define NET_IO_THREAD_POLL_MS 5
+// Datagrams read from one socket before looking at the others.
+#define NET_IO_THREAD_MAX_BURST 256
+
+class CNetReceiveThread : public CThread {
+ public:
+  CNetReceiveThread() : m_bShouldExit(false), m_nSocketMask(0) {
+    SetName("NetReceive");
+  }
+
+  bool Start(u32 nBytesStack = 0) override;
+  void Stop();
+
+  bool Owns(int sock) const {
+    return sock < MAX_SOCKETS && (m_nSocketMask & (1 << sock));
+  }
+
+  // Pops the next received packet of sock, free it with NET_FreeLaggedPacket.
+  bool PopPacket(int sock, netpacket_t **ppPacket) {
+    return sock < MAX_SOCKETS && m_Queues[sock].PopItem(ppPacket);
+  }
+
+  int QueuedPackets() {
+    int nQueued = 0;
+    for (int i = 0; i < MAX_SOCKETS; i++) nQueued += m_Queues[i].Count();
+    return nQueued;
+  }
+
+  void DiscardQueued();
+
+  CInterlockedInt m_nReceived;
+  CInterlockedInt m_nDropped;
+
+ private:
+  int Run() override;
+  void ReceiveAll(int sock, uint8_t *scratch);
+
+  CTSQueue<netpacket_t *> m_Queues[MAX_SOCKETS];
+  volatile bool m_bShouldExit;
+  // Only changes while the thread is stopped. The thread reads net_sockets
+  // and net_splitpackets, so anything that changes the socket set stops it
+  // first (NET_PauseIOThread).
+  int m_nSocketMask;
+};
+
+static CNetReceiveThread s_NetReceiveThread;
+
+bool CNetReceiveThread::Start(u32 nBytesStack) {
+  Stop();
+
+  m_nSocketMask = 0;
+  for (int i = 0; i < std::min(net_sockets.Count(), MAX_SOCKETS); i++) {
+    if (net_sockets[i].hUDP) m_nSocketMask |= 1 << i;
+  }
+
+  if (!m_nSocketMask) return false;
+
+  m_bShouldExit = false;
+
+  if (!CThread::Start(nBytesStack)) {
+    m_nSocketMask = 0;
+    return false;
+  }
+
+  return true;
+}
+
+void CNetReceiveThread::Stop() {
+  if (IsAlive()) {
+    m_bShouldExit = true;
+    Join();
+
+    // Partial split packets are stamped with the thread's clock, not net_time.
+    for (int i = 0; i < MAX_SOCKETS; i++) {
+      if (Owns(i)) {
+        NET_DiscardStaleSplitpackets(i, std::numeric_limits<double>::max());
+      }
+    }
+  }
+
+  // The host frame owns the sockets and split packet state again.
+  m_nSocketMask = 0;
+}
+
+void CNetReceiveThread::DiscardQueued() {
+  netpacket_t *pPacket;
+  for (int i = 0; i < MAX_SOCKETS; i++) {
+    while (m_Queues[i].PopItem(&pPacket)) NET_FreeLaggedPacket(pPacket);
+  }
+}
+
+int CNetReceiveThread::Run() {
+  struct pollfd fds[MAX_SOCKETS];
+  int socks[MAX_SOCKETS];
+  int nFds = 0;
+
+  for (int i = 0; i < MAX_SOCKETS; i++) {
+    if (!Owns(i)) continue;
+
+    fds[nFds].fd = net_sockets[i].hUDP;
+    fds[nFds].events = POLLIN;
+    socks[nFds] = i;
+    nFds++;
+  }
+
+  netbufferlarge_t *scratch = NET_GetPooled(NET_GetPacketPool(socks[0]).large);
+
+  while (!m_bShouldExit) {
+    const int nReady = poll(fds, nFds, NET_IO_THREAD_POLL_MS);
+
+    for (int i = 0; i < nFds; i++) {
+      NET_DiscardStaleSplitpackets(socks[i], Plat_FloatTime());
+
+      if (nReady > 0 && (fds[i].revents & POLLIN)) {
+        ReceiveAll(socks[i], scratch->data);
+      }
+    }
+  }
+
+  NET_GetPacketPool(socks[0]).large.PutObject(scratch);
+  return 0;
+}
+
+void CNetReceiveThread::ReceiveAll(int sock, uint8_t *scratch) {
+  netpacket_t packet;
+
+  for (int i = 0; i < NET_IO_THREAD_MAX_BURST; i++) {
+    packet.from.SetType(NA_IP);
+    packet.from.Clear();
+    packet.source = sock;
+    packet.data = scratch;
+    packet.size = 0;
+    packet.wiresize = 0;
+    packet.stream = 0;
+    packet.pNext = nullptr;
+
+    if (!NET_ReceiveRawDatagram(sock, &packet, Plat_FloatTime())) {
+      // Socket drained, else a split packet part or a bad datagram.
+      if (!packet.wiresize) return;
+
+      continue;
+    }
+
+    if (m_Queues[sock].Count() >= NET_IO_THREAD_MAX_QUEUED) {
+      ++m_nDropped;
+      continue;
+    }
+
+    // Plat_FloatTime, the host frame turns it into net_time when popping.
+    packet.received = Plat_FloatTime();
+
+    netpacket_t *pQueued = NET_GetPooled(NET_GetPacketPool(sock).packets);
+    *pQueued = packet;
+    pQueued->data = NET_AllocPacketBuffer(sock, packet.size);
+    Q_memcpy(pQueued->data, packet.data, packet.size);
+
+    m_Queues[sock].PushItem(pQueued);
+    ++m_nReceived;
+  }
+}
+
+#endif  // OS_LINUX
+
+// Starts or stops the I/O thread as net_io_thread and the socket setup ask.
+static void NET_UpdateIOThread() {
+#if defined(OS_LINUX)
+  const bool bWanted = net_io_thread.GetBool() && net_dedicated &&
+                       net_multiplayer && VCRGetMode() == VCR_Disabled;
+
+  if (bWanted == s_NetReceiveThread.IsAlive()) return;
+
+  if (bWanted) {
+    s_NetReceiveThread.Start();
+  } else {
+    s_NetReceiveThread.Stop();
+  }
+#endif
+}
+
+// True if the I/O thread services sock, the host frame must not read it then.
+static bool NET_IsIOThreadSocket(int sock) {
+#if defined(OS_LINUX)
+  return s_NetReceiveThread.Owns(sock);
+#else
+  return false;
+#endif
+}
+
+// Stops the I/O thread before net_sockets or net_splitpackets change, packets
+// it queued are still read by the host frame. NET_RunFrame starts it again.
+static void NET_PauseIOThread() {
+#if defined(OS_LINUX)
+  s_NetReceiveThread.Stop();
+#endif
+}
+
+// Stops the I/O thread and drops what it received, before sockets get closed
+// or flushed. NET_RunFrame starts it again.
+static void NET_StopIOThread() {
+#if defined(OS_LINUX)
+  s_NetReceiveThread.Stop();
+  s_NetReceiveThread.DiscardQueued();
+#endif
+}
+
+// Next packet of sock, popped from the I/O thread or read from the socket.
+static bool NET_ReceiveQueuedDatagram(const int sock, netpacket_t *packet) {
+#if defined(OS_LINUX)
+  netpacket_t *pQueued;
+  if (s_NetReceiveThread.PopPacket(sock, &pQueued)) {
+    packet->from = pQueued->from;
+    const double flAge = std::max(Plat_FloatTime() - pQueued->received, 0.0);
+    packet->received = net_time - flAge;
+    packet->size = pQueued->size;
+    packet->wiresize = pQueued->wiresize;
+    Q_memcpy(packet->data, pQueued->data, pQueued->size);
+
+    NET_FreeLaggedPacket(pQueued);
+
+    return NET_LagPacket(true, packet);
+  }
+
+#endif
+
+  if (NET_IsIOThreadSocket(sock)) return false;
+
+  return NET_ReceiveDatagram(sock, packet);
+}
+
 netpacket_t *NET_GetPacket(int sock, uint8_t *scratch) {
   // Each socket has its own netpacket to allow multithreading
   netpacket_t &inpacket = net_packets[sock];
 
   NET_AdjustLag();
-  NET_DiscardStaleSplitpackets(sock);
+  // The I/O thread owns the split packet state of its sockets.
+  if (!NET_IsIOThreadSocket(sock)) {
+    NET_DiscardStaleSplitpackets(sock, net_time);
+  }
 
   // setup new packet
   inpacket.from.SetType(NA_IP);
@@ -1345,7 +1960,7 @@ netpacket_t *NET_GetPacket(int sock, uint8_t *scratch) {
     }
 
     // then check UDP data
-    if (!NET_ReceiveDatagram(sock, &inpacket)) {
+    if (!NET_ReceiveQueuedDatagram(sock, &inpacket)) {
       // at last check if the lag system has a packet for us
       if (!NET_LagPacket(false, &inpacket)) {
         return nullptr;  // we don't have any new packet
@@ -1481,8 +2096,6 @@ void NET_ProcessListen(int sock) {
   }
 }
 
-CTSList<uint8_t *> g_NetScratchBuffers;
-
 void NET_ProcessSocket(int sock, IConnectionlessPacketHandler *handler) {
   netpacket_t *packet;
 
@@ -1508,11 +2121,8 @@ void NET_ProcessSocket(int sock, IConnectionlessPacketHandler *handler) {
   }
 
   // now get datagrams from sockets
-  uint8_t *scratch;
-  if (!g_NetScratchBuffers.PopItem(&scratch)) {
-    scratch = new byte[NET_MAX_MESSAGE];
-  }
-  while ((packet = NET_GetPacket(sock, scratch)) != nullptr) {
+  netbufferlarge_t *scratch = NET_GetPooled(NET_GetPacketPool(sock).large);
+  while ((packet = NET_GetPacket(sock, scratch->data)) != nullptr) {
     if (Filter_ShouldDiscard(
             packet->from))  // filtering is done by network layer
     {
@@ -1546,7 +2156,7 @@ void NET_ProcessSocket(int sock, IConnectionlessPacketHandler *handler) {
     packet->from.ToString() );
     }*/
   }
-  g_NetScratchBuffers.PushItem(scratch);
+  NET_GetPacketPool(sock).large.PutObject(scratch);
 }
 
 void NET_LogBadPacket(netpacket_t *packet) {
@@ -1581,6 +2191,16 @@ void NET_LogBadPacket(netpacket_t *packet) {
 int NET_SendToImpl(SOCKET s, const char FAR *buf, int len,
                    const struct sockaddr FAR *to, int tolen,
                    int iGameDataLength) {
+#if defined(OS_LINUX)
+  CNetSendBatch *pBatch = s_pSendBatch;
+  if (pBatch && pBatch->IsOpen() && pBatch->Add(s, buf, len, to, tolen)) {
+    return len;
+  }
+#endif
+
+  ++s_nUDPSendCalls;
+  ++s_nUDPSendDatagrams;
+
   return sendto(s, buf, len, 0, to, tolen);
 }
 
@@ -1824,6 +2444,9 @@ int NET_SendLong(INetChannel *chan, int sock, SOCKET s, const char FAR *buf,
   int nTotalBytesSent = 0;
   bool bFirstSend = true;
 
+  // All fragments go out in one sendmmsg where batching is available.
+  NET_BeginSendBatch();
+
   while (nBytesLeft > 0) {
     int size = std::min(nSplitSizeMinusHeader, nBytesLeft);
 
@@ -1870,6 +2493,7 @@ int NET_SendLong(INetChannel *chan, int sock, SOCKET s, const char FAR *buf,
     bFirstSend = false;
 
     if (ret < 0) {
+      NET_EndSendBatch();
       return ret;
     }
 
@@ -1894,6 +2518,8 @@ int NET_SendLong(INetChannel *chan, int sock, SOCKET s, const char FAR *buf,
     }
   }
 
+  NET_EndSendBatch();
+
   return nTotalBytesSent;
 }
 
@@ -1951,11 +2577,8 @@ int NET_SendPacket(INetChannel *chan, int sock, const netadr_t &to,
 
   to.ToSockadr(&addr);
 
-  MEM_ALLOC_CREDIT();
-  CUtlMemoryFixedGrowable<byte, NET_COMPRESSION_STACKBUF_SIZE> memCompressed(
-      NET_COMPRESSION_STACKBUF_SIZE);
-  CUtlMemoryFixedGrowable<byte, NET_COMPRESSION_STACKBUF_SIZE>
-      memCompressedVoice(NET_COMPRESSION_STACKBUF_SIZE);
+  CNetPacketBuffer memCompressed(sock);
+  CNetPacketBuffer memCompressedVoice(sock);
 
   int iGameDataLength = pVoicePayload ? length : -1;
 
@@ -2089,6 +2712,8 @@ NET_CloseAllSockets
 ====================
 */
 void NET_CloseAllSockets() {
+  NET_StopIOThread();
+
   // shut down any existing and open sockets
   for (int i = 0; i < net_sockets.Count(); i++) {
     if (net_sockets[i].nPort) {
@@ -2102,6 +2727,8 @@ void NET_CloseAllSockets() {
     }
   }
 
+  NET_DiscardRecvBatches();
+
   // shut down all pending sockets
   AUTO_LOCK_FM(s_PendingSockets);
   for (int j = 0; j < s_PendingSockets.Count(); j++) {
@@ -2117,7 +2744,11 @@ NET_FlushAllSockets
 ====================
 */
 void NET_FlushAllSockets() {
+  NET_StopIOThread();
+
   // drain any packets that my still lurk in our incoming queue
+  NET_DiscardRecvBatches();
+
   char data[2048];
   struct sockaddr from;
   int fromlen = sizeof(from);
@@ -2137,6 +2768,8 @@ void NET_FlushAllSockets() {
 
 static void OpenSocketInternal(int nModule, int nSetPort, int nDefaultPort,
                                const char *pName, int nProtocol, bool bTryAny) {
+  NET_PauseIOThread();
+
   int port = nSetPort ? nSetPort : nDefaultPort;
   int *handle = nullptr;
   if (nProtocol == IPPROTO_TCP) {
@@ -2188,6 +2821,8 @@ void NET_OpenSockets() {
 }
 
 int NET_AddExtraSocket(int port) {
+  NET_PauseIOThread();
+
   int newSocket = net_sockets.AddToTail();
 
   Q_memset(&net_sockets[newSocket], 0, sizeof(netsocket_t));
@@ -2201,6 +2836,8 @@ int NET_AddExtraSocket(int port) {
 }
 
 void NET_RemoveAllExtraSockets() {
+  NET_PauseIOThread();
+
   for (int i = MAX_SOCKETS; i < net_sockets.Count(); i++) {
     if (net_sockets[i].nPort) {
       NET_CloseSocket(net_sockets[i].hUDP);
@@ -2296,6 +2933,7 @@ RunFrame must be called each system frame before reading/sending on any socket
 */
 void NET_RunFrame(double the_realtime) {
   NET_SetTime(the_realtime);
+  NET_UpdateIOThread();
 
   RCONServer().RunFrame();
   RPTServer().RunFrame();
@@ -2394,6 +3032,8 @@ void NET_SetDedicated() {
 void NET_ListenSocket(int sock, bool bListen) {
   Assert((sock >= 0) && (sock < net_sockets.Count()));
 
+  NET_PauseIOThread();
+
   netsocket_t *netsock = &net_sockets[sock];
 
   if (netsock->hTCP) {
@@ -2614,6 +3254,50 @@ CON_COMMAND(net_start, "Inits multiplayer network sockets") {
   NET_Config();
 }
 
+// Socket calls per host frame since the last net_status, the datagrams per
+// call show what batching buys. Packet heap allocations should stay at zero
+// once the pools are warm.
+static void NET_PrintUDPStats() {
+  static int s_nLastFrame = 0;
+  static int s_nLastRecvCalls = 0, s_nLastRecvDatagrams = 0;
+  static int s_nLastSendCalls = 0, s_nLastSendDatagrams = 0;
+  static int s_nLastAllocations = 0;
+
+  const int nFrames = std::max(1, host_framecount - s_nLastFrame);
+  const int nRecvCalls = s_nUDPRecvCalls - s_nLastRecvCalls;
+  const int nRecvDatagrams = s_nUDPRecvDatagrams - s_nLastRecvDatagrams;
+  const int nSendCalls = s_nUDPSendCalls - s_nLastSendCalls;
+  const int nSendDatagrams = s_nUDPSendDatagrams - s_nLastSendDatagrams;
+  const int nAllocations = s_nPacketAllocations - s_nLastAllocations;
+
+  ConMsg("- Sockets: calls per frame out %.1f, in %.1f\n",
+         (float)nSendCalls / nFrames, (float)nRecvCalls / nFrames);
+  ConMsg("           datagrams per call out %.1f, in %.1f\n",
+         (float)nSendDatagrams / std::max(1, nSendCalls),
+         (float)nRecvDatagrams / std::max(1, nRecvCalls));
+  ConMsg("- Buffers: %i packet heap allocations (%.3f per datagram), %i "
+         "total\n",
+         nAllocations,
+         (float)nAllocations / std::max(1, nRecvDatagrams + nSendDatagrams),
+         (int)s_nPacketAllocations);
+
+#if defined(OS_LINUX)
+  if (s_NetReceiveThread.IsAlive()) {
+    ConMsg("- I/O thread: %i packets received, %i dropped, %i queued\n",
+           (int)s_NetReceiveThread.m_nReceived,
+           (int)s_NetReceiveThread.m_nDropped,
+           s_NetReceiveThread.QueuedPackets());
+  }
+#endif
+
+  s_nLastFrame = host_framecount;
+  s_nLastRecvCalls = s_nUDPRecvCalls;
+  s_nLastRecvDatagrams = s_nUDPRecvDatagrams;
+  s_nLastSendCalls = s_nUDPSendCalls;
+  s_nLastSendDatagrams = s_nUDPSendDatagrams;
+  s_nLastAllocations = s_nPacketAllocations;
+}
+
 CON_COMMAND(net_status, "Shows current network status") {
   AUTO_LOCK_FM(s_NetChannels);
   int numChannels = s_NetChannels.Count();
@@ -2630,6 +3314,8 @@ CON_COMMAND(net_status, "Shows current network status") {
       net_sockets[NS_HLTV].nPort, net_sockets[NS_MATCHMAKING].nPort,
       net_sockets[NS_SYSTEMLINK].nPort);
 
+  NET_PrintUDPStats();
+
   if (numChannels <= 0) {
     return;
   }
@@ -2676,6 +3362,122 @@ CON_COMMAND(net_status, "Shows current network status") {
          (avgDataIn / numChannels) / 1024.0f);
 }
 
+#if defined(OS_LINUX)
+// Non-blocking UDP socket on an ephemeral loopback port.
+static SOCKET NET_OpenBenchSocket(sockaddr_in *pAddr) {
+  SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s == -1) return -1;
+
+  int opt = 1;
+  ioctlsocket(s, FIONBIO, (unsigned long *)&opt);
+
+  int bufsize = 4 * 1024 * 1024;
+  setsockopt(s, SOL_SOCKET, SO_RCVBUF, (char *)&bufsize, sizeof(bufsize));
+
+  Q_memset(pAddr, 0, sizeof(*pAddr));
+  pAddr->sin_family = AF_INET;
+  pAddr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t addrlen = sizeof(*pAddr);
+  if (bind(s, (sockaddr *)pAddr, sizeof(*pAddr)) == -1 ||
+      getsockname(s, (sockaddr *)pAddr, &addrlen) == -1) {
+    closesocket(s);
+    return -1;
+  }
+
+  return s;
+}
+
+static void NET_RunUDPBench(bool bBatched, int nTicks, int nPacketsPerTick,
+                            int nSize, SOCKET hSend, SOCKET hRecv,
+                            const sockaddr_in &to) {
+  CNetSendBatch *pSendBatch = bBatched ? new CNetSendBatch : nullptr;
+  CNetRecvBatch *pRecvBatch = bBatched ? new CNetRecvBatch : nullptr;
+
+  CUtlMemory<char> data(0, NET_UDP_BATCH_SLOT_SIZE);
+  Q_memset(data.Base(), 0xAB, nSize);
+
+  const int nSendCalls = s_nUDPSendCalls;
+  const int nRecvCalls = s_nUDPRecvCalls;
+  int nReceived = 0;
+
+  CFastTimer timer;
+  timer.Start();
+
+  for (int tick = 0; tick < nTicks; tick++) {
+    if (pSendBatch) pSendBatch->Begin();
+
+    for (int i = 0; i < nPacketsPerTick; i++) {
+      if (pSendBatch && pSendBatch->Add(hSend, data.Base(), nSize,
+                                        (const sockaddr *)&to, sizeof(to))) {
+        continue;
+      }
+
+      NET_SendToImpl(hSend, data.Base(), nSize, (const sockaddr *)&to,
+                     sizeof(to), -1);
+    }
+
+    if (pSendBatch) pSendBatch->End();
+
+    // Drain like NET_ProcessSocket does, until the socket would block.
+    for (;;) {
+      sockaddr from;
+      int fromlen = sizeof(from);
+
+      const int ret =
+          pRecvBatch
+              ? pRecvBatch->RecvFrom(hRecv, data.Base(), data.Count(), &from,
+                                     &fromlen)
+              : NET_RecvFromImpl(hRecv, data.Base(), data.Count(), &from,
+                                 &fromlen);
+      if (ret <= 0) break;
+
+      ++nReceived;
+    }
+  }
+
+  timer.End();
+
+  const double flSeconds = std::max(timer.GetDuration().GetSeconds(), 1e-6);
+  Msg("%-8s %8d/%d datagrams in %6.3fs, %9.0f datagrams/s, %.2f send + %.2f "
+      "recv calls per tick\n",
+      bBatched ? "batched" : "scalar", nReceived, nTicks * nPacketsPerTick,
+      flSeconds, nReceived / flSeconds,
+      (float)(s_nUDPSendCalls - nSendCalls) / nTicks,
+      (float)(s_nUDPRecvCalls - nRecvCalls) / nTicks);
+
+  delete pSendBatch;
+  delete pRecvBatch;
+}
+
+CON_COMMAND(net_udp_bench,
+            "Loopback UDP throughput, per-datagram calls against "
+            "recvmmsg/sendmmsg: [ticks] [datagrams per tick] [bytes]") {
+  const int nTicks = args.ArgC() > 1 ? std::max(1, atoi(args[1])) : 1000;
+  const int nPacketsPerTick =
+      args.ArgC() > 2 ? std::max(1, atoi(args[2])) : 64;
+  const int nSize = args.ArgC() > 3 ? std::clamp(atoi(args[3]), 1,
+                                                 NET_UDP_BATCH_SLOT_SIZE)
+                                    : MAX_USER_MAXROUTABLE_SIZE;
+
+  sockaddr_in sendAddr, recvAddr;
+  SOCKET hSend = NET_OpenBenchSocket(&sendAddr);
+  SOCKET hRecv = NET_OpenBenchSocket(&recvAddr);
+
+  if (hSend != -1 && hRecv != -1) {
+    NET_RunUDPBench(false, nTicks, nPacketsPerTick, nSize, hSend, hRecv,
+                    recvAddr);
+    NET_RunUDPBench(true, nTicks, nPacketsPerTick, nSize, hSend, hRecv,
+                    recvAddr);
+  } else {
+    Warning("net_udp_bench: couldn't open loopback sockets.\n");
+  }
+
+  if (hSend != -1) closesocket(hSend);
+  if (hRecv != -1) closesocket(hRecv);
+}
+#endif  // OS_LINUX
+
 //-----------------------------------------------------------------------------
 // Purpose: Generic buffer compression from source into dest
 // Input  : *dest -
@@ -2685,21 +3487,13 @@ CON_COMMAND(net_status, "Shows current network status") {
 // Output : int
 //-----------------------------------------------------------------------------
 bool NET_BufferToBufferCompress(char *dest, unsigned int *destLen, char *source,
-                                unsigned int sourceLen) {
+                                unsigned int sourceLen, NetCompressor_t codec) {
   Assert(dest);
   Assert(destLen);
   Assert(source);
 
-  Q_memcpy(dest, source, sourceLen);
-  CLZSS s;
-  unsigned int uCompressedLen = 0;
-  uint8_t *pbOut = s.Compress((uint8_t *)source, sourceLen, &uCompressedLen);
-  if (pbOut && uCompressedLen > 0 && uCompressedLen <= *destLen) {
-    Q_memcpy(dest, pbOut, uCompressedLen);
-    *destLen = uCompressedLen;
-    heap_free(pbOut);
-  } else {
-    heap_free(pbOut);
+  if (!NET_Compress(codec, (uint8_t *)dest, destLen, (uint8_t *)source,
+                    sourceLen)) {
     Q_memcpy(dest, source, sourceLen);
     *destLen = sourceLen;
     return false;
@@ -2717,19 +3511,16 @@ bool NET_BufferToBufferCompress(char *dest, unsigned int *destLen, char *source,
 //-----------------------------------------------------------------------------
 bool NET_BufferToBufferDecompress(char *dest, unsigned int *destLen,
                                   char *source, unsigned int sourceLen) {
-  CLZSS s;
-  if (s.IsCompressed((uint8_t *)source)) {
-    unsigned int uDecompressedLen = s.GetActualSize((uint8_t *)source);
-    if (uDecompressedLen > *destLen) {
-      Sys_Error(
-          "NET_BufferToBufferDecompress with improperly sized dest buffer (%u "
-          "in, %u needed)\n",
-          *destLen, uDecompressedLen);
-      return false;
-    } else {
-      *destLen = s.Uncompress((uint8_t *)source, (uint8_t *)dest);
-    }
+  unsigned int uDecompressedLen;
+  if (NET_IsCompressed((uint8_t *)source, sourceLen, &uDecompressedLen)) {
+    // The size comes from the peer, so no Sys_Error on a bad one.
+    if (uDecompressedLen > *destLen) return false;
+
+    return NET_Decompress((uint8_t *)dest, destLen, (uint8_t *)source,
+                          sourceLen);
   } else {
+    if (sourceLen > *destLen) return false;
+
     Q_memcpy(dest, source, sourceLen);
     *destLen = sourceLen;
   }
@@ -18,6 +18,8 @@ ConVar net_queued_packet_thread{"net_queued_packet_thread", "1", 0,
                                 "frame."};
 ConVar net_queue_trace{"net_queue_trace", "0", 0};
 
+extern void NET_AddPacketAllocations(int nAllocations);
+
 class CQueuedPacketSender : public CThread, public IQueuedPacketSender {
  public:
   CQueuedPacketSender();
@@ -54,7 +56,11 @@ class CQueuedPacketSender : public CThread, public IQueuedPacketSender {
     }
   };
 
+  void FreePacket(QueuedPacket *packet);
+
   CUtlPriorityQueue<QueuedPacket *> queued_packets_;
+  // Sent packets are recycled, their buffers keep the capacity they grew to.
+  CTSPool<QueuedPacket> free_packets_;
   CThreadMutex queued_packets_mutex_;
   CThreadEvent thread_Event_;
   volatile bool should_thread_exit_;
@@ -69,6 +75,10 @@ CQueuedPacketSender::CQueuedPacketSender()
 
 CQueuedPacketSender::~CQueuedPacketSender() { Shutdown(); }
 
+void CQueuedPacketSender::FreePacket(QueuedPacket *packet) {
+  free_packets_.PutObject(packet);
+}
+
 bool CQueuedPacketSender::Setup() { return Start(); }
 
 bool CQueuedPacketSender::Start(unsigned nBytesStack) {
@@ -99,7 +109,7 @@ void CQueuedPacketSender::Shutdown() {
   Join();  // Wait for the thread to exit.
 
   while (queued_packets_.Count() > 0) {
-    delete queued_packets_.ElementAtHead();
+    FreePacket(queued_packets_.ElementAtHead());
     queued_packets_.RemoveAtHead();
   }
 
@@ -114,7 +124,7 @@ void CQueuedPacketSender::ClearQueuedPacketsForChannel(INetChannel *channel) {
 
     if (p->Channel == channel) {
       queued_packets_.RemoveAt(i);
-      delete p;
+      FreePacket(p);
     }
   }
 
@@ -134,7 +144,13 @@ void CQueuedPacketSender::QueuePacket(INetChannel *pChan, SOCKET s,
 
   if (queued_packets_.Count() < max_queued_packets) {
     // Add this packet to the queue.
-    auto *packet = new QueuedPacket{now_milliseconds + msecDelay, pChan, s};
+    bool is_allocated;
+    QueuedPacket *packet = free_packets_.GetObject(&is_allocated);
+    if (is_allocated) NET_AddPacketAllocations(1);
+
+    packet->UnsendTime = now_milliseconds + msecDelay;
+    packet->Channel = pChan;
+    packet->Socket = s;
     packet->To.CopyArray((char *)to, tolen);
     packet->Buffer.CopyArray((char *)buf, len);
 
@@ -182,6 +198,9 @@ int CQueuedPacketSender::Run() {
     const bool do_trace{net_queue_trace.GetInt() ==
                         NET_QUEUED_PACKET_THREAD_DEBUG_VALUE};
 
+    // Everything that is due goes out together.
+    NET_BeginSendBatch();
+
     while (queued_packets_.Count() > 0) {
       QueuedPacket *packet = queued_packets_.ElementAtHead();
 
@@ -217,10 +236,12 @@ int CQueuedPacketSender::Run() {
                        packet->To.Count(), -1);
       }
 
-      delete packet;
+      FreePacket(packet);
       queued_packets_.RemoveAtHead();
     }
 
+    NET_EndSendBatch();
+
     queued_packets_mutex_.Unlock();
   }
 }
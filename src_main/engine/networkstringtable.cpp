@@ -2,6 +2,8 @@
 
 #include "networkstringtable.h"
 
+#include <algorithm>
+
 #include "baseclient.h"
 #include "filesystem_engine.h"
 #include "host.h"
@@ -10,18 +12,33 @@
 #include "sysexternal.h"
 #include "tier0/include/vprof.h"
 #include "tier1/bitbuf.h"
+#include "tier1/convar.h"
+#include "tier1/generichash.h"
 #include "tier1/utlbuffer.h"
 
 #include "tier0/include/memdbgon.h"
 
 #define SUBSTRING_BITS 5
+// svc_UpdateStringTableDelta shares longer prefixes, long paths like
+// "models/props_c17/" often have more than 31 characters in common.
+#define DELTA_SUBSTRING_BITS 8
 struct StringHistoryEntry {
-  char string[(1 << SUBSTRING_BITS)];
+  char string[(1 << DELTA_SUBSTRING_BITS)];
 };
 
-static int CountSimilarCharacters(char const *str1, char const *str2) {
+// Matching runs of user data shorter than this are cheaper to send as part of
+// the changed bytes than as a run of their own.
+#define USERDATA_PATCH_MIN_KEEP 3
+
+static ConVar net_stringtable_deltas(
+    "net_stringtable_deltas", "1", FCVAR_USERINFO,
+    "Lets the server send string table updates with shared prefixes and user "
+    "data patches (svc_UpdateStringTableDelta).");
+
+static int CountSimilarCharacters(char const *str1, char const *str2,
+                                  int maxcount) {
   int c = 0;
-  while (*str1 && *str2 && *str1 == *str2 && c < ((1 << SUBSTRING_BITS) - 1)) {
+  while (*str1 && *str2 && *str1 == *str2 && c < maxcount) {
     str1++;
     str2++;
     c++;
@@ -31,13 +48,15 @@ static int CountSimilarCharacters(char const *str1, char const *str2) {
 }
 
 static int GetBestPreviousString(CUtlVector<StringHistoryEntry> &history,
-                                 char const *newstring, int &substringsize) {
+                                 char const *newstring, int &substringsize,
+                                 int substringbits) {
   int bestindex = -1;
   int bestcount = 0;
   int c = history.Count();
   for (int i = 0; i < c; i++) {
     char const *prev = history[i].string;
-    int similar = CountSimilarCharacters(prev, newstring);
+    int similar = CountSimilarCharacters(prev, newstring,
+                                         (1 << substringbits) - 1);
 
     if (similar < 3) continue;
 
@@ -51,29 +70,100 @@ static int GetBestPreviousString(CUtlVector<StringHistoryEntry> &history,
   return bestindex;
 }
 
-bool CNetworkStringTable_LessFunc(FileNameHandle_t const &a,
-                                  FileNameHandle_t const &b) {
-  return a < b;
-}
+//-----------------------------------------------------------------------------
+// Open addressed hash index from a key hash to a dictionary index. Linear
+// probing over a power of two slot array that is kept at most half full, the
+// dictionaries never remove single entries.
+//-----------------------------------------------------------------------------
+class CNetworkStringHashIndex {
+ public:
+  CNetworkStringHashIndex() : m_nCount{0} {}
+
+  void Purge() {
+    m_Slots.Purge();
+    m_nCount = 0;
+  }
+
+  // Dictionary index of the first entry with this hash for which
+  // IsMatch(index) is true, or -1.
+  template <typename Match>
+  int Find(unsigned int hash, const Match &IsMatch) const {
+    if (m_nCount == 0) return -1;
+
+    const int mask = m_Slots.Count() - 1;
+    for (int i = hash & mask; m_Slots[i].m_nIndex >= 0; i = (i + 1) & mask) {
+      if (m_Slots[i].m_nHash == hash && IsMatch(m_Slots[i].m_nIndex)) {
+        return m_Slots[i].m_nIndex;
+      }
+    }
+
+    return -1;
+  }
+
+  void Insert(unsigned int hash, int index) {
+    if (2 * (m_nCount + 1) > m_Slots.Count()) {
+      Rehash(std::max(16, 2 * m_Slots.Count()));
+    }
+
+    InsertSlot(hash, index);
+    m_nCount++;
+  }
+
+ private:
+  struct Slot_t {
+    unsigned int m_nHash;
+    int m_nIndex;  // -1 if free
+  };
+
+  void InsertSlot(unsigned int hash, int index) {
+    const int mask = m_Slots.Count() - 1;
+    int i = hash & mask;
+    while (m_Slots[i].m_nIndex >= 0) {
+      i = (i + 1) & mask;
+    }
+
+    m_Slots[i].m_nHash = hash;
+    m_Slots[i].m_nIndex = index;
+  }
+
+  void Rehash(int count) {
+    CUtlVector<Slot_t> old;
+    old.Swap(m_Slots);
+
+    m_Slots.SetCount(count);
+    for (int i = 0; i < count; i++) {
+      m_Slots[i].m_nIndex = -1;
+    }
+
+    for (int i = 0; i < old.Count(); i++) {
+      if (old[i].m_nIndex >= 0) InsertSlot(old[i].m_nHash, old[i].m_nIndex);
+    }
+  }
+
+  CUtlVector<Slot_t> m_Slots;
+  int m_nCount;
+};
 
 //-----------------------------------------------------------------------------
 // Implementation when dictionary strings are filenames
 //-----------------------------------------------------------------------------
 class CNetworkStringFilenameDict : public INetworkStringDict {
  public:
-  CNetworkStringFilenameDict() {
-    m_Items.SetLessFunc(CNetworkStringTable_LessFunc);
-  }
+  CNetworkStringFilenameDict() {}
 
   virtual ~CNetworkStringFilenameDict() { Purge(); }
 
   unsigned int Count() { return m_Items.Count(); }
 
-  void Purge() { m_Items.RemoveAll(); }
+  void Purge() {
+    m_Items.Purge();
+    m_Index.Purge();
+  }
 
   const char *String(int index) {
     char szString[SOURCE_MAX_PATH];
-    g_pFileSystem->String(m_Items.Key(index), szString, sizeof(szString));
+    g_pFileSystem->String(m_Items[index].m_hFileName, szString,
+                          sizeof(szString));
     return va("%s", szString);
   }
 
@@ -81,27 +171,45 @@ class CNetworkStringFilenameDict : public INetworkStringDict {
 
   int Insert(const char *pString) {
     FileNameHandle_t fnHandle = g_pFileSystem->FindOrAddFileName(pString);
-    return m_Items.Insert(fnHandle);
+
+    int index = m_Items.AddToTail();
+    m_Items[index].m_hFileName = fnHandle;
+    m_Index.Insert(HashFileName(fnHandle), index);
+    return index;
   }
 
   int Find(const char *pString) {
     FileNameHandle_t fnHandle = g_pFileSystem->FindFileName(pString);
     if (!fnHandle) return m_Items.InvalidIndex();
-    return m_Items.Find(fnHandle);
+
+    return m_Index.Find(HashFileName(fnHandle), [&](int index) {
+      return m_Items[index].m_hFileName == fnHandle;
+    });
   }
 
-  CNetworkStringTableItem &Element(int index) { return m_Items.Element(index); }
+  CNetworkStringTableItem &Element(int index) { return m_Items[index].m_Item; }
 
   const CNetworkStringTableItem &Element(int index) const {
-    return m_Items.Element(index);
+    return m_Items[index].m_Item;
   }
 
  private:
-  CUtlMap<FileNameHandle_t, CNetworkStringTableItem> m_Items;
+  struct Entry_t {
+    FileNameHandle_t m_hFileName;
+    CNetworkStringTableItem m_Item;
+  };
+
+  static unsigned int HashFileName(FileNameHandle_t fnHandle) {
+    return HashInt((int)(uintptr_t)fnHandle);
+  }
+
+  CUtlVector<Entry_t> m_Items;
+  CNetworkStringHashIndex m_Index;
 };
 
 //-----------------------------------------------------------------------------
-// Implementation for general purpose strings
+// Implementation for general purpose strings, case insensitive like the
+// CUtlDict it replaces.
 //-----------------------------------------------------------------------------
 class CNetworkStringDict : public INetworkStringDict {
  public:
@@ -111,24 +219,49 @@ class CNetworkStringDict : public INetworkStringDict {
 
   unsigned int Count() { return m_Items.Count(); }
 
-  void Purge() { m_Items.Purge(); }
+  void Purge() {
+    for (int i = 0; i < m_Items.Count(); i++) {
+      delete[] m_Items[i].m_pString;
+    }
+    m_Items.Purge();
+    m_Index.Purge();
+  }
 
-  const char *String(int index) { return m_Items.GetElementName(index); }
+  const char *String(int index) { return m_Items[index].m_pString; }
 
   bool IsValidIndex(int index) { return m_Items.IsValidIndex(index); }
 
-  int Insert(const char *pString) { return m_Items.Insert(pString); }
+  int Insert(const char *pString) {
+    const int length = Q_strlen(pString) + 1;
 
-  int Find(const char *pString) { return m_Items.Find(pString); }
+    int index = m_Items.AddToTail();
+    m_Items[index].m_pString = new char[length];
+    Q_memcpy(m_Items[index].m_pString, pString, length);
+    m_Index.Insert(HashStringCaselessConventional(pString), index);
+    return index;
+  }
 
-  CNetworkStringTableItem &Element(int index) { return m_Items.Element(index); }
+  int Find(const char *pString) {
+    const unsigned int hash = HashStringCaselessConventional(pString);
+    return m_Index.Find(hash, [&](int index) {
+      return !Q_stricmp(m_Items[index].m_pString, pString);
+    });
+  }
+
+  CNetworkStringTableItem &Element(int index) { return m_Items[index].m_Item; }
 
   const CNetworkStringTableItem &Element(int index) const {
-    return m_Items.Element(index);
+    return m_Items[index].m_Item;
   }
 
  private:
-  CUtlDict<CNetworkStringTableItem, int> m_Items;
+  struct Entry_t {
+    char *m_pString;
+    CNetworkStringTableItem m_Item;
+  };
+
+  CUtlVector<Entry_t> m_Items;
+  CNetworkStringHashIndex m_Index;
 };
 
 //-----------------------------------------------------------------------------
@@ -377,9 +510,105 @@ void CNetworkStringTable::UpdateMirrorTable(int tick_ack) {
   }
 }
 
+// Writes pNew as runs of bytes kept from pOld and runs of bytes sent. Kept
+// runs only cover bytes that are equal in both versions.
+static void WriteUserDataPatch(bf_write &buf, const u8 *pOld, int nOldBytes,
+                               const u8 *pNew, int nNewBytes) {
+  const int nCommon = std::min(nOldBytes, nNewBytes);
+
+  buf.WriteUBitLong(nNewBytes, CNetworkStringTableItem::MAX_USERDATA_BITS);
+
+  int i = 0;
+  while (i < nNewBytes) {
+    int nKeep = 0;
+    while (i + nKeep < nCommon && pOld[i + nKeep] == pNew[i + nKeep]) {
+      nKeep++;
+    }
+    i += nKeep;
+
+    int nSend = 0;
+    while (i + nSend < nNewBytes) {
+      int nMatch = 0;
+      while (i + nSend + nMatch < nCommon &&
+             pOld[i + nSend + nMatch] == pNew[i + nSend + nMatch]) {
+        nMatch++;
+      }
+
+      // Long matches and matches up to the end become the next kept run.
+      if (nMatch >= USERDATA_PATCH_MIN_KEEP ||
+          (nMatch > 0 && i + nSend + nMatch == nNewBytes)) {
+        break;
+      }
+
+      nSend += std::max(nMatch, 1);
+    }
+
+    buf.WriteUBitVar(nKeep);
+    buf.WriteUBitVar(nSend);
+    buf.WriteBytes(pNew + i, nSend);
+    i += nSend;
+  }
+}
+
+// Applies a WriteUserDataPatch patch to pBase, the data the client has.
+static bool ReadUserDataPatch(bf_read &buf, const u8 *pBase, int nBaseBytes,
+                              u8 *pOut, int *pnOutBytes) {
+  const int nBytes =
+      buf.ReadUBitLong(CNetworkStringTableItem::MAX_USERDATA_BITS);
+
+  int i = 0;
+  while (i < nBytes) {
+    const int nKeep = buf.ReadUBitVar();
+    const int nSend = buf.ReadUBitVar();
+
+    if (nKeep < 0 || nSend < 0 || nKeep + nSend == 0 ||
+        nKeep > nBaseBytes - i || nKeep + nSend > nBytes - i ||
+        buf.IsOverflowed()) {
+      return false;
+    }
+
+    Q_memcpy(pOut + i, pBase + i, nKeep);
+    i += nKeep;
+    buf.ReadBytes(pOut + i, nSend);
+    i += nSend;
+  }
+
+  *pnOutBytes = nBytes;
+  return !buf.IsOverflowed();
+}
+
+// User data of a svc_UpdateStringTableDelta entry: a patch against the
+// version before the last change if the client acked that version, else the
+// whole data. The client holds either that version or a newer one it didn't
+// ack yet, both have the kept bytes.
+static void WriteUserDataDelta(bf_write &buf, CNetworkStringTableItem *item,
+                               int tick_ack) {
+  const u8 *pNew = item->m_pUserData;
+  const int nNewBytes = item->m_nUserDataLength;
+  const int nStartBit = buf.GetNumBitsWritten();
+  const int nFullBits =
+      1 + CNetworkStringTableItem::MAX_USERDATA_BITS + nNewBytes * 8;
+
+  if (item->GetTickCreated() <= tick_ack && item->m_pPrevUserData &&
+      item->m_nTickPrevChanged >= 0 && item->m_nTickPrevChanged <= tick_ack) {
+    buf.WriteOneBit(1);
+    WriteUserDataPatch(buf, item->m_pPrevUserData, item->m_nPrevUserDataLength,
+                       pNew, nNewBytes);
+
+    if (buf.GetNumBitsWritten() - nStartBit < nFullBits) return;
+
+    buf.SeekToBit(nStartBit);
+  }
+
+  buf.WriteOneBit(0);
+  buf.WriteUBitLong(nNewBytes, CNetworkStringTableItem::MAX_USERDATA_BITS);
+  buf.WriteBits(pNew, nNewBytes * 8);
+}
+
 int CNetworkStringTable::WriteUpdate(CBaseClient *client, bf_write &buf,
-                                     int tick_ack) {
+                                     int tick_ack, bool bDelta) {
   CUtlVector<StringHistoryEntry> history;
+  const int substringbits = bDelta ? DELTA_SUBSTRING_BITS : SUBSTRING_BITS;
 
   int entriesUpdated = 0;
   int lastEntry = -1;
@@ -411,12 +640,13 @@ int CNetworkStringTable::WriteUpdate(CBaseClient *client, bf_write &buf,
       buf.WriteOneBit(1);
 
       int substringsize = 0;
-      int bestprevious = GetBestPreviousString(history, pEntry, substringsize);
+      int bestprevious =
+          GetBestPreviousString(history, pEntry, substringsize, substringbits);
       if (bestprevious != -1) {
         buf.WriteOneBit(1);
         buf.WriteUBitLong(bestprevious,
                           5);  // history never has more than 32 entries
-        buf.WriteUBitLong(substringsize, SUBSTRING_BITS);
+        buf.WriteUBitLong(substringsize, substringbits);
         buf.WriteString(pEntry + substringsize);
       } else {
         buf.WriteOneBit(0);
@@ -436,6 +666,8 @@ int CNetworkStringTable::WriteUpdate(CBaseClient *client, bf_write &buf,
         // Don't have to send length, it was sent as part of the table
         // definition
         buf.WriteBits(pUserData, GetUserDataSizeBits());
+      } else if (bDelta) {
+        WriteUserDataDelta(buf, p, tick_ack);
       } else {
         buf.WriteUBitLong(len, CNetworkStringTableItem::MAX_USERDATA_BITS);
         buf.WriteBits(pUserData, len * 8);
@@ -470,7 +702,9 @@ int CNetworkStringTable::WriteUpdate(CBaseClient *client, bf_write &buf,
 //-----------------------------------------------------------------------------
 // Purpose: Parse string update
 //-----------------------------------------------------------------------------
-void CNetworkStringTable::ParseUpdate(bf_read &buf, int entries) {
+void CNetworkStringTable::ParseUpdate(bf_read &buf, int entries,
+                                      bool bDelta) {
+  const int substringbits = bDelta ? DELTA_SUBSTRING_BITS : SUBSTRING_BITS;
   int lastEntry = -1;
 
   CUtlVector<StringHistoryEntry> history;
@@ -498,7 +732,7 @@ void CNetworkStringTable::ParseUpdate(bf_read &buf, int entries) {
 
       if (substringcheck) {
         int index = buf.ReadUBitLong(5);
-        int bytestocopy = buf.ReadUBitLong(SUBSTRING_BITS);
+        int bytestocopy = buf.ReadUBitLong(substringbits);
         Q_strncpy(entry, history[index].string, bytestocopy + 1);
         buf.ReadString(substr, sizeof(substr));
         Q_strncat(entry, substr, sizeof(entry), COPY_ALL_CHARACTERS);
@@ -523,6 +757,20 @@ void CNetworkStringTable::ParseUpdate(bf_read &buf, int entries) {
         Assert(nBytes > 0);
         tempbuf[nBytes - 1] = 0;  // be safe, clear last byte
         buf.ReadBits(tempbuf, GetUserDataSizeBits());
+      } else if (bDelta && buf.ReadOneBit()) {
+        // patched against the entry's current user data
+        int nBaseBytes = 0;
+        const void *pBase = NULL;
+        if (entryIndex < GetNumStrings()) {
+          pBase = GetStringUserData(entryIndex, &nBaseBytes);
+        }
+
+        if (!pBase ||
+            !ReadUserDataPatch(buf, (const u8 *)pBase, nBaseBytes, tempbuf,
+                               &nBytes)) {
+          Host_Error("Server sent bogus user data patch for entry %i of %s\n",
+                     entryIndex, GetTableName());
+        }
       } else {
         nBytes = buf.ReadUBitLong(CNetworkStringTableItem::MAX_USERDATA_BITS);
         ErrorIfNot(nBytes <= sizeof(tempbuf),
@@ -1177,11 +1425,15 @@ void CNetworkStringTableContainer::WriteUpdateMessage(CBaseClient *client,
 
     if (!table->ChangedSinceTick(tick_ack)) continue;
 
-    SVC_UpdateStringTable msg;
+    SVC_UpdateStringTable updateMsg;
+    SVC_UpdateStringTableDelta deltaMsg;
+    const bool bDelta = client && client->m_bStringTableDeltas;
+    SVC_UpdateStringTable &msg = bDelta ? deltaMsg : updateMsg;
 
     msg.m_DataOut.StartWriting(buffer, NET_MAX_PAYLOAD);
     msg.m_nTableID = table->GetTableId();
-    msg.m_nChangedEntries = table->WriteUpdate(client, msg.m_DataOut, tick_ack);
+    msg.m_nChangedEntries =
+        table->WriteUpdate(client, msg.m_DataOut, tick_ack, bDelta);
 
     Assert(msg.m_nChangedEntries > 0);  // don't send unnecessary empty updates
 
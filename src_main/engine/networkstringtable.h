@@ -68,8 +68,10 @@ class CNetworkStringTable : public INetworkStringTable {
 
  public:
 #ifndef SHARED_NET_STRING_TABLES
-  int WriteUpdate(CBaseClient *client, bf_write &buf, int tick_ack);
-  void ParseUpdate(bf_read &buf, int entries);
+  // bDelta selects the svc_UpdateStringTableDelta encoding.
+  int WriteUpdate(CBaseClient *client, bf_write &buf, int tick_ack,
+                  bool bDelta = false);
+  void ParseUpdate(bf_read &buf, int entries, bool bDelta = false);
 
   // HLTV change history & rollback
   void EnableRollback();
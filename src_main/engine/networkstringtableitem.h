@@ -42,6 +42,12 @@ class CNetworkStringTableItem {
 #ifndef SHARED_NET_STRING_TABLES
   int m_nTickCreated;
   CUtlVector<itemchange_s> *m_pChangeList;
+
+  // The user data before m_nTickChanged, so updates can patch it for clients
+  // that acked it. m_nTickPrevChanged is -1 if there is none.
+  unsigned char *m_pPrevUserData;
+  int m_nPrevUserDataLength;
+  int m_nTickPrevChanged;
 #endif
 };
 
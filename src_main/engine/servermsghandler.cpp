@@ -11,6 +11,7 @@
 #include "GameUI/IGameUI.h"
 #include "LocalNetworkBackdoor.h"
 #include "cdll_engine_int.h"
+#include "cl_demo.h"
 #include "cl_demoactionmanager.h"
 #include "cl_ents_parse.h"
 #include "cl_main.h"
@@ -527,6 +528,16 @@ bool CClientState::ProcessBSPDecal(SVC_BSPDecal *msg) {
   return true;
 }
 
+bool CClientState::ProcessUpdateStringTableDelta(
+    SVC_UpdateStringTableDelta *msg) {
+  // The demo gets recorded as received, mark it for its readers.
+  if (g_pClientDemoRecorder->IsRecording()) {
+    g_pClientDemoRecorder->m_bStringTableDeltas = true;
+  }
+
+  return CBaseClientState::ProcessUpdateStringTableDelta(msg);
+}
+
 bool CClientState::ProcessGameEvent(SVC_GameEvent *msg) {
   int startbit = msg->m_DataIn.GetNumBitsRead();
 
@@ -5,6 +5,8 @@
 
 #include "ispatialpartitioninternal.h"
 
+#include <algorithm>
+
 #include "bitvec.h"
 #include "bsptreedata.h"
 #include "cmodel.h"
@@ -14,6 +16,7 @@
 #include "enginethreads.h"
 #include "filesystem.h"
 #include "filesystem_engine.h"
+#include "host.h"
 #include "mathlib/vector.h"
 #include "sys_dll.h"
 #include "tier0/include/vprof.h"
@@ -85,6 +88,7 @@ struct EntityInfo_t {
   unsigned short m_nVisitBit[NUM_TREES];
   int m_iLeafList[NUM_TREES];  // Index into the leaf pool - leaf list for
                                // entity (m_aLeafList).
+  int m_iTreeNode[NUM_TREES];  // Leaf node, when the AABB tree is in use.
 };
 
 struct LeafListData_t {
@@ -237,16 +241,85 @@ class CVoxelHash {
 class CSpatialPartition;
 
 //-----------------------------------------------------------------------------
-//
+// One tree of the partition (client or server). CSpatialPartition keeps the
+// handles and list masks, the trees only index the bounds.
 //-----------------------------------------------------------------------------
+class CPartitionTree {
+ public:
+  CPartitionTree() : m_pOwner(NULL), m_TreeId(0) {}
+  virtual ~CPartitionTree() {}
+
+  virtual void Init(CSpatialPartition *pOwner, int iTree,
+                    const Vector &worldmin, const Vector &worldmax) = 0;
+  virtual void Shutdown() = 0;
+
+  virtual void InsertIntoTree(SpatialPartitionHandle_t hPartition,
+                              const Vector &mins, const Vector &maxs) = 0;
+  virtual void RemoveFromTree(SpatialPartitionHandle_t hPartition) = 0;
+  virtual void ElementMoved(SpatialPartitionHandle_t handle, const Vector &mins,
+                            const Vector &maxs) = 0;
+
+  virtual void EnumerateElementsInBox(SpatialPartitionListMask_t listMask,
+                                      const Vector &mins, const Vector &maxs,
+                                      bool coarseTest,
+                                      IPartitionEnumerator *pIterator) = 0;
+  virtual void EnumerateElementsInSphere(SpatialPartitionListMask_t listMask,
+                                         const Vector &origin, float radius,
+                                         bool coarseTest,
+                                         IPartitionEnumerator *pIterator) = 0;
+  virtual void EnumerateElementsAlongRay(SpatialPartitionListMask_t listMask,
+                                         const Ray_t &ray, bool coarseTest,
+                                         IPartitionEnumerator *pIterator) = 0;
+  virtual void EnumerateElementsAtPoint(SpatialPartitionListMask_t listMask,
+                                        const Vector &pt, bool coarseTest,
+                                        IPartitionEnumerator *pIterator) = 0;
+
+  virtual void RenderAllObjectsInTree(float flTime) = 0;
+  virtual void RenderObjectsInPlayerLeafs(const Vector &vecPlayerMin,
+                                          const Vector &vecPlayerMax,
+                                          float flTime) = 0;
+
+  virtual void ReportStats(const char *pFileName) = 0;
+  virtual void DrawDebugOverlays() = 0;
+
+  EntityInfo_t &EntityInfo(SpatialPartitionHandle_t hPartition);
+  int GetTreeId() const;
+
+  void LockForWrite() { m_lock.LockForWrite(); }
+  void UnlockWrite() { m_lock.UnlockWrite(); }
+
+  // Threads that joined a shared read already hold the lock through it.
+  void LockForRead() {
+    if (!m_bInSharedRead) m_lock.LockForRead();
+  }
+  void UnlockRead() {
+    if (!m_bInSharedRead) m_lock.UnlockRead();
+  }
 
-class CVoxelTree {
+  // See ISpatialPartitionInternal::BeginSharedRead.
+  void BeginSharedRead() { m_lock.LockForRead(); }
+  void EndSharedRead() { m_lock.UnlockRead(); }
+  void JoinSharedRead(bool bJoin) { m_bInSharedRead = bJoin; }
+  bool IsInSharedRead() const { return m_bInSharedRead != 0; }
+
+ protected:
+  CSpatialPartition *m_pOwner;
+  int m_TreeId;
+  CThreadSpinRWLock m_lock;
+  CThreadLocalInt<> m_bInSharedRead;
+};
+
+//-----------------------------------------------------------------------------
+// Loose voxel hash, 4 levels of uniform grids
+//-----------------------------------------------------------------------------
+
+class CVoxelTree : public CPartitionTree {
  public:
   // constructor, destructor
   CVoxelTree();
   virtual ~CVoxelTree();
 
-  // Inherited from ISpatialPartition
+  // Inherited from CPartitionTree
   virtual void Init(CSpatialPartition *pOwner, int iTree,
                     const Vector &worldmin, const Vector &worldmax);
 
@@ -275,30 +348,21 @@ class CVoxelTree {
   virtual void ReportStats(const char *pFileName);
   virtual void DrawDebugOverlays();
 
-  EntityInfo_t &EntityInfo(SpatialPartitionHandle_t hPartition);
   CLeafList &LeafList();
 
-  int GetTreeId() const;
-
   CPartitionVisits *BeginVisit();
   CPartitionVisits *GetVisits();
   void EndVisit(CPartitionVisits *);
 
   // Shut down the allocated memory
-  void Shutdown(void);
+  virtual void Shutdown(void);
 
   // Insert into the appropriate tree
-  void InsertIntoTree(SpatialPartitionHandle_t hPartition, const Vector &mins,
-                      const Vector &maxs);
+  virtual void InsertIntoTree(SpatialPartitionHandle_t hPartition,
+                              const Vector &mins, const Vector &maxs);
 
   // Remove from appropriate tree
-  void RemoveFromTree(SpatialPartitionHandle_t hPartition);
-
-  void LockForWrite() { m_lock.LockForWrite(); }
-  void UnlockWrite() { m_lock.UnlockWrite(); }
-
-  void LockForRead() { m_lock.LockForRead(); }
-  void UnlockRead() { m_lock.UnlockRead(); }
+  virtual void RemoveFromTree(SpatialPartitionHandle_t hPartition);
 
   // Ray casting
   bool EnumerateElementsAlongRay_Ray(SpatialPartitionListMask_t listMask,
@@ -320,9 +384,7 @@ class CVoxelTree {
   int m_nLevelCount;
   CVoxelHash *m_pVoxelHash;
   CLeafList m_aLeafList;  // Pool - Linked list(multilist) of leaves per entity.
-  int m_TreeId;
   CThreadLocalPtr<CPartitionVisits> m_pVisits;
-  CSpatialPartition *m_pOwner;
   CUtlVector<unsigned short> m_AvailableVisitBits;
   unsigned short m_nNextVisitBit;
 #if TEST_TRACE_POOL
@@ -330,7 +392,128 @@ class CVoxelTree {
 #else
   CObjectPool<CPartitionVisits, 2> m_FreeVisits;
 #endif
-  CThreadSpinRWLock m_lock;
+};
+
+//-----------------------------------------------------------------------------
+// Dynamic AABB tree, one leaf per handle. Leaf bounds carry some slack so
+// small moves only touch the leaf; a leaf that leaves its parent is put back
+// where it grows the tree least, and rotations keep the tree balanced.
+//-----------------------------------------------------------------------------
+#define SPTREE_NULL_NODE -1
+#define SPTREE_NODE_BLOCK 256
+#define SPTREE_MARGIN 4.0f         // leaf slack on every side
+#define SPTREE_MOTION_SCALE 2.0f   // leaf slack along the last move...
+#define SPTREE_MOTION_LIMIT 64.0f  // ...up to this, so teleports don't bloat
+
+struct AABBTreeNode_t {
+  Vector m_vecMin;  // Leaves: entity bounds plus slack, others: the children.
+  Vector m_vecMax;
+  int m_iParent;    // Next free node while on the free list.
+  int m_iChild[2];  // SPTREE_NULL_NODE for leaves.
+  int m_nHeight;    // 0 for leaves, -1 for free nodes.
+  SpatialPartitionHandle_t m_hPartition;
+
+  bool IsLeaf() const { return m_iChild[0] == SPTREE_NULL_NODE; }
+};
+
+class CAABBTree : public CPartitionTree {
+ public:
+  CAABBTree();
+  virtual ~CAABBTree();
+
+  // Inherited from CPartitionTree
+  virtual void Init(CSpatialPartition *pOwner, int iTree,
+                    const Vector &worldmin, const Vector &worldmax);
+  virtual void Shutdown();
+
+  virtual void InsertIntoTree(SpatialPartitionHandle_t hPartition,
+                              const Vector &mins, const Vector &maxs);
+  virtual void RemoveFromTree(SpatialPartitionHandle_t hPartition);
+  virtual void ElementMoved(SpatialPartitionHandle_t handle, const Vector &mins,
+                            const Vector &maxs);
+
+  virtual void EnumerateElementsInBox(SpatialPartitionListMask_t listMask,
+                                      const Vector &mins, const Vector &maxs,
+                                      bool coarseTest,
+                                      IPartitionEnumerator *pIterator);
+  virtual void EnumerateElementsInSphere(SpatialPartitionListMask_t listMask,
+                                         const Vector &origin, float radius,
+                                         bool coarseTest,
+                                         IPartitionEnumerator *pIterator);
+  virtual void EnumerateElementsAlongRay(SpatialPartitionListMask_t listMask,
+                                         const Ray_t &ray, bool coarseTest,
+                                         IPartitionEnumerator *pIterator);
+  virtual void EnumerateElementsAtPoint(SpatialPartitionListMask_t listMask,
+                                        const Vector &pt, bool coarseTest,
+                                        IPartitionEnumerator *pIterator);
+
+  virtual void RenderAllObjectsInTree(float flTime);
+  virtual void RenderObjectsInPlayerLeafs(const Vector &vecPlayerMin,
+                                          const Vector &vecPlayerMax,
+                                          float flTime);
+
+  virtual void ReportStats(const char *pFileName);
+  virtual void DrawDebugOverlays();
+
+ private:
+  // The tree is only read under the lock, callbacks run once it's dropped so
+  // they are free to move things around.
+  typedef CUtlVectorFixedGrowable<IHandleEntity *, 256> CHitList;
+
+  int AllocNode();
+  void FreeNode(int iNode);
+
+  void InsertLeaf(int iLeaf);
+  void RemoveLeaf(int iLeaf);
+  float InsertCost(int iNode, const Vector &vecMin, const Vector &vecMax) const;
+  void RefitAncestors(int iNode);
+  int Balance(int iNode);
+
+  template <class T>
+  void CollectElements(SpatialPartitionListMask_t listMask,
+                       const T &intersectTest, CHitList &hits);
+  void EnumerateHits(const CHitList &hits, IPartitionEnumerator *pIterator);
+
+  void RenderNodesAtDepth(int iNode, int nDepth, int nTargetDepth,
+                          float flTime);
+
+  CUtlVector<AABBTreeNode_t> m_Nodes;
+  int m_iRoot;
+  int m_iFreeNode;
+  int m_nLeafCount;
+};
+
+enum PartitionBackend_t {
+  PARTITION_BACKEND_VOXEL = 0,
+  PARTITION_BACKEND_AABBTREE,
+  NUM_PARTITION_BACKENDS,
+};
+
+//-----------------------------------------------------------------------------
+// Partition traffic recorded by partition_capture, for partition_bench
+//-----------------------------------------------------------------------------
+enum PartitionOp_t {
+  PARTITION_OP_CREATE = 0,
+  PARTITION_OP_DESTROY,
+  PARTITION_OP_SET_LISTS,
+  PARTITION_OP_INSERT,
+  PARTITION_OP_REMOVE,
+  PARTITION_OP_MOVE,
+  PARTITION_OP_BOX,
+  PARTITION_OP_SPHERE,
+  PARTITION_OP_RAY,
+  PARTITION_OP_POINT,
+};
+
+struct PartitionOpRecord_t {
+  uint8_t m_nOp;
+  bool m_bIsRay;  // Ray_t flags for PARTITION_OP_RAY.
+  bool m_bIsSwept;
+  SpatialPartitionHandle_t m_hPartition;
+  SpatialPartitionListMask_t m_nListMask;
+  Vector m_vec0;  // Mins, sphere origin, ray start or point.
+  Vector m_vec1;  // Maxs or ray delta, sphere radius in x.
+  Vector m_vec2;  // Ray extents.
 };
 
 //-----------------------------------------------------------------------------
@@ -348,6 +531,18 @@ class CSpatialPartition : public ISpatialPartitionInternal {
   virtual void Init(const Vector &worldmin, const Vector &worldmax);
   void Shutdown(void);
 
+  // Init with an explicit backend, the one above reads partition_tree.
+  void Init(const Vector &worldmin, const Vector &worldmax,
+            PartitionBackend_t backend);
+
+  // Records the calls made on the main thread over the next nTicks ticks,
+  // after a snapshot of the current handles.
+  void StartCapture(int nTicks);
+
+  // Replays the capture on new partitions of each backend, times the ticks
+  // and checks that both return the same elements.
+  void BenchmarkCapture(int nIterations);
+
   virtual SpatialPartitionHandle_t CreateHandle(IHandleEntity *pHandleEntity);
   virtual SpatialPartitionHandle_t CreateHandle(
       IHandleEntity *pHandleEntity, SpatialPartitionListMask_t listMask,
@@ -421,13 +616,22 @@ class CSpatialPartition : public ISpatialPartitionInternal {
                               const Vector &mins, const Vector &maxs);
   virtual void RemoveFromTree(SpatialPartitionHandle_t hPartition);
 
-  CVoxelTree *VoxelTree(SpatialPartitionListMask_t listMask);
-  CVoxelTree *VoxelTreeForHandle(SpatialPartitionHandle_t handle);
+  CPartitionTree *Tree(SpatialPartitionListMask_t listMask);
+  CPartitionTree *TreeForHandle(SpatialPartitionHandle_t handle);
+
+  virtual void BeginSharedRead(SpatialPartitionListMask_t listMask);
+  virtual void EndSharedRead(SpatialPartitionListMask_t listMask);
+  virtual void JoinSharedRead(SpatialPartitionListMask_t listMask, bool bJoin);
 
  protected:
   // Invokes the pre-query callbacks.
   void InvokeQueryCallbacks(SpatialPartitionListMask_t listMask, bool = false);
 
+  // Appends to the capture, NULL when not recording.
+  PartitionOpRecord_t *CaptureOp(PartitionOp_t nOp,
+                                 SpatialPartitionHandle_t handle,
+                                 SpatialPartitionListMask_t listMask);
+
   typedef CUtlLinkedList<
       EntityInfo_t, SpatialPartitionHandle_t, false, SpatialPartitionHandle_t,
       CUtlMemoryStack<
@@ -440,6 +644,10 @@ class CSpatialPartition : public ISpatialPartitionInternal {
   CThreadFastMutex m_HandlesMutex;
 
   CVoxelTree m_VoxelTrees[NUM_TREES];
+  CAABBTree m_AABBTrees[NUM_TREES];
+  CPartitionTree *m_pTrees[NUM_TREES];  // Backend picked by Init.
+  Vector m_vecWorldMin;
+  Vector m_vecWorldMax;
 
   IPartitionQueryCallback
       *m_pQueryCallback[MAX_QUERY_CALLBACK];  // Query callbacks.
@@ -448,6 +656,11 @@ class CSpatialPartition : public ISpatialPartitionInternal {
 
   // Debug!
   SpatialPartitionListMask_t m_nSuppressedListMask;
+
+  bool m_bCapturing;
+  int m_nCaptureEndTick;
+  int m_nCaptureSnapshotOps;  // Ops recreating the handles at the start.
+  CUtlVector<PartitionOpRecord_t> m_CaptureOps;
 };
 
 ISpatialPartition::~ISpatialPartition() {}
@@ -461,14 +674,14 @@ inline EntityInfo_t &CSpatialPartition::EntityInfo(
   return m_aHandles[hPartition];
 }
 
-inline EntityInfo_t &CVoxelTree::EntityInfo(
+inline EntityInfo_t &CPartitionTree::EntityInfo(
     SpatialPartitionHandle_t hPartition) {
   return m_pOwner->EntityInfo(hPartition);
 }
 
-inline CLeafList &CVoxelTree::LeafList() { return m_aLeafList; }
+inline int CPartitionTree::GetTreeId() const { return m_TreeId; }
 
-inline int CVoxelTree::GetTreeId() const { return m_TreeId; }
+inline CLeafList &CVoxelTree::LeafList() { return m_aLeafList; }
 
 inline CPartitionVisits *CVoxelTree::GetVisits() { return m_pVisits; }
 
@@ -485,16 +698,35 @@ inline void CVoxelTree::EndVisit(CPartitionVisits *pPrev) {
   m_pVisits = pPrev;
 }
 
-inline CVoxelTree *CSpatialPartition::VoxelTree(
+inline CPartitionTree *CSpatialPartition::Tree(
     SpatialPartitionListMask_t listMask) {
   int iTree = ((listMask & PARTITION_ALL_CLIENT_EDICTS) == 0) ? SERVER_TREE
                                                               : CLIENT_TREE;
-  return &m_VoxelTrees[iTree];
+  return m_pTrees[iTree];
 }
 
-inline CVoxelTree *CSpatialPartition::VoxelTreeForHandle(
+inline CPartitionTree *CSpatialPartition::TreeForHandle(
     SpatialPartitionHandle_t handle) {
-  return VoxelTree(m_aHandles[handle].m_fList);
+  return Tree(m_aHandles[handle].m_fList);
+}
+
+inline PartitionOpRecord_t *CSpatialPartition::CaptureOp(
+    PartitionOp_t nOp, SpatialPartitionHandle_t handle,
+    SpatialPartitionListMask_t listMask) {
+  if (!m_bCapturing || !ThreadInMainThread()) return NULL;
+
+  if (host_tickcount >= m_nCaptureEndTick) {
+    m_bCapturing = false;
+    Msg("Partition capture done, %d ops.\n", m_CaptureOps.Count());
+    return NULL;
+  }
+
+  PartitionOpRecord_t &op = m_CaptureOps[m_CaptureOps.AddToTail()];
+  memset(&op, 0, sizeof(op));
+  op.m_nOp = nOp;
+  op.m_hPartition = handle;
+  op.m_nListMask = listMask;
+  return &op;
 }
 
 //-----------------------------------------------------------------------------
@@ -1678,7 +1910,7 @@ void CVoxelHash::RenderObjectsInPlayerLeafs(const Vector &vecPlayerMin,
 //-----------------------------------------------------------------------------
 
 CVoxelTree::CVoxelTree()
-    : m_pVoxelHash(NULL), m_pOwner(NULL), m_nNextVisitBit(0) {
+    : m_pVoxelHash(NULL), m_nNextVisitBit(0) {
   // Compute max number of levels
   m_nLevelCount = 0;
   while (CVoxelHash::ComputeVoxelCountAtLevel(m_nLevelCount) > 2) {
@@ -1749,6 +1981,8 @@ void CVoxelTree::InsertIntoTree(SpatialPartitionHandle_t hPartition,
     UnlockRead();
   }
 
+  // The shared read lock is only dropped once every joined thread is done.
+  Assert(!IsInSharedRead());
   m_lock.LockForWrite();
   Assert(hPartition != PARTITION_INVALID_HANDLE);
 
@@ -1799,6 +2033,7 @@ void CVoxelTree::RemoveFromTree(SpatialPartitionHandle_t hPartition) {
       UnlockRead();
     }
 
+    Assert(!IsInSharedRead());
     m_lock.LockForWrite();
     m_pVoxelHash[nLevel].RemoveFromTree(hPartition);
     m_AvailableVisitBits.AddToTail(info.m_nVisitBit[m_TreeId]);
@@ -1862,12 +2097,12 @@ void CVoxelTree::EnumerateElementsInBox(SpatialPartitionListMask_t listMask,
   // Callbacks.
   CPartitionVisits *pPrevVisits = BeginVisit();
 
-  m_lock.LockForRead();
+  LockForRead();
   Voxel_t vs = m_pVoxelHash[0].VoxelIndexFromPoint(mins);
   Voxel_t ve = m_pVoxelHash[0].VoxelIndexFromPoint(maxs);
   if (!m_pVoxelHash[0].EnumerateElementsInBox(listMask, vs, ve, mins, maxs,
                                               pIterator)) {
-    m_lock.UnlockRead();
+    UnlockRead();
     EndVisit(pPrevVisits);
     return;
   }
@@ -1876,7 +2111,7 @@ void CVoxelTree::EnumerateElementsInBox(SpatialPartitionListMask_t listMask,
   ve = ConvertToNextLevel(ve);
   if (!m_pVoxelHash[1].EnumerateElementsInBox(listMask, vs, ve, mins, maxs,
                                               pIterator)) {
-    m_lock.UnlockRead();
+    UnlockRead();
     EndVisit(pPrevVisits);
     return;
   }
@@ -1885,7 +2120,7 @@ void CVoxelTree::EnumerateElementsInBox(SpatialPartitionListMask_t listMask,
   ve = ConvertToNextLevel(ve);
   if (!m_pVoxelHash[2].EnumerateElementsInBox(listMask, vs, ve, mins, maxs,
                                               pIterator)) {
-    m_lock.UnlockRead();
+    UnlockRead();
     EndVisit(pPrevVisits);
     return;
   }
@@ -1895,7 +2130,7 @@ void CVoxelTree::EnumerateElementsInBox(SpatialPartitionListMask_t listMask,
   m_pVoxelHash[3].EnumerateElementsInBox(listMask, vs, ve, mins, maxs,
                                          pIterator);
 
-  m_lock.UnlockRead();
+  UnlockRead();
   EndVisit(pPrevVisits);
 }
 
@@ -2247,7 +2482,7 @@ void CVoxelTree::EnumerateElementsAlongRay(SpatialPartitionListMask_t listMask,
 
   CPartitionVisits *pPrevVisits = BeginVisit();
 
-  m_lock.LockForRead();
+  LockForRead();
   if (ray.m_IsRay) {
     EnumerateElementsAlongRay_Ray(listMask, clippedRay, vecInvDelta, vecEnd,
                                   pIterator);
@@ -2256,7 +2491,7 @@ void CVoxelTree::EnumerateElementsAlongRay(SpatialPartitionListMask_t listMask,
                                           vecEnd, pIterator);
   }
 
-  m_lock.UnlockRead();
+  UnlockRead();
   EndVisit(pPrevVisits);
 }
 
@@ -2273,29 +2508,29 @@ void CVoxelTree::EnumerateElementsAtPoint(SpatialPartitionListMask_t listMask,
   // Early-out.
   if (listMask == 0) return;
 
-  m_lock.LockForRead();
+  LockForRead();
   // Callbacks.
   Voxel_t v = m_pVoxelHash[0].VoxelIndexFromPoint(pt);
   if (!m_pVoxelHash[0].EnumerateElementsAtPoint(listMask, v, pt, pIterator)) {
-    m_lock.UnlockRead();
+    UnlockRead();
     return;
   }
 
   v = ConvertToNextLevel(v);
   if (!m_pVoxelHash[1].EnumerateElementsAtPoint(listMask, v, pt, pIterator)) {
-    m_lock.UnlockRead();
+    UnlockRead();
     return;
   }
 
   v = ConvertToNextLevel(v);
   if (!m_pVoxelHash[2].EnumerateElementsAtPoint(listMask, v, pt, pIterator)) {
-    m_lock.UnlockRead();
+    UnlockRead();
     return;
   }
 
   v = ConvertToNextLevel(v);
   m_pVoxelHash[3].EnumerateElementsAtPoint(listMask, v, pt, pIterator);
-  m_lock.UnlockRead();
+  UnlockRead();
 }
 
 //-----------------------------------------------------------------------------
@@ -2303,11 +2538,11 @@ void CVoxelTree::EnumerateElementsAtPoint(SpatialPartitionListMask_t listMask,
 //-----------------------------------------------------------------------------
 void CVoxelTree::RenderAllObjectsInTree(float flTime) {
   MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
-  m_lock.LockForRead();
+  LockForRead();
   for (int i = 0; i < m_nLevelCount; ++i) {
     m_pVoxelHash[i].RenderAllObjectsInTree(flTime);
   }
-  m_lock.UnlockRead();
+  UnlockRead();
 }
 
 //-----------------------------------------------------------------------------
@@ -2317,12 +2552,607 @@ void CVoxelTree::RenderObjectsInPlayerLeafs(const Vector &vecPlayerMin,
                                             const Vector &vecPlayerMax,
                                             float flTime) {
   MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
-  m_lock.LockForRead();
+  LockForRead();
   for (int i = 0; i < m_nLevelCount; ++i) {
     m_pVoxelHash[i].RenderObjectsInPlayerLeafs(vecPlayerMin, vecPlayerMax,
                                                flTime);
   }
-  m_lock.UnlockRead();
+  UnlockRead();
+}
+
+//-----------------------------------------------------------------------------
+// AABB tree helpers
+//-----------------------------------------------------------------------------
+inline float BoxArea(const Vector &vecMin, const Vector &vecMax) {
+  // Half the surface area, all the insertion heuristic needs.
+  Vector vecSize;
+  VectorSubtract(vecMax, vecMin, vecSize);
+  return vecSize.x * vecSize.y + vecSize.y * vecSize.z + vecSize.z * vecSize.x;
+}
+
+inline bool IsBoxInBox(const Vector &vecMin, const Vector &vecMax,
+                       const Vector &vecOuterMin, const Vector &vecOuterMax) {
+  return (vecMin.x >= vecOuterMin.x) && (vecMax.x <= vecOuterMax.x) &&
+         (vecMin.y >= vecOuterMin.y) && (vecMax.y <= vecOuterMax.y) &&
+         (vecMin.z >= vecOuterMin.z) && (vecMax.z <= vecOuterMax.z);
+}
+
+class CAABBIntersectPoint {
+ public:
+  CAABBIntersectPoint(const Vector &pt) : m_vecPoint(pt) {}
+
+  bool Intersects(const Vector &vecMins, const Vector &vecMaxs) const {
+    return IsPointInBox(m_vecPoint, vecMins, vecMaxs);
+  }
+
+ private:
+  const Vector &m_vecPoint;
+};
+
+class CAABBIntersectBox {
+ public:
+  CAABBIntersectBox(const Vector &vecMins, const Vector &vecMaxs)
+      : m_vecMins(vecMins), m_vecMaxs(vecMaxs) {}
+
+  bool Intersects(const Vector &vecMins, const Vector &vecMaxs) const {
+    return (vecMins.x <= m_vecMaxs.x) && (vecMaxs.x >= m_vecMins.x) &&
+           (vecMins.y <= m_vecMaxs.y) && (vecMaxs.y >= m_vecMins.y) &&
+           (vecMins.z <= m_vecMaxs.z) && (vecMaxs.z >= m_vecMins.z);
+  }
+
+ private:
+  const Vector &m_vecMins;
+  const Vector &m_vecMaxs;
+};
+
+// Rays have zero extents, so this covers both kinds of swept traces.
+class CAABBIntersectSweptBox {
+ public:
+  CAABBIntersectSweptBox(const Ray_t &ray, const Vector &vecInvDelta)
+      : m_Ray(ray), m_vecInvDelta(vecInvDelta) {}
+
+  bool Intersects(const Vector &vecMins, const Vector &vecMaxs) const {
+    Vector vecTestMin, vecTestMax;
+    VectorSubtract(vecMins, m_Ray.m_Extents, vecTestMin);
+    VectorAdd(vecMaxs, m_Ray.m_Extents, vecTestMax);
+    return IsBoxIntersectingRay(vecTestMin, vecTestMax, m_Ray.m_Start,
+                                m_Ray.m_Delta, m_vecInvDelta);
+  }
+
+ private:
+  const Ray_t &m_Ray;
+  const Vector &m_vecInvDelta;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Constructor
+//-----------------------------------------------------------------------------
+CAABBTree::CAABBTree()
+    : m_iRoot(SPTREE_NULL_NODE),
+      m_iFreeNode(SPTREE_NULL_NODE),
+      m_nLeafCount(0) {
+  m_Nodes.SetGrowSize(SPTREE_NODE_BLOCK);
+}
+
+CAABBTree::~CAABBTree() {}
+
+void CAABBTree::Init(CSpatialPartition *pOwner, int iTree,
+                     const Vector &worldmin, const Vector &worldmax) {
+  m_pOwner = pOwner;
+  m_TreeId = iTree;
+  Shutdown();
+}
+
+void CAABBTree::Shutdown() {
+  m_Nodes.Purge();
+  m_iRoot = SPTREE_NULL_NODE;
+  m_iFreeNode = SPTREE_NULL_NODE;
+  m_nLeafCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Node pool
+//-----------------------------------------------------------------------------
+int CAABBTree::AllocNode() {
+  int iNode = m_iFreeNode;
+  if (iNode == SPTREE_NULL_NODE) {
+    iNode = m_Nodes.AddToTail();
+  } else {
+    m_iFreeNode = m_Nodes[iNode].m_iParent;
+  }
+
+  AABBTreeNode_t &node = m_Nodes[iNode];
+  node.m_iParent = SPTREE_NULL_NODE;
+  node.m_iChild[0] = node.m_iChild[1] = SPTREE_NULL_NODE;
+  node.m_nHeight = 0;
+  node.m_hPartition = PARTITION_INVALID_HANDLE;
+  return iNode;
+}
+
+void CAABBTree::FreeNode(int iNode) {
+  AABBTreeNode_t &node = m_Nodes[iNode];
+  node.m_iParent = m_iFreeNode;
+  node.m_nHeight = -1;
+  m_iFreeNode = iNode;
+}
+
+//-----------------------------------------------------------------------------
+// Growth of the tree's area if a leaf with these bounds went under iNode.
+//-----------------------------------------------------------------------------
+float CAABBTree::InsertCost(int iNode, const Vector &vecMin,
+                            const Vector &vecMax) const {
+  const AABBTreeNode_t &node = m_Nodes[iNode];
+  Vector vecUnionMin, vecUnionMax;
+  VectorMin(node.m_vecMin, vecMin, vecUnionMin);
+  VectorMax(node.m_vecMax, vecMax, vecUnionMax);
+
+  float flArea = BoxArea(vecUnionMin, vecUnionMax);
+  return node.IsLeaf() ? flArea
+                       : flArea - BoxArea(node.m_vecMin, node.m_vecMax);
+}
+
+//-----------------------------------------------------------------------------
+// Links a leaf in next to the sibling that grows the tree's area least.
+//-----------------------------------------------------------------------------
+void CAABBTree::InsertLeaf(int iLeaf) {
+  ++m_nLeafCount;
+  if (m_iRoot == SPTREE_NULL_NODE) {
+    m_iRoot = iLeaf;
+    m_Nodes[iLeaf].m_iParent = SPTREE_NULL_NODE;
+    return;
+  }
+
+  // Copies, AllocNode below may move the nodes.
+  Vector vecLeafMin = m_Nodes[iLeaf].m_vecMin;
+  Vector vecLeafMax = m_Nodes[iLeaf].m_vecMax;
+
+  // Walk down while pushing the leaf into a child is cheaper than pairing it
+  // with the current node.
+  int iSibling = m_iRoot;
+  while (!m_Nodes[iSibling].IsLeaf()) {
+    const AABBTreeNode_t &node = m_Nodes[iSibling];
+
+    Vector vecUnionMin, vecUnionMax;
+    VectorMin(node.m_vecMin, vecLeafMin, vecUnionMin);
+    VectorMax(node.m_vecMax, vecLeafMax, vecUnionMax);
+    float flUnionArea = BoxArea(vecUnionMin, vecUnionMax);
+
+    float flCost = 2.0f * flUnionArea;
+    float flInheritedCost =
+        2.0f * (flUnionArea - BoxArea(node.m_vecMin, node.m_vecMax));
+    float flCost0 =
+        InsertCost(node.m_iChild[0], vecLeafMin, vecLeafMax) + flInheritedCost;
+    float flCost1 =
+        InsertCost(node.m_iChild[1], vecLeafMin, vecLeafMax) + flInheritedCost;
+
+    if (flCost < flCost0 && flCost < flCost1) break;
+
+    iSibling = (flCost0 < flCost1) ? node.m_iChild[0] : node.m_iChild[1];
+  }
+
+  // New parent for the sibling and the leaf.
+  int iOldParent = m_Nodes[iSibling].m_iParent;
+  int iNewParent = AllocNode();
+
+  AABBTreeNode_t &newParent = m_Nodes[iNewParent];
+  AABBTreeNode_t &sibling = m_Nodes[iSibling];
+  newParent.m_iParent = iOldParent;
+  newParent.m_iChild[0] = iSibling;
+  newParent.m_iChild[1] = iLeaf;
+  newParent.m_nHeight = sibling.m_nHeight + 1;
+  VectorMin(sibling.m_vecMin, vecLeafMin, newParent.m_vecMin);
+  VectorMax(sibling.m_vecMax, vecLeafMax, newParent.m_vecMax);
+  sibling.m_iParent = iNewParent;
+  m_Nodes[iLeaf].m_iParent = iNewParent;
+
+  if (iOldParent == SPTREE_NULL_NODE) {
+    m_iRoot = iNewParent;
+  } else {
+    AABBTreeNode_t &oldParent = m_Nodes[iOldParent];
+    int nSide = (oldParent.m_iChild[0] == iSibling) ? 0 : 1;
+    oldParent.m_iChild[nSide] = iNewParent;
+  }
+
+  RefitAncestors(iNewParent);
+}
+
+//-----------------------------------------------------------------------------
+// Unlinks a leaf, its sibling takes the parent's place. The leaf node stays
+// allocated.
+//-----------------------------------------------------------------------------
+void CAABBTree::RemoveLeaf(int iLeaf) {
+  --m_nLeafCount;
+  if (iLeaf == m_iRoot) {
+    m_iRoot = SPTREE_NULL_NODE;
+    return;
+  }
+
+  int iParent = m_Nodes[iLeaf].m_iParent;
+  const AABBTreeNode_t &parent = m_Nodes[iParent];
+  int iGrandParent = parent.m_iParent;
+  int iSibling = (parent.m_iChild[0] == iLeaf) ? parent.m_iChild[1]
+                                                : parent.m_iChild[0];
+
+  m_Nodes[iSibling].m_iParent = iGrandParent;
+  if (iGrandParent == SPTREE_NULL_NODE) {
+    m_iRoot = iSibling;
+  } else {
+    AABBTreeNode_t &grandParent = m_Nodes[iGrandParent];
+    int nSide = (grandParent.m_iChild[0] == iParent) ? 0 : 1;
+    grandParent.m_iChild[nSide] = iSibling;
+  }
+
+  FreeNode(iParent);
+  m_Nodes[iLeaf].m_iParent = SPTREE_NULL_NODE;
+
+  RefitAncestors(iGrandParent);
+}
+
+//-----------------------------------------------------------------------------
+// Rebalances and recomputes bounds + heights from iNode up to the root.
+//-----------------------------------------------------------------------------
+void CAABBTree::RefitAncestors(int iNode) {
+  while (iNode != SPTREE_NULL_NODE) {
+    iNode = Balance(iNode);
+
+    AABBTreeNode_t &node = m_Nodes[iNode];
+    const AABBTreeNode_t &child0 = m_Nodes[node.m_iChild[0]];
+    const AABBTreeNode_t &child1 = m_Nodes[node.m_iChild[1]];
+    node.m_nHeight = 1 + std::max(child0.m_nHeight, child1.m_nHeight);
+    VectorMin(child0.m_vecMin, child1.m_vecMin, node.m_vecMin);
+    VectorMax(child0.m_vecMax, child1.m_vecMax, node.m_vecMax);
+
+    iNode = node.m_iParent;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// If one child of iA is 2 levels taller than the other, rotates it up into
+// iA's place: iA takes the child's shorter child, the child keeps the taller
+// one. Returns the node now at iA's place.
+//-----------------------------------------------------------------------------
+int CAABBTree::Balance(int iA) {
+  AABBTreeNode_t &A = m_Nodes[iA];
+  if (A.IsLeaf() || A.m_nHeight < 2) return iA;
+
+  int nBalance = m_Nodes[A.m_iChild[1]].m_nHeight -
+                 m_Nodes[A.m_iChild[0]].m_nHeight;
+  if (nBalance >= -1 && nBalance <= 1) return iA;
+
+  int nSide = (nBalance > 1) ? 1 : 0;
+  int iUp = A.m_iChild[nSide];
+  int iKeep = A.m_iChild[1 - nSide];
+  AABBTreeNode_t &up = m_Nodes[iUp];
+  const AABBTreeNode_t &keep = m_Nodes[iKeep];
+
+  bool bFirstTaller =
+      m_Nodes[up.m_iChild[0]].m_nHeight > m_Nodes[up.m_iChild[1]].m_nHeight;
+  int iTall = bFirstTaller ? up.m_iChild[0] : up.m_iChild[1];
+  int iShort = bFirstTaller ? up.m_iChild[1] : up.m_iChild[0];
+  AABBTreeNode_t &tall = m_Nodes[iTall];
+  AABBTreeNode_t &shortChild = m_Nodes[iShort];
+
+  // Up takes A's place.
+  up.m_iParent = A.m_iParent;
+  if (up.m_iParent == SPTREE_NULL_NODE) {
+    m_iRoot = iUp;
+  } else {
+    AABBTreeNode_t &parent = m_Nodes[up.m_iParent];
+    int nParentSide = (parent.m_iChild[0] == iA) ? 0 : 1;
+    parent.m_iChild[nParentSide] = iUp;
+  }
+
+  // A goes under up, next to the taller grandchild.
+  up.m_iChild[0] = iA;
+  up.m_iChild[1] = iTall;
+  A.m_iParent = iUp;
+  A.m_iChild[nSide] = iShort;
+  shortChild.m_iParent = iA;
+  tall.m_iParent = iUp;
+
+  VectorMin(keep.m_vecMin, shortChild.m_vecMin, A.m_vecMin);
+  VectorMax(keep.m_vecMax, shortChild.m_vecMax, A.m_vecMax);
+  A.m_nHeight = 1 + std::max(keep.m_nHeight, shortChild.m_nHeight);
+
+  VectorMin(A.m_vecMin, tall.m_vecMin, up.m_vecMin);
+  VectorMax(A.m_vecMax, tall.m_vecMax, up.m_vecMax);
+  up.m_nHeight = 1 + std::max(A.m_nHeight, tall.m_nHeight);
+
+  return iUp;
+}
+
+//-----------------------------------------------------------------------------
+// Insert into the tree
+//-----------------------------------------------------------------------------
+void CAABBTree::InsertIntoTree(SpatialPartitionHandle_t hPartition,
+                               const Vector &mins, const Vector &maxs) {
+  Assert(hPartition != PARTITION_INVALID_HANDLE);
+  Assert(!IsInSharedRead());
+  LockForWrite();
+
+  EntityInfo_t &info = EntityInfo(hPartition);
+  Assert(info.m_iTreeNode[m_TreeId] == SPTREE_NULL_NODE);
+
+  // Same bloated, clamped bounds as the voxel tree.
+  info.m_vecMin.Init(mins.x - SPHASH_EPS, mins.y - SPHASH_EPS,
+                     mins.z - SPHASH_EPS);
+  info.m_vecMax.Init(maxs.x + SPHASH_EPS, maxs.y + SPHASH_EPS,
+                     maxs.z + SPHASH_EPS);
+  ClampVector(info.m_vecMin, s_PartitionMin, s_PartitionMax);
+  ClampVector(info.m_vecMax, s_PartitionMin, s_PartitionMax);
+
+  int iLeaf = AllocNode();
+  AABBTreeNode_t &leaf = m_Nodes[iLeaf];
+  leaf.m_hPartition = hPartition;
+  leaf.m_vecMin.Init(info.m_vecMin.x - SPTREE_MARGIN,
+                     info.m_vecMin.y - SPTREE_MARGIN,
+                     info.m_vecMin.z - SPTREE_MARGIN);
+  leaf.m_vecMax.Init(info.m_vecMax.x + SPTREE_MARGIN,
+                     info.m_vecMax.y + SPTREE_MARGIN,
+                     info.m_vecMax.z + SPTREE_MARGIN);
+  info.m_iTreeNode[m_TreeId] = iLeaf;
+
+  InsertLeaf(iLeaf);
+  UnlockWrite();
+}
+
+//-----------------------------------------------------------------------------
+// Remove from the tree
+//-----------------------------------------------------------------------------
+void CAABBTree::RemoveFromTree(SpatialPartitionHandle_t hPartition) {
+  Assert(hPartition != PARTITION_INVALID_HANDLE);
+  EntityInfo_t &info = EntityInfo(hPartition);
+  int iLeaf = info.m_iTreeNode[m_TreeId];
+  if (iLeaf == SPTREE_NULL_NODE) return;
+
+  Assert(!IsInSharedRead());
+  LockForWrite();
+  RemoveLeaf(iLeaf);
+  FreeNode(iLeaf);
+  info.m_iTreeNode[m_TreeId] = SPTREE_NULL_NODE;
+  UnlockWrite();
+}
+
+//-----------------------------------------------------------------------------
+// Called when an element moves. Moves inside the leaf's slack only update the
+// entity, moves that stay inside the parent refit the leaf in place, anything
+// else relinks the leaf.
+//-----------------------------------------------------------------------------
+void CAABBTree::ElementMoved(SpatialPartitionHandle_t hPartition,
+                             const Vector &mins, const Vector &maxs) {
+  if (hPartition == PARTITION_INVALID_HANDLE) return;
+
+  EntityInfo_t &info = EntityInfo(hPartition);
+  int iLeaf = info.m_iTreeNode[m_TreeId];
+  if (iLeaf == SPTREE_NULL_NODE) {
+    InsertIntoTree(hPartition, mins, maxs);
+    return;
+  }
+
+  Vector vecMin(mins.x - SPHASH_EPS, mins.y - SPHASH_EPS, mins.z - SPHASH_EPS);
+  Vector vecMax(maxs.x + SPHASH_EPS, maxs.y + SPHASH_EPS, maxs.z + SPHASH_EPS);
+  ClampVector(vecMin, s_PartitionMin, s_PartitionMax);
+  ClampVector(vecMax, s_PartitionMin, s_PartitionMax);
+  if ((info.m_vecMin == vecMin) && (info.m_vecMax == vecMax)) return;
+
+  Assert(!IsInSharedRead());
+  LockForWrite();
+
+  Vector vecMove;
+  VectorSubtract(vecMin, info.m_vecMin, vecMove);
+  info.m_vecMin = vecMin;
+  info.m_vecMax = vecMax;
+
+  AABBTreeNode_t &leaf = m_Nodes[iLeaf];
+  if (!IsBoxInBox(vecMin, vecMax, leaf.m_vecMin, leaf.m_vecMax)) {
+    leaf.m_vecMin.Init(vecMin.x - SPTREE_MARGIN, vecMin.y - SPTREE_MARGIN,
+                       vecMin.z - SPTREE_MARGIN);
+    leaf.m_vecMax.Init(vecMax.x + SPTREE_MARGIN, vecMax.y + SPTREE_MARGIN,
+                       vecMax.z + SPTREE_MARGIN);
+
+    // Stretch the leaf along the move, it's likely to keep going that way.
+    for (int i = 0; i < 3; ++i) {
+      float flSlack = std::clamp(vecMove[i] * SPTREE_MOTION_SCALE,
+                                 -SPTREE_MOTION_LIMIT, SPTREE_MOTION_LIMIT);
+      if (flSlack < 0.0f) {
+        leaf.m_vecMin[i] += flSlack;
+      } else {
+        leaf.m_vecMax[i] += flSlack;
+      }
+    }
+
+    int iParent = leaf.m_iParent;
+    if ((iParent == SPTREE_NULL_NODE) ||
+        !IsBoxInBox(leaf.m_vecMin, leaf.m_vecMax, m_Nodes[iParent].m_vecMin,
+                    m_Nodes[iParent].m_vecMax)) {
+      RemoveLeaf(iLeaf);
+      InsertLeaf(iLeaf);
+    }
+  }
+
+  UnlockWrite();
+}
+
+//-----------------------------------------------------------------------------
+// Gathers the entities in listMask whose bounds pass the test.
+//-----------------------------------------------------------------------------
+template <class T>
+void CAABBTree::CollectElements(SpatialPartitionListMask_t listMask,
+                                const T &intersectTest, CHitList &hits) {
+  if (m_iRoot == SPTREE_NULL_NODE) return;
+
+  CUtlVectorFixedGrowable<int, 64> stack;
+  stack.AddToTail(m_iRoot);
+  while (stack.Count()) {
+    const AABBTreeNode_t &node = m_Nodes[stack.Tail()];
+    stack.Remove(stack.Count() - 1);
+
+    if (!intersectTest.Intersects(node.m_vecMin, node.m_vecMax)) continue;
+
+    if (!node.IsLeaf()) {
+      stack.AddToTail(node.m_iChild[0]);
+      stack.AddToTail(node.m_iChild[1]);
+      continue;
+    }
+
+    EntityInfo_t &info = EntityInfo(node.m_hPartition);
+
+    // Keep going if this dude isn't in the list
+    if (!(listMask & info.m_fList)) continue;
+
+    if (info.m_flags & ENTITY_HIDDEN) continue;
+
+    if (!intersectTest.Intersects(info.m_vecMin, info.m_vecMax)) continue;
+
+    hits.AddToTail(info.m_pHandleEntity);
+  }
+}
+
+void CAABBTree::EnumerateHits(const CHitList &hits,
+                              IPartitionEnumerator *pIterator) {
+  for (int i = 0; i < hits.Count(); ++i) {
+    if (pIterator->EnumElement(hits[i]) == ITERATION_STOP) return;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CAABBTree::EnumerateElementsInBox(SpatialPartitionListMask_t listMask,
+                                       const Vector &mins, const Vector &maxs,
+                                       bool coarseTest,
+                                       IPartitionEnumerator *pIterator) {
+  VPROF("BoxTest/SphereTest");
+
+  // Early-out.
+  if (listMask == 0) return;
+
+  CAABBIntersectBox intersectBox(mins, maxs);
+  CHitList hits;
+
+  LockForRead();
+  CollectElements(listMask, intersectBox, hits);
+  UnlockRead();
+
+  EnumerateHits(hits, pIterator);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CAABBTree::EnumerateElementsInSphere(SpatialPartitionListMask_t listMask,
+                                          const Vector &origin, float radius,
+                                          bool coarseTest,
+                                          IPartitionEnumerator *pIterator) {
+  // Same as the voxel tree, the box is close enough.
+  Vector vecMin(origin.x - radius, origin.y - radius, origin.z - radius);
+  Vector vecMax(origin.x + radius, origin.y + radius, origin.z + radius);
+  EnumerateElementsInBox(listMask, vecMin, vecMax, coarseTest, pIterator);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CAABBTree::EnumerateElementsAlongRay(SpatialPartitionListMask_t listMask,
+                                          const Ray_t &ray, bool coarseTest,
+                                          IPartitionEnumerator *pIterator) {
+  VPROF("EnumerateElementsAlongRay");
+
+  if (!ray.m_IsSwept) {
+    Vector vecMin, vecMax;
+    VectorSubtract(ray.m_Start, ray.m_Extents, vecMin);
+    VectorAdd(ray.m_Start, ray.m_Extents, vecMax);
+    EnumerateElementsInBox(listMask, vecMin, vecMax, coarseTest, pIterator);
+    return;
+  }
+
+  // Early-out.
+  if (listMask == 0) return;
+
+  Vector vecInvDelta;
+  vecInvDelta[0] = (ray.m_Delta[0] != 0.0f) ? 1.0f / ray.m_Delta[0] : FLT_MAX;
+  vecInvDelta[1] = (ray.m_Delta[1] != 0.0f) ? 1.0f / ray.m_Delta[1] : FLT_MAX;
+  vecInvDelta[2] = (ray.m_Delta[2] != 0.0f) ? 1.0f / ray.m_Delta[2] : FLT_MAX;
+
+  CAABBIntersectSweptBox intersectRay(ray, vecInvDelta);
+  CHitList hits;
+
+  LockForRead();
+  CollectElements(listMask, intersectRay, hits);
+  UnlockRead();
+
+  EnumerateHits(hits, pIterator);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CAABBTree::EnumerateElementsAtPoint(SpatialPartitionListMask_t listMask,
+                                         const Vector &pt, bool coarseTest,
+                                         IPartitionEnumerator *pIterator) {
+  // Early-out.
+  if (listMask == 0) return;
+
+  CAABBIntersectPoint intersectPoint(pt);
+  CHitList hits;
+
+  LockForRead();
+  CollectElements(listMask, intersectPoint, hits);
+  UnlockRead();
+
+  EnumerateHits(hits, pIterator);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Debug! Render boxes around objects in tree.
+//-----------------------------------------------------------------------------
+void CAABBTree::RenderAllObjectsInTree(float flTime) {
+#ifndef SWDS
+  MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
+  LockForRead();
+  for (int i = 0; i < m_Nodes.Count(); ++i) {
+    const AABBTreeNode_t &node = m_Nodes[i];
+    if (node.m_nHeight != 0) continue;
+
+    EntityInfo_t &info = EntityInfo(node.m_hPartition);
+    CDebugOverlay::AddBoxOverlay(vec3_origin, info.m_vecMin, info.m_vecMax,
+                                 vec3_angle, s_pVoxelColor[0][0],
+                                 s_pVoxelColor[0][1], s_pVoxelColor[0][2], 75,
+                                 flTime);
+  }
+  UnlockRead();
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CAABBTree::RenderObjectsInPlayerLeafs(const Vector &vecPlayerMin,
+                                           const Vector &vecPlayerMax,
+                                           float flTime) {
+#ifndef SWDS
+  MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
+  CAABBIntersectBox intersectBox(vecPlayerMin, vecPlayerMax);
+
+  LockForRead();
+  for (int i = 0; i < m_Nodes.Count(); ++i) {
+    const AABBTreeNode_t &node = m_Nodes[i];
+    if (node.m_nHeight != 0) continue;
+
+    EntityInfo_t &info = EntityInfo(node.m_hPartition);
+    if (!intersectBox.Intersects(node.m_vecMin, node.m_vecMax)) continue;
+
+    CDebugOverlay::AddBoxOverlay(vec3_origin, node.m_vecMin, node.m_vecMax,
+                                 vec3_angle, s_pVoxelColor[1][0],
+                                 s_pVoxelColor[1][1], s_pVoxelColor[1][2], 25,
+                                 flTime);
+    CDebugOverlay::AddBoxOverlay(vec3_origin, info.m_vecMin, info.m_vecMax,
+                                 vec3_angle, s_pVoxelColor[0][0],
+                                 s_pVoxelColor[0][1], s_pVoxelColor[0][2], 75,
+                                 flTime);
+  }
+  UnlockRead();
+#endif
 }
 
 //-----------------------------------------------------------------------------
@@ -2341,7 +3171,15 @@ ISpatialPartitionInternal *SpatialPartition() { return &g_SpatialPartition; }
 //-----------------------------------------------------------------------------
 // Purpose: Constructor
 //-----------------------------------------------------------------------------
-CSpatialPartition::CSpatialPartition() { m_nQueryCallbackCount = 0; }
+CSpatialPartition::CSpatialPartition() {
+  m_nQueryCallbackCount = 0;
+  m_bCapturing = false;
+  m_nCaptureEndTick = 0;
+  m_nCaptureSnapshotOps = 0;
+  for (int i = 0; i < NUM_TREES; i++) {
+    m_pTrees[i] = &m_VoxelTrees[i];
+  }
+}
 
 CSpatialPartition::~CSpatialPartition() { Shutdown(); }
 
@@ -2350,13 +3188,40 @@ CSpatialPartition::~CSpatialPartition() { Shutdown(); }
 //   Input: worldmin -
 //          worldmax -
 //-----------------------------------------------------------------------------
+static ConVar partition_tree("partition_tree", "0", 0,
+                             "Spatial partition backend, picked at map load. "
+                             "0: voxel hash, 1: dynamic AABB tree.");
+
 void CSpatialPartition::Init(const Vector &worldmin, const Vector &worldmax) {
+  PartitionBackend_t backend =
+      (partition_tree.GetInt() == PARTITION_BACKEND_AABBTREE)
+          ? PARTITION_BACKEND_AABBTREE
+          : PARTITION_BACKEND_VOXEL;
+  Init(worldmin, worldmax, backend);
+}
+
+void CSpatialPartition::Init(const Vector &worldmin, const Vector &worldmax,
+                             PartitionBackend_t backend) {
+  // The handles recorded so far are about to go away.
+  m_bCapturing = false;
+
   // Clear the handle list and ensure some new memory.
   m_aHandles.Purge();
   m_aHandles.EnsureCapacity(SPHASH_HANDLELIST_BLOCK);
 
+  m_vecWorldMin = worldmin;
+  m_vecWorldMax = worldmax;
+
   for (int i = 0; i < NUM_TREES; i++) {
-    m_VoxelTrees[i].Init(this, i, worldmin, worldmax);
+    // Frees the previous backend.
+    m_pTrees[i]->Shutdown();
+
+    if (backend == PARTITION_BACKEND_AABBTREE) {
+      m_pTrees[i] = &m_AABBTrees[i];
+    } else {
+      m_pTrees[i] = &m_VoxelTrees[i];
+    }
+    m_pTrees[i]->Init(this, i, worldmin, worldmax);
   }
 }
 
@@ -2365,7 +3230,7 @@ void CSpatialPartition::Init(const Vector &worldmin, const Vector &worldmax) {
 //-----------------------------------------------------------------------------
 void CSpatialPartition::Shutdown() {
   for (int i = 0; i < NUM_TREES; i++) {
-    m_VoxelTrees[i].Shutdown();
+    m_pTrees[i]->Shutdown();
   }
   m_aHandles.Purge();
 }
@@ -2463,8 +3328,10 @@ SpatialPartitionHandle_t CSpatialPartition::CreateHandle(
     m_aHandles[hPartition].m_nVisitBit[i] = 0xffff;
     m_aHandles[hPartition].m_nLevel[i] = (uint8_t)-1;
     m_aHandles[hPartition].m_iLeafList[i] = CLeafList::InvalidIndex();
+    m_aHandles[hPartition].m_iTreeNode[i] = SPTREE_NULL_NODE;
   }
 
+  CaptureOp(PARTITION_OP_CREATE, hPartition, 0);
   return hPartition;
 }
 
@@ -2475,6 +3342,7 @@ SpatialPartitionHandle_t CSpatialPartition::CreateHandle(
 void CSpatialPartition::DestroyHandle(SpatialPartitionHandle_t hPartition) {
   if (hPartition != PARTITION_INVALID_HANDLE) {
     RemoveFromTree(hPartition);
+    CaptureOp(PARTITION_OP_DESTROY, hPartition, 0);
     m_HandlesMutex.Lock();
     //		memset( &m_aHandles[hPartition], 0xcd, sizeof(EntityInfo_t) );
     m_aHandles.Remove(hPartition);
@@ -2513,6 +3381,7 @@ void CSpatialPartition::Insert(SpatialPartitionListMask_t listId,
   Assert(m_aHandles.IsValidIndex(handle));
   Assert(listId <= USHRT_MAX);
   m_aHandles[handle].m_fList |= listId;
+  CaptureOp(PARTITION_OP_SET_LISTS, handle, m_aHandles[handle].m_fList);
 }
 
 //-----------------------------------------------------------------------------
@@ -2525,6 +3394,7 @@ void CSpatialPartition::Remove(SpatialPartitionListMask_t listId,
   Assert(m_aHandles.IsValidIndex(handle));
   Assert(listId <= USHRT_MAX);
   m_aHandles[handle].m_fList &= ~listId;
+  CaptureOp(PARTITION_OP_SET_LISTS, handle, m_aHandles[handle].m_fList);
 }
 
 //-----------------------------------------------------------------------------
@@ -2538,6 +3408,7 @@ void CSpatialPartition::RemoveAndInsert(SpatialPartitionListMask_t removeMask,
   Assert(insertMask <= USHRT_MAX);
   m_aHandles[handle].m_fList &= ~removeMask;
   m_aHandles[handle].m_fList |= insertMask;
+  CaptureOp(PARTITION_OP_SET_LISTS, handle, m_aHandles[handle].m_fList);
 }
 
 //-----------------------------------------------------------------------------
@@ -2547,6 +3418,7 @@ void CSpatialPartition::RemoveAndInsert(SpatialPartitionListMask_t removeMask,
 void CSpatialPartition::Remove(SpatialPartitionHandle_t handle) {
   Assert(m_aHandles.IsValidIndex(handle));
   m_aHandles[handle].m_fList = 0;
+  CaptureOp(PARTITION_OP_SET_LISTS, handle, 0);
 }
 
 //-----------------------------------------------------------------------------
@@ -2607,15 +3479,20 @@ void CSpatialPartition::ElementMoved(SpatialPartitionHandle_t handle,
   EntityInfo_t &entityInfo = EntityInfo(handle);
   SpatialPartitionListMask_t listMask = entityInfo.m_fList;
 
+  if (PartitionOpRecord_t *pOp = CaptureOp(PARTITION_OP_MOVE, handle, 0)) {
+    pOp->m_vec0 = mins;
+    pOp->m_vec1 = maxs;
+  }
+
   static_assert(CLIENT_TREE != SERVER_TREE);
 
   if (listMask & PARTITION_ALL_CLIENT_EDICTS) {
-    m_VoxelTrees[CLIENT_TREE].ElementMoved(handle, mins, maxs);
+    m_pTrees[CLIENT_TREE]->ElementMoved(handle, mins, maxs);
     entityInfo.m_flags |= IN_CLIENT_TREE;
   }
 
   if (listMask & ~PARTITION_ALL_CLIENT_EDICTS) {
-    m_VoxelTrees[SERVER_TREE].ElementMoved(handle, mins, maxs);
+    m_pTrees[SERVER_TREE]->ElementMoved(handle, mins, maxs);
     entityInfo.m_flags |= IN_SERVER_TREE;
   }
 }
@@ -2626,8 +3503,19 @@ void CSpatialPartition::ElementMoved(SpatialPartitionHandle_t handle,
 void CSpatialPartition::EnumerateElementsInBox(
     SpatialPartitionListMask_t listMask, const Vector &mins, const Vector &maxs,
     bool coarseTest, IPartitionEnumerator *pIterator) {
+  CPartitionTree *pTree = Tree(listMask);
+  if (pTree->IsInSharedRead()) {
+    // BeginSharedRead ran the callbacks for the whole batch.
+    pTree->EnumerateElementsInBox(listMask, mins, maxs, coarseTest, pIterator);
+    return;
+  }
+
+  if (PartitionOpRecord_t *pOp = CaptureOp(PARTITION_OP_BOX, 0, listMask)) {
+    pOp->m_vec0 = mins;
+    pOp->m_vec1 = maxs;
+  }
+
   MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
-  CVoxelTree *pTree = VoxelTree(listMask);
   InvokeQueryCallbacks(listMask);
   pTree->EnumerateElementsInBox(listMask, mins, maxs, coarseTest, pIterator);
   InvokeQueryCallbacks(listMask, true);
@@ -2639,8 +3527,19 @@ void CSpatialPartition::EnumerateElementsInBox(
 void CSpatialPartition::EnumerateElementsInSphere(
     SpatialPartitionListMask_t listMask, const Vector &origin, float radius,
     bool coarseTest, IPartitionEnumerator *pIterator) {
+  CPartitionTree *pTree = Tree(listMask);
+  if (pTree->IsInSharedRead()) {
+    pTree->EnumerateElementsInSphere(listMask, origin, radius, coarseTest,
+                                     pIterator);
+    return;
+  }
+
+  if (PartitionOpRecord_t *pOp = CaptureOp(PARTITION_OP_SPHERE, 0, listMask)) {
+    pOp->m_vec0 = origin;
+    pOp->m_vec1.x = radius;
+  }
+
   MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
-  CVoxelTree *pTree = VoxelTree(listMask);
   InvokeQueryCallbacks(listMask);
   pTree->EnumerateElementsInSphere(listMask, origin, radius, coarseTest,
                                    pIterator);
@@ -2653,8 +3552,21 @@ void CSpatialPartition::EnumerateElementsInSphere(
 void CSpatialPartition::EnumerateElementsAlongRay(
     SpatialPartitionListMask_t listMask, const Ray_t &ray, bool coarseTest,
     IPartitionEnumerator *pIterator) {
+  CPartitionTree *pTree = Tree(listMask);
+  if (pTree->IsInSharedRead()) {
+    pTree->EnumerateElementsAlongRay(listMask, ray, coarseTest, pIterator);
+    return;
+  }
+
+  if (PartitionOpRecord_t *pOp = CaptureOp(PARTITION_OP_RAY, 0, listMask)) {
+    pOp->m_vec0 = ray.m_Start;
+    pOp->m_vec1 = ray.m_Delta;
+    pOp->m_vec2 = ray.m_Extents;
+    pOp->m_bIsRay = ray.m_IsRay;
+    pOp->m_bIsSwept = ray.m_IsSwept;
+  }
+
   MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
-  CVoxelTree *pTree = VoxelTree(listMask);
   InvokeQueryCallbacks(listMask);
   pTree->EnumerateElementsAlongRay(listMask, ray, coarseTest, pIterator);
   InvokeQueryCallbacks(listMask, true);
@@ -2666,13 +3578,44 @@ void CSpatialPartition::EnumerateElementsAlongRay(
 void CSpatialPartition::EnumerateElementsAtPoint(
     SpatialPartitionListMask_t listMask, const Vector &pt, bool coarseTest,
     IPartitionEnumerator *pIterator) {
+  CPartitionTree *pTree = Tree(listMask);
+  if (pTree->IsInSharedRead()) {
+    pTree->EnumerateElementsAtPoint(listMask, pt, coarseTest, pIterator);
+    return;
+  }
+
+  if (PartitionOpRecord_t *pOp = CaptureOp(PARTITION_OP_POINT, 0, listMask)) {
+    pOp->m_vec0 = pt;
+  }
+
   MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
-  CVoxelTree *pTree = VoxelTree(listMask);
   InvokeQueryCallbacks(listMask);
   pTree->EnumerateElementsAtPoint(listMask, pt, coarseTest, pIterator);
   InvokeQueryCallbacks(listMask, true);
 }
 
+//-----------------------------------------------------------------------------
+// Shared reads. The query callbacks run up front, so the dirty entities are
+// in place and the joined threads see the partition as it was at this point.
+//-----------------------------------------------------------------------------
+void CSpatialPartition::BeginSharedRead(SpatialPartitionListMask_t listMask) {
+  {
+    MDLCACHE_CRITICAL_SECTION_(g_pMDLCache);
+    InvokeQueryCallbacks(listMask);
+    InvokeQueryCallbacks(listMask, true);
+  }
+  Tree(listMask)->BeginSharedRead();
+}
+
+void CSpatialPartition::EndSharedRead(SpatialPartitionListMask_t listMask) {
+  Tree(listMask)->EndSharedRead();
+}
+
+void CSpatialPartition::JoinSharedRead(SpatialPartitionListMask_t listMask,
+                                       bool bJoin) {
+  Tree(listMask)->JoinSharedRead(bJoin);
+}
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -2681,17 +3624,23 @@ void CSpatialPartition::InsertIntoTree(SpatialPartitionHandle_t hPartition,
   EntityInfo_t &entityInfo = EntityInfo(hPartition);
   SpatialPartitionListMask_t listMask = entityInfo.m_fList;
 
+  if (PartitionOpRecord_t *pOp =
+          CaptureOp(PARTITION_OP_INSERT, hPartition, 0)) {
+    pOp->m_vec0 = mins;
+    pOp->m_vec1 = maxs;
+  }
+
   static_assert(CLIENT_TREE != SERVER_TREE);
 
   if ((listMask & PARTITION_ALL_CLIENT_EDICTS) &&
       !(entityInfo.m_flags & IN_CLIENT_TREE)) {
-    m_VoxelTrees[CLIENT_TREE].InsertIntoTree(hPartition, mins, maxs);
+    m_pTrees[CLIENT_TREE]->InsertIntoTree(hPartition, mins, maxs);
     entityInfo.m_flags |= IN_CLIENT_TREE;
   }
 
   if ((listMask & ~PARTITION_ALL_CLIENT_EDICTS) &&
       !(entityInfo.m_flags & IN_SERVER_TREE)) {
-    m_VoxelTrees[SERVER_TREE].InsertIntoTree(hPartition, mins, maxs);
+    m_pTrees[SERVER_TREE]->InsertIntoTree(hPartition, mins, maxs);
     entityInfo.m_flags |= IN_SERVER_TREE;
   }
 }
@@ -2701,14 +3650,15 @@ void CSpatialPartition::InsertIntoTree(SpatialPartitionHandle_t hPartition,
 //-----------------------------------------------------------------------------
 void CSpatialPartition::RemoveFromTree(SpatialPartitionHandle_t hPartition) {
   EntityInfo_t &entityInfo = EntityInfo(hPartition);
+  CaptureOp(PARTITION_OP_REMOVE, hPartition, 0);
 
   if (entityInfo.m_flags & IN_CLIENT_TREE) {
-    m_VoxelTrees[CLIENT_TREE].RemoveFromTree(hPartition);
+    m_pTrees[CLIENT_TREE]->RemoveFromTree(hPartition);
     entityInfo.m_flags &= ~IN_CLIENT_TREE;
   }
 
   if (entityInfo.m_flags & IN_SERVER_TREE) {
-    m_VoxelTrees[SERVER_TREE].RemoveFromTree(hPartition);
+    m_pTrees[SERVER_TREE]->RemoveFromTree(hPartition);
     entityInfo.m_flags &= ~IN_SERVER_TREE;
   }
 }
@@ -2733,7 +3683,7 @@ void CSpatialPartition::RenderObjectsAlongRay(const Ray_t &ray, float flTime) {}
 //-----------------------------------------------------------------------------
 void CSpatialPartition::RenderAllObjectsInTree(float flTime) {
   for (int i = 0; i < NUM_TREES; i++) {
-    m_VoxelTrees[i].RenderAllObjectsInTree(flTime);
+    m_pTrees[i]->RenderAllObjectsInTree(flTime);
   }
 }
 
@@ -2741,7 +3691,7 @@ void CSpatialPartition::RenderObjectsInPlayerLeafs(const Vector &vecPlayerMin,
                                                    const Vector &vecPlayerMax,
                                                    float flTime) {
   for (int i = 0; i < NUM_TREES; i++) {
-    m_VoxelTrees[i].RenderObjectsInPlayerLeafs(vecPlayerMin, vecPlayerMax,
+    m_pTrees[i]->RenderObjectsInPlayerLeafs(vecPlayerMin, vecPlayerMax,
                                                flTime);
   }
 }
@@ -2761,7 +3711,7 @@ void CSpatialPartition::ReportStats(const char *pFileName) {
       m_aHandles.Count() *
           (sizeof(EntityInfo_t) + 2 * sizeof(SpatialPartitionHandle_t)));
   for (int i = 0; i < NUM_TREES; i++) {
-    m_VoxelTrees[i].ReportStats(pFileName);
+    m_pTrees[i]->ReportStats(pFileName);
   }
 }
 
@@ -2773,20 +3723,263 @@ void CVoxelTree::DrawDebugOverlays() {
   int nLevel = r_partition_level.GetInt();
   if (nLevel < 0) return;
 
-  m_lock.LockForRead();
+  LockForRead();
   for (int i = 0; i < m_nLevelCount; ++i) {
     if ((nLevel >= 0) && (nLevel != i)) continue;
 
     m_pVoxelHash[i].RenderGrid();
     m_pVoxelHash[i].RenderAllObjectsInTree(0.01f);
   }
-  m_lock.UnlockRead();
+  UnlockRead();
+}
+
+void CAABBTree::ReportStats(const char *pFileName) {
+  LockForRead();
+  // Internal node area relative to the root, lower is a tighter tree.
+  float flInternalArea = 0;
+  for (int i = 0; i < m_Nodes.Count(); ++i) {
+    const AABBTreeNode_t &node = m_Nodes[i];
+    if (node.m_nHeight > 0) {
+      flInternalArea += BoxArea(node.m_vecMin, node.m_vecMax);
+    }
+  }
+
+  int nHeight = 0;
+  float flRootArea = 0;
+  if (m_iRoot != SPTREE_NULL_NODE) {
+    const AABBTreeNode_t &root = m_Nodes[m_iRoot];
+    nHeight = root.m_nHeight;
+    flRootArea = BoxArea(root.m_vecMin, root.m_vecMax);
+  }
+
+  Msg("AABB tree : %d leaves, %d nodes allocated, height %d, area ratio "
+      "%.2f\n",
+      m_nLeafCount, m_Nodes.Count(), nHeight,
+      (flRootArea > 0) ? flInternalArea / flRootArea : 0.0f);
+  UnlockRead();
+}
+
+void CAABBTree::RenderNodesAtDepth(int iNode, int nDepth, int nTargetDepth,
+                                   float flTime) {
+#ifndef SWDS
+  const AABBTreeNode_t &node = m_Nodes[iNode];
+  if (nDepth < nTargetDepth) {
+    if (!node.IsLeaf()) {
+      RenderNodesAtDepth(node.m_iChild[0], nDepth + 1, nTargetDepth, flTime);
+      RenderNodesAtDepth(node.m_iChild[1], nDepth + 1, nTargetDepth, flTime);
+    }
+    return;
+  }
+
+  const Color &color = s_pVoxelColor[nDepth % ARRAYSIZE(s_pVoxelColor)];
+  CDebugOverlay::AddBoxOverlay(vec3_origin, node.m_vecMin, node.m_vecMax,
+                               vec3_angle, color[0], color[1], color[2], 25,
+                               flTime);
+#endif
+}
+
+// r_partition_level picks the tree depth to draw.
+void CAABBTree::DrawDebugOverlays() {
+  int nLevel = r_partition_level.GetInt();
+  if (nLevel < 0) return;
+
+  LockForRead();
+  if (m_iRoot != SPTREE_NULL_NODE) {
+    RenderNodesAtDepth(m_iRoot, 0, nLevel, 0.01f);
+  }
+  UnlockRead();
 }
 
 void CSpatialPartition::DrawDebugOverlays() {
   for (int i = 0; i < NUM_TREES; i++) {
-    m_VoxelTrees[i].DrawDebugOverlays();
+    m_pTrees[i]->DrawDebugOverlays();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Traffic capture. The snapshot recreates the current handles, so a replay
+// starts from the partition as it was when the capture began.
+//-----------------------------------------------------------------------------
+void CSpatialPartition::StartCapture(int nTicks) {
+  m_CaptureOps.RemoveAll();
+  m_bCapturing = true;
+  m_nCaptureEndTick = host_tickcount + nTicks;
+
+  for (SpatialPartitionHandle_t h = m_aHandles.Head();
+       h != m_aHandles.InvalidIndex(); h = m_aHandles.Next(h)) {
+    const EntityInfo_t &info = m_aHandles[h];
+    CaptureOp(PARTITION_OP_CREATE, h, 0);
+    CaptureOp(PARTITION_OP_SET_LISTS, h, info.m_fList);
+
+    if (!(info.m_flags & (IN_CLIENT_TREE | IN_SERVER_TREE))) continue;
+
+    if (PartitionOpRecord_t *pOp = CaptureOp(PARTITION_OP_INSERT, h, 0)) {
+      // The trees keep the bounds bloated by SPHASH_EPS.
+      pOp->m_vec0.Init(info.m_vecMin.x + SPHASH_EPS,
+                       info.m_vecMin.y + SPHASH_EPS,
+                       info.m_vecMin.z + SPHASH_EPS);
+      pOp->m_vec1.Init(info.m_vecMax.x - SPHASH_EPS,
+                       info.m_vecMax.y - SPHASH_EPS,
+                       info.m_vecMax.z - SPHASH_EPS);
+    }
   }
+
+  m_nCaptureSnapshotOps = m_CaptureOps.Count();
+  Msg("Capturing partition traffic for %d ticks, %d handles.\n", nTicks,
+      m_aHandles.Count());
+}
+
+// Counts what the queries return. Order independent, the backends don't
+// visit elements in the same order.
+class CPartitionBenchEnumerator : public IPartitionEnumerator {
+ public:
+  CPartitionBenchEnumerator() : m_nHits(0), m_nHash(0) {}
+
+  virtual IterationRetval_t EnumElement(IHandleEntity *pHandleEntity) {
+    ++m_nHits;
+    m_nHash += (u32)(uintp)pHandleEntity * 2654435761u;
+    return ITERATION_CONTINUE;
+  }
+
+  int m_nHits;
+  u32 m_nHash;
+};
+
+static void ReplayPartitionOps(CSpatialPartition *pPartition,
+                               const PartitionOpRecord_t *pOps, int nOps,
+                               SpatialPartitionHandle_t *pHandles,
+                               IPartitionEnumerator *pIterator) {
+  for (int i = 0; i < nOps; ++i) {
+    const PartitionOpRecord_t &op = pOps[i];
+    SpatialPartitionHandle_t hPartition = pHandles[op.m_hPartition];
+
+    switch (op.m_nOp) {
+      case PARTITION_OP_CREATE:
+        // Fake entities, the queries only count them.
+        pHandles[op.m_hPartition] = pPartition->CreateHandle(
+            (IHandleEntity *)(uintp)(op.m_hPartition + 1));
+        break;
+      case PARTITION_OP_DESTROY:
+        pPartition->DestroyHandle(hPartition);
+        pHandles[op.m_hPartition] = PARTITION_INVALID_HANDLE;
+        break;
+      case PARTITION_OP_SET_LISTS:
+        if (hPartition == PARTITION_INVALID_HANDLE) break;
+        pPartition->RemoveAndInsert(USHRT_MAX, op.m_nListMask, hPartition);
+        break;
+      case PARTITION_OP_INSERT:
+        if (hPartition == PARTITION_INVALID_HANDLE) break;
+        pPartition->InsertIntoTree(hPartition, op.m_vec0, op.m_vec1);
+        break;
+      case PARTITION_OP_REMOVE:
+        if (hPartition == PARTITION_INVALID_HANDLE) break;
+        pPartition->RemoveFromTree(hPartition);
+        break;
+      case PARTITION_OP_MOVE:
+        if (hPartition == PARTITION_INVALID_HANDLE) break;
+        pPartition->ElementMoved(hPartition, op.m_vec0, op.m_vec1);
+        break;
+      case PARTITION_OP_BOX:
+        pPartition->EnumerateElementsInBox(op.m_nListMask, op.m_vec0,
+                                           op.m_vec1, false, pIterator);
+        break;
+      case PARTITION_OP_SPHERE:
+        pPartition->EnumerateElementsInSphere(op.m_nListMask, op.m_vec0,
+                                              op.m_vec1.x, false, pIterator);
+        break;
+      case PARTITION_OP_RAY: {
+        Ray_t ray;
+        ray.m_Start = op.m_vec0;
+        ray.m_Delta = op.m_vec1;
+        ray.m_Extents = op.m_vec2;
+        ray.m_StartOffset.Init();
+        ray.m_IsRay = op.m_bIsRay;
+        ray.m_IsSwept = op.m_bIsSwept;
+        pPartition->EnumerateElementsAlongRay(op.m_nListMask, ray, false,
+                                              pIterator);
+      } break;
+      case PARTITION_OP_POINT:
+        pPartition->EnumerateElementsAtPoint(op.m_nListMask, op.m_vec0, false,
+                                             pIterator);
+        break;
+    }
+  }
+}
+
+void CSpatialPartition::BenchmarkCapture(int nIterations) {
+  if (m_bCapturing) {
+    Warning("Partition capture still running.\n");
+    return;
+  }
+
+  int nTickOps = m_CaptureOps.Count() - m_nCaptureSnapshotOps;
+  if (nTickOps <= 0) {
+    Warning("Nothing captured, run partition_capture first.\n");
+    return;
+  }
+
+  static const char *s_pBackendNames[NUM_PARTITION_BACKENDS] = {
+      "voxel hash",
+      "AABB tree",
+  };
+
+  CUtlVector<SpatialPartitionHandle_t> handles;
+  handles.SetCount(PARTITION_INVALID_HANDLE + 1);
+
+  CPartitionBenchEnumerator results[NUM_PARTITION_BACKENDS];
+  for (int nBackend = 0; nBackend < NUM_PARTITION_BACKENDS; ++nBackend) {
+    double flBest = FLT_MAX;
+    for (int nIteration = 0; nIteration < nIterations; ++nIteration) {
+      for (int i = 0; i < handles.Count(); ++i) {
+        handles[i] = PARTITION_INVALID_HANDLE;
+      }
+
+      CSpatialPartition *pPartition = new CSpatialPartition;
+      pPartition->Init(m_vecWorldMin, m_vecWorldMax,
+                       (PartitionBackend_t)nBackend);
+
+      // Only the ticks are timed, the snapshot just sets the partition up.
+      CPartitionBenchEnumerator snapshotHits;
+      ReplayPartitionOps(pPartition, m_CaptureOps.Base(),
+                         m_nCaptureSnapshotOps, handles.Base(), &snapshotHits);
+
+      CPartitionBenchEnumerator hits;
+      double flStart = Plat_FloatTime();
+      ReplayPartitionOps(pPartition,
+                         m_CaptureOps.Base() + m_nCaptureSnapshotOps, nTickOps,
+                         handles.Base(), &hits);
+      flBest = std::min(flBest, Plat_FloatTime() - flStart);
+
+      delete pPartition;
+      results[nBackend] = hits;
+    }
+
+    Msg("%-10s : %.3fms  (%d ops, %d elements returned)\n",
+        s_pBackendNames[nBackend], flBest * 1000.0, nTickOps,
+        results[nBackend].m_nHits);
+  }
+
+  for (int nBackend = 1; nBackend < NUM_PARTITION_BACKENDS; ++nBackend) {
+    if ((results[nBackend].m_nHits != results[0].m_nHits) ||
+        (results[nBackend].m_nHash != results[0].m_nHash)) {
+      Warning("%s returned different elements than %s!\n",
+              s_pBackendNames[nBackend], s_pBackendNames[0]);
+    }
+  }
+}
+
+CON_COMMAND(partition_capture,
+            "Records spatial partition traffic for partition_bench. "
+            "Arguments: [ticks, default 1]") {
+  int nTicks = (args.ArgC() > 1) ? std::max(atoi(args[1]), 1) : 1;
+  g_SpatialPartition.StartCapture(nTicks);
+}
+
+CON_COMMAND(partition_bench,
+            "Replays the partition_capture traffic on each spatial partition "
+            "backend. Arguments: [iterations, default 10]") {
+  int nIterations = (args.ArgC() > 1) ? std::max(atoi(args[1]), 1) : 10;
+  g_SpatialPartition.BenchmarkCapture(nIterations);
 }
 
 //=============================================================================
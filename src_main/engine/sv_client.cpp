@@ -473,6 +473,10 @@ void CGameClient::Clear() {
   m_bVoiceLoopback = false;
   m_LastMovementTick = 0;
   m_nSoundSequence = 0;
+  {
+    AUTO_LOCK_FM(m_DeferredDisconnectMutex);
+    m_szDeferredDisconnect[0] = '\0';
+  }
 }
 
 void CGameClient::Reconnect() {
@@ -493,6 +497,22 @@ void CGameClient::Disconnect(const char *fmt, ...) {
   Q_vsnprintf(reason, sizeof(reason), fmt, argptr);
   va_end(argptr);
 
+  // Worker threads can't fire game events or call into the game .dll, so let
+  // SV_FinishPipelinedSnapshots disconnect us on the main thread.
+  if (SV_InPipelinedSend()) {
+    AUTO_LOCK_FM(m_DeferredDisconnectMutex);
+    if (!m_szDeferredDisconnect[0]) {
+      Q_strncpy(m_szDeferredDisconnect, reason,
+                sizeof(m_szDeferredDisconnect));
+    }
+    return;
+  }
+
+  // Don't pull the channel out from under a snapshot still being sent.
+  SV_FinishPipelinedSnapshots();
+  // A disconnect deferred by those sends may have just run.
+  if (m_nSignonState == SIGNONSTATE_NONE) return;
+
   // notify other clients of player leaving the game
   // send the username and network id so we don't depend on the CBasePlayer
   // pointer
@@ -14,6 +14,7 @@
 #include "net.h"
 #include "protocol.h"
 #include "soundinfo.h"
+#include "tier0/include/threadtools.h"
 #include "tier1/UtlVector.h"
 #include "tier1/bitbuf.h"
 #include "tier1/checksum_crc.h"
@@ -132,6 +133,11 @@ class CGameClient : public CBaseClient, public CClientFrameManager {
   bool m_bIsInReplayMode;
   CCheckTransmitInfo m_PrevPackInfo;  // Used to speed up CheckTransmit.
   CBitVec<MAX_EDICTS> m_PrevTransmitEdict;
+
+  // Disconnects raised on pipelined send workers, run later on the main
+  // thread by SV_FinishPipelinedSnapshots.
+  CThreadFastMutex m_DeferredDisconnectMutex;
+  char m_szDeferredDisconnect[256];
 };
 
 #endif  // SV_CLIENT_H
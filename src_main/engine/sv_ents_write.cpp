@@ -12,7 +12,9 @@
 #include "framesnapshot.h"
 #include "hltvserver.h"
 #include "net_synctags.h"
+#include "sv_packedentities.h"
 #include "tier0/include/vcrmode.h"
+#include "tier0/include/vprof.h"
 #include "tier1/UtlLinkedList.h"
 
 #include "tier0/include/memdbgon.h"
@@ -72,11 +74,187 @@ class CEntityWriteInfo : public CEntityInfo {
   int m_nFullProps;   // number of properties send as full update (Enter PVS)
   bool m_bCullProps;  // filter props by clients in recipient lists
 
+  int m_nSharedDeltaHits;    // entity deltas spliced from the shared cache
+  int m_nSharedDeltaMisses;  // entity deltas encoded and added to the cache
+
   /* Some profiling data
   int				m_nTotalGap;
   int				m_nTotalGapCount; */
 };
 
+//-----------------------------------------------------------------------------
+// Shared delta cache.
+//
+// Clients that acked the same tick delta each changed entity from the same
+// PackedEntity, so the encoded prop bits for (entity, from, to) are identical
+// for all of them as long as no SendProxy culled props for one client. The
+// cache is bound to the current tick snapshot and filled lock-free by the
+// SendSnapshot workers.
+//-----------------------------------------------------------------------------
+
+static ConVar sv_deltacache(
+    "sv_deltacache", "1024", 0,
+    "Size in KB of the per-snapshot entity delta cache shared by all clients, "
+    "0 disables it.");
+
+class CSnapshotDeltaCache {
+ public:
+  CSnapshotDeltaCache();
+
+  // Main thread only, with no snapshot being written.
+  void Begin(const CFrameSnapshot *pSnapshot);
+
+  bool IsActive(const CFrameSnapshot *pSnapshot) const {
+    return m_pSnapshot == pSnapshot && pSnapshot &&
+           m_nTickCount == pSnapshot->m_nTickCount;
+  }
+
+  // Writes the cached delta bits, returns false if they aren't cached yet.
+  bool WriteCached(int nEntity, const void *pFrom, const PackedEntity *pTo,
+                   bf_write *pOut, int *pnProps = NULL) const;
+
+  // pStart is a copy of the output buffer taken before the delta was encoded.
+  void Add(int nEntity, const void *pFrom, const PackedEntity *pTo, int nProps,
+           bf_write *pStart, int nBits);
+
+  void AddStats(int nHits, int nMisses);
+
+ private:
+  struct Entry_t {
+    Entry_t *m_pNext;
+    const void *m_pFrom;
+    const PackedEntity *m_pTo;
+    int m_nProps;
+    int m_nBits;
+    // encoded bits follow
+  };
+
+  const CFrameSnapshot *m_pSnapshot;
+  int m_nTickCount;
+  int m_nMaxEntities;
+
+  Entry_t *volatile m_pEntries[MAX_EDICTS];
+
+  CUtlMemory<u8> m_Memory;
+  volatile long m_nUsed;
+
+  volatile long m_nHits;
+  volatile long m_nMisses;
+};
+
+static CSnapshotDeltaCache s_SnapshotDeltaCache;
+
+CSnapshotDeltaCache::CSnapshotDeltaCache() {
+  m_pSnapshot = NULL;
+  m_nTickCount = -1;
+  m_nMaxEntities = 0;
+  Q_memset((void *)m_pEntries, 0, sizeof(m_pEntries));
+  m_nUsed = 0;
+  m_nHits = 0;
+  m_nMisses = 0;
+}
+
+void CSnapshotDeltaCache::Begin(const CFrameSnapshot *pSnapshot) {
+  if (m_pSnapshot) {
+    VPROF_INCREMENT_COUNTER("SV delta cache hits", m_nHits);
+    VPROF_INCREMENT_COUNTER("SV delta cache misses", m_nMisses);
+    VPROF_INCREMENT_COUNTER("SV delta cache bytes",
+                            std::min((int)m_nUsed, m_Memory.Count()));
+  }
+
+  Q_memset((void *)m_pEntries, 0, m_nMaxEntities * sizeof(m_pEntries[0]));
+  m_nUsed = 0;
+  m_nHits = 0;
+  m_nMisses = 0;
+
+  m_pSnapshot = NULL;
+  m_nTickCount = -1;
+  m_nMaxEntities = 0;
+
+  int nCacheSize = sv_deltacache.GetInt() * 1024;
+  if (nCacheSize <= 0 || !pSnapshot) {
+    m_Memory.Purge();
+    return;
+  }
+
+  if (m_Memory.Count() != nCacheSize) {
+    m_Memory.Purge();
+    m_Memory.Grow(nCacheSize);
+  }
+
+  m_pSnapshot = pSnapshot;
+  m_nTickCount = pSnapshot->m_nTickCount;
+  m_nMaxEntities = std::min(pSnapshot->m_nNumEntities, MAX_EDICTS);
+}
+
+bool CSnapshotDeltaCache::WriteCached(int nEntity, const void *pFrom,
+                                      const PackedEntity *pTo, bf_write *pOut,
+                                      int *pnProps) const {
+  if (nEntity < 0 || nEntity >= m_nMaxEntities) return false;
+
+  for (const Entry_t *pEntry = m_pEntries[nEntity]; pEntry;
+       pEntry = pEntry->m_pNext) {
+    if (pEntry->m_pFrom == pFrom && pEntry->m_pTo == pTo) {
+      if (pEntry->m_nBits > 0) {
+        pOut->WriteBits(pEntry + 1, pEntry->m_nBits);
+      }
+
+      if (pnProps) {
+        *pnProps = pEntry->m_nProps;
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void CSnapshotDeltaCache::Add(int nEntity, const void *pFrom,
+                              const PackedEntity *pTo, int nProps,
+                              bf_write *pStart, int nBits) {
+  if (nEntity < 0 || nEntity >= m_nMaxEntities || nBits < 0) return;
+
+  const int nBufferSize = SOURCE_PAD_NUMBER(Bits2Bytes(nBits), 8);
+  const int nEntrySize = sizeof(Entry_t) + nBufferSize;
+
+  long nOffset = ThreadInterlockedExchangeAdd(&m_nUsed, nEntrySize);
+  if (nOffset + nEntrySize > m_Memory.Count()) {
+    return;  // cache is full for this snapshot
+  }
+
+  Entry_t *pEntry = (Entry_t *)(m_Memory.Base() + nOffset);
+  pEntry->m_pFrom = pFrom;
+  pEntry->m_pTo = pTo;
+  pEntry->m_nProps = nProps;
+  pEntry->m_nBits = nBits;
+
+  if (nBits > 0) {
+    bf_read inBuffer;
+    inBuffer.StartReading(pStart->GetData(), pStart->m_nDataBytes,
+                          pStart->GetNumBitsWritten());
+    bf_write outBuffer(pEntry + 1, nBufferSize);
+    outBuffer.WriteBitsFromBuffer(&inBuffer, nBits);
+  }
+
+  // Entries are immutable once linked, readers never lock.
+  Entry_t *pHead;
+  do {
+    pHead = m_pEntries[nEntity];
+    pEntry->m_pNext = pHead;
+  } while (!ThreadInterlockedAssignPointerIf(
+      (void *volatile *)&m_pEntries[nEntity], pEntry, pHead));
+}
+
+void CSnapshotDeltaCache::AddStats(int nHits, int nMisses) {
+  if (nHits) ThreadInterlockedExchangeAdd(&m_nHits, nHits);
+  if (nMisses) ThreadInterlockedExchangeAdd(&m_nMisses, nMisses);
+}
+
+void SV_BeginSnapshotDeltaCache(CFrameSnapshot *pSnapshot) {
+  s_SnapshotDeltaCache.Begin(pSnapshot);
+}
+
 //-----------------------------------------------------------------------------
 // Delta timing helpers.
 //-----------------------------------------------------------------------------
@@ -231,25 +409,10 @@ static inline void SV_WritePropsFromPackedEntity(CEntityWriteInfo &u,
     }
   }
 
-  const void *pToData;
-  int nToBits;
-
-  if (pTo->IsCompressed()) {
-    // let server uncompress PackedEntity
-    pToData = u.m_pServer->UncompressPackedEntity(pTo, nToBits);
-  } else {
-    // get raw data direct
-    pToData = pTo->GetData();
-    nToBits = pTo->GetNumBits();
-  }
-
-  Assert(pToData != NULL);
-
   // Cull out the properties that their proxies said not to send to this client.
   int pSendProps[MAX_DATATABLE_PROPS];
   const int *sendProps = pCheckProps;
   int nSendProps = nCheckProps;
-  bf_write bufStart;
 
   // cull properties that are removed by SendProxies for this client.
   // don't do that for HLTV relay proxies
@@ -264,21 +427,53 @@ static inline void SV_WritePropsFromPackedEntity(CEntityWriteInfo &u,
         pTo->GetRecipients(), pTo->GetNumRecipients(),
 
         pSendProps, std::size(pSendProps));
+  }
+
+  // Nothing culled for this client, so the bits are the same for every client
+  // delta'ing from pFrom. Proxies turning off and on can cull and add the
+  // same number of props, so the count alone doesn't prove it.
+  const bool bShareDelta =
+      u.m_bCullProps && nSendProps == nCheckProps &&
+      !memcmp(sendProps, pCheckProps, sizeof(*pCheckProps) * nCheckProps) &&
+      s_SnapshotDeltaCache.IsActive(u.m_pToSnapshot);
+
+  if (bShareDelta && s_SnapshotDeltaCache.WriteCached(pTo->m_nEntityIndex,
+                                                      pFrom, pTo, u.m_pBuf)) {
+    ++u.m_nSharedDeltaHits;
+    return;
+  }
+
+  const void *pToData;
+  int nToBits;
+
+  if (pTo->IsCompressed()) {
+    // let server uncompress PackedEntity
+    pToData = u.m_pServer->UncompressPackedEntity(pTo, nToBits);
   } else {
-    // this is a HLTV relay proxy
-    bufStart = *u.m_pBuf;
+    // get raw data direct
+    pToData = pTo->GetData();
+    nToBits = pTo->GetNumBits();
   }
 
+  Assert(pToData != NULL);
+
+  bf_write bufStart = *u.m_pBuf;
+
   SendTable_WritePropList(pSendTable, pToData, nToBits, u.m_pBuf,
                           pTo->m_nEntityIndex,
 
                           sendProps, nSendProps);
 
+  int nBits = u.m_pBuf->GetNumBitsWritten() - bufStart.GetNumBitsWritten();
+
   if (!u.m_bCullProps && hltv) {
     // this is a HLTV relay proxy, cache delta bits
-    int nBits = u.m_pBuf->GetNumBitsWritten() - bufStart.GetNumBitsWritten();
     hltv->m_DeltaCache.AddDeltaBits(
         pTo->m_nEntityIndex, u.m_pFromSnapshot->m_nTickCount, nBits, &bufStart);
+  } else if (bShareDelta) {
+    s_SnapshotDeltaCache.Add(pTo->m_nEntityIndex, pFrom, pTo, nSendProps,
+                             &bufStart, nBits);
+    ++u.m_nSharedDeltaMisses;
   }
 }
 
@@ -535,19 +730,40 @@ static inline void SV_WriteEnterPVS(CEntityWriteInfo &u) {
     u.m_pTo->from_baseline->Set(u.m_nNewEntity);
   }
 
-  const void *pToData;
-  int nToBits;
+  // Full deltas from the same baseline don't depend on the client either.
+  const bool bShareDelta = s_SnapshotDeltaCache.IsActive(u.m_pToSnapshot);
+  int nProps;
 
-  if (u.m_pNewPack->IsCompressed()) {
-    pToData = u.m_pServer->UncompressPackedEntity(u.m_pNewPack, nToBits);
+  if (bShareDelta &&
+      s_SnapshotDeltaCache.WriteCached(u.m_pNewPack->m_nEntityIndex, pFromData,
+                                       u.m_pNewPack, u.m_pBuf, &nProps)) {
+    ++u.m_nSharedDeltaHits;
   } else {
-    pToData = u.m_pNewPack->GetData();
-    nToBits = u.m_pNewPack->GetNumBits();
+    const void *pToData;
+    int nToBits;
+
+    if (u.m_pNewPack->IsCompressed()) {
+      pToData = u.m_pServer->UncompressPackedEntity(u.m_pNewPack, nToBits);
+    } else {
+      pToData = u.m_pNewPack->GetData();
+      nToBits = u.m_pNewPack->GetNumBits();
+    }
+
+    bf_write bufStart = *u.m_pBuf;
+
+    nProps = SendTable_WriteAllDeltaProps(pClass->m_pTable, pFromData,
+                                          nFromBits, pToData, nToBits,
+                                          u.m_pNewPack->m_nEntityIndex, u.m_pBuf);
+
+    if (bShareDelta) {
+      int nBits = u.m_pBuf->GetNumBitsWritten() - bufStart.GetNumBitsWritten();
+      s_SnapshotDeltaCache.Add(u.m_pNewPack->m_nEntityIndex, pFromData,
+                               u.m_pNewPack, nProps, &bufStart, nBits);
+      ++u.m_nSharedDeltaMisses;
+    }
   }
 
-  u.m_nFullProps += SendTable_WriteAllDeltaProps(
-      pClass->m_pTable, pFromData, nFromBits, pToData, nToBits,
-      u.m_pNewPack->m_nEntityIndex, u.m_pBuf);
+  u.m_nFullProps += nProps;
 
   if (u.m_nNewEntity == u.m_nOldEntity)
     u.NextOldEntity();  // this was a entity recreate
@@ -694,6 +910,8 @@ void CBaseServer::WriteDeltaEntities(CBaseClient *client, CClientFrame *to,
   u.m_pToSnapshot = to->GetSnapshot();
   u.m_pBaseline = client->m_pBaseline;
   u.m_nFullProps = 0;
+  u.m_nSharedDeltaHits = 0;
+  u.m_nSharedDeltaMisses = 0;
   u.m_pServer = this;
   u.m_nClientEntity = client->m_nEntityIndex;
 #ifndef _XBOX
@@ -817,6 +1035,8 @@ void CBaseServer::WriteDeltaEntities(CBaseClient *client, CClientFrame *to,
     }
   }
 
+  s_SnapshotDeltaCache.AddStats(u.m_nSharedDeltaHits, u.m_nSharedDeltaMisses);
+
   // get number of written bits
   int length = u.m_pBuf->GetNumBitsWritten() - startbit;
 
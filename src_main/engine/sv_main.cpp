@@ -254,6 +254,8 @@ static FILE *OpenRecordingFile() {
 #endif  // #if defined( DEBUG_NETWORKING )
 
 void CGameServer::Clear() {
+  SV_FinishPipelinedSnapshots();
+
   m_pModelPrecacheTable = NULL;
   m_pGenericPrecacheTable = NULL;
   m_pSoundPrecacheTable = NULL;
@@ -796,6 +798,8 @@ bool CGameServer::IsPausable() const {
 }
 
 void CGameServer::Shutdown() {
+  SV_FinishPipelinedSnapshots();
+
   m_bIsLevelMainMenuBackground = false;
 
   CBaseServer::Shutdown();
@@ -1235,6 +1239,11 @@ void CGameServer::CopyTempEntities(CFrameSnapshot *pSnapshot) {
 }
 
 static ConVar sv_parallel_sendsnapshot("sv_parallel_sendsnapshot", "1");
+static ConVar sv_pipeline_sendsnapshot(
+    "sv_pipeline_sendsnapshot", "0", 0,
+    "Dedicated server only: send snapshots on worker threads while the host "
+    "frame continues. Pending sends are finished before the next tick or "
+    "console command runs.");
 
 void SV_ParallelSendSnapshot(CGameClient *&pClient) {
   CClientFrame *pFrame = pClient->GetSendFrame();
@@ -1243,9 +1252,112 @@ void SV_ParallelSendSnapshot(CGameClient *&pClient) {
   pClient->UpdateSendState();
 }
 
+// Snapshot sends handed to the thread pool by the pipelined path. The tick
+// snapshot stays referenced until the main thread collects the jobs.
+struct PipelinedSnapshots_t {
+  CFrameSnapshot *m_pSnapshot;
+  CUtlVector<CJob *> m_Jobs;
+  CUtlVector<CGameClient *> m_Clients;
+  CUtlVector<CClientFrame *> m_Frames;
+  CInterlockedInt m_nNextClient;
+  CInterlockedInt m_nSendMicroseconds;
+};
+
+static PipelinedSnapshots_t s_PipelinedSnapshots;
+
+// Per thread, a main thread disconnect during the sends must not be deferred.
+static thread_local bool s_bInPipelinedSend;
+
+bool SV_InPipelinedSend() { return s_bInPipelinedSend; }
+
+// Worker job, pulls clients until all of them are sent. Each worker keeps its
+// datagrams in one send batch.
+static void SV_PipelinedSendSnapshots() {
+  PipelinedSnapshots_t &pipeline = s_PipelinedSnapshots;
+
+  CFastTimer timer;
+  timer.Start();
+
+  NET_BeginSendBatch();
+  s_bInPipelinedSend = true;
+
+  for (;;) {
+    const int i = ++pipeline.m_nNextClient - 1;
+    if (i >= pipeline.m_Clients.Count()) break;
+
+    CGameClient *pClient = pipeline.m_Clients[i];
+
+    pClient->SendSnapshot(pipeline.m_Frames[i]);
+    pClient->UpdateSendState();
+  }
+
+  s_bInPipelinedSend = false;
+  NET_EndSendBatch();
+
+  timer.End();
+  s_PipelinedSnapshots.m_nSendMicroseconds +=
+      (int)timer.GetDuration().GetMicroseconds();
+}
+
+static bool SV_ShouldPipelineSnapshots() {
+  return sv_pipeline_sendsnapshot.GetBool() && g_pThreadPool &&
+         sv.IsDedicated() && sv.IsMultiplayer() && !g_pLocalNetworkBackdoor;
+}
+
+void SV_FinishPipelinedSnapshots() {
+  PipelinedSnapshots_t &pipeline = s_PipelinedSnapshots;
+  if (!pipeline.m_pSnapshot) return;
+
+  Assert(ThreadInMainThread());
+
+  {
+    // Time the main thread still spends blocked on last tick's sends.
+    VPROF_BUDGET("SV_FinishPipelinedSnapshots",
+                 VPROF_BUDGETGROUP_OTHER_NETWORKING);
+
+    g_pThreadPool->YieldWait(pipeline.m_Jobs.Base(), pipeline.m_Jobs.Count());
+  }
+
+  for (int i = 0; i < pipeline.m_Jobs.Count(); ++i) {
+    pipeline.m_Jobs[i]->Release();
+  }
+  pipeline.m_Jobs.RemoveAll();
+
+  // Total send time moved off the main thread.
+  VPROF_INCREMENT_COUNTER("Pipelined SendSnapshot (us)",
+                          pipeline.m_nSendMicroseconds);
+  pipeline.m_nSendMicroseconds = 0;
+
+  pipeline.m_pSnapshot->ReleaseReference();
+  pipeline.m_pSnapshot = NULL;
+
+  pipeline.m_Frames.RemoveAll();
+  pipeline.m_nNextClient = 0;
+
+  // Clear the pending state first, Disconnect comes back in here.
+  CGameClient *pClients[ABSOLUTE_PLAYER_LIMIT];
+  int nClients = pipeline.m_Clients.Count();
+  Q_memcpy(pClients, pipeline.m_Clients.Base(), nClients * sizeof(*pClients));
+  pipeline.m_Clients.RemoveAll();
+
+  for (int i = 0; i < nClients; ++i) {
+    CGameClient *pClient = pClients[i];
+    char reason[sizeof(pClient->m_szDeferredDisconnect)];
+    {
+      AUTO_LOCK_FM(pClient->m_DeferredDisconnectMutex);
+      Q_strncpy(reason, pClient->m_szDeferredDisconnect, sizeof(reason));
+      pClient->m_szDeferredDisconnect[0] = '\0';
+    }
+
+    if (reason[0]) pClient->Disconnect("%s", reason);
+  }
+}
+
 void CGameServer::SendClientMessages(bool bSendSnapshots) {
   VPROF_BUDGET("SendClientMessages", VPROF_BUDGETGROUP_OTHER_NETWORKING);
 
+  SV_FinishPipelinedSnapshots();
+
   // build individual updates
   int receivingClientCount = 0;
   CGameClient *pReceivingClients[ABSOLUTE_PLAYER_LIMIT];
@@ -1292,10 +1404,48 @@ void CGameServer::SendClientMessages(bool bSendSnapshots) {
     // Compute the client packs
     SV_ComputeClientPacks(receivingClientCount, pReceivingClients, pSnapshot);
 
-    if (receivingClientCount > 1 && sv_parallel_sendsnapshot.GetBool()) {
+    SV_BeginSnapshotDeltaCache(pSnapshot);
+
+    if (SV_ShouldPipelineSnapshots()) {
+      PipelinedSnapshots_t &pipeline = s_PipelinedSnapshots;
+
+      // The packed entities of this tick are immutable now, so delta writing
+      // and transmission can run while the host frame moves on. Send frames
+      // are picked here since that may call into the game .dll.
+      for (int i = 0; i < receivingClientCount; ++i) {
+        CGameClient *pClient = pReceivingClients[i];
+        CClientFrame *pFrame = pClient->GetSendFrame();
+
+        if (!pFrame) continue;
+
+        // SourceTV feeds the HLTV server directly, keep it on this thread.
+        if (pClient->IsHLTV()) {
+          pClient->SendSnapshot(pFrame);
+          pClient->UpdateSendState();
+          continue;
+        }
+
+        pipeline.m_Clients.AddToTail(pClient);
+        pipeline.m_Frames.AddToTail(pFrame);
+      }
+
+      const int nJobs = std::min(pipeline.m_Clients.Count(),
+                                 std::max(1, g_pThreadPool->NumThreads()));
+      for (int i = 0; i < nJobs; ++i) {
+        pipeline.m_Jobs.AddToTail(
+            g_pThreadPool->QueueCall(&SV_PipelinedSendSnapshots));
+      }
+
+      pSnapshot->AddReference();
+      pipeline.m_pSnapshot = pSnapshot;
+    } else if (receivingClientCount > 1 &&
+               sv_parallel_sendsnapshot.GetBool()) {
       ParallelProcess(pReceivingClients, receivingClientCount,
-                      &SV_ParallelSendSnapshot);
+                      &SV_ParallelSendSnapshot, &NET_BeginSendBatch,
+                      &NET_EndSendBatch);
     } else {
+      NET_BeginSendBatch();
+
       for (int i = 0; i < receivingClientCount; ++i) {
         CGameClient *pClient = pReceivingClients[i];
         CClientFrame *pFrame = pClient->GetSendFrame();
@@ -1305,6 +1455,8 @@ void CGameServer::SendClientMessages(bool bSendSnapshots) {
         pClient->SendSnapshot(pFrame);
         pClient->UpdateSendState();
       }
+
+      NET_EndSendBatch();
     }
 
     pSnapshot->ReleaseReference();
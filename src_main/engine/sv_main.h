@@ -27,6 +27,12 @@ extern CUtlVector<int> g_AreasNetworked;
 void SV_Frame(bool send_client_updates);
 void SV_FrameExecuteThreadDeferred();
 
+// Waits for snapshots still being sent by sv_pipeline_sendsnapshot workers.
+// Must be called on the main thread before anything touches client channels.
+void SV_FinishPipelinedSnapshots();
+// True on a worker thread while it runs pipelined snapshot sends.
+bool SV_InPipelinedSend();
+
 void SV_InitGameDLL(void);
 
 void SV_ReplicateConVarChange(ConVar const *var, char const *newValue);
@@ -10,6 +10,10 @@
 void SV_ComputeClientPacks(int clientCount, CGameClient **clients,
                            CFrameSnapshot *snapshot);
 
+// Binds the shared entity delta cache (sv_ents_write.cpp) to the snapshot
+// about to be sent, dropping the previous snapshot's entries.
+void SV_BeginSnapshotDeltaCache(CFrameSnapshot *snapshot);
+
 void SV_WriteSendTables(ServerClass *pClasses, bf_write &pBuf);
 void SV_WriteClassInfos(ServerClass *pClasses, bf_write &pBuf);
 
@@ -0,0 +1,773 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+
+#include "asyncreadqueue.h"
+
+#include "build/include/build_config.h"
+
+#ifdef OS_LINUX
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+#include "basefilesystem.h"
+#include "tier0/include/icommandline.h"
+#include "tier1/utllinkedlist.h"
+#include "tier1/utlvector.h"
+
+#include "tier0/include/memdbgon.h"
+
+// Jobs taken off the queue at a time, per thread.
+#define ASYNC_READ_URING_BATCH 64
+#define ASYNC_READ_PREADV_BATCH 16
+#define ASYNC_READ_PREADV_THREADS 4
+
+// Reads in the same file merge into one readv when the hole between them is
+// at most ASYNC_READ_MAX_GAP bytes, up to these limits per readv.
+#define ASYNC_READ_MAX_GAP (16 * 1024)
+#define ASYNC_READ_MAX_RUN_BYTES (1024 * 1024)
+#define ASYNC_READ_MAX_RUN_IOVECS 64
+
+namespace {
+
+//-----------------------------------------------------------------------------
+// A job whose bytes the queue reads itself.
+//-----------------------------------------------------------------------------
+struct QueuedRead_t {
+  IAsyncReadJob *m_pJob;
+  int m_fd;
+  int64_t m_nOffset;  // in the file behind m_fd
+  int m_nBytes;       // clamped to the end of the file
+  int m_nRequested;   // what SyncRead() would have asked for
+  void *m_pDest;
+};
+
+//-----------------------------------------------------------------------------
+// Sorted, adjacent reads of one file, read with a single readv. Holes between
+// them land in the batch's scratch buffer.
+//-----------------------------------------------------------------------------
+struct ReadRun_t {
+  int m_fd;
+  int64_t m_nOffset;
+  int m_nBytes;
+  int m_iFirstRead;
+  int m_nReads;
+  int m_iFirstIovec;
+  int m_nIovecs;
+  bool m_bDone;
+};
+
+struct BatchFile_t {
+  CUtlString m_Path;
+  int m_fd;
+};
+
+struct ReadBatch_t {
+  CUtlVector<QueuedRead_t> m_Reads;
+  CUtlVector<ReadRun_t> m_Runs;
+  CUtlVector<iovec> m_Iovecs;
+  // Opened for this batch only, so a file replaced on disk is never read
+  // through a stale descriptor.
+  CUtlVector<BatchFile_t> m_Files;
+  // Bytes between merged reads land here and are dropped. Per batch, so
+  // threads never write the same memory.
+  u8 m_Scratch[ASYNC_READ_MAX_GAP];
+
+  void Clear() {
+    for (int i = 0; i < m_Files.Count(); i++) {
+      close(m_Files[i].m_fd);
+    }
+    m_Reads.RemoveAll();
+    m_Runs.RemoveAll();
+    m_Iovecs.RemoveAll();
+    m_Files.RemoveAll();
+  }
+};
+
+bool ReadLess(const QueuedRead_t &a, const QueuedRead_t &b) {
+  if (a.m_fd != b.m_fd) return a.m_fd < b.m_fd;
+  return a.m_nOffset < b.m_nOffset;
+}
+
+// Reads the rest of a run after nDone bytes, stops short at the end of the
+// file or on an error. Returns the bytes read in total.
+int ReadRunFrom(const ReadRun_t &run, const iovec *pRunIovecs, int nDone) {
+  iovec iovecs[ASYNC_READ_MAX_RUN_IOVECS];
+  int nIovecs = 0;
+
+  int nSkip = nDone;
+  for (int i = 0; i < run.m_nIovecs; i++) {
+    iovec iov = pRunIovecs[i];
+    if (nSkip >= (int)iov.iov_len) {
+      nSkip -= (int)iov.iov_len;
+      continue;
+    }
+    iov.iov_base = (u8 *)iov.iov_base + nSkip;
+    iov.iov_len -= nSkip;
+    nSkip = 0;
+    iovecs[nIovecs++] = iov;
+  }
+
+  iovec *pIovec = iovecs;
+  while (nDone < run.m_nBytes && nIovecs > 0) {
+    ssize_t nRead = preadv(run.m_fd, pIovec, nIovecs, run.m_nOffset + nDone);
+    if (nRead < 0 && errno == EINTR) continue;
+    if (nRead <= 0) break;
+
+    nDone += (int)nRead;
+    while (nRead > 0 && nIovecs > 0) {
+      if (nRead >= (ssize_t)pIovec->iov_len) {
+        nRead -= pIovec->iov_len;
+        pIovec++;
+        nIovecs--;
+      } else {
+        pIovec->iov_base = (u8 *)pIovec->iov_base + nRead;
+        pIovec->iov_len -= nRead;
+        nRead = 0;
+      }
+    }
+  }
+
+  return nDone;
+}
+
+#ifdef __NR_io_uring_setup
+
+//-----------------------------------------------------------------------------
+// Just enough of io_uring for readv, straight on the syscalls so there's no
+// liburing dependency. Owned and driven by a single thread.
+//-----------------------------------------------------------------------------
+class CIoUring {
+ public:
+  CIoUring()
+      : m_fd(-1),
+        m_pSqRing(nullptr),
+        m_pCqRing(nullptr),
+        m_pSqes(nullptr),
+        m_nSqRingSize(0),
+        m_nCqRingSize(0),
+        m_nSqesSize(0),
+        m_nToSubmit(0) {}
+  ~CIoUring() { Shutdown(); }
+
+  bool Init(unsigned nEntries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_fd = (int)syscall(__NR_io_uring_setup, nEntries, &params);
+    if (m_fd < 0) return false;
+
+    m_nSqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    m_nCqRingSize =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool bSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (bSingleMap) {
+      m_nSqRingSize = m_nCqRingSize = std::max(m_nSqRingSize, m_nCqRingSize);
+    }
+
+    m_pSqRing = Map(m_nSqRingSize, IORING_OFF_SQ_RING);
+    m_pCqRing = bSingleMap ? m_pSqRing : Map(m_nCqRingSize, IORING_OFF_CQ_RING);
+    m_nSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_pSqes = (io_uring_sqe *)Map(m_nSqesSize, IORING_OFF_SQES);
+    if (!m_pSqRing || !m_pCqRing || !m_pSqes) {
+      Shutdown();
+      return false;
+    }
+
+    u8 *pSq = (u8 *)m_pSqRing;
+    m_pSqTail = (unsigned *)(pSq + params.sq_off.tail);
+    m_pSqHead = (unsigned *)(pSq + params.sq_off.head);
+    m_nSqMask = *(unsigned *)(pSq + params.sq_off.ring_mask);
+    m_pSqArray = (unsigned *)(pSq + params.sq_off.array);
+    m_nSqEntries = params.sq_entries;
+
+    u8 *pCq = (u8 *)m_pCqRing;
+    m_pCqHead = (unsigned *)(pCq + params.cq_off.head);
+    m_pCqTail = (unsigned *)(pCq + params.cq_off.tail);
+    m_nCqMask = *(unsigned *)(pCq + params.cq_off.ring_mask);
+    m_pCqes = (io_uring_cqe *)(pCq + params.cq_off.cqes);
+    return true;
+  }
+
+  void Shutdown() {
+    if (m_pSqes) munmap(m_pSqes, m_nSqesSize);
+    if (m_pCqRing && m_pCqRing != m_pSqRing) munmap(m_pCqRing, m_nCqRingSize);
+    if (m_pSqRing) munmap(m_pSqRing, m_nSqRingSize);
+    if (m_fd >= 0) close(m_fd);
+
+    m_fd = -1;
+    m_pSqRing = m_pCqRing = nullptr;
+    m_pSqes = nullptr;
+  }
+
+  // Prepared but not yet taken by the kernel.
+  unsigned GetUnsubmitted() const { return m_nToSubmit; }
+
+  // Queues a readv for the next Submit(), false when the ring is full.
+  bool PrepareReadv(int fd, const iovec *pIovecs, int nIovecs, int64_t nOffset,
+                    u64 userData) {
+    const unsigned tail = *m_pSqTail;
+    if (tail - __atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) >= m_nSqEntries) {
+      return false;
+    }
+
+    const unsigned index = tail & m_nSqMask;
+    io_uring_sqe *pSqe = &m_pSqes[index];
+    memset(pSqe, 0, sizeof(*pSqe));
+    pSqe->opcode = IORING_OP_READV;
+    pSqe->fd = fd;
+    pSqe->addr = (u64)(uintptr_t)pIovecs;
+    pSqe->len = nIovecs;
+    pSqe->off = (u64)nOffset;
+    pSqe->user_data = userData;
+
+    m_pSqArray[index] = index;
+    __atomic_store_n(m_pSqTail, tail + 1, __ATOMIC_RELEASE);
+    m_nToSubmit++;
+    return true;
+  }
+
+  // Submits what was prepared and waits for at least nWaitFor completions.
+  // Returns 0 or a negative errno.
+  int Submit(unsigned nWaitFor) {
+    for (;;) {
+      const int nResult = (int)syscall(__NR_io_uring_enter, m_fd, m_nToSubmit,
+                                       nWaitFor, IORING_ENTER_GETEVENTS,
+                                       nullptr, 0);
+      if (nResult >= 0) {
+        m_nToSubmit -= std::min((unsigned)nResult, m_nToSubmit);
+        return 0;
+      }
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EBUSY) {
+        ThreadSleep(0);
+        continue;
+      }
+      return -errno;
+    }
+  }
+
+  bool PeekCompletion(u64 *pUserData, int *pResult) {
+    const unsigned head = *m_pCqHead;
+    if (head == __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE)) return false;
+
+    const io_uring_cqe &cqe = m_pCqes[head & m_nCqMask];
+    *pUserData = cqe.user_data;
+    *pResult = cqe.res;
+    __atomic_store_n(m_pCqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+ private:
+  void *Map(usize nSize, u64 nOffset) {
+    void *p = mmap(nullptr, nSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_fd, (off_t)nOffset);
+    return p != MAP_FAILED ? p : nullptr;
+  }
+
+  int m_fd;
+  void *m_pSqRing;
+  void *m_pCqRing;
+  io_uring_sqe *m_pSqes;
+  usize m_nSqRingSize;
+  usize m_nCqRingSize;
+  usize m_nSqesSize;
+
+  unsigned *m_pSqHead;
+  unsigned *m_pSqTail;
+  unsigned *m_pSqArray;
+  unsigned m_nSqMask;
+  unsigned m_nSqEntries;
+  unsigned m_nToSubmit;
+
+  unsigned *m_pCqHead;
+  unsigned *m_pCqTail;
+  unsigned m_nCqMask;
+  io_uring_cqe *m_pCqes;
+};
+
+#endif  // __NR_io_uring_setup
+
+}  // namespace
+
+//-----------------------------------------------------------------------------
+// Priority queue, batching and completion shared by both backends, which only
+// differ in how a batch's runs get read.
+//-----------------------------------------------------------------------------
+class CAsyncReadQueue : public IAsyncReadQueue {
+ public:
+  CAsyncReadQueue(int nThreads, int nBatchSize)
+      : m_nThreads(nThreads),
+        m_nBatchSize(nBatchSize),
+        m_nQueued(0),
+        m_nSuspended(0),
+        m_bExit(false) {
+    memset(m_hThreads, 0, sizeof(m_hThreads));
+  }
+
+  bool Start() override {
+    m_bExit = false;
+    for (int i = 0; i < m_nThreads; i++) {
+      m_hThreads[i] = CreateSimpleThread(ThreadProc, this);
+    }
+    return true;
+  }
+
+  void Stop() override {
+    m_bExit = true;
+    m_WorkEvent.Set();
+    for (int i = 0; i < m_nThreads; i++) {
+      if (!m_hThreads[i]) continue;
+      ThreadJoin(m_hThreads[i]);
+      ReleaseThreadHandle(m_hThreads[i]);
+      m_hThreads[i] = nullptr;
+    }
+    AbortAll();
+  }
+
+  void AddJob(IAsyncReadJob *pJob) override {
+    CJob *pCJob = pJob->GetJob();
+    pCJob->AddRef();
+    {
+      AUTO_LOCK_FM(m_QueueMutex);
+      m_Queued[pCJob->GetPriority()].AddToTail(pJob);
+      m_nQueued++;
+    }
+    m_WorkEvent.Set();
+  }
+
+  void ChangePriority(CJob *pJob, JobPriority_t priority) override {
+    AUTO_LOCK_FM(m_QueueMutex);
+    for (auto &queued : m_Queued) {
+      for (auto i = queued.Head(); i != queued.InvalidIndex();
+           i = queued.Next(i)) {
+        IAsyncReadJob *pReadJob = queued[i];
+        if (pReadJob->GetJob() != pJob) continue;
+
+        queued.Remove(i);
+        m_Queued[priority].AddToTail(pReadJob);
+        pJob->SetPriority(priority);
+        return;
+      }
+    }
+    // Already being read, nothing left to reorder.
+    pJob->SetPriority(priority);
+  }
+
+  int ExecuteToPriority(JobPriority_t toPriority,
+                        bool bWaitInFlight) override {
+    int nExecuted = 0;
+    while (IAsyncReadJob *pJob = PopJob(toPriority)) {
+      pJob->GetJob()->Execute();
+      pJob->GetJob()->Release();
+      nExecuted++;
+    }
+
+    while (bWaitInFlight && m_nInFlight > 0) {
+      m_BatchDoneEvent.Wait(10);
+    }
+    return nExecuted;
+  }
+
+  int AbortAll() override {
+    int nAborted = 0;
+    while (IAsyncReadJob *pJob = PopJob(JP_LOW)) {
+      pJob->GetJob()->Abort();
+      pJob->GetJob()->Release();
+      nAborted++;
+    }
+    return nAborted;
+  }
+
+  void SuspendExecution() override { ++m_nSuspended; }
+
+  void ResumeExecution() override {
+    if (--m_nSuspended <= 0) {
+      m_nSuspended = 0;
+      m_WorkEvent.Set();
+    }
+  }
+
+  int GetQueueDepth() override { return m_nQueued + m_nInFlight; }
+
+ protected:
+  // Reads every run of the batch, calling CompleteRun() for each.
+  virtual void ReadRuns(ReadBatch_t &batch) = 0;
+
+  void CompleteRun(ReadBatch_t &batch, ReadRun_t &run, int nDone);
+  // Reads and completes the runs not done yet with blocking preadv.
+  void ReadRemainingRuns(ReadBatch_t &batch);
+
+ private:
+  static u32 ThreadProc(void *pParam) {
+    ThreadSetDebugName("AsyncRead");
+    ((CAsyncReadQueue *)pParam)->ServiceLoop();
+    return 0;
+  }
+
+  void ServiceLoop();
+  int TakeBatch(IAsyncReadJob **ppJobs);
+  IAsyncReadJob *PopJob(JobPriority_t toPriority);
+  bool QueueRead(ReadBatch_t &batch, IAsyncReadJob *pJob);
+  void BuildRuns(ReadBatch_t &batch);
+  void CompleteRead(const QueuedRead_t &read, int nRead);
+
+  const int m_nThreads;
+  const int m_nBatchSize;
+  ThreadHandle_t m_hThreads[ASYNC_READ_PREADV_THREADS];
+
+  CThreadFastMutex m_QueueMutex;
+  CUtlLinkedList<IAsyncReadJob *> m_Queued[JP_HIGH + 1];
+  CInterlockedInt m_nQueued;
+
+  CThreadEvent m_WorkEvent;
+  CThreadEvent m_BatchDoneEvent;
+  CInterlockedInt m_nInFlight;
+  CInterlockedInt m_nSuspended;
+  volatile bool m_bExit;
+};
+
+void CAsyncReadQueue::ServiceLoop() {
+  IAsyncReadJob *pJobs[ASYNC_READ_URING_BATCH];
+  ReadBatch_t batch;
+
+  while (!m_bExit) {
+    const int nJobs = TakeBatch(pJobs);
+    if (!nJobs) {
+      m_WorkEvent.Wait();
+      continue;
+    }
+
+    for (int i = 0; i < nJobs; i++) {
+      IAsyncReadJob *pJob = pJobs[i];
+      CJob *pCJob = pJob->GetJob();
+
+      // Already being executed or aborted by another thread.
+      if (!pCJob->TryLock()) {
+        pCJob->Release();
+        --m_nInFlight;
+        continue;
+      }
+      if (!pCJob->CanExecute()) {
+        pCJob->Unlock();
+        pCJob->Release();
+        --m_nInFlight;
+        continue;
+      }
+
+      if (!QueueRead(batch, pJob)) {
+        // Size queries, held files, HPK packs, open failures: the job does
+        // its own synchronous read.
+        pCJob->Execute();
+        pCJob->Unlock();
+        pCJob->Release();
+        --m_nInFlight;
+      }
+    }
+
+    BuildRuns(batch);
+    ReadRuns(batch);
+    batch.Clear();
+    m_BatchDoneEvent.Set();
+  }
+
+  // Pass the exit on to the next thread.
+  m_WorkEvent.Set();
+}
+
+int CAsyncReadQueue::TakeBatch(IAsyncReadJob **ppJobs) {
+  AUTO_LOCK_FM(m_QueueMutex);
+  if (m_nSuspended > 0 || m_bExit) return 0;
+
+  // Only the most urgent priority present, so lower priority reads never sit
+  // in front of it in the same batch.
+  for (int priority = JP_HIGH; priority >= JP_LOW; priority--) {
+    auto &queued = m_Queued[priority];
+    int nJobs = 0;
+    while (nJobs < m_nBatchSize && queued.Count()) {
+      ppJobs[nJobs++] = queued[queued.Head()];
+      queued.Remove(queued.Head());
+    }
+
+    if (nJobs) {
+      m_nQueued -= nJobs;
+      m_nInFlight += nJobs;
+      // Let another thread take what's left.
+      if (m_nQueued) m_WorkEvent.Set();
+      return nJobs;
+    }
+  }
+  return 0;
+}
+
+IAsyncReadJob *CAsyncReadQueue::PopJob(JobPriority_t toPriority) {
+  AUTO_LOCK_FM(m_QueueMutex);
+  for (int priority = JP_HIGH; priority >= toPriority; priority--) {
+    auto &queued = m_Queued[priority];
+    if (!queued.Count()) continue;
+
+    IAsyncReadJob *pJob = queued[queued.Head()];
+    queued.Remove(queued.Head());
+    m_nQueued--;
+    return pJob;
+  }
+  return nullptr;
+}
+
+bool CAsyncReadQueue::QueueRead(ReadBatch_t &batch, IAsyncReadJob *pJob) {
+  const FileAsyncRequest_t &request = pJob->GetReadRequest();
+  if (request.nBytes < 0 || request.nOffset < 0 ||
+      request.hSpecificAsyncFile != FS_INVALID_ASYNC_FILE) {
+    return false;
+  }
+
+  RawFileLocation_t location;
+  if (!BaseFileSystem()->GetRawFileLocation(request.pszFilename,
+                                            request.pszPathID, &location)) {
+    return false;
+  }
+
+  int fd = -1;
+  for (int i = 0; i < batch.m_Files.Count(); i++) {
+    if (!V_strcmp(batch.m_Files[i].m_Path, location.m_szPath)) {
+      fd = batch.m_Files[i].m_fd;
+      break;
+    }
+  }
+  if (fd < 0) {
+    fd = open(location.m_szPath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    BatchFile_t &file = batch.m_Files[batch.m_Files.AddToTail()];
+    file.m_Path = location.m_szPath;
+    file.m_fd = fd;
+  }
+
+  // Same sizes SyncRead() works out.
+  const int nLeft = std::max(location.m_nLength - request.nOffset, 0);
+  const int nRequested = request.nBytes ? request.nBytes : nLeft;
+
+  void *pDest = request.pData;
+  if (!pDest) {
+    const int nBuffer =
+        nRequested + ((request.flags & FSASYNC_FLAGS_NULLTERMINATE) ? 1 : 0);
+    pDest = request.pfnAlloc
+                ? (*request.pfnAlloc)(request.pszFilename, nBuffer)
+                : BaseFileSystem()->AllocOptimalReadBuffer(
+                      FILESYSTEM_INVALID_HANDLE, nBuffer, 0);
+  }
+
+  QueuedRead_t &read = batch.m_Reads[batch.m_Reads.AddToTail()];
+  read.m_pJob = pJob;
+  read.m_fd = fd;
+  read.m_nOffset = location.m_nOffset + request.nOffset;
+  read.m_nBytes = std::min(nRequested, nLeft);
+  read.m_nRequested = nRequested;
+  read.m_pDest = pDest;
+  return true;
+}
+
+void CAsyncReadQueue::BuildRuns(ReadBatch_t &batch) {
+  std::sort(batch.m_Reads.Base(), batch.m_Reads.Base() + batch.m_Reads.Count(),
+            ReadLess);
+
+  // Every read takes at most one iovec for itself and one for the hole in
+  // front of it, reserved up front so runs can point into the vector.
+  batch.m_Iovecs.EnsureCapacity(2 * batch.m_Reads.Count());
+
+  ReadRun_t *pRun = nullptr;
+  for (int i = 0; i < batch.m_Reads.Count(); i++) {
+    const QueuedRead_t &read = batch.m_Reads[i];
+    if (!read.m_nBytes) {
+      // Nothing on disk to read, past the end or an empty file.
+      CompleteRead(read, 0);
+      continue;
+    }
+
+    const int64_t nRunEnd = pRun ? pRun->m_nOffset + pRun->m_nBytes : 0;
+    const int64_t nGap = read.m_nOffset - nRunEnd;
+    const bool bMerge =
+        pRun && pRun->m_fd == read.m_fd && nGap >= 0 &&
+        nGap <= ASYNC_READ_MAX_GAP &&
+        pRun->m_nBytes + nGap + read.m_nBytes <= ASYNC_READ_MAX_RUN_BYTES &&
+        pRun->m_nIovecs + 2 <= ASYNC_READ_MAX_RUN_IOVECS;
+
+    if (bMerge) {
+      if (nGap) {
+        iovec &hole = batch.m_Iovecs[batch.m_Iovecs.AddToTail()];
+        hole.iov_base = batch.m_Scratch;
+        hole.iov_len = (usize)nGap;
+        pRun->m_nIovecs++;
+      }
+      pRun->m_nBytes += (int)nGap + read.m_nBytes;
+      pRun->m_nReads++;
+    } else {
+      pRun = &batch.m_Runs[batch.m_Runs.AddToTail()];
+      pRun->m_fd = read.m_fd;
+      pRun->m_nOffset = read.m_nOffset;
+      pRun->m_nBytes = read.m_nBytes;
+      pRun->m_iFirstRead = i;
+      pRun->m_nReads = 1;
+      pRun->m_iFirstIovec = batch.m_Iovecs.Count();
+      pRun->m_nIovecs = 0;
+      pRun->m_bDone = false;
+    }
+
+    iovec &iov = batch.m_Iovecs[batch.m_Iovecs.AddToTail()];
+    iov.iov_base = read.m_pDest;
+    iov.iov_len = read.m_nBytes;
+    pRun->m_nIovecs++;
+  }
+}
+
+void CAsyncReadQueue::CompleteRun(ReadBatch_t &batch, ReadRun_t &run,
+                                  int nDone) {
+  run.m_bDone = true;
+  for (int i = 0; i < run.m_nReads; i++) {
+    const QueuedRead_t &read = batch.m_Reads[run.m_iFirstRead + i];
+    const int64_t nStart = read.m_nOffset - run.m_nOffset;
+    const int64_t nRead =
+        std::min<int64_t>(std::max<int64_t>(nDone - nStart, 0), read.m_nBytes);
+    CompleteRead(read, (int)nRead);
+  }
+}
+
+void CAsyncReadQueue::CompleteRead(const QueuedRead_t &read, int nRead) {
+  const FileAsyncRequest_t &request = read.m_pJob->GetReadRequest();
+  if (request.flags & FSASYNC_FLAGS_NULLTERMINATE) {
+    ((char *)read.m_pDest)[nRead] = 0;
+  }
+
+  const FSAsyncStatus_t result = (nRead == 0 && read.m_nRequested != 0)
+                                     ? FSASYNC_ERR_READING
+                                     : FSASYNC_OK;
+  read.m_pJob->SetReadResult(read.m_pDest, nRead, result);
+
+  CJob *pJob = read.m_pJob->GetJob();
+  pJob->Execute();
+  pJob->Unlock();
+  pJob->Release();
+  --m_nInFlight;
+}
+
+void CAsyncReadQueue::ReadRemainingRuns(ReadBatch_t &batch) {
+  for (int i = 0; i < batch.m_Runs.Count(); i++) {
+    ReadRun_t &run = batch.m_Runs[i];
+    if (run.m_bDone) continue;
+    CompleteRun(batch, run,
+                ReadRunFrom(run, &batch.m_Iovecs[run.m_iFirstIovec], 0));
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Fallback: a few threads, each reading its batch's runs with blocking preadv.
+//-----------------------------------------------------------------------------
+class CPreadvReadQueue : public CAsyncReadQueue {
+ public:
+  CPreadvReadQueue()
+      : CAsyncReadQueue(ASYNC_READ_PREADV_THREADS, ASYNC_READ_PREADV_BATCH) {}
+
+  const char *GetName() override { return "preadv"; }
+
+ protected:
+  void ReadRuns(ReadBatch_t &batch) override { ReadRemainingRuns(batch); }
+};
+
+#ifdef __NR_io_uring_setup
+
+//-----------------------------------------------------------------------------
+// One thread keeps a whole batch of runs in flight on a ring and completes
+// each run as its readv lands.
+//-----------------------------------------------------------------------------
+class CIoUringReadQueue : public CAsyncReadQueue {
+ public:
+  CIoUringReadQueue()
+      : CAsyncReadQueue(1, ASYNC_READ_URING_BATCH), m_bRingFailed(false) {}
+
+  bool Init() { return m_Ring.Init(ASYNC_READ_URING_BATCH); }
+
+  const char *GetName() override { return "io_uring"; }
+
+ protected:
+  void ReadRuns(ReadBatch_t &batch) override {
+    if (m_bRingFailed) {
+      ReadRemainingRuns(batch);
+      return;
+    }
+
+    int iNext = 0;
+    int nPending = 0;
+    while (iNext < batch.m_Runs.Count() || nPending) {
+      while (iNext < batch.m_Runs.Count()) {
+        const ReadRun_t &run = batch.m_Runs[iNext];
+        if (!m_Ring.PrepareReadv(run.m_fd, &batch.m_Iovecs[run.m_iFirstIovec],
+                                 run.m_nIovecs, run.m_nOffset, iNext)) {
+          break;
+        }
+        iNext++;
+        nPending++;
+      }
+
+      const int nError = m_Ring.Submit(1);
+      if (nError) {
+        Warning("Async read: io_uring_enter failed (%d), using preadv\n",
+                -nError);
+        m_bRingFailed = true;
+
+        // The kernel still owns the buffers of reads it took before the
+        // failure, wait those out before reading the rest directly.
+        int nInKernel = nPending - (int)m_Ring.GetUnsubmitted();
+        while (nInKernel > 0) {
+          nInKernel -= ReapCompletions(batch);
+          if (nInKernel > 0) ThreadSleep(1);
+        }
+        ReadRemainingRuns(batch);
+        return;
+      }
+
+      nPending -= ReapCompletions(batch);
+    }
+  }
+
+ private:
+  int ReapCompletions(ReadBatch_t &batch) {
+    int nReaped = 0;
+    u64 iRun;
+    int nResult;
+    while (m_Ring.PeekCompletion(&iRun, &nResult)) {
+      nReaped++;
+      ReadRun_t &run = batch.m_Runs[(int)iRun];
+      int nDone = std::max(nResult, 0);
+      if (nDone < run.m_nBytes) {
+        // Short read or an error, finish or retry it synchronously.
+        nDone = ReadRunFrom(run, &batch.m_Iovecs[run.m_iFirstIovec], nDone);
+      }
+      CompleteRun(batch, run, nDone);
+    }
+    return nReaped;
+  }
+
+  CIoUring m_Ring;
+  bool m_bRingFailed;
+};
+
+#endif  // __NR_io_uring_setup
+
+IAsyncReadQueue *CreateAsyncReadQueue() {
+#ifdef __NR_io_uring_setup
+  if (!CommandLine()->FindParm("-noiouring")) {
+    CIoUringReadQueue *pQueue = new CIoUringReadQueue;
+    if (pQueue->Init()) return pQueue;
+
+    Msg("Async read: io_uring unavailable (%d), using preadv\n", errno);
+    delete pQueue;
+  }
+#endif
+  return new CPreadvReadQueue;
+}
+
+#endif  // OS_LINUX
@@ -0,0 +1,64 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// Services async reads outside the IThreadPool. Linux only: requests are
+// queued by priority, resolved to a file descriptor and offset (pack files
+// included), sorted and merged when adjacent in the same file, then read with
+// io_uring, or with preadv on a few worker threads where io_uring is missing.
+
+#ifndef SOURCE_FILESYSTEM_ASYNCREADQUEUE_H_
+#define SOURCE_FILESYSTEM_ASYNCREADQUEUE_H_
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "build/include/build_config.h"
+#include "filesystem.h"
+#include "vstdlib/jobthread.h"
+
+// A read job the queue can do the I/O for. The queue holds the job's lock
+// while its read is in flight, hands the outcome over with SetReadResult(),
+// then executes the job so completion goes through CJob as usual. Jobs it
+// can't read directly are just executed on a queue thread.
+the_interface IAsyncReadJob {
+ public:
+  virtual CJob *GetJob() = 0;
+  virtual const FileAsyncRequest_t &GetReadRequest() = 0;
+  virtual void SetReadResult(void *pData, int nBytesRead,
+                             FSAsyncStatus_t result) = 0;
+};
+
+the_interface IAsyncReadQueue {
+ public:
+  virtual ~IAsyncReadQueue() {}
+
+  virtual bool Start() = 0;
+  virtual void Stop() = 0;
+
+  // "io_uring" or "preadv".
+  virtual const char *GetName() = 0;
+
+  // Takes a reference to the job until it completes.
+  virtual void AddJob(IAsyncReadJob * pJob) = 0;
+  virtual void ChangePriority(CJob * pJob, JobPriority_t priority) = 0;
+
+  // Runs queued jobs at or above toPriority on the calling thread, then
+  // optionally waits out the reads already in flight. Completing those takes
+  // the filesystem's callback lock, so never wait from inside a callback.
+  virtual int ExecuteToPriority(JobPriority_t toPriority,
+                                bool bWaitInFlight) = 0;
+  virtual int AbortAll() = 0;
+
+  virtual void SuspendExecution() = 0;
+  virtual void ResumeExecution() = 0;
+
+  // Jobs queued plus jobs whose reads are in flight.
+  virtual int GetQueueDepth() = 0;
+};
+
+#ifdef OS_LINUX
+// Prefers io_uring, falls back to preadv workers. Never fails.
+IAsyncReadQueue *CreateAsyncReadQueue();
+#endif
+
+#endif  // SOURCE_FILESYSTEM_ASYNCREADQUEUE_H_
@@ -42,6 +42,12 @@ ConVar fs_warning_mode("fs_warning_mode", "0", 0,
                        "0:Off, 1:Warn main thread, 2:Warn other threads");
 ConVar fs_monitor_read_from_pack("fs_monitor_read_from_pack", "0", 0,
                                  "0:Off, 1:Any, 2:Sync only");
+ConVar fs_resolve_cache("fs_resolve_cache", "1", 0,
+                        "Remember which search path relative names resolve "
+                        "to, and which don't resolve at all");
+ConVar fs_report_resolve_cache("fs_report_resolve_cache", "0", 0,
+                               "Report resolution cache savings at the end of "
+                               "each map load");
 
 // bsp output flag -- determines type of fs_log output to generate
 #define BSPOUTPUT 0
@@ -243,6 +249,7 @@ CBaseFileSystem::CBaseFileSystem()
   m_DirtyDiskReportFunc = nullptr;
 
   m_pThreadPool = nullptr;
+  m_pAsyncReadQueue = nullptr;
 #if defined(TRACK_BLOCKING_IO)
   m_pBlockingItems = new CBlockingFileItemList(this);
   m_bBlockingFileAccessReportingEnabled = false;
@@ -597,8 +604,39 @@ bool CBaseFileSystem::AddPackFileFromPath(const char *pPath,
 
   if (FS_fexists(fullpath) == -1) return false;
 
-  CPackFile *pf = new CZipPackFile{this};
-  pf->m_hPackFileHandle = Trace_FOpen(fullpath, "rb", 0, nullptr);
+  CPackFile *pf = OpenPackFile(fullpath);
+  // Failed for some reason, ignore it
+  if (!pf) return false;
+
+  // Add this pack file to the search path:
+  CSearchPath *sp = &m_SearchPaths[m_SearchPaths.AddToTail()];
+  pf->SetPath(sp->GetPath());
+  pf->m_lPackFileTime = GetFileTime(pakfile);
+
+  sp->SetPath(pPath);
+  sp->m_pPathIDInfo->SetPathID(pathID);
+  sp->SetPackFile(pf);
+
+  InvalidateResolveCache();
+
+  return true;
+}
+
+CPackFile *CBaseFileSystem::CreatePackFile(const char *pFileName) {
+  const char *pExt = V_GetFileExtension(pFileName);
+  if (pExt && !_stricmp(pExt, "hpk")) {
+    return new CHpkPackFile{this};
+  }
+  return new CZipPackFile{this};
+}
+
+CPackFile *CBaseFileSystem::OpenPackFile(const char *pFullPath) {
+  CPackFile *pf = CreatePackFile(pFullPath);
+  pf->m_hPackFileHandle = Trace_FOpen(pFullPath, "rb", 0, nullptr);
+  if (!pf->m_hPackFileHandle) {
+    delete pf;
+    return nullptr;
+  }
 
   // Get the length of the pack file:
   FS_fseek((FILE *)pf->m_hPackFileHandle, 0, FILESYSTEM_SEEK_TAIL);
@@ -606,24 +644,14 @@ bool CBaseFileSystem::AddPackFileFromPath(const char *pPath,
   FS_fseek((FILE *)pf->m_hPackFileHandle, 0, FILESYSTEM_SEEK_HEAD);
 
   if (!pf->Prepare(len)) {
-    // Failed for some reason, ignore it
     Trace_FClose(pf->m_hPackFileHandle);
     pf->m_hPackFileHandle = nullptr;
     delete pf;
-
-    return false;
+    return nullptr;
   }
 
-  // Add this pack file to the search path:
-  CSearchPath *sp = &m_SearchPaths[m_SearchPaths.AddToTail()];
-  pf->SetPath(sp->GetPath());
-  pf->m_lPackFileTime = GetFileTime(pakfile);
-
-  sp->SetPath(pPath);
-  sp->m_pPathIDInfo->SetPathID(pathID);
-  sp->SetPackFile(pf);
-
-  return true;
+  pf->m_ZipName = pFullPath;
+  return pf;
 }
 
 // Read a bit of the file from the pack file:
@@ -1075,6 +1103,7 @@ bool CZipPackFile::CPackFileLessFunc::Less(
 // Input  : *pPath -
 //-----------------------------------------------------------------------------
 #define PACK_NAME_FORMAT "zip%i.zip"
+#define HPK_PACK_NAME_FORMAT "zip%i.hpk"
 
 void CBaseFileSystem::AddPackFiles(const char *pPath, const CUtlSymbol &pathID,
                                    SearchPathAdd_t addType) {
@@ -1084,15 +1113,21 @@ void CBaseFileSystem::AddPackFiles(const char *pPath, const CUtlSymbol &pathID,
   CUtlVector<CUtlString> pakNames;
   CUtlVector<int64_t> pakSizes;
 
-  // determine pak files, [zip0..zipN]
+  // determine pak files, [zip0..zipN], an .hpk wins over a .zip of the same
+  // number
   for (int i = 0;; i++) {
     char pakfile[SOURCE_MAX_PATH];
     char fullpath[SOURCE_MAX_PATH];
-    sprintf_s(pakfile, PACK_NAME_FORMAT, i);
+    sprintf_s(pakfile, HPK_PACK_NAME_FORMAT, i);
     V_ComposeFileName(pPath, pakfile, fullpath, sizeof(fullpath));
 
     struct _stat buf;
-    if (FS_stat(fullpath, &buf) == -1) break;
+    if (FS_stat(fullpath, &buf) == -1) {
+      sprintf_s(pakfile, PACK_NAME_FORMAT, i);
+      V_ComposeFileName(pPath, pakfile, fullpath, sizeof(fullpath));
+
+      if (FS_stat(fullpath, &buf) == -1) break;
+    }
 
     MEM_ALLOC_CREDIT();
 
@@ -1132,7 +1167,7 @@ void CBaseFileSystem::AddPackFiles(const char *pPath, const CUtlSymbol &pathID,
     }
 
     if (!pf) {
-      pf = new CZipPackFile(this);
+      pf = CreatePackFile(fullpath);
       pf->SetPath(sp->GetPath());
 
       MEM_ALLOC_CREDIT();
@@ -1173,6 +1208,8 @@ void CBaseFileSystem::RemoveAllMapSearchPaths() {
 
     m_SearchPaths.Remove(i);
   }
+
+  InvalidateResolveCache();
 }
 
 //-----------------------------------------------------------------------------
@@ -1283,6 +1320,7 @@ void CBaseFileSystem::AddMapPackFile(const char *pPath, const char *pPathID,
     pf->m_hPackFileHandle = nullptr;
 
     m_ZipFiles.AddToTail(pf);
+    InvalidateResolveCache();
   } else {
     delete pf;
   }
@@ -1290,6 +1328,8 @@ void CBaseFileSystem::AddMapPackFile(const char *pPath, const char *pPathID,
 
 void CBaseFileSystem::BeginMapAccess() {
   if (m_iMapLoad++ == 0) {
+    m_FileTracker.ResetResolveStats();
+
     int c = m_SearchPaths.Count();
     for (int i = 0; i < c; i++) {
       CSearchPath *pSearchPath = &m_SearchPaths[i];
@@ -1312,6 +1352,8 @@ void CBaseFileSystem::BeginMapAccess() {
 
 void CBaseFileSystem::EndMapAccess() {
   if (m_iMapLoad-- == 1) {
+    if (fs_report_resolve_cache.GetBool()) ReportResolveCache();
+
     int c = m_SearchPaths.Count();
     for (int i = 0; i < c; i++) {
       CSearchPath *pSearchPath = &m_SearchPaths[i];
@@ -1446,6 +1488,8 @@ void CBaseFileSystem::AddSearchPathInternal(const char *pPath,
 
   // all matching paths have a reference to the same store
   sp->m_storeId = id;
+
+  InvalidateResolveCache();
 }
 
 //-----------------------------------------------------------------------------
@@ -1557,6 +1601,8 @@ bool CBaseFileSystem::RemoveSearchPath(const char *pPath, const char *pathID) {
     m_SearchPaths.Remove(i);
     bret = true;
   }
+
+  if (bret) InvalidateResolveCache();
   return bret;
 }
 
@@ -1573,6 +1619,8 @@ void CBaseFileSystem::RemoveSearchPaths(const char *pathID) {
       m_SearchPaths.FastRemove(i);
     }
   }
+
+  InvalidateResolveCache();
 }
 
 //-----------------------------------------------------------------------------
@@ -1912,6 +1960,7 @@ void CBaseFileSystem::RemoveAllSearchPaths() {
   AUTO_LOCK(m_SearchPathsMutex);
   m_SearchPaths.Purge();
   // m_PackFileHandles.Purge();
+  InvalidateResolveCache();
 }
 
 void CBaseFileSystem::LogFileAccess(const char *pFullFileName) {
@@ -2068,6 +2117,9 @@ bool CBaseFileSystem::HandleOpenFromZipFile(CFileOpenInfo &openInfo) {
   // assuming a reasonable restriction that the zip must be a pre-existing
   // search path zip
   char *pZipExt = V_stristr(openInfo.m_AbsolutePath, ".zip");
+  if (!pZipExt) {
+    pZipExt = V_stristr(openInfo.m_AbsolutePath, ".hpk");
+  }
   if (!pZipExt) {
     pZipExt = V_stristr(openInfo.m_AbsolutePath, ".bsp");
   }
@@ -2198,20 +2250,146 @@ FileHandle_t CBaseFileSystem::FindFile(const CSearchPath *path,
   return (FileHandle_t)openInfo.m_pFileHandle;
 }
 
+// A bound, not an LRU: past it the cache starts over.
+#define RESOLVE_CACHE_MAX_ENTRIES 65536
+
+CResolveCache::CResolveCache()
+    : m_Entries(k_eDictCompareTypeCaseSensitive), m_nGeneration(0) {}
+
+bool CResolveCache::Find(const char *pKey, Entry_t *pEntry) {
+  AUTO_LOCK_FM(m_Mutex);
+  int i = m_Entries.Find(pKey);
+  if (i == m_Entries.InvalidIndex()) return false;
+
+  *pEntry = m_Entries[i];
+  return true;
+}
+
+void CResolveCache::Add(int generation, const char *pKey,
+                        const Entry_t &entry) {
+  AUTO_LOCK_FM(m_Mutex);
+  // The walk saw search paths that have changed since.
+  if (generation != m_nGeneration) return;
+
+  int i = m_Entries.Find(pKey);
+  if (i != m_Entries.InvalidIndex()) {
+    m_Entries[i] = entry;
+    return;
+  }
+
+  if (m_Entries.Count() >= RESOLVE_CACHE_MAX_ENTRIES) m_Entries.Purge();
+
+  MEM_ALLOC_CREDIT();
+  m_Entries.Insert(pKey, entry);
+}
+
+void CResolveCache::Invalidate() {
+  AUTO_LOCK_FM(m_Mutex);
+  ++m_nGeneration;
+  m_Entries.Purge();
+}
+
+int CResolveCache::Count() {
+  AUTO_LOCK_FM(m_Mutex);
+  return m_Entries.Count();
+}
+
+void CBaseFileSystem::InvalidateResolveCache() {
+  // Iterators read the generation under this lock as they copy the paths.
+  AUTO_LOCK(m_SearchPathsMutex);
+  m_ResolveCache.Invalidate();
+}
+
+void CBaseFileSystem::ReportResolveCache() {
+  m_FileTracker.ReportResolveStats(m_ResolveCache.Count());
+}
+
+CON_COMMAND(fs_resolve_cache_report,
+            "Reports resolution cache savings since the last map load "
+            "started") {
+  BaseFileSystem()->ReportResolveCache();
+}
+
+template <typename Probe>
+CBaseFileSystem::CSearchPath *CBaseFileSystem::ResolveSearchPath(
+    CSearchPathsIterator &iter, char kind, unsigned flags, Probe probe) {
+  const char *pFileName = iter.GetFilename();
+  if (!pFileName[0] || !fs_resolve_cache.GetBool()) {
+    for (CSearchPath *pSearchPath = iter.GetFirst(); pSearchPath != nullptr;
+         pSearchPath = iter.GetNext()) {
+      if (probe(pSearchPath)) return pSearchPath;
+    }
+    return nullptr;
+  }
+
+  char szKey[SOURCE_MAX_PATH + 32];
+  sprintf_s(szKey, "%c%x:%x:%s", kind, (UtlSymId_t)iter.GetPathID(), flags,
+            pFileName);
+#ifdef OS_WIN
+  Q_strlower(szKey);
+#endif
+
+  CResolveCache::Entry_t entry;
+  if (m_ResolveCache.Find(szKey, &entry)) {
+    if (entry.m_iSearchPath < 0) {
+      m_FileTracker.NoteResolve(true, false, 0, 0, entry.m_nProbes,
+                                entry.m_nDiskProbes);
+      return nullptr;
+    }
+
+    CSearchPath *pSearchPath = iter.GetAt(entry.m_iSearchPath);
+    if (pSearchPath && probe(pSearchPath)) {
+      const int nDiskProbes = pSearchPath->GetPackFile() ? 0 : 1;
+      m_FileTracker.NoteResolve(true, true, 1, nDiskProbes,
+                                entry.m_nProbes - 1,
+                                entry.m_nDiskProbes - nDiskProbes);
+      return pSearchPath;
+    }
+
+    // Gone from where it was, walk again.
+  }
+
+  int nProbes = 0, nDiskProbes = 0;
+  CSearchPath *pFound = nullptr;
+  for (CSearchPath *pSearchPath = iter.GetFirst(); pSearchPath != nullptr;
+       pSearchPath = iter.GetNext()) {
+    nProbes++;
+    if (!pSearchPath->GetPackFile()) nDiskProbes++;
+
+    if (probe(pSearchPath)) {
+      pFound = pSearchPath;
+      break;
+    }
+  }
+
+  m_FileTracker.NoteResolve(false, pFound != nullptr, nProbes, nDiskProbes, 0,
+                            0);
+
+  // No search paths at all gives a stand-in that has no index.
+  if (pFound && iter.GetIndex() < 0) return pFound;
+
+  entry.m_iSearchPath = pFound ? (short)iter.GetIndex() : -1;
+  entry.m_nProbes = (short)nProbes;
+  entry.m_nDiskProbes = (short)nDiskProbes;
+  m_ResolveCache.Add(iter.GetResolveGeneration(), szKey, entry);
+
+  return pFound;
+}
+
 FileHandle_t CBaseFileSystem::FindFileInSearchPaths(
     const char *pFileName, const char *pOptions, const char *pathID,
     unsigned flags, char **ppszResolvedFilename, bool bTrackCRCs) {
   // Run through all the search paths.
   CSearchPathsIterator iter(this, &pFileName, pathID, FILTER_NONE);
 
-  for (auto *search_path = iter.GetFirst(); search_path != nullptr;
-       search_path = iter.GetNext()) {
-    FileHandle_t filehandle = FindFile(search_path, pFileName, pOptions, flags,
-                                       ppszResolvedFilename, bTrackCRCs);
-    if (filehandle) return filehandle;
-  }
+  FileHandle_t filehandle = nullptr;
+  ResolveSearchPath(iter, 'o', flags, [&](CSearchPath *search_path) {
+    filehandle = FindFile(search_path, pFileName, pOptions, flags,
+                          ppszResolvedFilename, bTrackCRCs);
+    return filehandle != nullptr;
+  });
 
-  return (FileHandle_t) nullptr;
+  return filehandle;
 }
 
 //-----------------------------------------------------------------------------
@@ -2247,9 +2425,16 @@ FileHandle_t CBaseFileSystem::OpenForWrite(const char *pFileName,
     pTmpFileName = szScratchFileName;
   }
 
+  // Only a new file can turn a remembered miss into a hit. Appending to a
+  // log that is already there, as Con_DebugLog does per line, keeps the cache.
+  struct _stat buf;
+  const bool bExisted = FS_stat(pTmpFileName, &buf) != -1;
+
   int64_t size;
   FILE *fp = Trace_FOpen(pTmpFileName, pOptions, 0, &size);
   if (fp) {
+    if (!bExisted) InvalidateResolveCache();
+
     CFileHandle *fh = new CFileHandle{this};
     fh->m_nLength = size;
     fh->m_type = FT_NORMAL;
@@ -2349,6 +2534,41 @@ FileHandle_t CBaseFileSystem::OpenEx(const char *pFileName,
   return OpenForWrite(tempFileName, pOptions, pathID);
 }
 
+bool CBaseFileSystem::GetRawFileLocation(const char *pFileName,
+                                         const char *pPathID,
+                                         RawFileLocation_t *pLocation) {
+#ifdef FILESYSTEM_STEAM
+  // Files may come out of the Steam caches rather than the disk.
+  return false;
+#else
+  char *pszResolved = nullptr;
+  CFileHandle *fh =
+      (CFileHandle *)OpenEx(pFileName, "rb", 0, pPathID, &pszResolved);
+  if (!fh) return false;
+
+  bool bRaw = false;
+  if (fh->m_pFile) {
+    if (pszResolved) {
+      strcpy_s(pLocation->m_szPath, pszResolved);
+      pLocation->m_nOffset = 0;
+      bRaw = true;
+    }
+  } else if (fh->m_pPackFileHandle) {
+    CPackFile *pPack = fh->m_pPackFileHandle->GetOwner();
+    if (pPack->HasRawFiles()) {
+      strcpy_s(pLocation->m_szPath, pPack->m_ZipName.String());
+      pLocation->m_nOffset = fh->m_pPackFileHandle->AbsoluteBaseOffset();
+      bRaw = true;
+    }
+  }
+  pLocation->m_nLength = fh->Size();
+
+  Close((FileHandle_t)fh);
+  heap_free(pszResolved);
+  return bRaw;
+#endif
+}
+
 void CBaseFileSystem::Close(FileHandle_t file) {
   VPROF_BUDGET("CBaseFileSystem::Close", VPROF_BUDGETGROUP_OTHER_FILESYSTEM);
   if (!file) {
@@ -2429,14 +2649,13 @@ unsigned int CBaseFileSystem::Size(const char *pFileName, const char *pPathID) {
   // Ok, fall through to the fast path.
   int iSize = 0;
 
+  // Empty files don't count, so this can't share FileExists() entries.
   CSearchPathsIterator iter(this, &pFileName, pPathID);
-  for (CSearchPath *pSearchPath = iter.GetFirst(); pSearchPath != nullptr;
-       pSearchPath = iter.GetNext()) {
+  ResolveSearchPath(iter, 's', 0, [&](CSearchPath *pSearchPath) {
     iSize = FastFindFile(pSearchPath, pFileName);
-
-    if (iSize > 0) break;
-  }
-  return iSize;
+    return iSize > 0;
+  });
+  return iSize > 0 ? iSize : 0;
 }
 
 long CBaseFileSystem::FastFileTime(const CSearchPath *search_path,
@@ -3254,6 +3473,9 @@ void CBaseFileSystem::RegisterFileWhitelist(IFileList *pWantCRCList,
     m_FileWhitelist.Init(pNewList);
   }
 
+  // Which files may come off disk decides where opens resolve.
+  InvalidateResolveCache();
+
   // Even if they passed nullptr for their lists, we still want to let them ask
   // which files to reload since the default w/o a whitelist is that all files
   // can come from disk (so if their old whitelist made it force certain files
@@ -3305,14 +3527,9 @@ bool CBaseFileSystem::FileExists(const char *pFileName, const char *pPathID) {
   CHECK_DOUBLE_SLASHES(pFileName);
 
   CSearchPathsIterator iter(this, &pFileName, pPathID);
-  for (CSearchPath *pSearchPath = iter.GetFirst(); pSearchPath != nullptr;
-       pSearchPath = iter.GetNext()) {
-    int size = FastFindFile(pSearchPath, pFileName);
-    if (size >= 0) {
-      return true;
-    }
-  }
-  return false;
+  return ResolveSearchPath(iter, 'e', 0, [&](CSearchPath *pSearchPath) {
+           return FastFindFile(pSearchPath, pFileName) >= 0;
+         }) != nullptr;
 }
 
 bool CBaseFileSystem::IsFileWritable(char const *pFileName,
@@ -3838,6 +4055,8 @@ void CBaseFileSystem::RemoveFile(char const *pRelativePath,
     Warning(FILESYSTEM_WARNING, "Unable to remove file %s: %s.\n", file_path,
             source::posix_errno_info_last_error().description);
   }
+
+  InvalidateResolveCache();
 }
 
 //-----------------------------------------------------------------------------
@@ -3897,6 +4116,7 @@ bool CBaseFileSystem::RenameFile(char const *pOldPath, char const *pNewPath,
     return false;
   }
 
+  InvalidateResolveCache();
   return true;
 }
 
@@ -4093,6 +4313,24 @@ CBaseFileSystem::CSearchPath *CBaseFileSystem::CSearchPathsIterator::GetNext() {
   return nullptr;
 }
 
+CBaseFileSystem::CSearchPath *CBaseFileSystem::CSearchPathsIterator::GetAt(
+    int index) {
+  if (index < 0 || index >= m_SearchPaths.Count()) return nullptr;
+
+  CSearchPath *pSearchPath = &m_SearchPaths[index];
+
+  if (m_PathTypeFilter == FILTER_CULLPACK && pSearchPath->GetPackFile())
+    return nullptr;
+
+  if (m_PathTypeFilter == FILTER_CULLNONPACK && !pSearchPath->GetPackFile())
+    return nullptr;
+
+  if (CBaseFileSystem::FilterByPathID(pSearchPath, m_pathID)) return nullptr;
+
+  m_iCurrent = index;
+  return pSearchPath;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Load/unload a DLL
 //-----------------------------------------------------------------------------
@@ -4218,6 +4456,7 @@ CBaseFileSystem::CPathIDInfo *CBaseFileSystem::FindOrAddPathIDInfo(
 void CBaseFileSystem::MarkPathIDByRequestOnly(const char *pPathID,
                                               bool bRequestOnly) {
   FindOrAddPathIDInfo(g_PathIDTable.AddString(pPathID), bRequestOnly);
+  InvalidateResolveCache();
 }
 
 #if defined(TRACK_BLOCKING_IO)
@@ -43,6 +43,7 @@
 #include "bspfile.h"
 #include "filesystem.h"
 #include "filetracker.h"
+#include "hpkfile.h"
 #include "threadsaferefcountedobject.h"
 #include "tier1/UtlSortVector.h"
 #include "tier1/byteswap.h"
@@ -80,6 +81,7 @@ enum FileMode_t { FM_BINARY, FM_TEXT };
 enum FileType_t { FT_NORMAL, FT_PACK_BINARY, FT_PACK_TEXT };
 
 class IThreadPool;
+class IAsyncReadQueue;
 class CAsyncJobFuliller;
 class CBlockingFileItemList;
 class KeyValues;
@@ -167,6 +169,8 @@ class CPackFileHandle {
   inline int GetSectorSize();
   inline int64_t AbsoluteBaseOffset();
 
+  CPackFile *GetOwner() const { return m_pOwner; }
+
  protected:
   int64_t m_nBase;              // Base offset of the file inside the pack file.
   unsigned int m_nFilePointer;  // Current seek pointer (0 based from the
@@ -205,6 +209,12 @@ class CPackFile : public CRefCounted<CRefCountServiceMT> {
   virtual void DiscardPreloadData() {}
   virtual int64_t GetPackFileBaseOffset() = 0;
 
+  // True when every file sits uncompressed in m_ZipName, at its FindFile()
+  // offset plus GetPackFileBaseOffset() for packs embedded in another file
+  // like a map's pakfile lump. Such files can be read without going through
+  // ReadFromPack().
+  virtual bool HasRawFiles() { return true; }
+
   // Note: threading model for pack files assumes that data
   // is segmented into pack files that aggregate files
   // meant to be read in one thread. Performance characteristics
@@ -319,6 +329,86 @@ class CZipPackFile : public CPackFile {
   CByteswap m_swap;
 };
 
+// HPK pack, see public/hpkfile.h. FindFile() hands out offsets local to the
+// file, ReadFromPack() maps them onto the file's blocks and decodes only
+// those.
+class CHpkPackFile : public CPackFile {
+ public:
+  CHpkPackFile(CBaseFileSystem *fs);
+  ~CHpkPackFile();
+
+  virtual bool Prepare(int64_t fileLen = -1, int64_t nFileOfs = 0);
+  virtual bool FindFile(const char *pFilename, int &nIndex, int64_t &nOffset,
+                        int &nLength);
+  virtual int ReadFromPack(int nIndex, void *buffer, int nDestBytes, int nBytes,
+                           int64_t nOffset);
+
+  int64_t GetPackFileBaseOffset() { return m_nBaseOffset; }
+  bool HasRawFiles() { return false; }
+
+  bool IndexToFilename(int nIndex, char *pBuffer, int nBufferSize);
+
+  int GetEntryCount() const { return m_Header.numEntries; }
+
+ protected:
+  // Decodes block iBlock, nSize is its uncompressed size.
+  bool DecodeBlock(int nIndex, u32 iBlock, u8 *pDest, u32 nSize);
+
+  hpk_header_t m_Header;
+
+  // Loaded with a single read, the tables point into it.
+  CUtlMemory<u8> m_Directory;
+  const u32 *m_pDisplacements;
+  const hpk_entry_t *m_pEntries;
+  const hpk_content_t *m_pContents;
+  const hpk_block_t *m_pBlocks;
+  const char *m_pNames;
+
+  // Last partially read block, so small sequential reads decode it once.
+  CUtlMemory<u8> m_BlockCache;
+  u32 m_iCachedBlock;
+  CUtlMemory<u8> m_CompressedBlock;
+};
+
+//-----------------------------------------------------------------------------
+// Remembers which search path a relative name resolved to for a path ID, or
+// that none has it, so repeated opens and existence checks skip the walk.
+// Emptied when the search paths, their path ID filters or the whitelist
+// change, and when the filesystem itself creates, renames or removes a file.
+//-----------------------------------------------------------------------------
+class CResolveCache {
+ public:
+  struct Entry_t {
+    short m_iSearchPath;  // -1 when no search path has the file
+    short m_nProbes;      // search paths the uncached walk looked at
+    short m_nDiskProbes;  // of those, the ones that weren't pack files
+  };
+
+  CResolveCache();
+
+  bool Find(const char *pKey, Entry_t *pEntry);
+  // Dropped if the cache was invalidated since generation was read.
+  void Add(int generation, const char *pKey, const Entry_t &entry);
+  void Invalidate();
+
+  int GetGeneration() const { return m_nGeneration; }
+  int Count();
+
+ private:
+  CThreadFastMutex m_Mutex;
+  CUtlDict<Entry_t, int> m_Entries;
+  int m_nGeneration;
+};
+
+//-----------------------------------------------------------------------------
+// Where a file's bytes sit on disk, see CBaseFileSystem::GetRawFileLocation().
+//-----------------------------------------------------------------------------
+struct RawFileLocation_t {
+  char m_szPath[SOURCE_MAX_PATH];  // the loose file, or the pack holding it
+  int64_t m_nOffset;               // of the file's first byte in m_szPath
+  int m_nLength;
+};
+
 class CFileLoadInfo {
  public:
   bool m_bSteamCacheOnly;  // If Steam and this is true, then the file is only
@@ -548,6 +638,19 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
   bool AddPackFile(const char *pFileName, const char *pathID);
   bool AddPackFileFromPath(const char *pPath, const char *pakfile,
                            bool bCheckForAppendedPack, const char *pathID);
+  // A CHpkPackFile for .hpk names, otherwise a CZipPackFile.
+  CPackFile *CreatePackFile(const char *pFileName);
+  // Opens and prepares a pack outside the search paths, nullptr on failure.
+  CPackFile *OpenPackFile(const char *pFullPath);
+  // Spews m_ResolveCache stats since the last map load started.
+  void ReportResolveCache();
+  // Resolves a file the way OpenEx() would and says where its bytes are on
+  // disk, for readers that go to the OS directly. False when it's missing or
+  // not stored as is, like files in HPK packs.
+  bool GetRawFileLocation(const char *pFileName, const char *pPathID,
+                          RawFileLocation_t *pLocation);
+  // Reissues the reads captured by async_record_start, see filesystem_async.
+  void AsyncReplay(const char *pszCapture, int nPasses);
 
   // converts a partial path into a full path
   // can be filtered to restrict path types and can provide info about resolved
@@ -582,6 +685,10 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
       const char *pFullpath, const char *pPathId, char *pRelative, int maxlen);
 
   FSAsyncStatus_t SyncRead(const FileAsyncRequest_t &request);
+  // Completes a read an IAsyncReadQueue already did, as SyncRead() would.
+  FSAsyncStatus_t FinishQueuedRead(const FileAsyncRequest_t &request,
+                                   void *pData, int nBytesRead,
+                                   FSAsyncStatus_t result);
   FSAsyncStatus_t SyncWrite(const char *pszFilename, const void *pSrc,
                             int nSrcBytes, bool bFreeMemory, bool bAppend);
   FSAsyncStatus_t SyncAppendFile(const char *pAppendToFileName,
@@ -710,6 +817,7 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
         // Copy paths to minimize mutex lock time
         pFileSystem->m_SearchPathsMutex.Lock();
         CopySearchPaths(pFileSystem->m_SearchPaths);
+        m_nResolveGeneration = pFileSystem->m_ResolveCache.GetGeneration();
         pFileSystem->m_SearchPathsMutex.Unlock();
         V_strncpy(m_Filename, *ppszFilename, sizeof(m_Filename));
         V_FixSlashes(m_Filename);
@@ -720,6 +828,7 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
         m_EmptySearchPath.m_pPathIDInfo = &m_EmptyPathIDInfo;
         m_EmptySearchPath.SetPath(m_pathID);
         m_EmptySearchPath.m_storeId = -1;
+        m_nResolveGeneration = -1;
         m_Filename[0] = '\0';
       }
     }
@@ -735,12 +844,23 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
       // Copy paths to minimize mutex lock time
       pFileSystem->m_SearchPathsMutex.Lock();
       CopySearchPaths(pFileSystem->m_SearchPaths);
+      m_nResolveGeneration = pFileSystem->m_ResolveCache.GetGeneration();
       pFileSystem->m_SearchPathsMutex.Unlock();
       m_Filename[0] = '\0';
     }
 
     CSearchPath *GetFirst();
     CSearchPath *GetNext();
+    // Resumes at a position GetIndex() returned for an earlier walk over the
+    // same search paths, nullptr if the filters skip it.
+    CSearchPath *GetAt(int index);
+
+    int GetIndex() const { return m_iCurrent; }
+    CUtlSymbol GetPathID() const { return m_pathID; }
+    // Empty for absolute names.
+    const char *GetFilename() const { return m_Filename; }
+    // m_ResolveCache generation the search paths were copied at.
+    int GetResolveGeneration() const { return m_nResolveGeneration; }
 
    private:
     CSearchPathsIterator(const CSearchPathsIterator &);
@@ -755,6 +875,7 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
     }
 
     int m_iCurrent;
+    int m_nResolveGeneration;
     CUtlSymbol m_pathID;
     CUtlVector<CSearchPath> m_SearchPaths;
     CSearchPathsVisits m_visits;
@@ -808,6 +929,8 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
   bool m_bOutputDebugString;
 
   IThreadPool *m_pThreadPool;
+  // Linux services async reads here instead of in m_pThreadPool.
+  IAsyncReadQueue *m_pAsyncReadQueue;
   CThreadFastMutex m_AsyncCallbackMutex;
 
   // Statistics:
@@ -942,6 +1065,12 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
                         char **ppszResolvedFilename = nullptr,
                         bool bTrackCRCs = false);
   int FastFindFile(const CSearchPath *path, const char *pFileName);
+  // Walks iter until probe accepts a search path, through m_ResolveCache.
+  // kind tells apart lookups whose probes accept different things.
+  template <typename Probe>
+  CSearchPath *ResolveSearchPath(CSearchPathsIterator & iter, char kind,
+                                 unsigned flags, Probe probe);
+  void InvalidateResolveCache();
   long FastFileTime(const CSearchPath *path, const char *pFileName);
 
   const char *GetWritePath(const char *pFilename, const char *pathID);
@@ -980,6 +1109,7 @@ the_interface CBaseFileSystem : public CTier1AppSystem<IFileSystem> {
   // This manages most of the info we use for pure servers (whether files came
   // from Steam caches or off-disk, their CRCs, which ones are unverified, etc).
   CFileTracker m_FileTracker;
+  CResolveCache m_ResolveCache;
   int m_WhitelistFileTrackingEnabled;  // -1 if unset, 0 if disabled (single
                                        // player), 1 if enabled (multiplayer).
   FSDirtyDiskReportFunc_t m_DirtyDiskReportFunc;
@@ -12,13 +12,16 @@
 
 #include "basefilesystem.h"
 
+#include <algorithm>
 #include <climits>
+#include "asyncreadqueue.h"
 #include "build/include/build_config.h"
 
 #if defined(OS_WIN)
 #include "base/include/windows/windows_light.h"
 #endif
 
+#include "tier0/include/fasttimer.h"
 #include "tier0/include/icommandline.h"
 #include "tier0/include/vcrmode.h"
 #include "tier1/convar.h"
@@ -35,7 +38,8 @@
 
 #include "tier0/include/memdbgon.h"
 
-#ifdef OS_POSIX
+// Linux reads through IAsyncReadQueue, other POSIX platforms stay synchronous.
+#if defined(OS_POSIX) && !defined(OS_LINUX)
 #define DISABLE_ASYNC
 #endif
 
@@ -96,6 +100,68 @@ inline JobPriority_t ConvertPriority(int iFilesystemPriority) {
   return JP_LOW;
 }
 
+//-----------------------------------------------------------------------------
+//
+// Capture of AsyncReadMultiple() calls, say across a map load, for
+// async_replay. One line per request:
+//   <call> <priority> <offset> <bytes> <path ID or -> <file name>
+//
+//-----------------------------------------------------------------------------
+
+static CThreadFastMutex g_AsyncRecordMutex;
+static CUtlBuffer g_AsyncRecord(0, 0, CUtlBuffer::TEXT_BUFFER);
+static int g_nAsyncRecordCalls;
+static bool g_bAsyncRecording;
+
+static void AsyncRecordRequests(const FileAsyncRequest_t *pRequests,
+                                int nRequests) {
+  AUTO_LOCK_FM(g_AsyncRecordMutex);
+  if (!g_bAsyncRecording) return;
+
+  for (int i = 0; i < nRequests; i++) {
+    const FileAsyncRequest_t &request = pRequests[i];
+    const char *pszPathID = (request.pszPathID && request.pszPathID[0])
+                                ? request.pszPathID
+                                : "-";
+    g_AsyncRecord.Printf("%d %d %d %d %s %s\n", g_nAsyncRecordCalls,
+                         request.priority, request.nOffset, request.nBytes,
+                         pszPathID, request.pszFilename);
+  }
+  g_nAsyncRecordCalls++;
+}
+
+CON_COMMAND(async_record_start,
+            "Captures async reads for async_replay until async_record_stop") {
+  AUTO_LOCK_FM(g_AsyncRecordMutex);
+  g_AsyncRecord.Clear();
+  g_nAsyncRecordCalls = 0;
+  g_bAsyncRecording = true;
+}
+
+CON_COMMAND(async_record_stop,
+            "Writes the async_record_start capture: async_record_stop <file>") {
+  if (args.ArgC() < 2) {
+    Msg("Usage: async_record_stop <file>\n");
+    return;
+  }
+
+  CUtlBuffer capture(0, 0, CUtlBuffer::TEXT_BUFFER);
+  int nCalls;
+  {
+    AUTO_LOCK_FM(g_AsyncRecordMutex);
+    g_bAsyncRecording = false;
+    capture.Put(g_AsyncRecord.Base(), g_AsyncRecord.TellPut());
+    nCalls = g_nAsyncRecordCalls;
+    g_AsyncRecord.Purge();
+  }
+
+  if (!BaseFileSystem()->WriteFile(args[1], "DEFAULT_WRITE_PATH", capture)) {
+    Warning("async_record_stop: can't write %s.\n", args[1]);
+    return;
+  }
+  Msg("async_record_stop: %d calls written to %s\n", nCalls, args[1]);
+}
+
 //-----------------------------------------------------------------------------
 //
 // Support for holding files open
@@ -240,7 +306,9 @@ class CFileAsyncJob : public CJob {
 //---------------------------------------------------------
 // A standard filesystem read job
 //---------------------------------------------------------
-class CFileAsyncReadJob : public CFileAsyncJob, protected FileAsyncRequest_t {
+class CFileAsyncReadJob : public CFileAsyncJob,
+                          public IAsyncReadJob,
+                          protected FileAsyncRequest_t {
  public:
   CFileAsyncReadJob(const FileAsyncRequest_t &fromRequest)
       : CFileAsyncJob(ConvertPriority(fromRequest.priority)),
@@ -248,7 +316,11 @@ class CFileAsyncReadJob : public CFileAsyncJob, protected FileAsyncRequest_t {
         m_pResultData(nullptr),
         m_nResultSize(0),
         m_pRealContext(fromRequest.pContext),
-        m_pfnRealCallback(fromRequest.pfnCallback) {
+        m_pfnRealCallback(fromRequest.pfnCallback),
+        m_bQueuedRead(false),
+        m_pQueuedData(nullptr),
+        m_nQueuedBytes(0),
+        m_QueuedResult(FSASYNC_OK) {
 #if defined(TRACK_BLOCKING_IO)
     m_Timer.Start();
 #endif
@@ -279,7 +351,24 @@ class CFileAsyncReadJob : public CFileAsyncJob, protected FileAsyncRequest_t {
 
   const FileAsyncRequest_t *GetRequest() const { return this; }
 
+  // IAsyncReadJob
+  CJob *GetJob() override { return this; }
+  const FileAsyncRequest_t &GetReadRequest() override { return *this; }
+  void SetReadResult(void *pData, int nBytesRead,
+                     FSAsyncStatus_t result) override {
+    m_bQueuedRead = true;
+    m_pQueuedData = pData;
+    m_nQueuedBytes = nBytesRead;
+    m_QueuedResult = result;
+  }
+
   virtual JobStatus_t DoExecute() {
+    if (m_bQueuedRead) {
+      // The read queue did the I/O, only the completion is left.
+      return BaseFileSystem()->FinishQueuedRead(*this, m_pQueuedData,
+                                                m_nQueuedBytes, m_QueuedResult);
+    }
+
     SimulateDelay();
 #if defined(TRACK_BLOCKING_IO)
     bool oldState = BaseFileSystem()->SetAllowSynchronousLogging(false);
@@ -349,6 +438,10 @@ class CFileAsyncReadJob : public CFileAsyncJob, protected FileAsyncRequest_t {
   int m_nResultSize;
   void *m_pRealContext;
   FSAsyncCallbackFunc_t m_pfnRealCallback;
+  bool m_bQueuedRead;
+  void *m_pQueuedData;
+  int m_nQueuedBytes;
+  FSAsyncStatus_t m_QueuedResult;
 #if defined(TRACK_BLOCKING_IO)
   CFastTimer m_Timer;
 #endif
@@ -558,6 +651,16 @@ void CBaseFileSystem::InitAsync() {
       SafeRelease(m_pThreadPool);
     }
   }
+
+#ifdef OS_LINUX
+  if (VCRGetMode() == VCR_Disabled) {
+    m_pAsyncReadQueue = CreateAsyncReadQueue();
+    if (!m_pAsyncReadQueue->Start()) {
+      delete m_pAsyncReadQueue;
+      m_pAsyncReadQueue = nullptr;
+    }
+  }
+#endif
 }
 
 //-----------------------------------------------------------------------------
@@ -571,6 +674,12 @@ void CBaseFileSystem::ShutdownAsync() {
     SafeRelease(m_pThreadPool);
 #endif
   }
+
+  if (m_pAsyncReadQueue) {
+    m_pAsyncReadQueue->Stop();
+    delete m_pAsyncReadQueue;
+    m_pAsyncReadQueue = nullptr;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -592,12 +701,16 @@ FSAsyncStatus_t CBaseFileSystem::AsyncReadMultipleCreditAlloc(
   bool bAsyncMode = (GetAsyncMode() == FSAM_ASYNC);
   bool bSynchronous =
       (!bAsyncMode || (pRequests[0].flags & FSASYNC_FLAGS_SYNC) ||
-       !m_pThreadPool);
+       (!m_pThreadPool && !m_pAsyncReadQueue));
 
   if (!bAsyncMode) {
     AsyncFinishAll();
   }
 
+  if (g_bAsyncRecording) {
+    AsyncRecordRequests(pRequests, nRequests);
+  }
+
   CFileAsyncReadJob *pJob;
 
   for (int i = 0; i < nRequests; i++) {
@@ -612,7 +725,11 @@ FSAsyncStatus_t CBaseFileSystem::AsyncReadMultipleCreditAlloc(
 #endif
     if (!bSynchronous) {
       // async mode, queue request
-      m_pThreadPool->AddJob(pJob);
+      if (m_pAsyncReadQueue) {
+        m_pAsyncReadQueue->AddJob(pJob);
+      } else {
+        m_pThreadPool->AddJob(pJob);
+      }
     } else {
       // synchronous mode, execute now
       pJob->Execute();
@@ -733,6 +850,16 @@ void CBaseFileSystem::AsyncFinishAll(int iToPriority) {
     AUTO_LOCK(g_AsyncFinishMutex);
     m_pThreadPool->ExecuteToPriority(ConvertPriority(iToPriority));
   }
+
+  // Not under g_AsyncFinishMutex, the reads in flight complete through
+  // callbacks that may call back in here. From inside a callback, waiting on
+  // them would deadlock on m_AsyncCallbackMutex.
+  if (m_pAsyncReadQueue) {
+    const bool bInCallback =
+        m_AsyncCallbackMutex.GetOwnerId() == ThreadGetCurrentId();
+    m_pAsyncReadQueue->ExecuteToPriority(ConvertPriority(iToPriority),
+                                         !bInCallback);
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -758,6 +885,9 @@ bool CBaseFileSystem::AsyncSuspend() {
   if (m_pThreadPool) {
     m_pThreadPool->SuspendExecution();
   }
+  if (m_pAsyncReadQueue) {
+    m_pAsyncReadQueue->SuspendExecution();
+  }
 
   return true;
 }
@@ -769,6 +899,9 @@ bool CBaseFileSystem::AsyncResume() {
   if (m_pThreadPool) {
     m_pThreadPool->ResumeExecution();
   }
+  if (m_pAsyncReadQueue) {
+    m_pAsyncReadQueue->ResumeExecution();
+  }
 
   return true;
 }
@@ -883,6 +1016,9 @@ FSAsyncStatus_t CBaseFileSystem::AsyncFlush() {
   if (m_pThreadPool) {
     m_pThreadPool->AbortAll();
   }
+  if (m_pAsyncReadQueue) {
+    m_pAsyncReadQueue->AbortAll();
+  }
 
   return FSASYNC_OK;
 }
@@ -892,7 +1028,7 @@ FSAsyncStatus_t CBaseFileSystem::AsyncFlush() {
 //-----------------------------------------------------------------------------
 FSAsyncStatus_t CBaseFileSystem::AsyncSetPriority(FSAsyncControl_t hControl,
                                                   int newPriority) {
-  if (m_pThreadPool) {
+  if (m_pThreadPool || m_pAsyncReadQueue) {
     CJob *pJob = (CJob *)hControl;
 
     if (!pJob) {
@@ -901,7 +1037,11 @@ FSAsyncStatus_t CBaseFileSystem::AsyncSetPriority(FSAsyncControl_t hControl,
 
     JobPriority_t internalPriority = ConvertPriority(newPriority);
     if (internalPriority != pJob->GetPriority()) {
-      m_pThreadPool->ChangePriority(pJob, internalPriority);
+      if (m_pAsyncReadQueue) {
+        m_pAsyncReadQueue->ChangePriority(pJob, internalPriority);
+      } else {
+        m_pThreadPool->ChangePriority(pJob, internalPriority);
+      }
     }
   }
   return FSASYNC_OK;
@@ -1028,6 +1168,21 @@ FSAsyncStatus_t CBaseFileSystem::SyncRead(const FileAsyncRequest_t &request) {
   return result;
 }
 
+//-----------------------------------------------------------------------------
+//
+//-----------------------------------------------------------------------------
+FSAsyncStatus_t CBaseFileSystem::FinishQueuedRead(
+    const FileAsyncRequest_t &request, void *pData, int nBytesRead,
+    FSAsyncStatus_t result) {
+  DoAsyncCallback(request, pData, nBytesRead, result);
+
+  if (m_fwLevel >= FILESYSTEM_WARNING_REPORTALLACCESSES_ASYNC) {
+    LogAccessToFile("async", request.pszFilename, "");
+  }
+
+  return result;
+}
+
 //-----------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------
@@ -1150,3 +1305,161 @@ void CBaseFileSystem::DoAsyncCallback(const FileAsyncRequest_t &request,
     delete[] pDataToFree;
   }
 }
+
+//-----------------------------------------------------------------------------
+//
+// Replay of an async_record_stop capture
+//
+//-----------------------------------------------------------------------------
+
+namespace {
+
+struct ReplayRead_t {
+  int m_iCall;
+  int m_nPriority;
+  int m_nOffset;
+  int m_nBytes;
+  CUtlString m_PathID;  // empty for none
+  CUtlString m_FileName;
+};
+
+// Callbacks run under m_AsyncCallbackMutex, one at a time.
+i64 g_nReplayBytes;
+int g_nReplayErrors;
+
+void ReplayCallback(const FileAsyncRequest_t &request, int nBytesRead,
+                    FSAsyncStatus_t err) {
+  g_nReplayBytes += std::max(nBytesRead, 0);
+  if (err != FSASYNC_OK) g_nReplayErrors++;
+}
+
+bool ReplayPending(FSAsyncStatus_t status) {
+  return status == FSASYNC_STATUS_PENDING ||
+         status == FSASYNC_STATUS_INPROGRESS ||
+         status == FSASYNC_STATUS_UNSERVICED;
+}
+
+}  // namespace
+
+//-----------------------------------------------------------------------------
+// Issues the captured calls back to back, as fast as they are accepted, then
+// waits for every read. Queue depth is sampled after each call and every
+// millisecond while waiting. The OS file cache isn't dropped between passes.
+//-----------------------------------------------------------------------------
+void CBaseFileSystem::AsyncReplay(const char *pszCapture, int nPasses) {
+  CUtlBuffer capture(0, 0, CUtlBuffer::TEXT_BUFFER);
+  if (!ReadFile(pszCapture, nullptr, capture)) {
+    Warning("async_replay: can't read %s.\n", pszCapture);
+    return;
+  }
+
+  CUtlVector<ReplayRead_t> reads;
+  char szLine[SOURCE_MAX_PATH * 2 + 64];
+  while (capture.IsValid() && capture.GetBytesRemaining() > 0) {
+    capture.GetLine(szLine, sizeof(szLine));
+
+    ReplayRead_t read;
+    char szPathID[SOURCE_MAX_PATH];
+    int nName = 0;
+    if (sscanf(szLine, "%d %d %d %d %259s %n", &read.m_iCall,
+               &read.m_nPriority, &read.m_nOffset, &read.m_nBytes, szPathID,
+               &nName) < 5 ||
+        !nName) {
+      continue;
+    }
+
+    char *pszName = szLine + nName;
+    pszName[strcspn(pszName, "\r\n")] = '\0';
+    if (!pszName[0]) continue;
+
+    read.m_PathID = strcmp(szPathID, "-") ? szPathID : "";
+    read.m_FileName = pszName;
+    reads.AddToTail(read);
+  }
+
+  if (!reads.Count()) {
+    Warning("async_replay: %s has no reads.\n", pszCapture);
+    return;
+  }
+
+  CUtlVector<FileAsyncRequest_t> requests;
+  requests.SetCount(reads.Count());
+  for (int i = 0; i < reads.Count(); i++) {
+    FileAsyncRequest_t &request = requests[i];
+    request.pszFilename = reads[i].m_FileName.String();
+    request.pszPathID =
+        reads[i].m_PathID.IsEmpty() ? nullptr : reads[i].m_PathID.String();
+    request.priority = reads[i].m_nPriority;
+    request.nOffset = reads[i].m_nOffset;
+    request.nBytes = reads[i].m_nBytes;
+    request.pfnCallback = ReplayCallback;
+  }
+
+  const char *pszBackend = m_pAsyncReadQueue ? m_pAsyncReadQueue->GetName()
+                           : m_pThreadPool   ? "thread pool"
+                                             : "synchronous";
+  Msg("async_replay: %d reads in %d calls, %s reads\n", reads.Count(),
+      reads.Tail().m_iCall + 1, pszBackend);
+
+  CUtlVector<FSAsyncControl_t> controls;
+  controls.SetCount(reads.Count());
+
+  for (int iPass = 0; iPass < nPasses; iPass++) {
+    g_nReplayBytes = 0;
+    g_nReplayErrors = 0;
+
+    int nPeakDepth = 0;
+    i64 nDepthSum = 0;
+    int nSamples = 0;
+    auto SampleDepth = [&]() {
+      const int nDepth = m_pAsyncReadQueue ? m_pAsyncReadQueue->GetQueueDepth()
+                         : m_pThreadPool   ? (int)m_pThreadPool->GetJobCount()
+                                           : 0;
+      nPeakDepth = std::max(nPeakDepth, nDepth);
+      nDepthSum += nDepth;
+      nSamples++;
+    };
+
+    CFastTimer timer;
+    timer.Start();
+
+    for (int i = 0; i < reads.Count();) {
+      int iEnd = i + 1;
+      while (iEnd < reads.Count() && reads[iEnd].m_iCall == reads[i].m_iCall) {
+        iEnd++;
+      }
+      AsyncReadMultiple(&requests[i], iEnd - i, &controls[i]);
+      SampleDepth();
+      i = iEnd;
+    }
+
+    for (int i = 0; i < controls.Count(); i++) {
+      while (ReplayPending(AsyncStatus(controls[i]))) {
+        SampleDepth();
+        ThreadSleep(1);
+      }
+      AsyncRelease(controls[i]);
+    }
+
+    timer.End();
+
+    const f64 flMs = timer.GetDuration().GetMillisecondsF();
+    const f64 flMB = g_nReplayBytes / (1024.0 * 1024.0);
+    Msg("  pass %d: %.2f ms, %.2f MB (%.1f MB/s), queue depth %.1f mean, %d "
+        "peak, %d errors\n",
+        iPass + 1, flMs, flMB, flMB / std::max(flMs / 1000.0, 1e-9),
+        (f64)nDepthSum / std::max(nSamples, 1), nPeakDepth, g_nReplayErrors);
+  }
+}
+
+CON_COMMAND(async_replay,
+            "Replays an async_record_stop capture, reporting load time and "
+            "read queue depth: async_replay <file> [passes]") {
+  if (args.ArgC() < 2) {
+    Msg("Usage: async_replay <file> [passes]\n");
+    return;
+  }
+
+  const int nPasses = args.ArgC() > 2 ? std::max(1, atoi(args[2])) : 3;
+  BaseFileSystem()->AsyncReplay(args[1], nPasses);
+}
@@ -8,6 +8,39 @@ CFileTracker::CFileTracker(CBaseFileSystem *pFileSystem) {
 
 CFileTracker::~CFileTracker() { Clear(); }
 
+void CFileTracker::NoteResolve(bool bCacheHit, bool bFound, int nProbes,
+                               int nDiskProbes, int nSaved, int nDiskSaved) {
+  ++m_nResolves;
+  if (bCacheHit) {
+    ++m_nResolveHits;
+    if (!bFound) ++m_nResolveNegativeHits;
+  }
+  m_nResolveProbes += nProbes;
+  m_nResolveDiskProbes += nDiskProbes;
+  m_nResolveSaved += nSaved;
+  m_nResolveDiskSaved += nDiskSaved;
+}
+
+void CFileTracker::ResetResolveStats() {
+  m_nResolves = 0;
+  m_nResolveHits = 0;
+  m_nResolveNegativeHits = 0;
+  m_nResolveProbes = 0;
+  m_nResolveDiskProbes = 0;
+  m_nResolveSaved = 0;
+  m_nResolveDiskSaved = 0;
+}
+
+void CFileTracker::ReportResolveStats(int nCacheEntries) {
+  Msg("Resolution cache: %d entries, %d lookups, %d hits (%d misses "
+      "remembered)\n",
+      nCacheEntries, (int)m_nResolves, (int)m_nResolveHits,
+      (int)m_nResolveNegativeHits);
+  Msg("  %d search path probes (%d on disk), %d avoided (%d on disk)\n",
+      (int)m_nResolveProbes, (int)m_nResolveDiskProbes, (int)m_nResolveSaved,
+      (int)m_nResolveDiskSaved);
+}
+
 void CFileTracker::NoteFileLoadedFromDisk(const char *pFilename,
                                           const char *pPathID,
                                           FileHandle_t fp) {
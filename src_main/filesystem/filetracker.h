@@ -145,6 +145,14 @@ class CFileTracker {
   // Clear everything.
   void Clear();
 
+  // Resolution cache accounting, see CResolveCache. nProbes and nDiskProbes
+  // are the search paths a lookup looked at and how many of them weren't pack
+  // files, nSaved and nDiskSaved the part of the uncached walk a hit skipped.
+  void NoteResolve(bool bCacheHit, bool bFound, int nProbes, int nDiskProbes,
+                   int nSaved, int nDiskSaved);
+  void ResetResolveStats();
+  void ReportResolveStats(int nCacheEntries);
+
  private:
   void CalculateMissingCRC(const char *pFilename, const char *pPathID);
   CPathIDFileList *GetPathIDFileList(const char *pPathID, bool bAutoAdd = true);
@@ -157,6 +165,14 @@ class CFileTracker {
   CUtlDict<CPathIDFileList *, int> m_PathIDs;
   CBaseFileSystem *m_pFileSystem;
   CThreadMutex m_Mutex;  // Threads call into here, so we need to be safe.
+
+  CInterlockedInt m_nResolves;
+  CInterlockedInt m_nResolveHits;
+  CInterlockedInt m_nResolveNegativeHits;
+  CInterlockedInt m_nResolveProbes;
+  CInterlockedInt m_nResolveDiskProbes;
+  CInterlockedInt m_nResolveSaved;
+  CInterlockedInt m_nResolveDiskSaved;
 };
 
 inline const char *FileInfo::GetFilename() {
@@ -0,0 +1,374 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// Reader for HPK pack files, see public/hpkfile.h.
+
+#include "basefilesystem.h"
+
+#include <algorithm>
+#include <climits>
+
+#include "tier0/include/fasttimer.h"
+#include "tier1/convar.h"
+#include "tier1/lzfast.h"
+#include "tier1/lzmaDecoder.h"
+#include "tier1/strtools.h"
+#include "tier1/utlstring.h"
+
+#include "tier0/include/memdbgon.h"
+
+CHpkPackFile::CHpkPackFile(CBaseFileSystem *fs) {
+  m_fs = fs;
+  memset(&m_Header, 0, sizeof(m_Header));
+  m_pDisplacements = nullptr;
+  m_pEntries = nullptr;
+  m_pContents = nullptr;
+  m_pBlocks = nullptr;
+  m_pNames = nullptr;
+  m_iCachedBlock = (u32)-1;
+}
+
+CHpkPackFile::~CHpkPackFile() {}
+
+//-----------------------------------------------------------------------------
+// Reads the header and directory, and checks every table reference once so
+// lookups and reads don't have to.
+//-----------------------------------------------------------------------------
+bool CHpkPackFile::Prepare(int64_t fileLen, int64_t nFileOfs) {
+  if (fileLen < (int64_t)sizeof(hpk_header_t)) return false;
+
+  m_FileLength = fileLen;
+  m_nBaseOffset = nFileOfs;
+
+  if (ReadFromPack(-1, &m_Header, -1, sizeof(m_Header), 0) !=
+      sizeof(m_Header)) {
+    return false;
+  }
+
+  const hpk_header_t &h = m_Header;
+  if (h.id != HPK_ID || h.version != HPK_VERSION) {
+    Msg("Incompatible pack file detected! Not an HPK version %d file\n",
+        HPK_VERSION);
+    return false;
+  }
+
+  if (h.blockSize == 0 || h.blockSize > HPK_MAX_BLOCK_SIZE ||
+      (h.blockSize & (h.blockSize - 1)) != 0 ||
+      (h.numEntries && !h.numBuckets)) {
+    return false;
+  }
+
+  const u64 nDirectorySize = (u64)h.numBuckets * sizeof(u32) +
+                             (u64)h.numEntries * sizeof(hpk_entry_t) +
+                             (u64)h.numContents * sizeof(hpk_content_t) +
+                             (u64)h.numBlocks * sizeof(hpk_block_t) +
+                             h.namesSize;
+  if (nDirectorySize != h.directorySize ||
+      h.directoryOffset + h.directorySize > (u64)fileLen) {
+    return false;
+  }
+
+  MEM_ALLOC_CREDIT();
+
+  m_Directory.EnsureCapacity(h.directorySize);
+  if (ReadFromPack(-1, m_Directory.Base(), h.directorySize, h.directorySize,
+                   h.directoryOffset) != (int)h.directorySize) {
+    return false;
+  }
+
+  u8 *p = m_Directory.Base();
+  m_pDisplacements = (const u32 *)p;
+  p += h.numBuckets * sizeof(u32);
+  m_pEntries = (const hpk_entry_t *)p;
+  p += h.numEntries * sizeof(hpk_entry_t);
+  m_pContents = (const hpk_content_t *)p;
+  p += h.numContents * sizeof(hpk_content_t);
+  m_pBlocks = (const hpk_block_t *)p;
+  p += h.numBlocks * sizeof(hpk_block_t);
+  m_pNames = (const char *)p;
+
+  if (h.namesSize && m_pNames[h.namesSize - 1] != '\0') return false;
+
+  for (u32 i = 0; i < h.numEntries; i++) {
+    if (m_pEntries[i].nameOffset >= h.namesSize ||
+        m_pEntries[i].content >= h.numContents) {
+      return false;
+    }
+  }
+
+  for (u32 i = 0; i < h.numContents; i++) {
+    const u64 nBlocks =
+        ((u64)m_pContents[i].size + h.blockSize - 1) / h.blockSize;
+    if (m_pContents[i].size > INT_MAX ||
+        m_pContents[i].firstBlock + nBlocks > h.numBlocks) {
+      return false;
+    }
+  }
+
+  for (u32 i = 0; i < h.numBlocks; i++) {
+    const hpk_block_t &block = m_pBlocks[i];
+    if (block.codec > HPK_CODEC_LZMA ||
+        block.compressedSize > 2 * HPK_MAX_BLOCK_SIZE ||
+        block.offset + block.compressedSize > h.directoryOffset) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// One hash of the name, one displacement lookup and a compare.
+//-----------------------------------------------------------------------------
+bool CHpkPackFile::FindFile(const char *pFilename, int &nIndex,
+                            int64_t &nOffset, int &nLength) {
+  if (!m_Header.numEntries) return false;
+
+  char szCleanName[MAX_FILEPATH];
+  strcpy_s(szCleanName, pFilename);
+  Q_FixSlashes(szCleanName);
+
+  if (!Q_RemoveDotSlashes(szCleanName)) {
+    return false;
+  }
+
+  const u32 nameHash = HPK_HashName(szCleanName, m_Header.hashSeed);
+  const u32 slot =
+      HPK_Slot(nameHash, m_pDisplacements[nameHash % m_Header.numBuckets],
+               m_Header.numEntries);
+
+  const hpk_entry_t &entry = m_pEntries[slot];
+  if (entry.nameHash != nameHash ||
+      !HPK_NamesEqual(szCleanName, m_pNames + entry.nameOffset)) {
+    return false;
+  }
+
+  nIndex = slot;
+  nOffset = 0;
+  nLength = m_pContents[entry.content].size;
+  return true;
+}
+
+bool CHpkPackFile::IndexToFilename(int nIndex, char *pBuffer,
+                                   int nBufferSize) {
+  if (nIndex >= 0 && (u32)nIndex < m_Header.numEntries) {
+    strcpy_s(pBuffer, nBufferSize, m_pNames + m_pEntries[nIndex].nameOffset);
+    return true;
+  }
+
+  strcpy_s(pBuffer, nBufferSize, "unknown");
+
+  return false;
+}
+
+bool CHpkPackFile::DecodeBlock(int nIndex, u32 iBlock, u8 *pDest, u32 nSize) {
+  const hpk_block_t &block = m_pBlocks[iBlock];
+
+  m_CompressedBlock.EnsureCapacity(block.compressedSize);
+  u8 *pCompressed = m_CompressedBlock.Base();
+  if (CPackFile::ReadFromPack(nIndex, pCompressed, block.compressedSize,
+                              block.compressedSize, block.offset) !=
+      (int)block.compressedSize) {
+    return false;
+  }
+
+  switch (block.codec) {
+    case HPK_CODEC_STORE:
+      if (block.compressedSize != nSize) return false;
+      memcpy(pDest, pCompressed, nSize);
+      return true;
+
+    case HPK_CODEC_LZFAST:
+      return LZFast_Decompress(pDest, nSize, pCompressed,
+                               block.compressedSize) == nSize;
+
+    case HPK_CODEC_LZMA: {
+      const lzma_header_t *pHeader = (const lzma_header_t *)pCompressed;
+      LZMA lzma;
+      if (block.compressedSize < sizeof(lzma_header_t) ||
+          !lzma.IsCompressed(pCompressed) ||
+          lzma.GetActualSize(pCompressed) != nSize ||
+          pHeader->lzmaSize > block.compressedSize - sizeof(lzma_header_t)) {
+        return false;
+      }
+      return lzma.Uncompress(pCompressed, pDest, nSize) == nSize;
+    }
+  }
+
+  return false;
+}
+
+//-----------------------------------------------------------------------------
+// nIndex -1 reads raw pack data. Otherwise nOffset is relative to the start
+// of the file: stored blocks are read straight into the caller's buffer,
+// whole compressed blocks decoded into it, and partial ones go through the
+// block cache.
+//-----------------------------------------------------------------------------
+int CHpkPackFile::ReadFromPack(int nIndex, void *pBuffer, int nDestBytes,
+                               int nBytes, int64_t nOffset) {
+  if (nIndex < 0) {
+    return CPackFile::ReadFromPack(nIndex, pBuffer, nDestBytes, nBytes,
+                                   nOffset);
+  }
+
+  const hpk_content_t &content = m_pContents[m_pEntries[nIndex].content];
+  if (nBytes <= 0 || nOffset < 0 || nOffset >= content.size) {
+    return 0;
+  }
+
+  nBytes = std::min(nBytes, (int)(content.size - nOffset));
+
+  AUTO_LOCK_FM(m_mutex);
+
+  const u32 nBlockSize = m_Header.blockSize;
+  u8 *pOut = (u8 *)pBuffer;
+  int nRead = 0;
+
+  while (nRead < nBytes) {
+    const u32 nPosition = (u32)nOffset + nRead;
+    const u32 nBlockStart = nPosition & ~(nBlockSize - 1);
+    const u32 iBlock = content.firstBlock + nPosition / nBlockSize;
+    const u32 nSize = std::min(nBlockSize, content.size - nBlockStart);
+    const u32 nInBlock = nPosition - nBlockStart;
+    const u32 nCopy = std::min(nSize - nInBlock, (u32)(nBytes - nRead));
+
+    const hpk_block_t &block = m_pBlocks[iBlock];
+    if (block.codec == HPK_CODEC_STORE) {
+      if (CPackFile::ReadFromPack(nIndex, pOut + nRead, nCopy, nCopy,
+                                  block.offset + nInBlock) != (int)nCopy) {
+        break;
+      }
+    } else if (nCopy == nSize) {
+      if (!DecodeBlock(nIndex, iBlock, pOut + nRead, nSize)) break;
+    } else {
+      if (m_iCachedBlock != iBlock) {
+        m_BlockCache.EnsureCapacity(nBlockSize);
+        m_iCachedBlock = (u32)-1;
+        if (!DecodeBlock(nIndex, iBlock, m_BlockCache.Base(), nSize)) break;
+        m_iCachedBlock = iBlock;
+      }
+      memcpy(pOut + nRead, m_BlockCache.Base() + nInBlock, nCopy);
+    }
+
+    nRead += nCopy;
+  }
+
+  return nRead;
+}
+
+// Opens and reads every name in names through pPack, false on the first
+// missing or short file.
+static bool PackBench_ReadAll(CPackFile *pPack,
+                              const CUtlVector<CUtlString> &names,
+                              CUtlMemory<u8> &buffer, i64 *pnBytes) {
+  for (int i = 0; i < names.Count(); i++) {
+    CFileHandle *fh = pPack->OpenFile(names[i].Get());
+    if (!fh) return false;
+
+    const int nSize = fh->Size();
+    buffer.EnsureCapacity(std::max(nSize, 1));
+    const int nRead = fh->Read(buffer.Base(), nSize);
+    delete fh;
+
+    if (nRead != nSize) return false;
+    *pnBytes += nSize;
+  }
+  return true;
+}
+
+static void PackBench_Run(const char *pPath,
+                          const CUtlVector<CUtlString> &names, int nPasses) {
+  CFastTimer timer;
+  timer.Start();
+  CPackFile *pPack = BaseFileSystem()->OpenPackFile(pPath);
+  timer.End();
+  if (!pPack) {
+    Warning("fs_pack_bench: can't open %s.\n", pPath);
+    return;
+  }
+  const f64 flOpenMs = timer.GetDuration().GetMillisecondsF();
+
+  CUtlMemory<u8> buffer;
+  i64 nColdBytes = 0;
+  timer.Start();
+  const bool bColdOk = PackBench_ReadAll(pPack, names, buffer, &nColdBytes);
+  timer.End();
+  const f64 flColdMs = timer.GetDuration().GetMillisecondsF();
+
+  i64 nWarmBytes = 0;
+  bool bWarmOk = bColdOk;
+  timer.Start();
+  for (int i = 0; i < nPasses && bWarmOk; i++) {
+    bWarmOk = PackBench_ReadAll(pPack, names, buffer, &nWarmBytes);
+  }
+  timer.End();
+  const f64 flWarmMs = timer.GetDuration().GetMillisecondsF();
+
+  delete pPack;
+
+  if (!bWarmOk) {
+    Warning("fs_pack_bench: %s is missing files or returned short reads.\n",
+            pPath);
+    return;
+  }
+
+  const f64 flFiles = (f64)std::max(names.Count(), 1);
+  const f64 flMB = nColdBytes / (1024.0 * 1024.0);
+  const f64 flPackMB =
+      BaseFileSystem()->Size(pPath, nullptr) / (1024.0 * 1024.0);
+  Msg("%s: %.2f MB packed as %.2f MB (%.1f%%)\n", pPath, flMB, flPackMB,
+      100.0 * flPackMB / std::max(flMB, 1e-9));
+  Msg("  open %.2f ms, first read %.2f ms (%.1f us/file, %.1f MB/s)\n",
+      flOpenMs, flColdMs, 1000.0 * flColdMs / flFiles,
+      flMB / std::max(flColdMs / 1000.0, 1e-9));
+  if (nPasses > 0) {
+    const f64 flPassMs = flWarmMs / nPasses;
+    Msg("  warm read %.2f ms/pass (%.1f us/file, %.1f MB/s)\n", flPassMs,
+        1000.0 * flPassMs / flFiles,
+        (nWarmBytes / (1024.0 * 1024.0)) / std::max(flWarmMs / 1000.0, 1e-9));
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Opens each pack fresh and reads every file named in the .hpk through it,
+// once right after opening and then [passes] more times. The OS file cache
+// isn't dropped, so the first read is only cold as far as the pack's own
+// state goes.
+//-----------------------------------------------------------------------------
+CON_COMMAND(fs_pack_bench,
+            "Times opening and reading every file of an .hpk, and of the same "
+            "files in a .zip: <pack.hpk> [pack.zip] [passes]") {
+  if (args.ArgC() < 2) {
+    Msg("Usage: fs_pack_bench <pack.hpk> [pack.zip] [passes]\n");
+    return;
+  }
+
+  const int nPasses = args.ArgC() > 3 ? std::max(0, atoi(args[3])) : 5;
+
+  const char *pExt = V_GetFileExtension(args[1]);
+  if (!pExt || _stricmp(pExt, "hpk")) {
+    Warning("fs_pack_bench: %s isn't an .hpk.\n", args[1]);
+    return;
+  }
+
+  CUtlVector<CUtlString> names;
+  {
+    CHpkPackFile *pHpk =
+        static_cast<CHpkPackFile *>(BaseFileSystem()->OpenPackFile(args[1]));
+    if (!pHpk) {
+      Warning("fs_pack_bench: %s isn't a readable .hpk.\n", args[1]);
+      return;
+    }
+
+    char szName[MAX_FILEPATH];
+    for (int i = 0; i < pHpk->GetEntryCount(); i++) {
+      pHpk->IndexToFilename(i, szName, sizeof(szName));
+      names.AddToTail(szName);
+    }
+    delete pHpk;
+  }
+
+  PackBench_Run(args[1], names, nPasses);
+  if (args.ArgC() > 2) {
+    PackBench_Run(args[2], names, nPasses);
+  }
+}
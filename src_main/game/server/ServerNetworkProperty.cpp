@@ -65,6 +65,7 @@ void CServerNetworkProperty::Init( CBaseEntity *pEntity )
 //	m_pTransmitProxy = NULL;
 	m_bPendingStateChange = false;
 	m_PVSInfo.m_nClusterCount = 0;
+	m_nPVSSerial = 0;
 	m_TimerEvent.Init( &g_NetworkPropertyEventMgr, this );
 }
 
@@ -144,6 +145,12 @@ void CServerNetworkProperty::RecomputePVSInformation()
 	{
 		m_pPev->m_fStateFlags &= ~FL_EDICT_DIRTY_PVS_INFORMATION;
 		engine->BuildEntityClusterList( edict(), &m_PVSInfo );
+
+		// CheckTransmit caches PVS results against this, skip 0 on wrap
+		static unsigned int s_nPVSSerial = 0;
+		if ( ++s_nPVSSerial == 0 )
+			++s_nPVSSerial;
+		m_nPVSSerial = s_nPVSSerial;
 	}
 }
 
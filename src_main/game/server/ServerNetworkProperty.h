@@ -105,6 +105,10 @@ class CServerNetworkProperty : public IServerNetworkable,
   // Recomputes PVS information
   void RecomputePVSInformation();
 
+  // Changes every time RecomputePVSInformation rebuilds the PVS information.
+  // Serials are unique across entities, 0 means it was never built.
+  unsigned int GetPVSSerial() const;
+
  private:
   // Detaches the edict.. should only be called by CBaseNetworkable's
   // destructor.
@@ -119,6 +123,7 @@ class CServerNetworkProperty : public IServerNetworkable,
   // CBaseTransmitProxy *m_pTransmitProxy;
   edict_t *m_pPev;
   PVSInfo_t m_PVSInfo;
+  unsigned int m_nPVSSerial;
   ServerClass *m_pServerClass;
 
   // NOTE: This state is 'owned' by the entity. It's only copied here
@@ -145,6 +150,10 @@ inline CBaseEntity *CServerNetworkProperty::GetOuter() { return m_pOuter; }
 
 inline PVSInfo_t *CServerNetworkProperty::GetPVSInfo() { return &m_PVSInfo; }
 
+inline unsigned int CServerNetworkProperty::GetPVSSerial() const {
+  return m_nPVSSerial;
+}
+
 //-----------------------------------------------------------------------------
 // Marks the PVS information dirty
 //-----------------------------------------------------------------------------
@@ -1869,6 +1869,128 @@ nShouldTransmit );
         }
 } */
 
+ConVar sv_transmit_cache(
+    "sv_transmit_cache", "1", 0,
+    "Reuse each client's PVS results from earlier ticks for entities whose "
+    "PVS information didn't change.");
+
+//-----------------------------------------------------------------------------
+// Per client cache of CServerNetworkProperty::IsInPVS results. A result only
+// depends on the entity's PVS information and on the client's PVS, networked
+// areas and area portal state, so it stays valid until one of them changes.
+// The client side is compared as a whole every tick (moving to another
+// cluster or opening a door drops every result), the entity side is checked
+// per edict through its PVS serial.
+//-----------------------------------------------------------------------------
+class CTransmitPVSCache {
+ public:
+  CTransmitPVSCache() {
+    memset(m_PVSSerials, 0, sizeof(m_PVSSerials));
+    m_nPVSSize = -1;
+    m_AreasNetworked = 0;
+    m_nMapAreas = 0;
+  }
+
+  // Drops every result if the client sees the map differently than on the
+  // last call.
+  void Validate(const CCheckTransmitInfo *pInfo) {
+    if (pInfo->m_nPVSSize == m_nPVSSize &&
+        pInfo->m_AreasNetworked == m_AreasNetworked &&
+        pInfo->m_nMapAreas == m_nMapAreas &&
+        !memcmp(pInfo->m_PVS, m_PVS, m_nPVSSize) &&
+        !memcmp(pInfo->m_Areas, m_Areas,
+                m_AreasNetworked * sizeof(m_Areas[0])) &&
+        !memcmp(pInfo->m_AreaFloodNums, m_AreaFloodNums, m_nMapAreas))
+      return;
+
+    memset(m_PVSSerials, 0, sizeof(m_PVSSerials));
+    ++s_nInvalidations;
+
+    m_nPVSSize = pInfo->m_nPVSSize;
+    memcpy(m_PVS, pInfo->m_PVS, m_nPVSSize);
+    m_AreasNetworked = pInfo->m_AreasNetworked;
+    memcpy(m_Areas, pInfo->m_Areas, m_AreasNetworked * sizeof(m_Areas[0]));
+    m_nMapAreas = pInfo->m_nMapAreas;
+    memcpy(m_AreaFloodNums, pInfo->m_AreaFloodNums, m_nMapAreas);
+  }
+
+  bool IsInPVS(CServerNetworkProperty *pNetProp, int iEdict,
+               const CCheckTransmitInfo *pInfo) {
+    pNetProp->RecomputePVSInformation();
+
+    const unsigned int nSerial = pNetProp->GetPVSSerial();
+    if (nSerial && m_PVSSerials[iEdict] == nSerial) {
+      ++s_nHits;
+      return m_InPVS.IsBitSet(iEdict);
+    }
+
+    ++s_nMisses;
+    const bool bInPVS = pNetProp->IsInPVS(pInfo);
+    m_PVSSerials[iEdict] = nSerial;
+    m_InPVS.Set(iEdict, bInPVS);
+    return bInPVS;
+  }
+
+  static uint64_t s_nHits;
+  static uint64_t s_nMisses;
+  static uint64_t s_nInvalidations;
+
+ private:
+  // PVS serial of the entity each result was computed for, 0 if none.
+  unsigned int m_PVSSerials[MAX_EDICTS];
+  CBitVec<MAX_EDICTS> m_InPVS;
+
+  // The client's view of the map the results were computed against.
+  int m_nPVSSize;
+  uint8_t m_PVS[SOURCE_PAD_NUMBER(MAX_MAP_CLUSTERS, 8) / 8];
+  int m_AreasNetworked;
+  int m_Areas[MAX_WORLD_AREAS];
+  int m_nMapAreas;
+  uint8_t m_AreaFloodNums[MAX_MAP_AREAS];
+};
+
+uint64_t CTransmitPVSCache::s_nHits = 0;
+uint64_t CTransmitPVSCache::s_nMisses = 0;
+uint64_t CTransmitPVSCache::s_nInvalidations = 0;
+
+// Indexed by the client's entity index, allocated on first use.
+static CTransmitPVSCache *s_pTransmitPVSCaches[MAX_PLAYERS + 1];
+
+static CTransmitPVSCache *GetTransmitPVSCache(const CCheckTransmitInfo *pInfo) {
+  if (!sv_transmit_cache.GetBool()) return NULL;
+
+  const int iClient = engine->IndexOfEdict(pInfo->m_pClientEnt);
+  if (iClient < 1 || iClient > MAX_PLAYERS) return NULL;
+
+  if (!s_pTransmitPVSCaches[iClient])
+    s_pTransmitPVSCaches[iClient] = new CTransmitPVSCache;
+
+  s_pTransmitPVSCaches[iClient]->Validate(pInfo);
+  return s_pTransmitPVSCaches[iClient];
+}
+
+static inline bool IsInPVSCached(CTransmitPVSCache *pCache,
+                                 CServerNetworkProperty *pNetProp,
+                                 const CCheckTransmitInfo *pInfo) {
+  if (pCache) return pCache->IsInPVS(pNetProp, pNetProp->entindex(), pInfo);
+
+  pNetProp->RecomputePVSInformation();
+  return pNetProp->IsInPVS(pInfo);
+}
+
+CON_COMMAND(sv_transmit_cache_stats,
+            "Prints and resets the CheckTransmit PVS cache counters.") {
+  const double flLookups =
+      (double)(CTransmitPVSCache::s_nHits + CTransmitPVSCache::s_nMisses);
+  Msg("PVS results: %.0f lookups, %.1f%% cached, %.0f client view changes\n",
+      flLookups,
+      flLookups ? 100.0 * CTransmitPVSCache::s_nHits / flLookups : 0.0,
+      (double)CTransmitPVSCache::s_nInvalidations);
+
+  CTransmitPVSCache::s_nHits = CTransmitPVSCache::s_nMisses = 0;
+  CTransmitPVSCache::s_nInvalidations = 0;
+}
+
 void CServerGameEnts::CheckTransmit(CCheckTransmitInfo *pInfo,
                                     const unsigned short *pEdictIndices,
                                     int nEdicts) {
@@ -1896,6 +2018,8 @@ void CServerGameEnts::CheckTransmit(CCheckTransmitInfo *pInfo,
   Assert(bIsHLTV == (pInfo->m_pTransmitAlways != NULL));
 #endif
 
+  CTransmitPVSCache *pPVSCache = GetTransmitPVSCache(pInfo);
+
   for (int i = 0; i < nEdicts; i++) {
     int iEdict = pEdictIndices[i];
 
@@ -1979,7 +2103,7 @@ void CServerGameEnts::CheckTransmit(CCheckTransmitInfo *pInfo,
       continue;
     }
 
-    bool bInPVS = netProp->IsInPVS(pInfo);
+    bool bInPVS = IsInPVSCached(pPVSCache, netProp, pInfo);
     if (bInPVS || sv_force_transmit_ents.GetBool()) {
       // only send if entity is in PVS
       pEnt->SetTransmit(pInfo, false);
@@ -2031,8 +2155,7 @@ void CServerGameEnts::CheckTransmit(CCheckTransmitInfo *pInfo,
 
       if (checkFlags & FL_EDICT_PVSCHECK) {
         // Check pvs
-        check->RecomputePVSInformation();
-        bool bMoveParentInPVS = check->IsInPVS(pInfo);
+        bool bMoveParentInPVS = IsInPVSCached(pPVSCache, check, pInfo);
         if (bMoveParentInPVS) {
           orig->SetTransmit(pInfo, true);
           break;
@@ -6,8 +6,8 @@
 #include "igamesystem.h"
 #include "ilagcompensationmanager.h"
 #include "inetchannelinfo.h"
+#include "tier0/include/fasttimer.h"
 #include "tier0/include/vprof.h"
-#include "tier1/UtlLinkedList.h"
 #include "usercmd.h"
 
  
@@ -41,6 +41,14 @@ ConVar sv_unlag_fixstuck("sv_unlag_fixstuck", "0", FCVAR_DEVELOPMENTONLY,
                          "Disallow backtracking a player for lag compensation "
                          "if it will cause them to become stuck");
 
+ConVar sv_unlag_cull("sv_unlag_cull", "1", FCVAR_DEVELOPMENTONLY,
+                     "Only backtrack players whose current and historical "
+                     "bounds are inside the shooter's aim cone");
+ConVar sv_unlag_cull_angle("sv_unlag_cull_angle", "45", FCVAR_DEVELOPMENTONLY,
+                           "Half angle in degrees of the aim cone used by "
+                           "sv_unlag_cull",
+                           true, 0.0f, true, 180.0f);
+
 //-----------------------------------------------------------------------------
 // Purpose:
 //-----------------------------------------------------------------------------
@@ -111,6 +119,54 @@ struct LagRecord {
   float m_masterCycle;
 };
 
+// Records kept per player, enough for sv_maxunlag at up to 127 ticks/s.
+#define LAG_HISTORY_SIZE 128  // must be a power of 2
+#define LAG_HISTORY_MASK (LAG_HISTORY_SIZE - 1)
+
+//-----------------------------------------------------------------------------
+// Ring of a player's last LAG_HISTORY_SIZE records. Looking up the records
+// around a target time only reads the simulation times, flags and origins,
+// which are mirrored into their own arrays; the full records are read for
+// the one or two entries that get restored.
+//-----------------------------------------------------------------------------
+class CLagHistory {
+ public:
+  CLagHistory() { RemoveAll(); }
+
+  int Count() const { return m_nCount; }
+  void RemoveAll() {
+    m_iHead = 0;
+    m_nCount = 0;
+  }
+
+  // Ring slot of the nth newest record.
+  int Slot(int n) const {
+    Assert(n >= 0 && n < m_nCount);
+    return (m_iHead - n) & LAG_HISTORY_MASK;
+  }
+
+  // Slot for a new newest record, overwrites the oldest one when full.
+  int AddToHead() {
+    m_iHead = (m_iHead + 1) & LAG_HISTORY_MASK;
+    if (m_nCount < LAG_HISTORY_SIZE) ++m_nCount;
+    return m_iHead;
+  }
+
+  void RemoveTail() {
+    Assert(m_nCount > 0);
+    --m_nCount;
+  }
+
+  float m_flSimulationTime[LAG_HISTORY_SIZE];
+  int m_fFlags[LAG_HISTORY_SIZE];
+  Vector m_vecOrigin[LAG_HISTORY_SIZE];
+  LagRecord m_Records[LAG_HISTORY_SIZE];
+
+ private:
+  int m_iHead;
+  int m_nCount;
+};
+
 //
 // Try to take the player from his current origin to vWantedPos.
 // If it can't get there, leave the player where he is.
@@ -163,7 +219,11 @@ static void RestorePlayerTo(CBasePlayer *pPlayer, const Vector &vWantedPos) {
 class CLagCompensationManager : public CAutoGameSystemPerFrame,
                                 public ILagCompensationManager {
  public:
-  CLagCompensationManager(char const *name) : CAutoGameSystemPerFrame(name) {}
+  CLagCompensationManager(char const *name)
+      : CAutoGameSystemPerFrame(name),
+        m_flCullSin(0.0f),
+        m_flCullCos(1.0f),
+        m_nRecordsWalked(0) {}
 
   // IServerSystem stuff
   virtual void Shutdown() { ClearHistory(); }
@@ -180,14 +240,34 @@ class CLagCompensationManager : public CAutoGameSystemPerFrame,
   void FinishLagCompensation(CBasePlayer *player);
 
  private:
+  // Finds the newest record at or before flTargetTime and the one after it
+  // (-1 if none). False if the history is lost before getting there.
+  bool FindRecords(CBasePlayer *pPlayer, float flTargetTime, int *pSlot,
+                   int *pPrevSlot);
+
+  // True if the player's bounds, now and at the records, could be in the way
+  // of a shot from vecEye.
+  bool IsInAimCone(CBasePlayer *pPlayer, int iSlot, int iPrevSlot,
+                   const Vector &vecEye, const Vector &vecForward,
+                   float flSlack) const;
+
   void BacktrackPlayer(CBasePlayer *player, float flTargetTime);
+  void BacktrackPlayer(CBasePlayer *player, float flTargetTime, int iSlot,
+                       int iPrevSlot);
 
   void ClearHistory() {
-    for (int i = 0; i < MAX_PLAYERS; i++) m_PlayerTrack[i].Purge();
+    for (int i = 0; i < MAX_PLAYERS; i++) m_PlayerTrack[i].RemoveAll();
   }
 
-  // keep a list of lag records for each player
-  CUtlFixedLinkedList<LagRecord> m_PlayerTrack[MAX_PLAYERS];
+  // history ring for each player
+  CLagHistory m_PlayerTrack[MAX_PLAYERS];
+
+  // aim cone of sv_unlag_cull
+  float m_flCullSin;
+  float m_flCullCos;
+
+  // history records read during the current usercmd, for VPROF
+  int m_nRecordsWalked;
 
   // Scratchpad for determining what needs to be restored
   CBitVec<MAX_PLAYERS> m_RestorePlayer;
@@ -216,45 +296,40 @@ void CLagCompensationManager::FrameUpdatePostEntityThink() {
   VPROF_BUDGET("FrameUpdatePostEntityThink", "CLagCompensationManager");
 
   // remove all records before that time:
-  int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
+  float flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
 
   // Iterate all active players
   for (int i = 1; i <= gpGlobals->maxClients; i++) {
     CBasePlayer *pPlayer = UTIL_PlayerByIndex(i);
 
-    CUtlFixedLinkedList<LagRecord> *track = &m_PlayerTrack[i - 1];
+    CLagHistory *track = &m_PlayerTrack[i - 1];
 
     if (!pPlayer) {
       track->RemoveAll();
       continue;
     }
 
-    Assert(track->Count() < 1000);  // insanity check
-
     // remove tail records that are too old
-    int tailIndex = track->Tail();
-    while (track->IsValidIndex(tailIndex)) {
-      LagRecord &tail = track->Element(tailIndex);
+    while (track->Count() > 0) {
+      int tailSlot = track->Slot(track->Count() - 1);
 
       // if tail is within limits, stop
-      if (tail.m_flSimulationTime >= flDeadtime) break;
+      if (track->m_flSimulationTime[tailSlot] >= flDeadtime) break;
 
-      // remove tail, get new tail
-      track->Remove(tailIndex);
-      tailIndex = track->Tail();
+      track->RemoveTail();
     }
 
     // check if head has same simulation time
     if (track->Count() > 0) {
-      LagRecord &head = track->Element(track->Head());
-
       // check if player changed simulation time since last time updated
-      if (head.m_flSimulationTime >= pPlayer->GetSimulationTime())
+      if (track->m_flSimulationTime[track->Slot(0)] >=
+          pPlayer->GetSimulationTime())
         continue;  // don't add new entry for same or older time
     }
 
     // add new record to player track
-    LagRecord &record = track->Element(track->AddToHead());
+    int headSlot = track->AddToHead();
+    LagRecord &record = track->m_Records[headSlot];
 
     record.m_fFlags = 0;
     if (pPlayer->IsAlive()) {
@@ -280,6 +355,10 @@ void CLagCompensationManager::FrameUpdatePostEntityThink() {
     }
     record.m_masterSequence = pPlayer->GetSequence();
     record.m_masterCycle = pPlayer->GetCycle();
+
+    track->m_flSimulationTime[headSlot] = record.m_flSimulationTime;
+    track->m_fFlags[headSlot] = record.m_fFlags;
+    track->m_vecOrigin[headSlot] = record.m_vecOrigin;
   }
 }
 
@@ -302,6 +381,8 @@ void CLagCompensationManager::StartLagCompensation(CBasePlayer *player,
 
   // NOTE: Put this here so that it won't show up in single player mode.
   VPROF_BUDGET("StartLagCompensation", VPROF_BUDGETGROUP_OTHER_NETWORKING);
+  CFastTimer timer;
+  timer.Start();
   Q_memset(m_RestoreData, 0, sizeof(m_RestoreData));
   Q_memset(m_ChangeData, 0, sizeof(m_ChangeData));
 
@@ -339,6 +420,24 @@ void CLagCompensationManager::StartLagCompensation(CBasePlayer *player,
     targettick = gpGlobals->tickcount - TIME_TO_TICKS(correct);
   }
 
+  float flTargetTime = TICKS_TO_TIME(targettick);
+
+  // Aim cone of this usercmd. Anything the shot can hit this tick lies
+  // inside it once bounds are padded by how far the shooter itself can move.
+  bool bCull = sv_unlag_cull.GetBool() && sv_unlag_cull_angle.GetFloat() < 180;
+  Vector vecEye, vecForward;
+  float flSlack = 0.0f;
+  if (bCull) {
+    SinCos(DEG2RAD(sv_unlag_cull_angle.GetFloat()), &m_flCullSin,
+           &m_flCullCos);
+    vecEye = player->EyePosition();
+    AngleVectors(cmd->viewangles, &vecForward);
+    flSlack = player->MaxSpeed() * TICK_INTERVAL;
+  }
+
+  int nCulled = 0, nBacktracked = 0;
+  m_nRecordsWalked = 0;
+
   // Iterate all active players
   const CBitVec<MAX_EDICTS> *pEntityTransmitBits =
       engine->GetEntityTransmitBitsForClient(player->entindex() - 1);
@@ -360,72 +459,131 @@ void CLagCompensationManager::StartLagCompensation(CBasePlayer *player,
                                               pEntityTransmitBits))
       continue;
 
+    int iSlot, iPrevSlot;
+    if (!FindRecords(pPlayer, flTargetTime, &iSlot, &iPrevSlot)) continue;
+
+    // Leave players alone that can't be in the way of this shot at any time
+    // between the target tick and now.
+    if (bCull && !IsInAimCone(pPlayer, iSlot, iPrevSlot, vecEye, vecForward,
+                              flSlack)) {
+      ++nCulled;
+      continue;
+    }
+
     // Move other player back in time
-    BacktrackPlayer(pPlayer, TICKS_TO_TIME(targettick));
+    BacktrackPlayer(pPlayer, flTargetTime, iSlot, iPrevSlot);
+    ++nBacktracked;
   }
-}
-
-void CLagCompensationManager::BacktrackPlayer(CBasePlayer *pPlayer,
-                                              float flTargetTime) {
-  Vector org, mins, maxs;
-  QAngle ang;
 
-  VPROF_BUDGET("BacktrackPlayer", "CLagCompensationManager");
-  int pl_index = pPlayer->entindex() - 1;
+  timer.End();
+  VPROF_INCREMENT_COUNTER("lagcomp usercmds", 1);
+  VPROF_INCREMENT_COUNTER("lagcomp players culled", nCulled);
+  VPROF_INCREMENT_COUNTER("lagcomp players backtracked", nBacktracked);
+  VPROF_INCREMENT_COUNTER("lagcomp records walked", m_nRecordsWalked);
+  VPROF_INCREMENT_COUNTER("lagcomp usercmd us",
+                          (int)timer.GetDuration().GetMicroseconds());
+}
 
+bool CLagCompensationManager::FindRecords(CBasePlayer *pPlayer,
+                                          float flTargetTime, int *pSlot,
+                                          int *pPrevSlot) {
   // get track history of this player
-  CUtlFixedLinkedList<LagRecord> *track = &m_PlayerTrack[pl_index];
+  const CLagHistory &track = m_PlayerTrack[pPlayer->entindex() - 1];
 
   // check if we have at leat one entry
-  if (track->Count() <= 0) return;
+  if (track.Count() <= 0) return false;
 
-  int curr = track->Head();
-
-  LagRecord *prevRecord = NULL;
-  LagRecord *record = NULL;
+  int prevSlot = -1;
+  int slot = -1;
 
   Vector prevOrg = pPlayer->GetLocalOrigin();
 
   // Walk context looking for any invalidating event
-  while (track->IsValidIndex(curr)) {
+  for (int n = 0; n < track.Count(); n++) {
+    ++m_nRecordsWalked;
+
     // remember last record
-    prevRecord = record;
+    prevSlot = slot;
 
     // get next record
-    record = &track->Element(curr);
+    slot = track.Slot(n);
 
-    if (!(record->m_fFlags & LC_ALIVE)) {
+    if (!(track.m_fFlags[slot] & LC_ALIVE)) {
       // player most be alive, lost track
-      return;
+      return false;
     }
 
-    Vector delta = record->m_vecOrigin - prevOrg;
+    Vector delta = track.m_vecOrigin[slot] - prevOrg;
     if (delta.LengthSqr() > LAG_COMPENSATION_TELEPORTED_DISTANCE_SQR) {
       // lost track, too much difference
-      return;
+      return false;
     }
 
     // did we find a context smaller than target time ?
-    if (record->m_flSimulationTime <= flTargetTime) break;  // hurra, stop
+    if (track.m_flSimulationTime[slot] <= flTargetTime) break;  // hurra, stop
 
-    prevOrg = record->m_vecOrigin;
-
-    // go one step back
-    curr = track->Next(curr);
+    prevOrg = track.m_vecOrigin[slot];
   }
 
-  Assert(record);
+  *pSlot = slot;
+  *pPrevSlot = prevSlot;
+  return true;
+}
 
-  if (!record) {
-    if (sv_unlag_debug.GetBool()) {
-      DevMsg(
-          "No valid positions in history for BacktrackPlayer client ( %s )\n",
-          pPlayer->GetPlayerName());
-    }
+bool CLagCompensationManager::IsInAimCone(CBasePlayer *pPlayer, int iSlot,
+                                          int iPrevSlot, const Vector &vecEye,
+                                          const Vector &vecForward,
+                                          float flSlack) const {
+  const CLagHistory &track = m_PlayerTrack[pPlayer->entindex() - 1];
+
+  // Swept bounds: where the player is now plus the records it may be put
+  // back between.
+  Vector mins = pPlayer->WorldAlignMins() + pPlayer->GetAbsOrigin();
+  Vector maxs = pPlayer->WorldAlignMaxs() + pPlayer->GetAbsOrigin();
 
-    return;  // that should never happen
+  int slots[2] = {iSlot, iPrevSlot};
+  for (int i = 0; i < 2; i++) {
+    if (slots[i] < 0) continue;
+
+    const LagRecord &record = track.m_Records[slots[i]];
+    VectorMin(mins, record.m_vecOrigin + record.m_vecMins, mins);
+    VectorMax(maxs, record.m_vecOrigin + record.m_vecMaxs, maxs);
   }
 
+  // Bounding sphere against the cone.
+  Vector center = (mins + maxs) * 0.5f;
+  float radius = (maxs - center).Length() + flSlack;
+
+  Vector delta = center - vecEye;
+  float along = DotProduct(delta, vecForward);
+  float across = (delta - vecForward * along).Length();
+
+  if (delta.LengthSqr() <= radius * radius) return true;
+
+  return across * m_flCullCos - along * m_flCullSin <= radius;
+}
+
+void CLagCompensationManager::BacktrackPlayer(CBasePlayer *pPlayer,
+                                              float flTargetTime) {
+  int iSlot, iPrevSlot;
+  if (!FindRecords(pPlayer, flTargetTime, &iSlot, &iPrevSlot)) return;
+
+  BacktrackPlayer(pPlayer, flTargetTime, iSlot, iPrevSlot);
+}
+
+void CLagCompensationManager::BacktrackPlayer(CBasePlayer *pPlayer,
+                                              float flTargetTime, int iSlot,
+                                              int iPrevSlot) {
+  Vector org, mins, maxs;
+  QAngle ang;
+
+  VPROF_BUDGET("BacktrackPlayer", "CLagCompensationManager");
+  int pl_index = pPlayer->entindex() - 1;
+
+  CLagHistory *track = &m_PlayerTrack[pl_index];
+  LagRecord *record = &track->m_Records[iSlot];
+  LagRecord *prevRecord = iPrevSlot >= 0 ? &track->m_Records[iPrevSlot] : NULL;
+
   float frac = 0.0f;
   if (prevRecord && (record->m_flSimulationTime < flTargetTime) &&
       (record->m_flSimulationTime < prevRecord->m_flSimulationTime)) {
@@ -9,6 +9,13 @@
 
 #define DEMO_HEADER_ID "HL2DEMO"
 #define DEMO_PROTOCOL 3
+// DEMO_PROTOCOL plus dem_keyframe commands and a keyframe index after dem_stop
+#define DEMO_PROTOCOL_KEYFRAMES 4
+// DEMO_PROTOCOL_KEYFRAMES plus svc_UpdateStringTableDelta in packets, the
+// keyframe index is optional
+#define DEMO_PROTOCOL_STRINGTABLE_DELTAS 5
+
+#define DEMO_INDEX_ID "HL2DIDX"
 
 #if !defined(MAX_OSPATH)
 #define MAX_OSPATH 260  // max length of a filesystem pathname
@@ -30,9 +37,11 @@ enum {
   dem_datatables,
   // end of time.
   dem_stop,
+  // full entity and string table state, only read when seeking
+  dem_keyframe,
 
   // Last command
-  dem_lastcmd = dem_stop
+  dem_lastcmd = dem_keyframe
 };
 
 struct demoheader_t {
@@ -49,6 +58,18 @@ struct demoheader_t {
   int signonlength;                // lenght of sigondata in bytes
 };
 
+// Keyframe index entry. The index is a raw data block of an int count and the
+// entries, followed by demoindexfooter_t at the very end of the file.
+struct demokeyframe_t {
+  int tick;        // demo tick of the keyframe
+  int fileoffset;  // file offset of its dem_keyframe command
+};
+
+struct demoindexfooter_t {
+  int indexoffset;  // file offset of the index block
+  char id[8];       // Should be HL2DIDX
+};
+
 #define FDEMO_NORMAL 0
 #define FDEMO_USE_ORIGIN2 (1 << 0)
 #define FDEMO_USE_ANGLES2 (1 << 1)
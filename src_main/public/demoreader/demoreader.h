@@ -0,0 +1,90 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// Headless .dem parser for offline analysis. An IDemoReader decodes one demo
+// without a client DLL: it keeps its own copy of the recorded SendTables,
+// string tables and game event descriptors, so several readers can run on
+// different threads at once. Entity, prop and game event changes stream out
+// through an IDemoReaderListener. Buffers are sized during signon, reading
+// ticks doesn't allocate.
+//
+// Link demoreader.lib and create readers with CreateDemoReader.
+
+#ifndef DEMOREADER_DEMOREADER_H
+#define DEMOREADER_DEMOREADER_H
+
+#include "demofile/demoformat.h"
+#include "dt_common.h"
+#include "tier0/include/basetypes.h"
+
+class SendProp;
+class INetworkStringTable;
+the_interface IDemoReader;
+
+// One key of a game event. Strings point into the reader and are only valid
+// during the OnGameEvent call.
+struct DemoEventKey_t {
+  const ch *m_pName;
+  DVariant m_Value;  // DPT_String, DPT_Float or DPT_Int
+};
+
+the_interface IDemoReaderListener {
+ public:
+  virtual ~IDemoReaderListener() {}
+
+  // net_Tick, everything that follows belongs to this server tick.
+  virtual void OnTick(IDemoReader * pReader, int nTick) = 0;
+
+  virtual void OnEntityCreated(IDemoReader * pReader, int nEntity, int iClass,
+                               int nSerial) = 0;
+  virtual void OnEntityDeleted(IDemoReader * pReader, int nEntity) = 0;
+
+  // iProp indexes the class' flat prop list (IDemoReader::GetProp), iElement
+  // is the array index or -1. Entities entering the PVS report their baseline
+  // values first. String values are only valid during the call.
+  virtual void OnPropChanged(IDemoReader * pReader, int nEntity, int iProp,
+                             int iElement, const DVariant &value) = 0;
+
+  virtual void OnGameEvent(IDemoReader * pReader, const ch *pName,
+                           const DemoEventKey_t *pKeys, int nKeys) = 0;
+
+  virtual void OnStringTableChanged(IDemoReader * pReader,
+                                    INetworkStringTable * pTable, int nIndex,
+                                    const ch *pString,
+                                    const void *pUserData) = 0;
+};
+
+the_interface IDemoReader {
+ public:
+  virtual ~IDemoReader() {}
+
+  virtual bool Open(const ch *pFilename, IDemoReaderListener *pListener) = 0;
+  virtual void Close() = 0;
+
+  // Reads one demo command, false after dem_stop or on corrupt data.
+  virtual bool ReadCommand() = 0;
+
+  // Reads up to dem_stop, false if the demo was corrupt.
+  virtual bool ReadAll() = 0;
+
+  virtual bool IsCorrupt() const = 0;
+  virtual const demoheader_t &GetHeader() const = 0;
+  virtual int GetTick() const = 0;
+  virtual int GetNumTicksRead() const = 0;
+  virtual float GetTickInterval() const = 0;
+
+  virtual int GetNumServerClasses() const = 0;
+  virtual const ch *GetServerClassName(int iClass) const = 0;
+  virtual int GetNumProps(int iClass) const = 0;
+  virtual const SendProp *GetProp(int iClass, int iProp) const = 0;
+
+  // -1 if the slot is free.
+  virtual int GetEntityClass(int nEntity) const = 0;
+
+  virtual INetworkStringTable *FindStringTable(const ch *pName) const = 0;
+};
+
+// Readers are large, they live on the heap.
+IDemoReader *CreateDemoReader();
+void DestroyDemoReader(IDemoReader *pReader);
+
+#endif  // DEMOREADER_DEMOREADER_H
@@ -18,6 +18,9 @@ class CTraceListData;
 class CPhysCollide;
 struct cplane_t;
 
+// Traces queued with IEngineTrace::TraceRaysAsync.
+typedef struct TraceJob_t *TraceJobHandle_t;
+
 //-----------------------------------------------------------------------------
 // The standard trace filter... NOTE: Most normal traces inherit from
 // CTraceFilter!!!
@@ -90,8 +93,8 @@ the_interface IEntityEnumerator {
 //-----------------------------------------------------------------------------
 // Interface the engine exposes to the game DLL
 //-----------------------------------------------------------------------------
-#define INTERFACEVERSION_ENGINETRACE_SERVER "EngineTraceServer003"
-#define INTERFACEVERSION_ENGINETRACE_CLIENT "EngineTraceClient003"
+#define INTERFACEVERSION_ENGINETRACE_SERVER "EngineTraceServer004"
+#define INTERFACEVERSION_ENGINETRACE_CLIENT "EngineTraceClient004"
 the_interface IEngineTrace {
  public:
   // Returns the contents mask + entity at a particular world-space position
@@ -176,6 +179,28 @@ the_interface IEngineTrace {
 
   // Walks bsp to find the leaf containing the specified point
   virtual int GetLeafContainingPoint(const Vector &ptTest) = 0;
+
+  // Traces nRayCount rays with the same mask and filter, writing one trace per
+  // ray into pTraces. Same results as a TraceRay per ray, but rays starting in
+  // the same leaf share one world leaf walk and one spatial partition query,
+  // and the filter is asked once per entity near any of them.
+  virtual void TraceRays(const Ray_t *pRays, int nRayCount, unsigned int fMask,
+                         ITraceFilter *pTraceFilter, trace_t *pTraces) = 0;
+
+  // Runs TraceRays on the job pool and returns at once. The rays, traces and
+  // filter must stay valid until FinishTraceJob, and the filter is called
+  // from worker threads. The jobs see entities where they were at submission;
+  // moving one before the jobs are done waits for them.
+  virtual TraceJobHandle_t TraceRaysAsync(const Ray_t *pRays, int nRayCount,
+                                          unsigned int fMask,
+                                          ITraceFilter *pTraceFilter,
+                                          trace_t *pTraces) = 0;
+
+  // True once all traces of the job are written.
+  virtual bool IsTraceJobDone(TraceJobHandle_t hJob) = 0;
+
+  // Waits for the job to finish and frees the handle.
+  virtual void FinishTraceJob(TraceJobHandle_t hJob) = 0;
 };
 
 #endif  // ENGINE_IENGINETRACE_H
@@ -0,0 +1,133 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// HPK pack files: a content addressed, block compressed alternative to zip
+// packs. Names resolve through a minimal perfect hash (hash and displace),
+// files with identical contents share their data, and every file is split
+// into fixed size blocks compressed on their own, so a read only decodes the
+// blocks it touches. Built by utils/hpkpack, read by CHpkPackFile.
+//
+// Layout, all little endian:
+//   hpk_header_t
+//   block data
+//   directory at header.directoryOffset:
+//     u32 displacements[numBuckets]
+//     hpk_entry_t entries[numEntries]    indexed by HPK_Slot()
+//     hpk_content_t contents[numContents]
+//     hpk_block_t blocks[numBlocks]
+//     ch names[namesSize]                 NUL terminated, lower case, '/'
+
+#ifndef HPKFILE_H
+#define HPKFILE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "base/include/base_types.h"
+
+// "HPK1"
+#define HPK_ID (('1' << 24) | ('K' << 16) | ('P' << 8) | ('H'))
+#define HPK_VERSION 1
+
+#define HPK_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define HPK_MAX_BLOCK_SIZE (1024 * 1024)
+
+enum HpkCodec_t {
+  HPK_CODEC_STORE = 0,  // uncompressed
+  HPK_CODEC_LZFAST,     // tier1 LZFast, cheap to decode
+  HPK_CODEC_LZMA,       // tier1 LZMA with lzma_header_t, smaller and slower
+};
+
+#pragma pack(1)
+struct hpk_header_t {
+  u32 id;
+  u32 version;
+  u32 blockSize;   // uncompressed bytes per block, power of two
+  u32 hashSeed;    // HPK_HashName() seed, picked by the builder
+  u32 numEntries;  // file names, also the perfect hash slot count
+  u32 numBuckets;  // displacement table size
+  u32 numContents;
+  u32 numBlocks;
+  u32 namesSize;
+  u32 directorySize;
+  u64 directoryOffset;
+};
+
+struct hpk_entry_t {
+  u32 nameHash;    // HPK_HashName(name, hashSeed)
+  u32 nameOffset;  // into the name table
+  u32 content;
+};
+
+struct hpk_content_t {
+  u64 hash;  // HPK_HashContent(), what the builder dedups on
+  u32 size;  // uncompressed, the file spans ceil(size / blockSize) blocks
+  u32 firstBlock;
+};
+
+struct hpk_block_t {
+  u64 offset;
+  u32 compressedSize;
+  u8 codec;  // HpkCodec_t
+  u8 pad[3];
+};
+#pragma pack()
+
+// Caseless, '\\' and '/' hash alike. FNV-1a with a murmur3 finalizer, plain
+// FNV leaves the high bits badly mixed.
+inline u32 HPK_HashName(const ch *pName, u32 seed) {
+  u32 hash = 2166136261U ^ (seed * 0x9E3779B9U);
+  for (; *pName; ++pName) {
+    u8 c = (u8)*pName;
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    } else if (c == '\\') {
+      c = '/';
+    }
+    hash = (hash ^ c) * 16777619U;
+  }
+
+  hash ^= hash >> 16;
+  hash *= 0x85EBCA6BU;
+  hash ^= hash >> 13;
+  hash *= 0xC2B2AE35U;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// Slot of a name in the entry table, the bucket is nameHash % numBuckets.
+inline u32 HPK_Slot(u32 nameHash, u32 displacement, u32 numEntries) {
+  u32 x = nameHash ^ (displacement * 0x9E3779B9U);
+  x ^= x >> 15;
+  x *= 0x2C1B3C6DU;
+  x ^= x >> 12;
+  x *= 0x297A2D39U;
+  x ^= x >> 15;
+  return x % numEntries;
+}
+
+// 64 bit FNV-1a of a file's contents.
+inline u64 HPK_HashContent(const void *pData, usize nSize) {
+  const u8 *p = (const u8 *)pData;
+  u64 hash = 14695981039346656037ULL;
+  for (usize i = 0; i < nSize; i++) {
+    hash = (hash ^ p[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Name comparison matching HPK_HashName().
+inline bool HPK_NamesEqual(const ch *pName, const ch *pPackName) {
+  for (;; ++pName, ++pPackName) {
+    u8 c = (u8)*pName;
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    } else if (c == '\\') {
+      c = '/';
+    }
+    if (c != (u8)*pPackName) return false;
+    if (!c) return true;
+  }
+}
+
+#endif  // HPKFILE_H
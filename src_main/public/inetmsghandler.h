@@ -120,6 +120,7 @@ class SVC_ClassInfo;
 class SVC_SetPause;
 class SVC_CreateStringTable;
 class SVC_UpdateStringTable;
+class SVC_UpdateStringTableDelta;
 class SVC_VoiceInit;
 class SVC_VoiceData;
 class SVC_Sounds;
@@ -149,6 +150,7 @@ public:
 	PROCESS_SVC_MESSAGE( SetPause ) = 0;
 	PROCESS_SVC_MESSAGE( CreateStringTable ) = 0;
 	PROCESS_SVC_MESSAGE( UpdateStringTable ) = 0;
+	PROCESS_SVC_MESSAGE( UpdateStringTableDelta ) = 0;
 	PROCESS_SVC_MESSAGE( VoiceInit ) = 0;
 	PROCESS_SVC_MESSAGE( VoiceData ) = 0;
 	PROCESS_SVC_MESSAGE( Sounds ) = 0;
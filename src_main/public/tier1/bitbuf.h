@@ -113,6 +113,11 @@ class old_bf_write {
   // Returns an error if this buffer or the read buffer overflows.
   bool WriteBitsFromBuffer(class bf_read *pIn, int nBits);
 
+  // Writes nCount values of numbits (1-32) each, masked to numbits. Bounds
+  // are checked once for the run, the bits go out a dword at a time.
+  bool WriteUBitLongArray(const unsigned int *pValues, int nCount,
+                          int numbits);
+
   void WriteBitAngle(float fAngle, int numbits);
   void WriteBitCoord(const float f);
   void WriteBitCoordMP(const float f, bool bIntegral, bool bLowPrecision);
@@ -356,6 +361,10 @@ class old_bf_read {
   unsigned int PeekUBitLong(int numbits);
   int ReadSBitLong(int numbits);
 
+  // Reads nCount values of numbits (1-32) each, the counterpart of
+  // WriteUBitLongArray. The values are zero if the buffer overflows.
+  void ReadUBitLongArray(unsigned int *pValues, int nCount, int numbits);
+
   // reads an unsigned integer with variable bit length
   unsigned int ReadUBitVar();
 
@@ -849,6 +858,7 @@ class CBitRead : public CBitBuffer {
   SOURCE_FORCEINLINE int ReadSBitLong(int numbits);
   SOURCE_FORCEINLINE unsigned int ReadUBitVar();
   SOURCE_FORCEINLINE unsigned int PeekUBitLong(int numbits);
+  void ReadUBitLongArray(unsigned int *pValues, int nCount, int numbits);
   SOURCE_FORCEINLINE float ReadBitFloat();
   float ReadBitCoord();
   float ReadBitCoordMP(bool bIntegral, bool bLowPrecision);
@@ -0,0 +1,25 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// LZFast: byte aligned LZ77 in the LZ4 block layout. A sequence is a token
+// (high nibble literal count, low nibble match length - 4), 255-run length
+// extensions, the literals, and a 16 bit little endian match offset. The last
+// sequence holds only literals. Fast both ways, the decoder is bounds checked.
+// Raw blocks, callers keep the uncompressed size themselves.
+
+#ifndef SOURCE_TIER1_LZFAST_H_
+#define SOURCE_TIER1_LZFAST_H_
+
+#include "base/include/base_types.h"
+
+// Largest output LZFast_Compress() can produce for sourceLen bytes.
+inline u32 LZFast_CompressBound(u32 sourceLen) {
+  return sourceLen + sourceLen / 255 + 16;
+}
+
+// Returns the compressed size, 0 if it doesn't fit into destLen.
+u32 LZFast_Compress(u8 *dest, u32 destLen, const u8 *source, u32 sourceLen);
+
+// Returns the decompressed size, 0 on corrupt data.
+u32 LZFast_Decompress(u8 *dest, u32 destLen, const u8 *source, u32 sourceLen);
+
+#endif  // SOURCE_TIER1_LZFAST_H_
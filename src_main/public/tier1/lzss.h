@@ -27,6 +27,11 @@ class CLZSS {
                                  unsigned char *pOutput,
                                  unsigned int *pOutputSize);
   unsigned int Uncompress(unsigned char *pInput, unsigned char *pOutput);
+  // Bounds checked, for data that came off the network.
+  unsigned int SafeUncompress(const unsigned char *pInput,
+                              unsigned int inputLength,
+                              unsigned char *pOutput,
+                              unsigned int outputLength);
   bool IsCompressed(unsigned char *pInput);
   unsigned int GetActualSize(unsigned char *pInput);
 
@@ -269,7 +269,14 @@ class TSLIST_HEAD_ALIGN CTSPool : public CTSListBase {
   }
 
   T *GetObject() {
+    bool bAllocated;
+    return GetObject(&bAllocated);
+  }
+
+  // Same, also tells if the pool was empty and a new object was allocated.
+  T *GetObject(bool *pbAllocated) {
     simpleTSPoolStruct_t *pNode = (simpleTSPoolStruct_t *)CTSListBase::Pop();
+    *pbAllocated = !pNode;
     if (!pNode) {
       pNode = new simpleTSPoolStruct_t;
     }
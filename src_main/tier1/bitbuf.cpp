@@ -2,6 +2,7 @@
 
 #include "tier1/bitbuf.h"
 
+#include <algorithm>
 #include "bitvec.h"
 #include "coordsize.h"
 #include "mathlib/mathlib.h"
@@ -74,6 +75,73 @@ struct BitWriteMasksInit {
 
 BitWriteMasksInit g_BitWriteMasksInit;
 
+// Bit ranges for the bulk paths. Buffers are little endian dwords and only
+// the dwords holding the requested bits are touched, like ReadUBitLong.
+
+// Up to 32 bits starting at iBit.
+static inline u32 LoadBitRange(const u32 *pData, int iBit, int nBits) {
+  const u32 *pDWord = pData + (iBit >> 5);
+  const int nShift = iBit & 31;
+
+  u64 nValue = LittleDWord(pDWord[0]) >> nShift;
+  if (nShift + nBits > 32) {
+    nValue |= (u64)LittleDWord(pDWord[1]) << (32 - nShift);
+  }
+
+  return (u32)(nValue & ((1ull << nBits) - 1));
+}
+
+// Up to 32 bits at iBit within one dword, the other bits are kept.
+static inline void StoreBitRange(u32 *pData, int iBit, int nBits, u32 nValue) {
+  u32 *pDWord = pData + (iBit >> 5);
+  const int nShift = iBit & 31;
+  Assert(nShift + nBits <= 32);
+
+  const u32 nMask = (u32)(((1ull << nBits) - 1) << nShift);
+  *pDWord = LittleDWord((LittleDWord(*pDWord) & ~nMask) | (nValue << nShift));
+}
+
+// Copies nBits from pIn at iInBit to pOut at iOutBit, the bits around the
+// destination range are kept. Whole destination dwords are assembled from
+// two source dwords through a 64 bit shift.
+static void CopyBitRange(u32 *pOut, int iOutBit, const u32 *pIn, int iInBit,
+                         int nBits) {
+  // Up to the next destination dword.
+  const int nHead = std::min(nBits, (32 - (iOutBit & 31)) & 31);
+  if (nHead) {
+    StoreBitRange(pOut, iOutBit, nHead, LoadBitRange(pIn, iInBit, nHead));
+    iOutBit += nHead;
+    iInBit += nHead;
+    nBits -= nHead;
+  }
+
+  if (nBits >= 32) {
+    u32 *pDWord = pOut + (iOutBit >> 5);
+    const u32 *pSrc = pIn + (iInBit >> 5);
+    const int nShift = iInBit & 31;
+    const int nDWords = nBits >> 5;
+
+    if (nShift == 0) {
+      Q_memcpy(pDWord, pSrc, nDWords * sizeof(u32));
+    } else {
+      u64 nAcc = LittleDWord(*pSrc++) >> nShift;
+      for (int i = 0; i < nDWords; i++) {
+        nAcc |= (u64)LittleDWord(*pSrc++) << (32 - nShift);
+        pDWord[i] = LittleDWord((u32)nAcc);
+        nAcc >>= 32;
+      }
+    }
+
+    iOutBit += nDWords << 5;
+    iInBit += nDWords << 5;
+    nBits -= nDWords << 5;
+  }
+
+  if (nBits) {
+    StoreBitRange(pOut, iOutBit, nBits, LoadBitRange(pIn, iInBit, nBits));
+  }
+}
+
 // old_bf_write
 old_bf_write::old_bf_write() {
   m_pData = nullptr;
@@ -282,7 +350,18 @@ bool old_bf_write::WriteBits(const void *pInData, int nBits) {
 }
 
 bool old_bf_write::WriteBitsFromBuffer(bf_read *pIn, int nBits) {
-  // This could be optimized a little by
+  // Both buffers hold the bits, copy the range directly.
+  if (nBits > 0 && nBits <= GetNumBitsLeft() &&
+      nBits <= pIn->GetNumBitsLeft()) {
+    CopyBitRange((u32 *)m_pData, m_iCurBit,
+                 (const u32 *)pIn->GetBasePointer(), pIn->GetNumBitsRead(),
+                 nBits);
+    m_iCurBit += nBits;
+    pIn->SeekRelative(nBits);
+    return !IsOverflowed() && !pIn->IsOverflowed();
+  }
+
+  // One of them overflows, go through the checked calls to flag it.
   while (nBits > 32) {
     WriteUBitLong(pIn->ReadUBitLong(32), 32);
     nBits -= 32;
@@ -292,6 +371,48 @@ bool old_bf_write::WriteBitsFromBuffer(bf_read *pIn, int nBits) {
   return !IsOverflowed() && !pIn->IsOverflowed();
 }
 
+bool old_bf_write::WriteUBitLongArray(const u32 *pValues, int nCount,
+                                      int numbits) {
+  Assert(numbits >= 1 && numbits <= 32);
+
+  if (nCount <= 0) return !IsOverflowed();
+
+  const int nBits = nCount * numbits;
+  if ((m_iCurBit + nBits) > m_nDataBits) {
+    m_iCurBit = m_nDataBits;
+    SetOverflowFlag();
+    CallErrorHandler(BITBUFERROR_BUFFER_OVERRUN, GetDebugName());
+    return false;
+  }
+
+  const u64 nMask = (1ull << numbits) - 1;
+  u32 *pDWord = (u32 *)m_pData + (m_iCurBit >> 5);
+
+  // Start with the bits already in front of the cursor.
+  int nAccBits = m_iCurBit & 31;
+  u64 nAcc = LittleDWord(*pDWord) & ((1u << nAccBits) - 1);
+
+  for (int i = 0; i < nCount; i++) {
+    nAcc |= (pValues[i] & nMask) << nAccBits;
+    nAccBits += numbits;
+
+    if (nAccBits >= 32) {
+      *pDWord++ = LittleDWord((u32)nAcc);
+      nAcc >>= 32;
+      nAccBits -= 32;
+    }
+  }
+
+  // Merge the tail, the bits behind it are kept.
+  if (nAccBits) {
+    const u32 nKeep = ~((1u << nAccBits) - 1);
+    *pDWord = LittleDWord((LittleDWord(*pDWord) & nKeep) | (u32)nAcc);
+  }
+
+  m_iCurBit += nBits;
+  return !IsOverflowed();
+}
+
 void old_bf_write::WriteBitAngle(f32 fAngle, int numbits) {
   u32 shift = BitForBitnum(numbits);
   u32 mask = shift - 1;
@@ -595,6 +716,40 @@ void old_bf_read::ReadBits(void *pOutData, int nBits) {
   }
 }
 
+void old_bf_read::ReadUBitLongArray(u32 *pValues, int nCount, int numbits) {
+  Assert(numbits >= 1 && numbits <= 32);
+
+  if (nCount <= 0) return;
+
+  const int nBits = nCount * numbits;
+  if ((m_iCurBit + nBits) > m_nDataBits) {
+    m_iCurBit = m_nDataBits;
+    SetOverflowFlag();
+    Q_memset(pValues, 0, nCount * sizeof(u32));
+    return;
+  }
+
+  const u64 nMask = (1ull << numbits) - 1;
+  const u32 *pDWord = (const u32 *)m_pData + (m_iCurBit >> 5);
+
+  // Bits left in the accumulator, the next dword is only loaded when needed.
+  int nAccBits = 32 - (m_iCurBit & 31);
+  u64 nAcc = LittleDWord(*pDWord++) >> (m_iCurBit & 31);
+
+  for (int i = 0; i < nCount; i++) {
+    if (nAccBits < numbits) {
+      nAcc |= (u64)LittleDWord(*pDWord++) << nAccBits;
+      nAccBits += 32;
+    }
+
+    pValues[i] = (u32)(nAcc & nMask);
+    nAcc >>= numbits;
+    nAccBits -= numbits;
+  }
+
+  m_iCurBit += nBits;
+}
+
 f32 old_bf_read::ReadBitAngle(int numbits) {
   f32 fReturn;
   int i;
@@ -0,0 +1,171 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+
+#include "tier1/lzfast.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tier0/include/memdbgon.h"
+
+#define LZFAST_MIN_MATCH 4
+#define LZFAST_HASH_BITS 12
+#define LZFAST_MAX_OFFSET 65535
+// Matches stop this far from the end, the tail always goes out as literals.
+#define LZFAST_LAST_LITERALS 5
+
+static inline u32 LZFast_Read32(const u8 *p) {
+  u32 value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline u32 LZFast_Hash(u32 sequence) {
+  return (sequence * 2654435761U) >> (32 - LZFAST_HASH_BITS);
+}
+
+// Writes the 255-run extension of a length that didn't fit its nibble.
+static inline u8 *LZFast_WriteLength(u8 *op, const u8 *oend, u32 length) {
+  for (; length >= 255; length -= 255) {
+    if (op >= oend) return nullptr;
+    *op++ = 255;
+  }
+
+  if (op >= oend) return nullptr;
+  *op++ = (u8)length;
+
+  return op;
+}
+
+static u8 *LZFast_WriteSequence(u8 *op, const u8 *oend, const u8 *literals,
+                                u32 nLiterals, u32 offset, u32 matchLength) {
+  if (op >= oend) return nullptr;
+
+  const u32 matchCode = matchLength ? matchLength - LZFAST_MIN_MATCH : 0;
+  u8 *token = op++;
+  *token = (u8)((std::min(nLiterals, 15U) << 4) | std::min(matchCode, 15U));
+
+  if (nLiterals >= 15) {
+    op = LZFast_WriteLength(op, oend, nLiterals - 15);
+    if (!op) return nullptr;
+  }
+
+  if (nLiterals > (u32)(oend - op)) return nullptr;
+  memcpy(op, literals, nLiterals);
+  op += nLiterals;
+
+  // Last sequence.
+  if (!matchLength) return op;
+
+  if (oend - op < 2) return nullptr;
+  *op++ = (u8)(offset & 0xFF);
+  *op++ = (u8)(offset >> 8);
+
+  if (matchCode >= 15) op = LZFast_WriteLength(op, oend, matchCode - 15);
+
+  return op;
+}
+
+u32 LZFast_Compress(u8 *dest, u32 destLen, const u8 *source, u32 sourceLen) {
+  i32 hashTable[1 << LZFAST_HASH_BITS];
+  memset(hashTable, 0xFF, sizeof(hashTable));
+
+  u8 *op = dest;
+  const u8 *oend = dest + destLen;
+
+  u32 anchor = 0;
+  u32 ip = 0;
+
+  // Need room to read a whole sequence and keep the literal tail.
+  const u32 matchLimit =
+      sourceLen > LZFAST_LAST_LITERALS ? sourceLen - LZFAST_LAST_LITERALS : 0;
+
+  while (ip + LZFAST_MIN_MATCH <= matchLimit) {
+    const u32 sequence = LZFast_Read32(source + ip);
+    const u32 hash = LZFast_Hash(sequence);
+    const i32 ref = hashTable[hash];
+    hashTable[hash] = (i32)ip;
+
+    if (ref < 0 || ip - ref > LZFAST_MAX_OFFSET ||
+        LZFast_Read32(source + ref) != sequence) {
+      // Skip faster through data that doesn't compress.
+      ip += 1 + ((ip - anchor) >> 6);
+      continue;
+    }
+
+    u32 matchLength = LZFAST_MIN_MATCH;
+    while (ip + matchLength < matchLimit &&
+           source[ref + matchLength] == source[ip + matchLength]) {
+      matchLength++;
+    }
+
+    op = LZFast_WriteSequence(op, oend, source + anchor, ip - anchor, ip - ref,
+                              matchLength);
+    if (!op) return 0;
+
+    ip += matchLength;
+    anchor = ip;
+  }
+
+  op = LZFast_WriteSequence(op, oend, source + anchor, sourceLen - anchor, 0,
+                            0);
+  return op ? (u32)(op - dest) : 0;
+}
+
+// Reads a 255-run length extension, false if it runs past the input.
+static inline bool LZFast_ReadLength(const u8 *&ip, const u8 *iend,
+                                     u32 &length) {
+  u8 byte;
+  do {
+    if (ip >= iend) return false;
+    byte = *ip++;
+    length += byte;
+  } while (byte == 255);
+
+  return true;
+}
+
+u32 LZFast_Decompress(u8 *dest, u32 destLen, const u8 *source,
+                      u32 sourceLen) {
+  const u8 *ip = source;
+  const u8 *iend = source + sourceLen;
+  u8 *op = dest;
+  const u8 *oend = dest + destLen;
+
+  while (ip < iend) {
+    const u8 token = *ip++;
+
+    u32 nLiterals = token >> 4;
+    if (nLiterals == 15 && !LZFast_ReadLength(ip, iend, nLiterals)) return 0;
+
+    if (nLiterals > (u32)(iend - ip) || nLiterals > (u32)(oend - op)) return 0;
+    memcpy(op, ip, nLiterals);
+    ip += nLiterals;
+    op += nLiterals;
+
+    // Literals only, that was the last sequence.
+    if (ip == iend) break;
+
+    if (iend - ip < 2) return 0;
+    const u32 offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+
+    if (offset == 0 || offset > (u32)(op - dest)) return 0;
+
+    u32 matchLength = token & 15;
+    if (matchLength == 15 && !LZFast_ReadLength(ip, iend, matchLength)) {
+      return 0;
+    }
+    matchLength += LZFAST_MIN_MATCH;
+
+    if (matchLength > (u32)(oend - op)) return 0;
+
+    // Byte copy, matches may overlap their own output.
+    const u8 *match = op - offset;
+    for (u32 i = 0; i < matchLength; i++) {
+      op[i] = match[i];
+    }
+    op += matchLength;
+  }
+
+  return (u32)(op - dest);
+}
@@ -245,3 +245,54 @@ unsigned int CLZSS::Uncompress(unsigned char *pInput, unsigned char *pOutput) {
 
   return totalBytes;
 }
+
+// Uncompress untrusted data. Returns 0 instead of reading past inputLength,
+// writing past outputLength or copying from before pOutput.
+
+unsigned int CLZSS::SafeUncompress(const unsigned char *pInput,
+                                   unsigned int inputLength,
+                                   unsigned char *pOutput,
+                                   unsigned int outputLength) {
+  if (inputLength < sizeof(lzss_header_t)) return 0;
+
+  unsigned int actualSize = GetActualSize((unsigned char *)pInput);
+  if (!actualSize || actualSize > outputLength) return 0;
+
+  const unsigned char *pInputEnd = pInput + inputLength;
+  pInput += sizeof(lzss_header_t);
+
+  unsigned int totalBytes = 0;
+  int cmdByte = 0;
+  int getCmdByte = 0;
+
+  for (;;) {
+    if (!getCmdByte) {
+      if (pInput >= pInputEnd) return 0;
+      cmdByte = *pInput++;
+    }
+    getCmdByte = (getCmdByte + 1) & 0x07;
+
+    if (cmdByte & 0x01) {
+      if (pInputEnd - pInput < 2) return 0;
+      unsigned int position = *pInput++ << LZSS_LOOKSHIFT;
+      position |= (*pInput >> LZSS_LOOKSHIFT);
+      unsigned int count = (*pInput++ & 0x0F) + 1;
+      if (count == 1) {
+        break;
+      }
+      if (position + 1 > totalBytes || count > actualSize - totalBytes) {
+        return 0;
+      }
+      unsigned char *pSource = pOutput + totalBytes - position - 1;
+      for (unsigned int i = 0; i < count; i++) {
+        pOutput[totalBytes++] = *pSource++;
+      }
+    } else {
+      if (pInput >= pInputEnd || totalBytes >= actualSize) return 0;
+      pOutput[totalBytes++] = *pInput++;
+    }
+    cmdByte = cmdByte >> 1;
+  }
+
+  return totalBytes == actualSize ? totalBytes : 0;
+}
@@ -442,6 +442,26 @@ void CBitRead::ReadBits(void *pOutData, int nBits) {
   }
 }
 
+void CBitRead::ReadUBitLongArray(unsigned int *pValues, int nCount,
+                                 int numbits) {
+  Assert(numbits >= 1 && numbits <= 32);
+
+  if (nCount <= 0) return;
+
+  // The input word already acts as a shift register, what the run saves is
+  // the per field overflow handling.
+  if (nCount * numbits > GetNumBitsLeft()) {
+    Seek(m_nDataBits);
+    SetOverflowFlag();
+    Q_memset(pValues, 0, nCount * sizeof(unsigned int));
+    return;
+  }
+
+  for (int i = 0; i < nCount; i++) {
+    pValues[i] = ReadUBitLong(numbits);
+  }
+}
+
 bool CBitRead::ReadBytes(void *pOut, int nBytes) {
   ReadBits(pOut, nBytes << 3);
   return !IsOverflowed();
@@ -0,0 +1,453 @@
+// Copyright © 1996-2018, Valve Corporation, All rights reserved.
+//
+// Builds HPK pack files, see public/hpkfile.h.
+
+#include <io.h>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "hpkfile.h"
+#include "lzma/lzma.h"
+#include "tier0/include/platform.h"
+#include "tier1/lzfast.h"
+#include "tier1/strtools.h"
+#include "tier1/utlmap.h"
+#include "tier1/utlstring.h"
+#include "tier1/utlvector.h"
+
+#include "tier0/include/memdbgon.h"
+
+// Per bucket displacement search limit before trying another seed.
+#define HPK_MAX_DISPLACEMENT (1u << 20)
+#define HPK_MAX_SEEDS 64
+
+struct PackFile_t {
+  CUtlString name;  // lower case, '/'
+  CUtlString path;  // on disk
+  u32 content;
+};
+
+struct PackContent_t {
+  hpk_content_t header;
+  int iFile;  // first file with these contents, to compare against
+  int iNextSameHash;
+};
+
+static void Usage() {
+  fprintf(stderr,
+          "usage: hpkpack [-lzma | -store] [-blocksize <bytes>] <pack.hpk> "
+          "<directory> [listfile]\n"
+          "  Packs every file under <directory>, or only the ones listed in\n"
+          "  [listfile] relative to it. Blocks are LZFast compressed unless\n"
+          "  -lzma or -store is given.\n");
+  exit(-1);
+}
+
+static void NormalizeName(char *pName) {
+  V_strlower(pName);
+  for (char *p = pName; *p; ++p) {
+    if (*p == '\\') *p = '/';
+  }
+}
+
+static void AddDirectory(const char *pRoot, const char *pRelative,
+                         CUtlVector<PackFile_t> &files) {
+  char szWildcard[SOURCE_MAX_PATH];
+  sprintf_s(szWildcard, "%s%s*", pRoot, pRelative);
+
+  __finddata64_t data;
+  intptr_t hFind = _findfirst64(szWildcard, &data);
+  if (hFind == -1) return;
+
+  do {
+    if (!strcmp(data.name, ".") || !strcmp(data.name, "..")) continue;
+
+    char szRelative[SOURCE_MAX_PATH];
+    sprintf_s(szRelative, "%s%s", pRelative, data.name);
+
+    if (data.attrib & _A_SUBDIR) {
+      V_strncat(szRelative, "/", sizeof(szRelative));
+      AddDirectory(pRoot, szRelative, files);
+      continue;
+    }
+
+    char szPath[SOURCE_MAX_PATH];
+    sprintf_s(szPath, "%s%s", pRoot, szRelative);
+
+    PackFile_t &file = files[files.AddToTail()];
+    NormalizeName(szRelative);
+    file.name = szRelative;
+    file.path = szPath;
+  } while (_findnext64(hFind, &data) == 0);
+
+  _findclose(hFind);
+}
+
+static bool AddListFile(const char *pRoot, const char *pListFile,
+                        CUtlVector<PackFile_t> &files) {
+  FILE *fp = fopen(pListFile, "rt");
+  if (!fp) return false;
+
+  char szLine[SOURCE_MAX_PATH];
+  while (fgets(szLine, sizeof(szLine), fp)) {
+    char *pName = szLine;
+    while (*pName == ' ' || *pName == '\t') ++pName;
+
+    int nLen = V_strlen(pName);
+    while (nLen && (pName[nLen - 1] == '\n' || pName[nLen - 1] == '\r' ||
+                    pName[nLen - 1] == ' ' || pName[nLen - 1] == '\t')) {
+      pName[--nLen] = '\0';
+    }
+    if (!nLen) continue;
+
+    char szPath[SOURCE_MAX_PATH];
+    sprintf_s(szPath, "%s%s", pRoot, pName);
+
+    PackFile_t &file = files[files.AddToTail()];
+    NormalizeName(pName);
+    file.name = pName;
+    file.path = szPath;
+  }
+
+  fclose(fp);
+  return true;
+}
+
+static bool ReadWholeFile(const char *pPath, CUtlMemory<u8> &data,
+                          u32 *pnSize) {
+  FILE *fp = fopen(pPath, "rb");
+  if (!fp) return false;
+
+  const i64 nSize = _filelengthi64(_fileno(fp));
+  if (nSize < 0 || nSize > INT_MAX) {
+    fclose(fp);
+    return false;
+  }
+
+  data.EnsureCapacity(std::max((int)nSize, 1));
+  const bool bOk = fread(data.Base(), 1, (usize)nSize, fp) == (usize)nSize;
+  fclose(fp);
+
+  *pnSize = (u32)nSize;
+  return bOk;
+}
+
+// Compresses one block with codec and appends it, falls back to storing it
+// when compression doesn't save anything.
+static bool WriteBlock(FILE *fp, const u8 *pData, u32 nSize, HpkCodec_t codec,
+                       u64 *pnOffset, CUtlVector<hpk_block_t> &blocks,
+                       CUtlMemory<u8> &scratch) {
+  hpk_block_t &block = blocks[blocks.AddToTail()];
+  memset(&block, 0, sizeof(block));
+  block.offset = *pnOffset;
+  block.codec = HPK_CODEC_STORE;
+  block.compressedSize = nSize;
+
+  const u8 *pOut = pData;
+  u8 *pLzma = nullptr;
+
+  if (codec == HPK_CODEC_LZFAST) {
+    scratch.EnsureCapacity(LZFast_CompressBound(nSize));
+    const u32 nCompressed =
+        LZFast_Compress(scratch.Base(), LZFast_CompressBound(nSize), pData,
+                        nSize);
+    if (nCompressed && nCompressed < nSize) {
+      block.codec = HPK_CODEC_LZFAST;
+      block.compressedSize = nCompressed;
+      pOut = scratch.Base();
+    }
+  } else if (codec == HPK_CODEC_LZMA) {
+    usize nCompressed = 0;
+    pLzma = LZMA_Compress(const_cast<u8 *>(pData), nSize, &nCompressed);
+    if (pLzma && nCompressed < nSize) {
+      block.codec = HPK_CODEC_LZMA;
+      block.compressedSize = (u32)nCompressed;
+      pOut = pLzma;
+    }
+  }
+
+  const bool bOk =
+      fwrite(pOut, 1, block.compressedSize, fp) == block.compressedSize;
+  *pnOffset += block.compressedSize;
+
+  if (pLzma) heap_free(pLzma);
+  return bOk;
+}
+
+// Hash and displace: buckets are placed largest first, each one searching
+// for a displacement that sends all of its names to free slots.
+static bool BuildPerfectHash(const CUtlVector<PackFile_t> &files, u32 seed,
+                             u32 nBuckets, CUtlVector<u32> &hashes,
+                             CUtlVector<u32> &displacements,
+                             CUtlVector<int> &slots) {
+  const u32 nEntries = files.Count();
+
+  hashes.SetCount(nEntries);
+  for (u32 i = 0; i < nEntries; i++) {
+    hashes[i] = HPK_HashName(files[i].name.Get(), seed);
+  }
+
+  // Names sharing a hash can never land in different slots.
+  CUtlVector<u32> sorted;
+  sorted.CopyArray(hashes.Base(), hashes.Count());
+  std::sort(sorted.Base(), sorted.Base() + sorted.Count());
+  for (u32 i = 1; i < nEntries; i++) {
+    if (sorted[i] == sorted[i - 1]) return false;
+  }
+
+  CUtlVector<CUtlVector<int>> buckets;
+  buckets.SetCount(nBuckets);
+  for (u32 i = 0; i < nEntries; i++) {
+    buckets[hashes[i] % nBuckets].AddToTail(i);
+  }
+
+  CUtlVector<u32> order;
+  order.SetCount(nBuckets);
+  for (u32 i = 0; i < nBuckets; i++) order[i] = i;
+  std::sort(order.Base(), order.Base() + order.Count(), [&](u32 a, u32 b) {
+    return buckets[a].Count() > buckets[b].Count();
+  });
+
+  displacements.SetCount(nBuckets);
+  memset(displacements.Base(), 0, nBuckets * sizeof(u32));
+  slots.SetCount(nEntries);
+  for (u32 i = 0; i < nEntries; i++) slots[i] = -1;
+
+  CUtlVector<u32> candidate;
+  for (u32 i = 0; i < nBuckets; i++) {
+    const CUtlVector<int> &bucket = buckets[order[i]];
+    if (!bucket.Count()) break;
+
+    u32 d = 0;
+    for (; d < HPK_MAX_DISPLACEMENT; d++) {
+      candidate.RemoveAll();
+      bool bFits = true;
+      for (int j = 0; j < bucket.Count() && bFits; j++) {
+        const u32 slot = HPK_Slot(hashes[bucket[j]], d, nEntries);
+        bFits = slots[slot] == -1 && candidate.Find(slot) == -1;
+        candidate.AddToTail(slot);
+      }
+      if (bFits) break;
+    }
+    if (d == HPK_MAX_DISPLACEMENT) return false;
+
+    displacements[order[i]] = d;
+    for (int j = 0; j < bucket.Count(); j++) {
+      slots[candidate[j]] = bucket[j];
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  HpkCodec_t codec = HPK_CODEC_LZFAST;
+  u32 nBlockSize = HPK_DEFAULT_BLOCK_SIZE;
+
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-'; i++) {
+    if (!_stricmp(argv[i], "-lzma")) {
+      codec = HPK_CODEC_LZMA;
+    } else if (!_stricmp(argv[i], "-store")) {
+      codec = HPK_CODEC_STORE;
+    } else if (!_stricmp(argv[i], "-blocksize") && i + 1 < argc) {
+      nBlockSize = (u32)atoi(argv[++i]);
+    } else {
+      Usage();
+    }
+  }
+
+  if (argc - i < 2) Usage();
+
+  if (nBlockSize < 4096 || nBlockSize > HPK_MAX_BLOCK_SIZE ||
+      (nBlockSize & (nBlockSize - 1)) != 0) {
+    fprintf(stderr, "Block size must be a power of two from 4K to %uK.\n",
+            HPK_MAX_BLOCK_SIZE / 1024);
+    return -1;
+  }
+
+  const char *pPackName = argv[i];
+  char szRoot[SOURCE_MAX_PATH];
+  V_strncpy(szRoot, argv[i + 1], sizeof(szRoot));
+  V_AppendSlash(szRoot, sizeof(szRoot));
+
+  CUtlVector<PackFile_t> files;
+  if (argc - i > 2) {
+    if (!AddListFile(szRoot, argv[i + 2], files)) {
+      fprintf(stderr, "Can't read list file %s.\n", argv[i + 2]);
+      return -1;
+    }
+  } else {
+    AddDirectory(szRoot, "", files);
+  }
+
+  // The same name twice would never resolve to both.
+  std::sort(files.Base(), files.Base() + files.Count(),
+            [](const PackFile_t &a, const PackFile_t &b) {
+              return strcmp(a.name.Get(), b.name.Get()) < 0;
+            });
+  for (int j = files.Count() - 1; j > 0; j--) {
+    if (files[j].name == files[j - 1].name) {
+      fprintf(stderr, "Skipping duplicate %s.\n", files[j].name.Get());
+      files.Remove(j);
+    }
+  }
+
+  FILE *fp = fopen(pPackName, "wb");
+  if (!fp) {
+    fprintf(stderr, "Can't write %s.\n", pPackName);
+    return -1;
+  }
+
+  hpk_header_t header;
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, fp);
+  u64 nOffset = sizeof(header);
+
+  CUtlVector<PackContent_t> contents;
+  CUtlVector<hpk_block_t> blocks;
+  CUtlMap<u64, int, int> contentsByHash(DefLessFunc(u64));
+  CUtlMemory<u8> data, other, scratch;
+  u64 nInputBytes = 0;
+  int nShared = 0;
+
+  for (int j = 0; j < files.Count(); j++) {
+    PackFile_t &file = files[j];
+
+    u32 nSize;
+    if (!ReadWholeFile(file.path.Get(), data, &nSize)) {
+      fprintf(stderr, "Can't read %s.\n", file.path.Get());
+      fclose(fp);
+      return -1;
+    }
+    nInputBytes += nSize;
+
+    const u64 hash = HPK_HashContent(data.Base(), nSize);
+
+    // Same hash, same size and same bytes share one copy.
+    int iContent = -1;
+    int iMap = contentsByHash.Find(hash);
+    if (iMap != contentsByHash.InvalidIndex()) {
+      for (int k = contentsByHash[iMap]; k != -1;
+           k = contents[k].iNextSameHash) {
+        u32 nOtherSize;
+        if (contents[k].header.size == nSize &&
+            ReadWholeFile(files[contents[k].iFile].path.Get(), other,
+                          &nOtherSize) &&
+            nOtherSize == nSize && !memcmp(data.Base(), other.Base(), nSize)) {
+          iContent = k;
+          break;
+        }
+      }
+    }
+
+    if (iContent == -1) {
+      iContent = contents.AddToTail();
+      PackContent_t &content = contents[iContent];
+      content.header.hash = hash;
+      content.header.size = nSize;
+      content.header.firstBlock = blocks.Count();
+      content.iFile = j;
+      content.iNextSameHash = -1;
+
+      if (iMap == contentsByHash.InvalidIndex()) {
+        contentsByHash.Insert(hash, iContent);
+      } else {
+        content.iNextSameHash = contentsByHash[iMap];
+        contentsByHash[iMap] = iContent;
+      }
+
+      for (u32 nPos = 0; nPos < nSize; nPos += nBlockSize) {
+        if (!WriteBlock(fp, data.Base() + nPos,
+                        std::min(nBlockSize, nSize - nPos), codec, &nOffset,
+                        blocks, scratch)) {
+          fprintf(stderr, "Can't write %s.\n", pPackName);
+          fclose(fp);
+          return -1;
+        }
+      }
+    } else {
+      nShared++;
+    }
+
+    file.content = iContent;
+  }
+
+  // Perfect hash over the names, a fresh seed on collisions and more
+  // buckets when displacements run out.
+  CUtlVector<u32> hashes, displacements;
+  CUtlVector<int> slots;
+  const u32 nEntries = files.Count();
+  u32 nBuckets = std::max(nEntries / 4, 1u);
+  u32 seed = 0;
+  if (nEntries) {
+    for (; seed < HPK_MAX_SEEDS; seed++) {
+      if (seed && seed % 8 == 0) nBuckets += nBuckets / 2 + 1;
+      if (BuildPerfectHash(files, seed, nBuckets, hashes, displacements,
+                           slots)) {
+        break;
+      }
+    }
+    if (seed == HPK_MAX_SEEDS) {
+      fprintf(stderr, "Can't build a perfect hash for %u names.\n",
+              nEntries);
+      fclose(fp);
+      return -1;
+    }
+  } else {
+    nBuckets = 0;
+  }
+
+  CUtlVector<hpk_entry_t> entries;
+  CUtlVector<char> names;
+  entries.SetCount(nEntries);
+  for (u32 slot = 0; slot < nEntries; slot++) {
+    const PackFile_t &file = files[slots[slot]];
+    entries[slot].nameHash = hashes[slots[slot]];
+    entries[slot].nameOffset = names.Count();
+    entries[slot].content = file.content;
+    names.AddMultipleToTail(file.name.Length() + 1, file.name.Get());
+  }
+
+  header.id = HPK_ID;
+  header.version = HPK_VERSION;
+  header.blockSize = nBlockSize;
+  header.hashSeed = seed;
+  header.numEntries = nEntries;
+  header.numBuckets = nBuckets;
+  header.numContents = contents.Count();
+  header.numBlocks = blocks.Count();
+  header.namesSize = names.Count();
+  header.directoryOffset = nOffset;
+
+  fwrite(displacements.Base(), sizeof(u32), nBuckets, fp);
+  fwrite(entries.Base(), sizeof(hpk_entry_t), nEntries, fp);
+  for (int j = 0; j < contents.Count(); j++) {
+    fwrite(&contents[j].header, sizeof(hpk_content_t), 1, fp);
+  }
+  fwrite(blocks.Base(), sizeof(hpk_block_t), blocks.Count(), fp);
+  fwrite(names.Base(), 1, names.Count(), fp);
+
+  header.directorySize = nBuckets * sizeof(u32) +
+                         nEntries * sizeof(hpk_entry_t) +
+                         contents.Count() * sizeof(hpk_content_t) +
+                         blocks.Count() * sizeof(hpk_block_t) + names.Count();
+
+  fseek(fp, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, fp);
+
+  const bool bOk = !ferror(fp);
+  fclose(fp);
+  if (!bOk) {
+    fprintf(stderr, "Can't write %s.\n", pPackName);
+    return -1;
+  }
+
+  printf("%s: %u files (%d sharing contents), %.2f MB in %.2f MB\n",
+         pPackName, nEntries, nShared, nInputBytes / (1024.0 * 1024.0),
+         (nOffset + header.directorySize) / (1024.0 * 1024.0));
+  return 0;
+}